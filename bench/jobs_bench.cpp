@@ -0,0 +1,106 @@
+// Job system scaling: the same work on 1 to N threads, N the core count
+// unless given, each count a system of its own as JOB_THREADS would make
+// it (the calling thread and count - 1 workers). Prints each workload's
+// time and its speedup over one thread.
+//
+//   jobs_bench [max threads] [rounds]
+
+#include "jobs/job_system.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+// Large enough that a piece of parallel_for is mostly arithmetic
+constexpr size_t items     = size_t(1) << 22;
+constexpr size_t grain     = 4096;
+constexpr size_t tiny_jobs = 100000;
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Best of the rounds, so a stray interruption doesn't count
+template <class F>
+double best_of(int rounds, F &&f) {
+  double best = 1e30;
+  for (int r = 0; r != rounds; ++r) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    best = std::min(best, seconds_since(start));
+  }
+  return best;
+}
+
+struct workload {
+  const char *name;
+  const char *unit;
+  double      per; // Units in one run
+  double (*run)(job_system &jobs, int rounds);
+};
+
+std::vector<float> data(items);
+
+// parallel_for over arithmetic, as tessellation and culling use it
+double compute(job_system &jobs, int rounds) {
+  return best_of(rounds, [&] {
+    jobs.parallel_for(items, grain, [](size_t first, size_t last) {
+      for (size_t i = first; i != last; ++i)
+        data[i] = std::sqrt(std::sin(i * 0.001f) * std::sin(i * 0.001f) + 1.0f);
+    });
+  });
+}
+
+// parallel_for split down to single items, so splitting and stealing is
+// most of the cost
+double split(job_system &jobs, int rounds) {
+  return best_of(rounds, [&] {
+    jobs.parallel_for(tiny_jobs, 1, [](size_t first, size_t last) {
+      for (size_t i = first; i != last; ++i)
+        data[i] += 1.0f;
+    });
+  });
+}
+
+// Jobs run one by one from the calling thread, what a job costs to start
+double run(job_system &jobs, int rounds) {
+  return best_of(rounds, [&] {
+    job_group g;
+    for (size_t i = 0; i != tiny_jobs; ++i)
+      jobs.run(g, [i] { data[i] += 1.0f; });
+    jobs.wait(g);
+  });
+}
+
+const workload workloads[] = {
+  { "compute", "M items/s", double(items),     compute },
+  { "split",   "M items/s", double(tiny_jobs), split },
+  { "run",     "M jobs/s",  double(tiny_jobs), run },
+};
+
+}
+
+int main(int argc, char *argv[]) {
+  unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+  if (argc > 1)
+    max_threads = std::max(1, std::atoi(argv[1]));
+  int rounds = argc > 2 ? std::max(1, std::atoi(argv[2])) : 5;
+
+  std::printf("%-8s %8s %16s %10s\n", "workload", "threads", "throughput", "speedup");
+  for (const auto &w : workloads) {
+    double single = 0.0;
+    for (unsigned n = 1; n <= max_threads; ++n) {
+      job_system jobs(n - 1);
+      double t = w.run(jobs, rounds);
+      if (n == 1)
+        single = t;
+      std::printf("%-8s %8u %8.1f %-9s %9.2fx\n", w.name, n, w.per / t * 1e-6, w.unit, single / t);
+    }
+  }
+  return 0;
+}
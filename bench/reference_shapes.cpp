@@ -0,0 +1,726 @@
+// The primitive generators as they were before the tessellator, a class a
+// shape pushing back one vertex at a time, and the flat per-triangle
+// tangents geometry_set made for them. Kept unchanged apart from helper
+// names that would clash, so tessellation_bench has something to measure
+// the tessellator against.
+
+#include "reference_shapes.h"
+
+#include <cmath>
+
+using glm::vec2;
+using glm::vec3;
+using std::vector;
+
+namespace reference {
+
+constexpr float pi = 3.1415926535f;
+
+// shapes/cube.h and shapes/cube.cpp
+
+class cube
+{
+public:
+  void update_params(int param1);
+  std::vector<float> vertex_data;
+  std::vector<float> normal_data;
+  std::vector<float> uv_data;
+  void set_vertex_data();
+
+private:
+  void insert_vec3(std::vector<float> &data, glm::vec3 v);
+  void insert_vec2(std::vector<float> &data, glm::vec2 v);
+  void make_tile(glm::vec3 top_left, glm::vec3 top_right,
+    glm::vec3 bottom_left, glm::vec3 bottom_right);
+  void make_face(glm::vec3 top_left, glm::vec3 top_right,
+    glm::vec3 bottom_left, glm::vec3 bottom_right);
+
+  int m_param1;
+};
+
+void cube::update_params(int param1) {
+  vertex_data = vector<float>();
+  normal_data = vector<float>();
+  m_param1 = param1 < 1 ? 1 : param1;
+  set_vertex_data();
+}
+
+static inline vec2 cube_uv(const vec3 &p, const vec3 &n) {
+  // X+
+  if (abs(n.x - 1.f) < 0.01)
+    return vec2(-p.z + 0.5, -p.y + 0.5);
+  // X-
+  if (abs(n.x + 1.f) < 0.01)
+    return vec2(p.z + 0.5,  -p.y + 0.5);
+  // Y+
+  if (abs(n.y - 1.f) < 0.01)
+    return vec2(p.x + 0.5,  -p.z + 0.5);
+  // Y-
+  if (abs(n.y + 1.f) < 0.01)
+    return vec2(p.x + 0.5,  -p.z + 0.5);
+  // Z+
+  if (abs(n.z - 1.f) < 0.01)
+    return vec2(p.x + 0.5,  -p.y + 0.5);
+  // Z-
+  if (abs(n.z + 1.f) < 0.01)
+    return vec2(-p.x + 0.5, -p.y + 0.5);
+  return vec2(0.f, 0.f);
+}
+
+void cube::make_tile(vec3 top_left, vec3 top_right,
+  vec3 bottom_left, vec3 bottom_right) {
+  auto n_0 = normalize((cross(bottom_left - top_left,  top_right - top_left)));
+  auto n_1 = normalize((cross(bottom_left - top_right, bottom_right - top_right)));
+
+  insert_vec3(vertex_data, top_left);
+  insert_vec2(uv_data, cube_uv(top_left, n_0));
+  insert_vec3(normal_data, n_0);
+  insert_vec3(vertex_data, bottom_left);
+  insert_vec2(uv_data, cube_uv(bottom_left, n_0));
+  insert_vec3(normal_data, n_0);
+  insert_vec3(vertex_data, top_right);
+  insert_vec2(uv_data, cube_uv(top_right, n_0));
+  insert_vec3(normal_data, n_0);
+
+  insert_vec3(vertex_data, top_right);
+  insert_vec2(uv_data, cube_uv(top_right, n_1));
+  insert_vec3(normal_data, n_1);
+  insert_vec3(vertex_data, bottom_left);
+  insert_vec2(uv_data, cube_uv(bottom_left, n_1));
+  insert_vec3(normal_data, n_1);
+  insert_vec3(vertex_data, bottom_right);
+  insert_vec2(uv_data, cube_uv(bottom_right, n_1));
+  insert_vec3(normal_data, n_1);
+}
+
+void cube::make_face(vec3 top_left, vec3 top_right,
+  vec3 bottom_left, vec3 bottom_right) {
+  auto x_dir  = top_right - top_left;
+  auto y_dir  = bottom_left - top_left;
+  auto x_step = x_dir / static_cast<float>(m_param1);
+  auto y_step = y_dir / static_cast<float>(m_param1);
+
+  auto curr_top_left = top_left;
+  for (size_t i = 0; i != m_param1; ++i) {
+    auto curr_bot_left = curr_top_left + y_step;
+
+    for (size_t j = 0; j != m_param1; ++j) {
+      make_tile(curr_top_left + (static_cast<float>(j)     * x_step),
+                curr_top_left + (static_cast<float>(j + 1) * x_step),
+                curr_bot_left + (static_cast<float>(j)     * x_step),
+                curr_bot_left + (static_cast<float>(j + 1) * x_step));
+    }
+
+    curr_top_left = curr_bot_left;
+  }
+}
+
+void cube::set_vertex_data() {
+  make_face(vec3(-0.5f,  0.5f,  0.5f),
+            vec3( 0.5f,  0.5f,  0.5f),
+            vec3(-0.5f, -0.5f,  0.5f),
+            vec3( 0.5f, -0.5f,  0.5f));
+
+  make_face(vec3( 0.5f,  0.5f, -0.5f),
+            vec3(-0.5f,  0.5f, -0.5f),
+            vec3( 0.5f, -0.5f, -0.5f),
+            vec3(-0.5f, -0.5f, -0.5f));
+
+  make_face(vec3(-0.5f,  0.5f, -0.5f),
+            vec3( 0.5f,  0.5f, -0.5f),
+            vec3(-0.5f,  0.5f,  0.5f),
+            vec3( 0.5f,  0.5f,  0.5f));
+
+  make_face(vec3(-0.5f, -0.5f,  0.5f),
+            vec3( 0.5f, -0.5f,  0.5f),
+            vec3(-0.5f, -0.5f, -0.5f),
+            vec3( 0.5f, -0.5f, -0.5f));
+
+  make_face(vec3(-0.5f,  0.5f, -0.5f),
+            vec3(-0.5f,  0.5f,  0.5f),
+            vec3(-0.5f, -0.5f, -0.5f),
+            vec3(-0.5f, -0.5f,  0.5f));
+
+  make_face(vec3( 0.5f,  0.5f,  0.5f),
+            vec3( 0.5f,  0.5f, -0.5f),
+            vec3( 0.5f, -0.5f,  0.5f),
+            vec3( 0.5f, -0.5f, -0.5f));
+}
+
+void cube::insert_vec3(vector<float> &data, vec3 v) {
+  data.push_back(v.x);
+  data.push_back(v.y);
+  data.push_back(v.z);
+}
+
+void cube::insert_vec2(vector<float> &data, vec2 v) {
+  data.push_back(v.x);
+  data.push_back(v.y);
+}
+
+// shapes/cone.h and shapes/cone.cpp
+
+class cone
+{
+public:
+  void update_params(int param1, int param2);
+  std::vector<float> vertex_data;
+  std::vector<float> normal_data;
+  std::vector<float> uv_data;
+  void set_vertex_data();
+
+private:
+  void insert_vec3(std::vector<float> &data, glm::vec3 v);
+  void insert_vec2(std::vector<float> &data, glm::vec2 v);
+
+  void make_cap_tile(glm::vec3 top_left, glm::vec3 top_right,
+    glm::vec3 bottom_left, glm::vec3 bottom_right);
+  void make_body_tile(glm::vec3 top_left, glm::vec3 top_right,
+    glm::vec3 bottom_left, glm::vec3 bottom_right, bool last);
+  void make_wedge(float curr_theta, float next_theta, bool last);
+  void make_cone();
+
+  int m_param1;
+  int m_param2;
+};
+
+void cone::update_params(int param1, int param2) {
+  vertex_data = vector<float>();
+  normal_data = vector<float>();
+  m_param1 = param1 < 1 ? 1 : param1;
+  m_param2 = param2 < 3 ? 3 : param2;
+  set_vertex_data();
+}
+
+// Auxiliary functions for cap and body UVs
+static inline vec2 cone_cap_uv(const vec3 &p) {
+  return vec2(p.x + 0.5, -p.z + 0.5);
+}
+
+static inline vec2 cone_body_uv(const vec3 &p, bool last) {
+  float u = 0.f;
+  float t = atan2(p.z, p.x);
+
+  if (last)
+    u = 0.f;
+  else if (t < 0.f)
+    u = (-t) / (2 * pi);
+  else
+    u = 1 - (t / ( 2 *pi));
+
+  return vec2(u, 0.5 - p.y);
+}
+
+// Data building funtions
+void cone::make_cap_tile(vec3 top_left, vec3 top_right,
+  vec3 bottom_left, vec3 bottom_right) {
+  vec3 normal = vec3(0, -1, 0);
+
+  insert_vec3(vertex_data, top_left);
+  insert_vec2(uv_data, cone_cap_uv(top_left));
+  insert_vec3(normal_data, normal);
+  insert_vec3(vertex_data, bottom_left);
+  insert_vec2(uv_data, cone_cap_uv(bottom_left));
+  insert_vec3(normal_data, normal);
+  insert_vec3(vertex_data, top_right);
+  insert_vec2(uv_data, cone_cap_uv(top_right));
+  insert_vec3(normal_data, normal);
+
+  insert_vec3(vertex_data, top_right);
+  insert_vec2(uv_data, cone_cap_uv(top_right));
+  insert_vec3(normal_data, normal);
+  insert_vec3(vertex_data, bottom_left);
+  insert_vec2(uv_data, cone_cap_uv(bottom_left));
+  insert_vec3(normal_data, normal);
+  insert_vec3(vertex_data, bottom_right);
+  insert_vec2(uv_data, cone_cap_uv(bottom_right));
+  insert_vec3(normal_data, normal);
+}
+
+void cone::make_body_tile(vec3 top_left, vec3 top_right,
+  vec3 bottom_left, vec3 bottom_right, bool last) {
+  glm::vec3 tl_normal = glm::vec3(top_left.x, 0, top_left.z);
+  glm::vec3 tr_normal = glm::vec3(top_right.x, 0, top_right.z);
+  glm::vec3 bl_normal = glm::vec3(bottom_left.x, 0, bottom_left.z);
+  glm::vec3 br_normal = glm::vec3(bottom_right.x, 0, bottom_right.z);
+
+  bl_normal.y = glm::length(bl_normal) * 0.5;
+  br_normal.y = glm::length(br_normal) * 0.5;
+  // Tip special case
+  if (top_left.x  == 0.f && top_left.z  == 0.f &&
+      top_right.x == 0.f && top_right.z == 0.f) {
+    auto midpoint = (bl_normal + br_normal) / 2.f;
+    tl_normal     = midpoint;
+    tr_normal     = midpoint;
+    tl_normal.y   = bl_normal.y;
+    tr_normal.y   = br_normal.y;
+  } else {
+    tl_normal.y = glm::length(tl_normal) * 0.5;
+    tr_normal.y = glm::length(tr_normal) * 0.5;
+  }
+
+  insert_vec3(vertex_data, top_left);
+  insert_vec2(uv_data, cone_body_uv(top_left, last));
+  insert_vec3(normal_data, normalize(tl_normal));
+  insert_vec3(vertex_data, bottom_left);
+  insert_vec2(uv_data, cone_body_uv(bottom_left, last));
+  insert_vec3(normal_data, normalize(bl_normal));
+  insert_vec3(vertex_data, top_right);
+  insert_vec2(uv_data, cone_body_uv(top_right, false));
+  insert_vec3(normal_data, normalize(tr_normal));
+
+  insert_vec3(vertex_data, top_right);
+  insert_vec2(uv_data, cone_body_uv(top_right, false));
+  insert_vec3(normal_data, normalize(tr_normal));
+  insert_vec3(vertex_data, bottom_left);
+  insert_vec2(uv_data, cone_body_uv(bottom_left, last));
+  insert_vec3(normal_data, normalize(bl_normal));
+  insert_vec3(vertex_data, bottom_right);
+  insert_vec2(uv_data, cone_body_uv(bottom_right, false));
+  insert_vec3(normal_data, normalize(br_normal));
+}
+
+void cone::make_wedge(float currentTheta, float nextTheta, bool last) {
+  // Body
+  float y_step   = 1.f / m_param1;
+  float curr_top = 0.5f;
+
+  float curr_radius = 0.f;
+  float radius_step = 0.5 / m_param1;
+
+  for (size_t i = 0; i != m_param1; ++i) {
+    float curr_bot = curr_top - y_step;
+    float next_radius = curr_radius + radius_step;
+
+    auto top_left  = vec3(curr_radius * cos(nextTheta),
+      curr_top, curr_radius * sin(nextTheta));
+    auto bot_left  = vec3(next_radius * cos(nextTheta),
+      curr_bot, next_radius * sin(nextTheta));
+    auto top_right = vec3(curr_radius * cos(currentTheta),
+      curr_top, curr_radius * sin(currentTheta));
+    auto bot_right = vec3(next_radius * cos(currentTheta),
+      curr_bot, next_radius * sin(currentTheta));
+
+    make_body_tile(top_left, top_right, bot_left, bot_right, last);
+    curr_top = curr_bot;
+    curr_radius = next_radius;
+  }
+
+  // Bottom cap
+  curr_radius = 0.f;
+  for (size_t i = 0; i != m_param1; ++i) {
+    float next_radius = curr_radius + radius_step;
+
+    auto top_left  = vec3(curr_radius * cos(nextTheta),
+      -0.5, curr_radius * sin(nextTheta));
+    auto bot_left  = vec3(next_radius * cos(nextTheta),
+      -0.5, next_radius * sin(nextTheta));
+    auto top_right = vec3(curr_radius * cos(currentTheta),
+      -0.5, curr_radius * sin(currentTheta));
+    auto bot_right = vec3(next_radius * cos(currentTheta),
+      -0.5, next_radius * sin(currentTheta));
+    make_cap_tile(bot_left, bot_right, top_left, top_right);
+
+    curr_radius = next_radius;
+  }
+}
+
+void cone::make_cone() {
+  float theta_step = glm::radians(360.f / m_param2);
+  float curr_theta = 0 * theta_step;
+
+  for (size_t i = 0; i != m_param2; ++i, curr_theta += theta_step)
+    make_wedge(curr_theta, curr_theta + theta_step, i == m_param2 - 1);
+}
+
+void cone::set_vertex_data() {
+  make_cone();
+}
+
+void cone::insert_vec3(vector<float> &data, vec3 v) {
+  data.push_back(v.x);
+  data.push_back(v.y);
+  data.push_back(v.z);
+}
+
+void cone::insert_vec2(vector<float> &data, vec2 v) {
+  data.push_back(v.x);
+  data.push_back(v.y);
+}
+
+// shapes/cylinder.h and shapes/cylinder.cpp
+
+class cylinder
+{
+public:
+  void update_params(int param1, int param2);
+  std::vector<float> vertex_data;
+  std::vector<float> normal_data;
+  std::vector<float> uv_data;
+  void set_vertex_data();
+
+private:
+  void insert_vec3(std::vector<float> &data, glm::vec3 v);
+  void insert_vec2(std::vector<float> &data, glm::vec2 v);
+
+  void make_cap_tile(glm::vec3 top_left, glm::vec3 top_right,
+    glm::vec3 bottom_left, glm::vec3 bottom_right);
+  void make_body_tile(glm::vec3 top_left, glm::vec3 top_right,
+    glm::vec3 bottom_left, glm::vec3 bottom_right, bool last);
+  void make_wedge(float curr_theta, float next_theta, bool last);
+  void make_cylinder();
+
+  int m_param1;
+  int m_param2;
+};
+
+void cylinder::update_params(int param1, int param2) {
+  vertex_data = vector<float>();
+  normal_data = vector<float>();
+  m_param1 = param1 < 1 ? 1 : param1;
+  m_param2 = param2 < 3 ? 3 : param2;
+  set_vertex_data();
+}
+
+// Auxiliary functions for cap and body UVs
+static inline vec2 cylinder_cap_uv(const vec3 &p) {
+  return vec2(p.x + .5f, -p.z + .5f);
+}
+
+static inline vec2 cylinder_body_uv(const vec3 &p, bool last) {
+  float u = 0.f;
+  float t = atan2(p.z, p.x);
+
+  if (last)
+    u = 0.f;
+  else if (t < 0.f)
+    u = (-t) / (2 * pi);
+  else
+    u = 1 - (t / ( 2 *pi));
+
+  return vec2(u, p.y - .5f);
+}
+
+// Data building funtions
+void cylinder::make_cap_tile(vec3 top_left, vec3 top_right,
+  vec3 bottom_left, vec3 bottom_right) {
+  vec3 normal = vec3(0, 0, 0);
+  normal.y = top_left.y > 0.f ? 1.f : -1.f;
+
+  insert_vec3(vertex_data, top_left);
+  insert_vec2(uv_data, cylinder_cap_uv(top_left));
+  insert_vec3(normal_data, normal);
+  insert_vec3(vertex_data, bottom_left);
+  insert_vec2(uv_data, cylinder_cap_uv(bottom_left));
+  insert_vec3(normal_data, normal);
+  insert_vec3(vertex_data, top_right);
+  insert_vec2(uv_data, cylinder_cap_uv(top_right));
+  insert_vec3(normal_data, normal);
+
+  insert_vec3(vertex_data, top_right);
+  insert_vec2(uv_data, cylinder_cap_uv(top_right));
+  insert_vec3(normal_data, normal);
+  insert_vec3(vertex_data, bottom_left);
+  insert_vec2(uv_data, cylinder_cap_uv(bottom_left));
+  insert_vec3(normal_data, normal);
+  insert_vec3(vertex_data, bottom_right);
+  insert_vec2(uv_data, cylinder_cap_uv(bottom_right));
+  insert_vec3(normal_data, normal);
+}
+
+void cylinder::make_body_tile(vec3 top_left, vec3 top_right,
+  vec3 bottom_left, vec3 bottom_right, bool last) {
+  vec3 tl_normal = normalize(vec3(top_left.x, 0, top_left.z));
+  vec3 tr_normal = normalize(vec3(top_right.x, 0, top_right.z));
+  vec3 bl_normal = normalize(vec3(bottom_left.x, 0, bottom_left.z));
+  vec3 br_normal = normalize(vec3(bottom_right.x, 0, bottom_right.z));
+
+  insert_vec3(vertex_data, top_left);
+  insert_vec2(uv_data, cylinder_body_uv(top_left, last));
+  insert_vec3(normal_data, normalize(tl_normal));
+  insert_vec3(vertex_data, bottom_left);
+  insert_vec2(uv_data, cylinder_body_uv(bottom_left, last));
+  insert_vec3(normal_data, normalize(bl_normal));
+  insert_vec3(vertex_data, top_right);
+  insert_vec2(uv_data, cylinder_body_uv(top_right, false));
+  insert_vec3(normal_data, normalize(tr_normal));
+
+  insert_vec3(vertex_data, top_right);
+  insert_vec2(uv_data, cylinder_body_uv(top_right, false));
+  insert_vec3(normal_data, normalize(tr_normal));
+  insert_vec3(vertex_data, bottom_left);
+  insert_vec2(uv_data, cylinder_body_uv(bottom_left, last));
+  insert_vec3(normal_data, normalize(bl_normal));
+  insert_vec3(vertex_data, bottom_right);
+  insert_vec2(uv_data, cylinder_body_uv(bottom_right, false));
+  insert_vec3(normal_data, normalize(br_normal));
+}
+
+void cylinder::make_wedge(float currentTheta, float nextTheta, bool last) {
+  // Body
+  float y_step   = 1.f / m_param1;
+  float curr_top = 0.5f;
+  for (size_t i = 0; i != m_param1; ++i) {
+    // If it's the last iter we override the U coordinate to 1.f
+    float curr_bot = curr_top - y_step;
+    auto top_left  = vec3(0.5 * cos(nextTheta),
+      curr_top, 0.5 * sin(nextTheta));
+    auto bot_left  = vec3(0.5 * cos(nextTheta),
+      curr_bot, 0.5 * sin(nextTheta));
+    auto top_right = vec3(0.5 * cos(currentTheta),
+      curr_top, 0.5 * sin(currentTheta));
+    auto bot_right = vec3(0.5 * cos(currentTheta),
+      curr_bot, 0.5 * sin(currentTheta));
+
+    make_body_tile(top_left, top_right, bot_left, bot_right, last);
+    curr_top = curr_bot;
+  }
+
+  // Caps
+  float curr_radius = 0.f;
+  float radius_step = 0.5 / m_param1;
+  for (size_t i = 0; i != m_param1; ++i) {
+    float next_radius = curr_radius + radius_step;
+
+    // Top cap
+    auto top_left  = vec3(curr_radius * cos(nextTheta),
+      0.5, curr_radius * sin(nextTheta));
+    auto bot_left  = vec3(next_radius * cos(nextTheta),
+      0.5, next_radius * sin(nextTheta));
+    auto top_right = vec3(curr_radius * cos(currentTheta),
+      0.5, curr_radius * sin(currentTheta));
+    auto bot_right = vec3(next_radius * cos(currentTheta),
+      0.5, next_radius * sin(currentTheta));
+    make_cap_tile(top_left, top_right, bot_left, bot_right);
+
+    // Bottom cap
+    top_left  = vec3(curr_radius * cos(nextTheta),
+      -0.5, curr_radius * sin(nextTheta));
+    bot_left  = vec3(next_radius * cos(nextTheta),
+      -0.5, next_radius * sin(nextTheta));
+    top_right = vec3(curr_radius * cos(currentTheta),
+      -0.5, curr_radius * sin(currentTheta));
+    bot_right = vec3(next_radius * cos(currentTheta),
+      -0.5, next_radius * sin(currentTheta));
+    make_cap_tile(bot_left, bot_right, top_left, top_right);
+
+    curr_radius = next_radius;
+  }
+}
+
+void cylinder::make_cylinder() {
+  float theta_step = glm::radians(360.f / m_param2);
+  float curr_theta = 0 * theta_step;
+
+  for (size_t i = 0; i != m_param2; ++i, curr_theta += theta_step)
+    make_wedge(curr_theta, curr_theta + theta_step, i == m_param2 - 1);
+}
+
+void cylinder::set_vertex_data() {
+  make_cylinder();
+}
+
+void cylinder::insert_vec3(vector<float> &data, vec3 v) {
+  data.push_back(v.x);
+  data.push_back(v.y);
+  data.push_back(v.z);
+}
+
+void cylinder::insert_vec2(vector<float> &data, vec2 v) {
+  data.push_back(v.x);
+  data.push_back(v.y);
+}
+
+// shapes/sphere.h and shapes/sphere.cpp
+
+class sphere
+{
+public:
+  void update_params(int param1, int param2);
+  std::vector<float> vertex_data;
+  std::vector<float> normal_data;
+  std::vector<float> uv_data;
+  void set_vertex_data();
+
+private:
+  void insert_vec3(std::vector<float> &data, glm::vec3 v);
+  void insert_vec2(std::vector<float> &data, glm::vec2 v);
+
+  void make_tile(glm::vec3 top_left, glm::vec3 top_right,
+    glm::vec3 bottom_left, glm::vec3 bottom_right, glm::vec3 uv_top_left,
+    glm::vec3 uv_top_right, glm::vec3 uv_bot_left, glm::vec3 uv_bot_right,
+    bool last);
+  void make_wedge(float curr_theta, float next_theta, bool last);
+  void make_sphere();
+
+  int m_param1;
+  int m_param2;
+};
+
+void sphere::update_params(int param1, int param2) {
+  vertex_data = vector<float>();
+  normal_data = vector<float>();
+  m_param1 = param1 < 2 ? 2 : param1;
+  m_param2 = param2 < 3 ? 3 : param2;
+  set_vertex_data();
+}
+
+// Auxiliary function for sphere UVs
+static inline vec2 sphere_uv(const vec3 &p, bool last) {
+  float u = 0.f;
+  float t = atan2(p.z, p.x);
+
+  if (last)
+    u = 0.f;
+  else if (t < 0.f)
+    u = (-t) / (2 * pi);
+  else
+    u = 1 - (t / (2 * pi));
+
+  return vec2(u, 0.5 + asin(-p.y / 0.5) / pi);
+}
+
+void sphere::make_tile(vec3 top_left, vec3 top_right,
+  vec3 bottom_left, vec3 bottom_right,
+  vec3 uv_top_left, vec3 uv_top_right, vec3 uv_bot_left,
+  vec3 uv_bot_right, bool last) {
+  insert_vec3(vertex_data, top_left);
+  insert_vec2(uv_data, sphere_uv(uv_top_left, last));
+  insert_vec3(normal_data, normalize(top_left));
+  insert_vec3(vertex_data, bottom_left);
+  insert_vec2(uv_data, sphere_uv(uv_bot_left, last));
+  insert_vec3(normal_data, normalize(bottom_left));
+  insert_vec3(vertex_data, top_right);
+  insert_vec2(uv_data, sphere_uv(uv_top_right, false));
+  insert_vec3(normal_data, normalize(top_right));
+
+  insert_vec3(vertex_data, top_right);
+  insert_vec2(uv_data, sphere_uv(uv_top_right, false));
+  insert_vec3(normal_data, normalize(top_right));
+  insert_vec3(vertex_data, bottom_left);
+  insert_vec2(uv_data, sphere_uv(uv_bot_left, last));
+  insert_vec3(normal_data, normalize(bottom_left));
+  insert_vec3(vertex_data, bottom_right);
+  insert_vec2(uv_data, sphere_uv(uv_bot_right, false));
+  insert_vec3(normal_data, normalize(bottom_right));
+}
+
+void sphere::make_wedge(float currentTheta, float nextTheta, bool last) {
+  float phi_step = pi / static_cast<float>(m_param1);
+  float curr_phi = 0.f;
+  for (size_t i = 0; i != m_param1; ++i) {
+    float next_phi = curr_phi + phi_step;
+
+    auto top_left  = vec3(0.5 * sin(curr_phi) * cos(nextTheta),
+      0.5 * cos(curr_phi), 0.5 * sin(curr_phi) * sin(nextTheta));
+    auto bot_left  = vec3(0.5 * sin(next_phi) * cos(nextTheta),
+      0.5 * cos(next_phi), 0.5 * sin(next_phi) * sin(nextTheta));
+    auto top_right = vec3(0.5 * sin(curr_phi) * cos(currentTheta),
+      0.5 * cos(curr_phi), 0.5 * sin(curr_phi) * sin(currentTheta));
+    auto bot_right = vec3(0.5 * sin(next_phi) * cos(currentTheta),
+      0.5 * cos(next_phi), 0.5 * sin(next_phi) * sin(currentTheta));
+
+    // Do a cylindrical projection on the sphere
+    auto uv_top_left  = vec3(0.5 * cos(nextTheta),
+      0.5 * cos(curr_phi), 0.5 * sin(nextTheta));
+    auto uv_bot_left  = vec3(0.5 * cos(nextTheta),
+      0.5 * cos(next_phi), 0.5 * sin(nextTheta));
+    auto uv_top_right = vec3(0.5 * cos(currentTheta),
+      0.5 * cos(curr_phi), 0.5 * sin(currentTheta));
+    auto uv_bot_right = vec3(0.5 * cos(currentTheta),
+      0.5 * cos(next_phi), 0.5 * sin(currentTheta));
+
+    make_tile(top_left, top_right, bot_left, bot_right,
+              uv_top_left, uv_top_right, uv_bot_left, uv_bot_right, last);
+    curr_phi = next_phi;
+  }
+}
+
+void sphere::make_sphere() {
+  float theta_step = glm::radians(360.f / m_param2);
+  float curr_theta = 0 * theta_step;
+
+  for (size_t i = 0; i != m_param2; ++i, curr_theta += theta_step)
+    make_wedge(curr_theta, curr_theta + theta_step, i == m_param2 - 1);
+}
+
+void sphere::set_vertex_data() {
+  make_sphere();
+}
+
+void sphere::insert_vec3(vector<float> &data, vec3 v) {
+  data.push_back(v.x);
+  data.push_back(v.y);
+  data.push_back(v.z);
+}
+
+void sphere::insert_vec2(vector<float> &data, vec2 v) {
+  data.push_back(v.x);
+  data.push_back(v.y);
+}
+
+// geometry_set::make_tangents
+
+static void add_to_vec(vector<float> &data, const vec3 &v) {
+  data.push_back(v.x);
+  data.push_back(v.y);
+  data.push_back(v.z);
+}
+
+// Parallax mapping, given a bunch of verts / uvs,
+// calculate tangents for them
+static vector<float> make_tangents(const vector<float> &vertices,
+  const vector<float> &uvs) {
+  vector<float> ret;
+  ret.reserve(vertices.size());
+
+  for (size_t i = 0; i < vertices.size() / 9; ++i) {
+    size_t p_idx = i * 9;
+    size_t t_idx = i * 6;
+
+    auto p0 = vec3(vertices[p_idx],     vertices[p_idx + 1], vertices[p_idx + 2]);
+    auto p1 = vec3(vertices[p_idx + 3], vertices[p_idx + 4], vertices[p_idx + 5]);
+    auto p2 = vec3(vertices[p_idx + 6], vertices[p_idx + 7], vertices[p_idx + 8]);
+    auto t0 = vec2(uvs[t_idx],     uvs[t_idx + 1]);
+    auto t1 = vec2(uvs[t_idx + 2], uvs[t_idx + 3]);
+    auto t2 = vec2(uvs[t_idx + 4], uvs[t_idx + 5]);
+
+    // Get edges and uv diffs
+    auto e0 = p1 - p0;
+    auto e1 = p2 - p0;
+    auto d0 = t1 - t0;
+    auto d1 = t2 - t0;
+
+    // Calculate tangent
+    float inv_factor = 1.f / (d0.x * d1.y - d0.y * d1.x);
+    auto  tan = vec3(inv_factor * (d1.y * e0.x - d0.y * e1.x),
+                     inv_factor * (d1.y * e0.y - d0.y * e1.y),
+                     inv_factor * (d1.y * e0.z - d0.y * e1.z));
+
+    add_to_vec(ret, tan);
+    add_to_vec(ret, tan);
+    add_to_vec(ret, tan);
+  }
+
+  return ret;
+}
+
+// Makes a built shape's tangents, returns its vertex count
+template <class S>
+static size_t build(S &shape) {
+  auto tangents = make_tangents(shape.vertex_data, shape.uv_data);
+  return tangents.size() / 3;
+}
+
+// A shape object each time, the way geometry_set made them
+size_t tessellate(PrimitiveType type, int param1, int param2) {
+  switch (type) {
+  case PrimitiveType::PRIMITIVE_CUBE:     { cube s;     s.update_params(param1);         return build(s); }
+  case PrimitiveType::PRIMITIVE_CONE:     { cone s;     s.update_params(param1, param2); return build(s); }
+  case PrimitiveType::PRIMITIVE_CYLINDER: { cylinder s; s.update_params(param1, param2); return build(s); }
+  case PrimitiveType::PRIMITIVE_SPHERE:   { sphere s;   s.update_params(param1, param2); return build(s); }
+  default:                                return 0;
+  }
+}
+
+}
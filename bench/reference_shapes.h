@@ -0,0 +1,12 @@
+#pragma once
+
+#include "utils/scenedata.h"
+
+#include <cstddef>
+
+// The primitives as they were built before the tessellator, for comparison
+namespace reference {
+  // Tessellates a primitive and makes its tangents the old way, returns
+  // the vertex count
+  size_t tessellate(PrimitiveType type, int param1, int param2);
+}
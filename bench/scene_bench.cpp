@@ -0,0 +1,149 @@
+// Scene file readers: a generated scene parsed by the streaming reader and
+// by the DOM reader, each in a process of its own so its peak resident
+// memory is its own. Prints the time SceneParser::parse takes and the
+// process's peak RSS.
+//
+//   scene_bench [objects]         generate a scene and compare both readers
+//   scene_bench generate <file> <objects>
+//   scene_bench stream <file>
+//   scene_bench dom <file>
+
+#include "utils/sceneparser.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+// Peak resident memory of this process in MB, 0 where it can't be told
+double peak_rss_mb() {
+#if defined(__unix__) || defined(__APPLE__)
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0.0;
+#if defined(__APPLE__)
+  return usage.ru_maxrss / (1024.0 * 1024.0); // Bytes
+#else
+  return usage.ru_maxrss / 1024.0;            // KB
+#endif
+#else
+  return 0.0;
+#endif
+}
+
+// A scene like the course's, scaled up: a lamp master referenced all over,
+// small nested trees, and mostly single primitives with a full transblock.
+// Objects counts every primitive the scene draws
+bool generate(const std::string &path, int objects) {
+  std::ofstream out(path);
+  if (!out)
+    return false;
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> coord(-50.0f, 50.0f);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  std::uniform_real_distribution<float> stretch(0.5f, 2.0f);
+  const char *names[] = { "cube", "cone", "cylinder", "sphere", "torus" };
+
+  out << "<?xml version=\"1.0\"?>\n<!-- generated by scene_bench -->\n<scenefile>\n"
+      << "<globaldata><ambientcoeff v=\"0.5\"/><diffusecoeff v=\"0.5\"/><specularcoeff v=\"0.5\"/></globaldata>\n"
+      << "<cameradata><pos x=\"0\" y=\"0\" z=\"10\"/><look x=\"0\" y=\"0\" z=\"-1\"/><up x=\"0\" y=\"1\" z=\"0\"/>"
+         "<heightangle v=\"45\"/></cameradata>\n"
+      << "<lightdata><id v=\"0\"/><type v=\"directional\"/><direction x=\"0\" y=\"-1\" z=\"-1\"/>"
+         "<color r=\"1\" g=\"1\" b=\"1\"></color></lightdata>\n"
+      << "<object type=\"tree\" name=\"lamp\">"
+         "<transblock><scale x=\"0.2\" y=\"2\" z=\"0.2\"/><object type=\"primitive\" name=\"cylinder\">"
+         "<diffuse r=\"0.3\" g=\"0.3\" b=\"0.3\"/></object></transblock>"
+         "<transblock><translate x=\"0\" y=\"1.1\" z=\"0\"/><object type=\"primitive\" name=\"sphere\"/></transblock>"
+         "</object>\n"
+      << "<object type=\"tree\" name=\"root\">\n";
+
+  char line[1024];
+  for (int i = 0; i < objects;) {
+    float k = unit(rng);
+    if (k < 0.1f) {
+      std::snprintf(line, sizeof line,
+        "<transblock><translate x=\"%.3f\" y=\"0\" z=\"%.3f\"/><object type=\"master\" name=\"lamp\"/></transblock>\n",
+        coord(rng), coord(rng));
+      i += 2;
+    } else if (k < 0.2f) {
+      std::snprintf(line, sizeof line,
+        "<transblock>\n  <translate x=\"%.3f\" y=\"%.3f\" z=\"%.3f\"/>\n  <object type=\"tree\">\n"
+        "    <transblock><rotate x=\"0\" y=\"1\" z=\"0\" angle=\"%.3f\"/><object type=\"primitive\" name=\"cube\">"
+        "<diffuse r=\"0.5\" g=\"0.25\" b=\"1\"/></object></transblock>\n"
+        "    <transblock><matrix><row a=\"1\" b=\"0\" c=\"0\" d=\"%.3f\"/><row a=\"0\" b=\"1\" c=\"0\" d=\"1\"/>"
+        "<row a=\"0\" b=\"0\" c=\"1\" d=\"0\"/><row a=\"0\" b=\"0\" c=\"0\" d=\"1\"/></matrix>"
+        "<object type=\"primitive\" name=\"sphere\"/></transblock>\n  </object>\n</transblock>\n",
+        coord(rng), coord(rng), coord(rng), coord(rng), coord(rng));
+      i += 2;
+    } else {
+      std::snprintf(line, sizeof line,
+        "<transblock>\n  <translate x=\"%.3f\" y=\"%.3f\" z=\"%.3f\"/>\n  <rotate x=\"0\" y=\"1\" z=\"0\" angle=\"%.3f\"/>\n"
+        "  <scale x=\"1\" y=\"%.2f\" z=\"1\"/>\n  <object type=\"primitive\" name=\"%s\">\n"
+        "    <diffuse r=\"%.3f\" g=\"%.3f\" b=\"%.3f\"/>\n    <specular r=\"1\" g=\"1\" b=\"1\"/>\n"
+        "    <shininess v=\"20\"/>\n  </object>\n</transblock>\n",
+        coord(rng), coord(rng), coord(rng), coord(rng), stretch(rng), names[rng() % 5],
+        unit(rng), unit(rng), unit(rng));
+      i += 1;
+    }
+    out << line;
+  }
+  out << "</object>\n</scenefile>\n";
+  return static_cast<bool>(out);
+}
+
+int parse(const std::string &path, bool streaming) {
+  RenderData data;
+  auto start = std::chrono::steady_clock::now();
+  if (!SceneParser::parse(path, data, streaming)) {
+    std::fprintf(stderr, "could not parse %s\n", path.c_str());
+    return 1;
+  }
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  std::printf("%-8s %10zu shapes %10.1f ms %10.1f MB peak\n", streaming ? "stream" : "dom",
+              data.drawn_shapes(), ms, peak_rss_mb());
+  return 0;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+  std::string mode = argc > 1 ? argv[1] : "";
+
+  if (mode == "generate" && argc == 4)
+    return generate(argv[2], std::max(1, std::atoi(argv[3]))) ? 0 : 1;
+  if ((mode == "stream" || mode == "dom") && argc == 3)
+    return parse(argv[2], mode == "stream");
+  if (argc > 2 || (argc == 2 && std::atoi(argv[1]) <= 0)) {
+    std::fprintf(stderr, "usage: %s [objects] | generate <file> <objects> | stream <file> | dom <file>\n", argv[0]);
+    return 1;
+  }
+
+  // Both readers on one generated scene, each run as this program again
+  int objects = argc > 1 ? std::atoi(argv[1]) : 120000;
+  std::string path = (std::filesystem::temp_directory_path() / "scene_bench.xml").string();
+  if (!generate(path, objects)) {
+    std::fprintf(stderr, "could not write %s\n", path.c_str());
+    return 1;
+  }
+  std::printf("%d objects, %.1f MB of XML\n", objects, std::filesystem::file_size(path) / (1024.0 * 1024.0));
+  std::fflush(stdout);
+
+  int failed = 0;
+  for (const char *reader : { "stream", "dom" }) {
+    std::string command = std::string("\"") + argv[0] + "\" " + reader + " \"" + path + "\"";
+    failed |= std::system(command.c_str()) != 0;
+  }
+  std::filesystem::remove(path);
+  return failed;
+}
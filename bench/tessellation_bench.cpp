@@ -0,0 +1,68 @@
+// Tessellator throughput: every primitive at parameters 1 to 100, each
+// tessellated as a background build does it, tangent frames included, and
+// by the generators it replaced with their flat tangents. Prints M
+// vertices/s per primitive for both and the speedup.
+//
+//   tessellation_bench [rounds]
+
+#include "reference_shapes.h"
+#include "shapes/tessellator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+struct primitive {
+  const char   *name;
+  PrimitiveType type;
+};
+
+constexpr primitive primitives[] = {
+  { "cube",     PrimitiveType::PRIMITIVE_CUBE },
+  { "cone",     PrimitiveType::PRIMITIVE_CONE },
+  { "cylinder", PrimitiveType::PRIMITIVE_CYLINDER },
+  { "sphere",   PrimitiveType::PRIMITIVE_SPHERE },
+};
+
+constexpr int max_param = 100;
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+int main(int argc, char *argv[]) {
+  int rounds = argc > 1 ? std::max(1, std::atoi(argv[1])) : 5;
+
+  std::printf("%-10s %12s %16s %16s %10s\n", "primitive", "vertices", "reference", "tessellate", "speedup");
+  for (const auto &p : primitives) {
+    // Best of the rounds, so a stray interruption doesn't count. Both get
+    // new output every time, as builds do
+    double best_reference = 1e30, best = 1e30;
+    size_t vertices = 0;
+    for (int r = 0; r != rounds; ++r) {
+      auto start = std::chrono::steady_clock::now();
+      for (int k = 1; k <= max_param; ++k)
+        if (!reference::tessellate(p.type, k, k))
+          return 1;
+      best_reference = std::min(best_reference, seconds_since(start));
+
+      vertices = 0;
+      start    = std::chrono::steady_clock::now();
+      for (int k = 1; k <= max_param; ++k) {
+        tessellation out;
+        tessellator::tessellate(p.type, k, k, out);
+        vertices += out.vertices();
+      }
+      best = std::min(best, seconds_since(start));
+    }
+
+    std::printf("%-10s %12zu %11.1f M/s %11.1f M/s %9.2fx\n", p.name, vertices,
+                vertices / best_reference * 1e-6, vertices / best * 1e-6, best_reference / best);
+  }
+  return 0;
+}
@@ -1,11 +1,14 @@
 #version 330 core
 
 layout(location = 0) in vec3 pos;
-layout(location = 1) in vec3 nor;
 layout(location = 2) in vec2 uv;
 
-// Parallax mapping
-layout(location = 3) in vec3 tan;
+// Tangent frame as a quaternion, bitangent sign in the sign of w
+layout(location = 3) in vec4 frame;
+
+// Where the shape's prototype is placed, once per instance
+layout(location = 4) in mat4 instance_matrix;
+layout(location = 8) in mat4 inv_instance_matrix;
 out mat3 tangent_matrix;
 uniform bool parallax_vert;
 
@@ -21,17 +24,29 @@ uniform mat4 pv_matrix;
 uniform float u_repeat;
 uniform float v_repeat;
 
+vec3 rotate(vec4 q, vec3 v) {
+  return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
 void main() {
-  vec_pos = vec3(model_matrix * vec4(pos, 1));
-  vec_nor = normalize(transpose(mat3(inv_model_matrix)) * nor);
+  vec4 q   = normalize(frame);
+  vec3 nor = rotate(q, vec3(0, 0, 1));
+
+  mat4 model     = instance_matrix * model_matrix;
+  mat4 inv_model = inv_model_matrix * inv_instance_matrix;
+
+  vec_pos = vec3(model * vec4(pos, 1));
+  vec_nor = normalize(transpose(mat3(inv_model)) * nor);
   vec_uv  = uv * vec2(u_repeat, v_repeat);
 
   // Parallax mapping
   if (parallax_vert) {
-    vec3 w_tan     = normalize(transpose(mat3(inv_model_matrix)) * tan);
-    vec3 w_bit     = cross(vec_nor, w_tan);
-    tangent_matrix = mat3(w_tan, w_bit, vec_nor);
+    vec3  tan       = rotate(q, vec3(1, 0, 0));
+    float handed    = q.w < 0.0 ? -1.0 : 1.0;
+    vec3  w_tan     = normalize(transpose(mat3(inv_model)) * tan);
+    vec3  w_bit     = cross(vec_nor, w_tan) * handed;
+    tangent_matrix  = mat3(w_tan, w_bit, vec_nor);
   }
 
-  gl_Position = pv_matrix * model_matrix * vec4(pos, 1);
+  gl_Position = pv_matrix * vec4(vec_pos, 1);
 }
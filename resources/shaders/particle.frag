@@ -1,17 +1,18 @@
 #version 330 core
 out vec4 FragColor;
 
-uniform sampler2D u_part_texture;
+uniform sampler2DArray u_part_texture;
 
 //in vec3 fColor;
 in vec2 frag_uv;
 in float life;
 in float coordY;
+flat in float layer;
 
 void main()
 {
 //    FragColor = texture(u_part_texture, frag_uv);
-    vec4 tex = texture(u_part_texture, frag_uv);
+    vec4 tex = texture(u_part_texture, vec3(frag_uv, layer));
     float intensity = 0.299 * tex.x + 0.587 * tex.y + 0.114F * tex.z;
 //    if (coordY < 0.01 ) intensity*=coordY*100;
     if (intensity < 0.5) discard;
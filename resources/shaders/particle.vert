@@ -1,7 +1,19 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 uv;
-layout (location = 2) in vec4 aOffset;
+// Instance data, one scalar per attribute so both the interleaved GPU
+// state and the CPU structure of arrays can be bound directly
+layout (location = 2) in float aX;
+layout (location = 3) in float aY;
+layout (location = 4) in float aZ;
+layout (location = 5) in float aLife;
+// Sprite layer, one value per pool block, negative for free blocks
+layout (location = 6) in float aLayer;
+// The previous simulation step, blended towards the latest one by alpha
+layout (location = 7) in float aPrevX;
+layout (location = 8) in float aPrevY;
+layout (location = 9) in float aPrevZ;
+layout (location = 10) in float aPrevLife;
 
 out vec3 fColor;
 
@@ -9,16 +21,31 @@ uniform mat4 mvp;
 uniform vec3 cameraRight;
 uniform vec3 cameraUp;
 uniform float quadSize;
+uniform float alpha;
 
 out vec2 frag_uv;
 out float life;
 out float coordY;
+flat out float layer;
 
 void main()
 {
-    vec3 obj_pos = vec3(aOffset) + cameraRight * aPos.x + cameraUp * aPos.y;
+    layer = aLayer;
+    if (aLayer < 0.0 || aLife <= 0.0) {
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0); // Outside the clip volume
+        return;
+    }
+
+    // Life only goes up when a particle respawns, then there is nothing to blend from
+    vec3 pos = vec3(aX, aY, aZ);
+    life = aLife;
+    if (aLife <= aPrevLife) {
+        pos  = mix(vec3(aPrevX, aPrevY, aPrevZ), pos, alpha);
+        life = mix(aPrevLife, aLife, alpha);
+    }
+
+    vec3 obj_pos = pos + cameraRight * aPos.x + cameraUp * aPos.y;
     frag_uv = uv;
-    life = aOffset[3];
-    coordY = aOffset[1];
+    coordY = pos.y;
     gl_Position = mvp * vec4(obj_pos, 1.0f);
 }
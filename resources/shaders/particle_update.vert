@@ -0,0 +1,72 @@
+#version 330 core
+// Advances one particle per vertex, output is captured with transform feedback
+layout (location = 0) in vec4 in_state; // xyz = position, w = life
+
+out vec4 out_state;
+
+uniform uint  frame;
+uniform uint  seed;
+uniform vec2  center;
+uniform float mag;
+
+// Emitter parameters per pool block, two texels each, see
+// particle::particleUpdateGPU: xyz = emitter position, w = spawn radius,
+// then x = lifetime scale, 0 leaves the block as it is
+uniform int           blockSize;
+uniform samplerBuffer blockData;
+
+const float PI = 3.14159265;
+
+// Integer hash (lowbias32), used as a stateless per-particle RNG
+uint hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+// Uniform float in [0, 1), advances the state
+float uniform01(inout uint state) {
+    state = hash(state);
+    return float(state >> 8) * (1.0 / 16777216.0);
+}
+
+// Spawn randomly in circle, same as particle::randCirc
+vec2 randCirc(inout uint state, float radius) {
+    float theta = 2.0 * PI * uniform01(state);
+    float len   = sqrt(uniform01(state)) * radius;
+    return vec2(len * cos(theta), len * sin(theta));
+}
+
+void main()
+{
+    int   block     = gl_VertexID / blockSize;
+    float lifeScale = texelFetch(blockData, 2 * block + 1).x;
+    if (lifeScale == 0.0) {
+        out_state = in_state; // Free, frozen or throttled this frame
+        return;
+    }
+    vec4 spawn = texelFetch(blockData, 2 * block);
+
+    uint state = hash(uint(gl_VertexID) ^ hash(frame ^ hash(seed)));
+
+    vec3  position = in_state.xyz;
+    float life     = in_state.w;
+
+    position.x += (floor(uniform01(state) * 3.0) - 1.0) * 0.01; // Move randomly in x direction
+    position.y += floor(uniform01(state) * 10.0) * 0.01;        // Move upwards in y direction
+    position.z += (floor(uniform01(state) * 3.0) - 1.0) * 0.01; // Move randomly in z direction
+    life -= 0.1;
+
+    // Same as particle::particleRevive
+    if (life <= 0.0) {
+        vec2 randPoint = randCirc(state, spawn.w);
+        position = spawn.xyz + vec3(randPoint.x, 0.0, randPoint.y);
+        float dist = distance(center, randPoint);
+        life = uniform01(state) * mix(5.0, 0.0, pow(dist, 0.1)) * mag * lifeScale;
+    }
+
+    out_state = vec4(position, life);
+}
@@ -3,11 +3,12 @@
 layout(location = 0) in vec3 pos;
 layout(location = 1) in vec3 nor;
 layout(location = 2) in vec2 uv;
+layout(location = 4) in mat4 instance_matrix;
 
 uniform mat4 model;
 uniform mat4 spotLightSpaceMat;
 
 void main()
 {
-    gl_Position = spotLightSpaceMat * model * vec4(pos, 1.0);
+    gl_Position = spotLightSpaceMat * instance_matrix * model * vec4(pos, 1.0);
 }
@@ -0,0 +1,28 @@
+#version 410 core
+
+// Patch cage corners: where they are on the surface's (u, v) parameters,
+// which surface, and the corner's position
+layout(location = 0) in vec3 coord;
+layout(location = 1) in vec3 pos;
+
+// Where the shape's prototype is placed, once per instance
+layout(location = 4) in mat4 instance_matrix;
+layout(location = 8) in mat4 inv_instance_matrix;
+
+out vec3 tc_coord;
+out vec4 tc_clip;
+
+// The instance's model matrices, for the evaluation stage
+out mat4 tc_model;
+out mat4 tc_inv_model;
+
+uniform mat4 model_matrix;
+uniform mat4 inv_model_matrix;
+uniform mat4 pv_matrix;
+
+void main() {
+  tc_coord     = coord;
+  tc_model     = instance_matrix * model_matrix;
+  tc_inv_model = inv_model_matrix * inv_instance_matrix;
+  tc_clip      = pv_matrix * tc_model * vec4(pos, 1);
+}
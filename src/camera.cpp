@@ -46,8 +46,14 @@ void camera::initialize(GLuint program_id) {
   inv_view_matrix = inverse(view_matrix);
   proj_matrix     = get_projection(horizontal_angle, height_angle, near, far);
 
-  pv_u  = glGetUniformLocation(program_id, "pv_matrix");
-  pos_u = glGetUniformLocation(program_id, "camera_pos");
+  add_program(program_id);
+}
+
+void camera::add_program(GLuint program_id) {
+  programs.push_back({ program_id,
+                       static_cast<GLuint>(glGetUniformLocation(program_id, "pv_matrix")),
+                       static_cast<GLuint>(glGetUniformLocation(program_id, "camera_pos")) });
+  update = true;
 }
 
 void camera::update_scene(const SceneCameraData &s, int wi, int he) {
@@ -127,8 +133,11 @@ void camera::send_uniforms() {
   if (!initialized)
     return;
 
-  glUniform3fv(pos_u, 1, &position[0]);
-  glUniformMatrix4fv(pv_u, 1, 0, &pv_matrix[0][0]);
+  // Doesn't need any of the programs bound
+  for (const auto &p : programs) {
+    glProgramUniform3fv(p.program, p.pos_u, 1, &position[0]);
+    glProgramUniformMatrix4fv(p.program, p.pv_u, 1, 0, &pv_matrix[0][0]);
+  }
 
   update = false;
 }
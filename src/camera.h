@@ -2,6 +2,7 @@
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
+#include <vector>
 #include "utils/scenedata.h"
 
 // A class representing a virtual camera.
@@ -30,8 +31,13 @@ private:
   float near;
   float far;
 
-  GLuint pv_u;  // Projection * View
-  GLuint pos_u; // Camera position
+  // Every program the camera is sent to
+  struct program_uniforms {
+    GLuint program;
+    GLuint pv_u;  // Projection * View
+    GLuint pos_u; // Camera position
+  };
+  std::vector<program_uniforms> programs;
 
   // In pixels
   int width;
@@ -43,6 +49,7 @@ public:
   camera();
 
   void initialize(GLuint program_id);
+  void add_program(GLuint program_id); // Another program that takes the camera
   void update_scene(const SceneCameraData &s, int width, int height);
   void update_position();
   void update_settings();
@@ -51,7 +58,16 @@ public:
   bool should_update() { return update; };
 
   // Get position in world space
-  glm::vec3 get_pos() { return glm::vec3(position); }
+  glm::vec3 get_pos() const { return glm::vec3(position); }
+
+  // Pixels per world unit at distance 1, for sizes on screen
+  float get_focal_pixels() const { return height * .5f / tan(height_angle * .5f); }
+
+  // Window size in pixels
+  glm::vec2 get_size() const { return glm::vec2(width, height); }
+
+  // Projection * View, used for frustum tests
+  const glm::mat4 &get_pv() const { return pv_matrix; }
 
   // Movement
   void move(bool w, bool a, bool s, bool d, bool c, bool u, float t);
@@ -0,0 +1,63 @@
+#include "frame_scheduler.h"
+
+#include <algorithm>
+
+namespace {
+
+// Weight of the newest frame in the average
+constexpr double smoothing = 0.1;
+
+// Share of the budget frames may use before the interval grows, and share
+// of the shorter interval's they have to fit to shrink it again, apart so
+// a frame time near a boundary doesn't flip between the two
+constexpr double grow_at   = 0.9;
+constexpr double shrink_at = 0.7;
+
+// Started this much early besides the frame's own time, for timer jitter
+constexpr double slack = 0.002;
+
+}
+
+frame_scheduler::frame_scheduler(double refresh_hz, int max_interval_p)
+  : max_interval(max_interval_p) {
+  set_refresh(refresh_hz);
+}
+
+void frame_scheduler::set_refresh(double hz) {
+  period = 1.0 / (hz > 0.0 ? hz : 60.0);
+}
+
+bool frame_scheduler::set_active(source s, bool on) {
+  bool was = sources != 0;
+  sources  = on ? sources | s : sources & ~s;
+  return !was && sources != 0;
+}
+
+void frame_scheduler::begin_frame() {
+  started = clock_type::now();
+}
+
+void frame_scheduler::end_frame() {
+  double t = std::chrono::duration<double>(clock_type::now() - started).count();
+  average  = average == 0.0 ? t : average + (t - average) * smoothing;
+
+  if (frames_per < max_interval && average > grow_at * frames_per * period)
+    ++frames_per;
+  else if (frames_per > 1 && average < shrink_at * (frames_per - 1) * period)
+    --frames_per;
+}
+
+void frame_scheduler::presented() {
+  last_swap = clock_type::now();
+  swapped   = true;
+}
+
+frame_scheduler::clock_type::duration frame_scheduler::until_next() const {
+  if (!swapped)
+    return clock_type::duration::zero();
+
+  auto due = last_swap + std::chrono::duration_cast<clock_type::duration>(
+    std::chrono::duration<double>(frames_per * period - average - slack));
+  auto now = clock_type::now();
+  return std::max(clock_type::duration::zero(), due - now);
+}
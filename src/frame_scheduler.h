@@ -0,0 +1,59 @@
+#pragma once
+
+#include <chrono>
+
+// Decides when frames are drawn. A still scene draws a frame when an event
+// asks for one and nothing else, so it costs no CPU or GPU between events.
+// Frames run back to back only while a source keeps changing what's on
+// screen, paced to the display: the next one starts so it's done just
+// before the vblank interval() refreshes after the last swap. A governor
+// watches how long frames take, and when they stop fitting one refresh it
+// draws every second (third...) one, evenly, instead of missing vblanks
+// at random.
+class frame_scheduler
+{
+public:
+  using clock_type = std::chrono::steady_clock;
+
+  // What keeps frames coming, while on
+  enum source : unsigned {
+    camera    = 1, // Movement keys held
+    animation = 2, // Instances and spot lights turning
+    particles = 4,
+    building  = 8, // Shapes being tessellated in the background
+  };
+
+  explicit frame_scheduler(double refresh_hz = 60.0, int max_interval = 4);
+
+  void set_refresh(double hz);
+
+  // Returns whether anything is on now that nothing was before
+  bool set_active(source s, bool on);
+  bool active() const { return sources != 0; }
+
+  // Around a frame's work, for the governor
+  void begin_frame();
+  void end_frame();
+
+  // The last frame was swapped to the screen
+  void presented();
+
+  // Time from now the next frame should start at
+  clock_type::duration until_next() const;
+
+  // Refreshes per frame, what a frame may take at it, and what frames take
+  int    interval() const { return frames_per; }
+  double budget() const { return frames_per * period; }
+  double frame_time() const { return average; }
+
+private:
+  double period;        // Seconds per refresh
+  int    max_interval;
+  int    frames_per = 1;
+  double average    = 0.0; // Seconds a frame takes, smoothed
+  unsigned sources  = 0;
+
+  clock_type::time_point started;
+  clock_type::time_point last_swap;
+  bool                   swapped = false;
+};
@@ -0,0 +1,238 @@
+#include "job_system.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+
+// The system whose worker the calling thread is, and which one
+thread_local const job_system *current       = nullptr;
+thread_local size_t            current_index = 0;
+
+// The system whose queue a thread that isn't a worker has, and which one
+thread_local const job_system *owner       = nullptr;
+thread_local size_t            owner_index = 0;
+
+// Queues for threads that aren't workers: the GUI, the builder and the
+// particle simulation have one each
+constexpr size_t outside_queues = 4;
+
+// Times a worker looks for jobs again before going to sleep, so short gaps
+// between one parallel_for and the next don't cost a wake up
+constexpr int spins = 32;
+
+}
+
+job_system::job_system(unsigned workers) : queues(workers + outside_queues) {
+  threads.reserve(workers);
+  for (unsigned w = 0; w != workers; ++w)
+    threads.emplace_back(&job_system::worker_loop, this, w);
+}
+
+job_system::~job_system() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    stopping = true;
+  }
+  sleep_cv.notify_all();
+
+  for (auto &t : threads)
+    t.join();
+}
+
+job_system &job_system::shared() {
+  static job_system system([] {
+    if (const char *env = std::getenv("JOB_THREADS"))
+      if (int n = std::atoi(env); n > 0)
+        return static_cast<unsigned>(n - 1);
+    return std::max(2u, std::thread::hardware_concurrency()) - 1;
+  }());
+  return system;
+}
+
+size_t job_system::home() {
+  if (current == this)
+    return current_index;
+  if (owner != this) {
+    owner       = this;
+    owner_index = threads.size() + std::min(outside.fetch_add(1), outside_queues - 1);
+  }
+  return owner_index;
+}
+
+void job_system::run(job_group &g, std::function<void()> fn) {
+  g.pending.fetch_add(1, std::memory_order_relaxed);
+  push({ std::move(fn), &g });
+}
+
+void job_system::then(job_group &after, job_group &g, std::function<void()> fn) {
+  g.pending.fetch_add(1, std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> lock(after.mutex);
+    if (!after.done()) {
+      after.continuations.push_back({ &g, std::move(fn) });
+      return;
+    }
+  }
+  push({ std::move(fn), &g });
+}
+
+// Workers help with anything, other threads only with what they pushed
+void job_system::wait(job_group &g) {
+  size_t h      = home();
+  bool   worker = h < threads.size();
+  job j;
+  while (!g.done()) {
+    if (worker ? pop(h, j) : pop_own(h, j))
+      execute(j);
+    else
+      std::this_thread::yield();
+  }
+
+  // The last job counts itself out holding the lock, once it's free nothing
+  // touches g any more
+  std::lock_guard<std::mutex> lock(g.mutex);
+}
+
+void job_system::parallel_for(size_t count, size_t grain,
+                              const std::function<void(size_t, size_t)> &fn) {
+  grain = std::max<size_t>(grain, 1);
+  if (count <= grain || threads.empty()) {
+    for (size_t first = 0; first < count; first += grain)
+      fn(first, std::min(count, first + grain));
+    return;
+  }
+
+  job_group g;
+  split(g, 0, count, grain, fn);
+  wait(g);
+}
+
+// Keeps the first half and leaves the second for thieves, until what's
+// kept is small enough to run
+void job_system::split(job_group &g, size_t first, size_t last, size_t grain,
+                       const std::function<void(size_t, size_t)> &fn) {
+  while (last - first > grain) {
+    size_t mid = first + (last - first) / 2;
+    run(g, [this, &g, mid, last, grain, &fn] { split(g, mid, last, grain, fn); });
+    last = mid;
+  }
+  fn(first, last);
+}
+
+void job_system::post_main(std::function<void()> fn) {
+  std::lock_guard<std::mutex> lock(main_mutex);
+  main_jobs.push_back(std::move(fn));
+}
+
+size_t job_system::run_main() {
+  std::vector<std::function<void()>> jobs;
+  {
+    std::lock_guard<std::mutex> lock(main_mutex);
+    jobs.swap(main_jobs);
+  }
+  for (auto &fn : jobs)
+    fn();
+  return jobs.size();
+}
+
+// Counted before it's in a queue, so a worker that finds nothing where the
+// count says there's something looks again instead of sleeping
+void job_system::push(job j) {
+  queued.fetch_add(1);
+  auto &q = queues[home()];
+  {
+    std::lock_guard<std::mutex> lock(q.mutex);
+    q.jobs.push_back(std::move(j));
+  }
+
+  if (sleeping.load() != 0) {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    sleep_cv.notify_one();
+  }
+}
+
+// The thread's own queue from the back, everyone else's from the front
+bool job_system::pop(size_t first, job &j) {
+  size_t count = queues.size();
+  for (size_t k = 0; k != count; ++k) {
+    size_t index = (first + k) % count;
+    auto &q = queues[index];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.jobs.empty())
+      continue;
+
+    if (k == 0) {
+      j = std::move(q.jobs.back());
+      q.jobs.pop_back();
+    } else {
+      j = std::move(q.jobs.front());
+      q.jobs.pop_front();
+    }
+    queued.fetch_sub(1);
+    return true;
+  }
+  return false;
+}
+
+bool job_system::pop_own(size_t index, job &j) {
+  auto &q = queues[index];
+  std::lock_guard<std::mutex> lock(q.mutex);
+  if (q.jobs.empty())
+    return false;
+
+  j = std::move(q.jobs.back());
+  q.jobs.pop_back();
+  queued.fetch_sub(1);
+  return true;
+}
+
+void job_system::execute(job &j) {
+  j.fn();
+  j.fn = nullptr;
+  finish(*j.group);
+}
+
+// The last job of a group starts what was waiting for it
+void job_system::finish(job_group &g) {
+  std::vector<job_group::continuation> ready;
+  {
+    std::lock_guard<std::mutex> lock(g.mutex);
+    if (g.pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+      return;
+    ready.swap(g.continuations);
+  }
+  for (auto &c : ready)
+    push({ std::move(c.fn), c.group });
+}
+
+void job_system::worker_loop(size_t index) {
+  current       = this;
+  current_index = index;
+
+  job j;
+  int idle = 0;
+  while (true) {
+    if (pop(index, j)) {
+      execute(j);
+      idle = 0;
+      continue;
+    }
+    if (++idle < spins) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    sleeping.fetch_add(1);
+    bool stop;
+    {
+      std::unique_lock<std::mutex> lock(sleep_mutex);
+      sleep_cv.wait(lock, [&] { return stopping || queued.load() != 0; });
+      stop = stopping;
+    }
+    sleeping.fetch_sub(1);
+    if (stop)
+      return;
+    idle = 0;
+  }
+}
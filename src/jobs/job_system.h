@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Jobs counted together, to wait for or to run more work after. A group is
+// waited for by whoever started its jobs, and has to outlive them.
+class job_group
+{
+public:
+  job_group() = default;
+  job_group(const job_group &) = delete;
+  job_group &operator=(const job_group &) = delete;
+
+  bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+  friend class job_system;
+
+  // Continuations counted in another group, run once this one is done
+  struct continuation {
+    job_group            *group;
+    std::function<void()> fn;
+  };
+
+  std::atomic<size_t>       pending = 0;
+  std::mutex                mutex; // Held by the job that counts itself out
+  std::vector<continuation> continuations;
+};
+
+// Work-stealing scheduler the loaders, tessellation, particles and scene
+// flattening share instead of starting threads of their own. Every worker
+// has a deque: it pushes and pops jobs at the back, so it works on what it
+// split most recently while that's still in cache, and when it runs dry it
+// steals the oldest job at the front of another's, which is the largest
+// piece left. Threads that aren't workers get a queue of their own too,
+// which workers steal from. Waiting runs jobs instead of blocking, so jobs
+// can wait on jobs of their own, but a thread that isn't a worker only runs
+// its own queue's: the GUI thread waiting for a frame's jobs never picks up
+// the builder thread's tessellation, and only yields while a worker
+// finishes a piece it stole.
+//
+// GL calls only work on the GUI thread, which has the context, so work
+// that ends in one is posted to the main queue, which the GUI thread runs
+// with run_main().
+class job_system
+{
+public:
+  explicit job_system(unsigned workers);
+ ~job_system();
+
+  // One worker per core but the GUI thread's, at least one. JOB_THREADS in
+  // the environment sets the count instead, for measuring scaling
+  static job_system &shared();
+
+  // Threads running jobs while one waits, counting it
+  unsigned concurrency() const { return static_cast<unsigned>(threads.size()) + 1; }
+
+  // Runs fn on any thread, counted in g
+  void run(job_group &g, std::function<void()> fn);
+
+  // Runs fn once every job counted in after is done, counted in g from now.
+  // Right away if after is done already
+  void then(job_group &after, job_group &g, std::function<void()> fn);
+
+  // Runs jobs until every one counted in g is done
+  void wait(job_group &g);
+
+  // Calls fn(first, last) on pieces of [0, count) no larger than grain, in
+  // parallel, and returns once all of them are done. Ranges are halved
+  // until they're small enough, the halves left for thieves
+  void parallel_for(size_t count, size_t grain,
+                    const std::function<void(size_t, size_t)> &fn);
+
+  // GUI thread work, run in the order it was posted
+  void post_main(std::function<void()> fn);
+
+  // Runs what was posted to the main queue, on the GUI thread. Returns how
+  // many jobs ran
+  size_t run_main();
+
+private:
+  struct job {
+    std::function<void()> fn;
+    job_group            *group;
+  };
+
+  struct queue {
+    std::mutex      mutex;
+    std::deque<job> jobs;
+  };
+
+  // One per worker, then one per other thread that pushes, the last shared
+  // once there are more of those than queues
+  std::vector<queue>       queues;
+  std::vector<std::thread> threads;
+  std::atomic<size_t>      outside = 0; // Queues handed to other threads so far
+
+  // Jobs in every queue, and workers asleep for lack of them
+  std::atomic<size_t>     queued   = 0;
+  std::atomic<size_t>     sleeping = 0;
+  std::mutex              sleep_mutex;
+  std::condition_variable sleep_cv;
+  bool                    stopping = false;
+
+  std::mutex                         main_mutex;
+  std::vector<std::function<void()>> main_jobs;
+
+  // The queue the calling thread pushes into and pops from first
+  size_t home();
+
+  void push(job j);
+  bool pop(size_t first, job &j);
+  bool pop_own(size_t index, job &j);
+  void execute(job &j);
+  void finish(job_group &g);
+  void split(job_group &g, size_t first, size_t last, size_t grain,
+             const std::function<void(size_t, size_t)> &fn);
+  void worker_loop(size_t index);
+};
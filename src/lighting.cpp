@@ -6,36 +6,40 @@ using glm::vec3;
 lighting::lighting() : num_lights(8), valid(false), update(true) {}
 
 void lighting::initialize(GLuint program_id) {
-  ka_u = glGetUniformLocation(program_id, "ka");
-  kd_u = glGetUniformLocation(program_id, "kd");
-  ks_u = glGetUniformLocation(program_id, "ks");
+  program_uniforms u;
+  u.program = program_id;
+
+  u.ka_u = glGetUniformLocation(program_id, "ka");
+  u.kd_u = glGetUniformLocation(program_id, "kd");
+  u.ks_u = glGetUniformLocation(program_id, "ks");
 
   for (int i = 0; i != num_lights; ++i) {
     auto idx_str = "[" + std::to_string(i) + "]";
 
-    light_dir_uniforms.push_back(
+    u.light_dir_uniforms.push_back(
       glGetUniformLocation(program_id,
                            ("light_directions" + idx_str).c_str()));
-    light_pos_uniforms.push_back(
+    u.light_pos_uniforms.push_back(
       glGetUniformLocation(program_id,
                            ("light_positions" + idx_str).c_str()));
-    light_col_uniforms.push_back(
+    u.light_col_uniforms.push_back(
       glGetUniformLocation(program_id,
                            ("light_colors" + idx_str).c_str()));
-    light_typ_uniforms.push_back(
+    u.light_typ_uniforms.push_back(
       glGetUniformLocation(program_id,
                            ("light_types" + idx_str).c_str()));
-    light_ang_uniforms.push_back(
+    u.light_ang_uniforms.push_back(
       glGetUniformLocation(program_id,
                            ("light_angles" + idx_str).c_str()));
-    light_pen_uniforms.push_back(
+    u.light_pen_uniforms.push_back(
       glGetUniformLocation(program_id,
                            ("light_penumbras" + idx_str).c_str()));
-    light_fun_uniforms.push_back(
+    u.light_fun_uniforms.push_back(
       glGetUniformLocation(program_id,
                            ("light_functions" + idx_str).c_str()));
   }
 
+  programs.push_back(std::move(u));
   update = true;
 }
 
@@ -54,35 +58,40 @@ void lighting::send_uniforms() {
   if (!valid)
     return;
 
-  // Send global parameters
-  glUniform1f(ka_u, ka);
-  glUniform1f(kd_u, kd);
-  glUniform1f(ks_u, ks);
+  // Straight into every program, none of them has to be bound
+  for (const auto &u : programs) {
+    GLuint p = u.program;
 
-  // Send Light data
-  size_t i = 0;
-  for (i = 0; i != num_lights && i != lights->size(); ++i) {
-    auto curr_light = (*lights)[i];
-    glUniform3fv(light_dir_uniforms[i], 1, &curr_light.dir[0]);
-    glUniform3fv(light_pos_uniforms[i], 1, &curr_light.pos[0]);
-    glUniform3fv(light_col_uniforms[i], 1, &curr_light.color[0]);
-    glUniform1i(light_typ_uniforms[i], static_cast<int>(curr_light.type));
-    glUniform1f(light_ang_uniforms[i], curr_light.angle);
-    glUniform1f(light_pen_uniforms[i], curr_light.penumbra);
-    glUniform3fv(light_fun_uniforms[i], 1, &curr_light.function[0]);
-  }
+    // Send global parameters
+    glProgramUniform1f(p, u.ka_u, ka);
+    glProgramUniform1f(p, u.kd_u, kd);
+    glProgramUniform1f(p, u.ks_u, ks);
+
+    // Send Light data
+    size_t i = 0;
+    for (i = 0; i != num_lights && i != lights->size(); ++i) {
+      auto curr_light = (*lights)[i];
+      glProgramUniform3fv(p, u.light_dir_uniforms[i], 1, &curr_light.dir[0]);
+      glProgramUniform3fv(p, u.light_pos_uniforms[i], 1, &curr_light.pos[0]);
+      glProgramUniform3fv(p, u.light_col_uniforms[i], 1, &curr_light.color[0]);
+      glProgramUniform1i(p, u.light_typ_uniforms[i], static_cast<int>(curr_light.type));
+      glProgramUniform1f(p, u.light_ang_uniforms[i], curr_light.angle);
+      glProgramUniform1f(p, u.light_pen_uniforms[i], curr_light.penumbra);
+      glProgramUniform3fv(p, u.light_fun_uniforms[i], 1, &curr_light.function[0]);
+    }
 
-  // Fill empty spaces with 0 directions
-  auto zero_vec = vec3(0.f);
-  while (i != num_lights) {
-    glUniform3fv(light_dir_uniforms[i], 1, &zero_vec[0]);
-    glUniform3fv(light_pos_uniforms[i], 1, &zero_vec[0]);
-    glUniform3fv(light_col_uniforms[i], 1, &zero_vec[0]);
-    glUniform1i(light_typ_uniforms[i], -1);
-    glUniform1f(light_ang_uniforms[i], 0.f);
-    glUniform1f(light_pen_uniforms[i], 0.f);
-    glUniform3fv(light_fun_uniforms[i], 1, &zero_vec[0]);
-    ++i;
+    // Fill empty spaces with 0 directions
+    auto zero_vec = vec3(0.f);
+    while (i != num_lights) {
+      glProgramUniform3fv(p, u.light_dir_uniforms[i], 1, &zero_vec[0]);
+      glProgramUniform3fv(p, u.light_pos_uniforms[i], 1, &zero_vec[0]);
+      glProgramUniform3fv(p, u.light_col_uniforms[i], 1, &zero_vec[0]);
+      glProgramUniform1i(p, u.light_typ_uniforms[i], -1);
+      glProgramUniform1f(p, u.light_ang_uniforms[i], 0.f);
+      glProgramUniform1f(p, u.light_pen_uniforms[i], 0.f);
+      glProgramUniform3fv(p, u.light_fun_uniforms[i], 1, &zero_vec[0]);
+      ++i;
+    }
   }
 
   update = false;
@@ -20,23 +20,29 @@ private:
   float kd;
   float ks;
 
-  // Uniforms for lighting array
-  std::vector<GLuint> light_dir_uniforms;
-  std::vector<GLuint> light_pos_uniforms;
-  std::vector<GLuint> light_col_uniforms;
-  std::vector<GLuint> light_typ_uniforms;
-  std::vector<GLuint> light_ang_uniforms;
-  std::vector<GLuint> light_pen_uniforms;
-  std::vector<GLuint> light_fun_uniforms;
-
-  // Uniforms for global lighting variables
-  GLuint ka_u;
-  GLuint kd_u;
-  GLuint ks_u;
+  // Uniforms for lighting array and global lighting variables, for every
+  // program the lights are sent to
+  struct program_uniforms {
+    GLuint program;
+
+    std::vector<GLuint> light_dir_uniforms;
+    std::vector<GLuint> light_pos_uniforms;
+    std::vector<GLuint> light_col_uniforms;
+    std::vector<GLuint> light_typ_uniforms;
+    std::vector<GLuint> light_ang_uniforms;
+    std::vector<GLuint> light_pen_uniforms;
+    std::vector<GLuint> light_fun_uniforms;
+
+    GLuint ka_u;
+    GLuint kd_u;
+    GLuint ks_u;
+  };
+  std::vector<program_uniforms> programs;
 
 public:
   lighting();
 
+  // Once for every program that draws lit shapes
   void initialize(GLuint program_id);
   void set_data(const std::vector<SceneLightData> &master_data,
     float ka, float kd, float ks);
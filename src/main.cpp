@@ -1,15 +1,39 @@
 #include "mainwindow.h"
+#include "settings.h"
 
 #include <QApplication>
 #include <QScreen>
 #include <iostream>
 #include <QSettings>
+#include <charconv>
+#include <cstring>
 
 int main(int argc, char *argv[]) {
     QGuiApplication::setHighDpiScaleFactorRoundingPolicy(Qt::HighDpiScaleFactorRoundingPolicy::Floor);
 
     QApplication a(argc, argv);
 
+    // --seed <n> makes the particle simulation reproducible, --particles <n>
+    // and --gpu-particles <n> size the CPU and GPU particle pools
+    const std::pair<const char *, unsigned *> options[] = {
+        {"--seed",          &settings.particleSeed},
+        {"--particles",     &settings.particleCount},
+        {"--gpu-particles", &settings.gpuParticleCount},
+    };
+    for (int i = 1; i + 1 < argc; ++i) {
+        for (auto [name, value] : options) {
+            if (std::string(argv[i]) != name)
+                continue;
+            const char *first = argv[i + 1], *last = first + std::strlen(first);
+            auto [end, ec] = std::from_chars(first, last, *value);
+            if (ec != std::errc() || end != last) {
+                std::cerr << "Usage: " << argv[0] << " [--seed <n>] [--particles <n>] [--gpu-particles <n>], where n is an unsigned integer, not \""
+                          << first << "\"" << std::endl;
+                return 1;
+            }
+        }
+    }
+
     QCoreApplication::setApplicationName("Projects 5 & 6: Lights, Camera & Action!");
     QCoreApplication::setOrganizationName("CS 1230");
     QCoreApplication::setApplicationVersion(QT_VERSION_STR);
@@ -17,6 +41,7 @@ int main(int argc, char *argv[]) {
     QSurfaceFormat fmt;
     fmt.setVersion(4, 1);
     fmt.setProfile(QSurfaceFormat::CoreProfile);
+    fmt.setSwapInterval(1); // Swaps wait for vsync, frames are paced to them
     QSurfaceFormat::setDefaultFormat(fmt);
 
     MainWindow w;
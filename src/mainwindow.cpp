@@ -1,12 +1,15 @@
 #include "mainwindow.h"
 #include "settings.h"
 
+#include <QAbstractButton>
+#include <QAbstractSlider>
 #include <QHBoxLayout>
 #include <QVBoxLayout>
 #include <QFileDialog>
 #include <QSettings>
 #include <QLabel>
 #include <QGroupBox>
+#include <cassert>
 #include <iostream>
 
 void MainWindow::initialize() {
@@ -40,6 +43,10 @@ void MainWindow::initialize() {
     uploadFile = new QPushButton();
     uploadFile->setText(QStringLiteral("Upload Scene File"));
 
+    // Compile the loaded scene, so it loads without parsing next time
+    compileScene = new QPushButton();
+    compileScene->setText(QStringLiteral("Compile Scene"));
+
     // Creates the boxes containing the camera sliders and number boxes
     QGroupBox *nearLayout = new QGroupBox(); // horizonal near slider alignment
     QHBoxLayout *lnear = new QHBoxLayout();
@@ -110,7 +117,30 @@ void MainWindow::initialize() {
     ec1->setText(QStringLiteral("Particles"));
     ec1->setChecked(false);
 
+    // Simulate fire on the GPU
+    gpuParticles = new QCheckBox();
+    gpuParticles->setText(QStringLiteral("GPU Particles"));
+    gpuParticles->setChecked(false);
+
+    // Tessellate spheres, cylinders and cones on the GPU
+    gpuTessellation = new QCheckBox();
+    gpuTessellation->setText(QStringLiteral("GPU Tessellation"));
+    gpuTessellation->setChecked(false);
+
+    // Reload the scene whenever its file is saved
+    watchScene = new QCheckBox();
+    watchScene->setText(QStringLiteral("Watch Scene File"));
+    watchScene->setChecked(false);
+
+    // Spin the scene's instances and spot lights
+    animateScene = new QCheckBox();
+    animateScene->setText(QStringLiteral("Animate Scene"));
+    animateScene->setChecked(false);
+
     vLayout->addWidget(uploadFile);
+    vLayout->addWidget(compileScene);
+    vLayout->addWidget(watchScene);
+    vLayout->addWidget(animateScene);
     vLayout->addWidget(camera_label);
     vLayout->addWidget(near_label);
     vLayout->addWidget(nearLayout);
@@ -124,6 +154,8 @@ void MainWindow::initialize() {
     vLayout->addWidget(ec3);
     vLayout->addWidget(ec5);
     vLayout->addWidget(ec1);
+    vLayout->addWidget(gpuParticles);
+    vLayout->addWidget(gpuTessellation);
     vLayout->addWidget(ec4);
 
     connectUIElements();
@@ -147,6 +179,7 @@ void MainWindow::connectUIElements() {
     connectFar();
     connectExtraCredit();
     connectDefaultFBO();
+    connectSettingsCheck();
 }
 
 void MainWindow::connectPerPixelFilter() {
@@ -159,6 +192,9 @@ void MainWindow::connectKernelBasedFilter() {
 
 void MainWindow::connectUploadFile() {
     connect(uploadFile, &QPushButton::clicked, this, &MainWindow::onUploadFile);
+    connect(compileScene, &QPushButton::clicked, this, &MainWindow::onCompileScene);
+    connect(watchScene, &QCheckBox::clicked, this, &MainWindow::onWatchScene);
+    connect(animateScene, &QCheckBox::clicked, this, &MainWindow::onAnimateScene);
 }
 
 void MainWindow::connectParam1() {
@@ -191,12 +227,33 @@ void MainWindow::connectDefaultFBO() {
             this, &MainWindow::onValChangeFBO);
 }
 
+// Queued, so it runs once the control's own handler is done. Every control
+// is checked, ones added later included
+void MainWindow::connectSettingsCheck() {
+#ifndef NDEBUG
+    for (auto *button : findChildren<QAbstractButton *>())
+        connect(button, &QAbstractButton::clicked, this, &MainWindow::checkSettingsApplied,
+                Qt::QueuedConnection);
+    for (auto *slider : findChildren<QAbstractSlider *>())
+        connect(slider, &QAbstractSlider::valueChanged, this, &MainWindow::checkSettingsApplied,
+                Qt::QueuedConnection);
+    for (auto *box : findChildren<QSpinBox *>())
+        connect(box, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+                this, &MainWindow::checkSettingsApplied, Qt::QueuedConnection);
+    for (auto *box : findChildren<QDoubleSpinBox *>())
+        connect(box, static_cast<void(QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged),
+                this, &MainWindow::checkSettingsApplied, Qt::QueuedConnection);
+#endif
+}
+
 void MainWindow::connectExtraCredit() {
     connect(ec2, &QCheckBox::clicked, this, &MainWindow::onExtraCredit2);
     connect(ec3, &QCheckBox::clicked, this, &MainWindow::onExtraCredit3);
     connect(ec4, &QCheckBox::clicked, this, &MainWindow::onExtraCredit4);
     connect(ec1, &QCheckBox::clicked, this, &MainWindow::onExtraCredit1);
     connect(ec5, &QCheckBox::clicked, this, &MainWindow::onExtraCredit5);
+    connect(gpuParticles, &QCheckBox::clicked, this, &MainWindow::onGpuParticles);
+    connect(gpuTessellation, &QCheckBox::clicked, this, &MainWindow::onGpuTessellation);
 }
 
 void MainWindow::onPerPixelFilter() {
@@ -224,6 +281,20 @@ void MainWindow::onUploadFile() {
     realtime->sceneChanged();
 }
 
+void MainWindow::onCompileScene() {
+    realtime->compileScene();
+}
+
+void MainWindow::onWatchScene() {
+    settings.watchScene = !settings.watchScene;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onAnimateScene() {
+    settings.animateScene = !settings.animateScene;
+    realtime->settingsChanged();
+}
+
 
 void MainWindow::onValChangeP1(int newValue) {
     p1Slider->setValue(newValue);
@@ -273,6 +344,7 @@ void MainWindow::onValChangeFarBox(double newValue) {
 
 void MainWindow::onExtraCredit1() {
     settings.fire = !settings.fire;
+    realtime->settingsChanged();
 }
 
 void MainWindow::onExtraCredit2() {
@@ -292,4 +364,21 @@ void MainWindow::onExtraCredit4() {
 
 void MainWindow::onExtraCredit5() {
     settings.shadows = !settings.shadows;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onGpuParticles() {
+    settings.gpuParticles = !settings.gpuParticles;
+    realtime->settingsChanged();
+}
+
+void MainWindow::onGpuTessellation() {
+    settings.gpuTessellation = !settings.gpuTessellation;
+    realtime->settingsChanged();
+}
+
+// A handler that changes a setting without telling Realtime leaves the
+// view showing the old one, nothing else draws a frame for it
+void MainWindow::checkSettingsApplied() {
+    assert(realtime->settingsApplied() && "a control changed settings without settingsChanged()");
 }
@@ -27,11 +27,15 @@ private:
     void connectUploadFile();
     void connectExtraCredit();
     void connectDefaultFBO();
+    void connectSettingsCheck();
 
     Realtime *realtime;
     QCheckBox *filter1;
     QCheckBox *filter2;
     QPushButton *uploadFile;
+    QPushButton *compileScene;
+    QCheckBox *watchScene;
+    QCheckBox *animateScene;
     QSlider *p1Slider;
     QSlider *p2Slider;
     QSpinBox *p1Box;
@@ -48,11 +52,16 @@ private:
     QCheckBox *ec3;
     QCheckBox *ec4;
     QCheckBox *ec5;
+    QCheckBox *gpuParticles;
+    QCheckBox *gpuTessellation;
 
 private slots:
     void onPerPixelFilter();
     void onKernelBasedFilter();
     void onUploadFile();
+    void onCompileScene();
+    void onWatchScene();
+    void onAnimateScene();
     void onValChangeP1(int newValue);
     void onValChangeP2(int newValue);
     void onValChangeNearSlider(int newValue);
@@ -67,4 +76,9 @@ private slots:
     void onExtraCredit3();
     void onExtraCredit4();
     void onExtraCredit5();
+    void onGpuParticles();
+    void onGpuTessellation();
+
+    // Debug builds: after any control's handler, the change was applied
+    void checkSettingsApplied();
 };
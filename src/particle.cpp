@@ -2,175 +2,513 @@
 
 #include "utils/shaderloader.h"
 #include <math.h>
-#include <random>
+#include <iostream>
+#include <map>
 
 #include <glm/gtc/matrix_transform.hpp>
 #include "glm/gtx/string_cast.hpp"
 
-float randam() {
-    return (float)rand() / (float)RAND_MAX;
-}
+// Longest particle life with the original fire settings: life starts below
+// 5 * mag (mag < 5) and drops 0.1 per step, at 60 steps per second
+constexpr float fireLifetime = 25.f / 6.f;
+
+// Emitter bounds for culling, the spawn disc plus how far particles rise
+constexpr float boundHeight = 3.f;
 
-void particle::particleInit(){
-    particles.resize(particleSize);
-    positions.resize(particleSize * particlelDataSize);
-    m_part_model = glm::translate(m_part_model, firePos);
+// Emitters further than this are updated every throttleInterval steps,
+// past freezeDistance they stop updating altogether
+constexpr float throttleDistance = 20.f;
+constexpr float freezeDistance   = 60.f;
+constexpr int   throttleInterval = 4;
 
-    QString particle_filepath = QString(":/resources/scene/Particle.png");
+particle::~particle(){
+    stopSim();
+}
 
-    m_image = QImage(particle_filepath);
+// Whole blocks, at least one, every one updated each step until culled
+void particle::path_blocks::resize(int particles){
+    int blocks = std::max(1, particles / blockSize + (particles % blockSize != 0));
+    pool = particle_pool(blocks, blockSize);
+    updateEvery = std::vector<std::atomic<int>>(blocks);
+    for (auto &every : updateEvery)
+        every = 1;
+}
 
-    // Task 2: Format image to fit OpenGL
-    m_image = m_image.convertToFormat(QImage::Format_RGBA8888).mirrored();
+void particle::particleInit(int particles, int gpuParticles){
+    cpuPath.resize(particles);
+    gpuPath.resize(gpuParticles);
+
+    store.resize(cpuPath.pool.capacity());
+    snapshot[0].assign(store.bytes() / sizeof(float), 0.f);
+    snapshot[1].assign(store.bytes() / sizeof(float), 0.f);
 
     m_particle_shader = ShaderLoader::createShaderProgram(":/resources/shaders/particle.vert", ":/resources/shaders/particle.frag");
     glUseProgram(m_particle_shader);
 
-    glGenBuffers(1, &m_partPos_vbo);
     glGenBuffers(1, &m_particle_vbo);
     glGenVertexArrays(1, &m_particle_vao);
 
-
+    // Only the default sprite until the scene's emitters are applied
     glGenTextures(1, &m_particle_texture);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, m_particle_texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_image.width(), m_image.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, m_image.bits());
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    loadTextures({""});
     GLint location = glGetUniformLocation(m_particle_shader, "u_part_texture");
     glUniform1i(location, 0);
 
+    // The quad never changes, so it is only uploaded once
+    std::vector<float> quadVertices = {
+        // positions         // uv
+        -0.05f, -0.05f, 0.0,  0.0f, 0.0f,
+         0.05f, -0.05f, 0.0,  1.0f, 0.0f,
+
+        -0.05f,  0.05f, 0.0,  0.0f, 1.0f,
+
+        -0.05f,  0.05f,  0.0, 0.0f, 1.0f,
+         0.05f, -0.05f,  0.0, 1.0f, 0.0f,
+         0.05f,  0.05f,  0.0, 1.0f, 1.0f,
+    };
+    glBindBuffer(GL_ARRAY_BUFFER, m_particle_vbo);
+    glBufferData(GL_ARRAY_BUFFER, quadVertices.size() * sizeof(GLfloat), quadVertices.data(), GL_STATIC_DRAW);
+
+    // Every block starts free, so nothing is drawn
+    for (auto *path : {&cpuPath, &gpuPath}) {
+        std::vector<float> layers(path->pool.blocks(), -1.f);
+        glGenBuffers(1, &path->layerVbo);
+        glBindBuffer(GL_ARRAY_BUFFER, path->layerVbo);
+        glBufferData(GL_ARRAY_BUFFER, layers.size() * sizeof(GLfloat), layers.data(), GL_DYNAMIC_DRAW);
+    }
+
+    // CPU simulation instance data, the last two SoA snapshots are streamed as is.
+    // Attributes are pointed at the right ring segment every frame in particleDraw
+    m_instances.initialize(GL_ARRAY_BUFFER, 2 * store.bytes());
+
+    // GPU simulation, every particle starts dead so it respawns on the first update
+    m_update_shader = ShaderLoader::createTransformFeedbackProgram(":/resources/shaders/particle_update.vert", {"out_state"});
+    m_frame_u       = glGetUniformLocation(m_update_shader, "frame");
+    m_center_u      = glGetUniformLocation(m_update_shader, "center");
+    m_mag_u         = glGetUniformLocation(m_update_shader, "mag");
+    m_seed_u        = glGetUniformLocation(m_update_shader, "seed");
+    m_block_size_u  = glGetUniformLocation(m_update_shader, "blockSize");
+    m_block_data_u  = glGetUniformLocation(m_update_shader, "blockData");
+
+    // Two texels per block, sized with the pool so the shader has no limit of its own
+    glGenBuffers(1, &m_block_tbo);
+    glBindBuffer(GL_TEXTURE_BUFFER, m_block_tbo);
+    glBufferData(GL_TEXTURE_BUFFER, 2 * gpuPath.pool.blocks() * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW);
+    glGenTextures(1, &m_block_texture);
+    glBindTexture(GL_TEXTURE_BUFFER, m_block_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_block_tbo);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    std::vector<float> initialState(gpuPath.pool.capacity() * particlelDataSize, 0.f);
+    glGenBuffers(2, m_state_vbo);
+    glGenVertexArrays(2, m_update_vao);
+    glGenVertexArrays(2, m_state_vao);
+    for (int i = 0; i < 2; i++) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_state_vbo[i]);
+        glBufferData(GL_ARRAY_BUFFER, initialState.size() * sizeof(GLfloat), initialState.data(), GL_DYNAMIC_COPY);
+
+        // Reads the state as a plain per-vertex attribute
+        glBindVertexArray(m_update_vao[i]);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, particlelDataSize, GL_FLOAT, GL_FALSE, particlelDataSize * sizeof(GLfloat), reinterpret_cast<void*>(0));
+    }
+
+    // Draws the state as instance data, the other buffer holds the previous step
+    for (int i = 0; i < 2; i++)
+        setDrawAttributes(m_state_vao[i], m_state_vbo[i], particlelDataSize * sizeof(GLfloat), sizeof(GLfloat),
+                          0, m_state_vbo[1 - i], 0, gpuPath.layerVbo);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
     glUseProgram(0);
+
+    cpuClock.reset();
+    gpuClock.reset();
+    simThread = std::thread(&particle::simLoop, this);
 }
 
-float uniform(){
-    return (float)rand() / RAND_MAX;
+// Instance data is four scalar attributes (x, y, z, life), which covers both the
+// interleaved transform feedback buffers and the CPU store's separate arrays.
+// The same four again for the previous step, and the sprite layer advances
+// once per pool block
+void particle::setDrawAttributes(GLuint vao, GLuint instance_vbo, GLsizei stride, size_t component_offset,
+                                 size_t base, GLuint prev_vbo, size_t prev_base, GLuint layer_vbo){
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_particle_vbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5* sizeof(GLfloat), reinterpret_cast<void*>(0));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), reinterpret_cast<void*>(3*sizeof(GLfloat)));
+    // also set instance data
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+    for (int i = 0; i < particlelDataSize; i++) {
+        glEnableVertexAttribArray(2 + i);
+        glVertexAttribPointer(2 + i, 1, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(base + i * component_offset));
+        glVertexAttribDivisor(2 + i, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, prev_vbo);
+    for (int i = 0; i < particlelDataSize; i++) {
+        glEnableVertexAttribArray(7 + i);
+        glVertexAttribPointer(7 + i, 1, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(prev_base + i * component_offset));
+        glVertexAttribDivisor(7 + i, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, layer_vbo);
+    glEnableVertexAttribArray(6);
+    glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE, sizeof(GLfloat), reinterpret_cast<void*>(0));
+    glVertexAttribDivisor(6, blockSize);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-glm::vec2 particle::randCirc(){
-    float theta = 2 * M_PI * uniform();
-    double len = sqrt(uniform()) * spawnRadius;
-    return glm::vec2(len * cos(theta), len * sin(theta));
+void particle::particleSetGPU(bool gpu){
+    gpuSim = gpu;
 }
 
-float y_lerp(float x, float y, float t) {
-  return x * (1.f - t) + y * t;
+void particle::particleSetPaused(bool pause){
+    paused = pause;
 }
 
-void particle::particleRevive(int i){
-    glm::vec2 randPoint = randCirc();
-    particles[i].position = glm::vec3(randPoint.x, 0,randPoint.y);
-    float dist = glm::distance(center, glm::vec2(particles[i].position.x, particles[i].position.z));
-    particles[i].life = uniform() * y_lerp(5, 0, pow(dist, 0.1)) * mag;
+void particle::particleSeed(uint32_t seed){
+    std::lock_guard<std::mutex> lock(stepMutex);
+    store.seed(seed);
+    gpuSeed = seed;
 }
 
-void particle::updatePositions(int i){
-    positions[i*particlelDataSize+0] = particles[i].position.x;
-    positions[i*particlelDataSize+1] = particles[i].position.y;
-    positions[i*particlelDataSize+2] = particles[i].position.z;
-    positions[i*particlelDataSize+3] = particles[i].life;
+void particle::particleSetEmitters(const std::vector<SceneEmitterData> &e){
+    pendingEmitters = e;
+    emittersChanged = true;
 }
 
-void particle::particleUpdate(){
-        for (int i=0; i<particles.size(); i++){
-            particles[i].position.x += (rand() % 3 - 1) * 0.01; // Move randomly in x direction
-            particles[i].position.y += (rand() % 10) * 0.01; // Move upwards in y direction
-            particles[i].position.z += (rand() % 3 - 1) * 0.01; // Move randomly in z direction
-            particles[i].life -= 0.1;
-
-            if (particles[i].life <= 0) {
-//               particles[i].life = 1;
-//               particles[i].position =  glm::vec3((float)rand() / RAND_MAX -0.5, (float)rand() / RAND_MAX-0.5, (float)rand() / RAND_MAX-0.5);
-                particleRevive(i);
+// Hands out pool blocks to the pending emitters and builds their sprite array.
+// Runs from particleDraw so the GL context is current
+void particle::applyEmitters(){
+    std::lock_guard<std::mutex> lock(stepMutex);
+    emitters.clear();
+
+    std::vector<std::string> files = {""};
+    std::map<std::string, int> layerOf = {{"", 0}};
+    std::vector<float> cpuLayers(cpuPath.pool.blocks(), -1.f);
+    std::vector<float> gpuLayers(gpuPath.pool.blocks(), -1.f);
+    std::vector<float> zeros(blockSize * particlelDataSize, 0.f);
+    for (auto *path : {&cpuPath, &gpuPath}) {
+        path->pool.release_all();
+        path->drawCount = 0;
+        path->stats = {};
+    }
+
+    // Up to `wanted` blocks of one path for an emitter, counting the ones it can't get
+    auto allocate = [](path_blocks &path, int wanted, int layer, std::vector<float> &layers,
+                       std::vector<uint32_t> &blocks) {
+        for (int i = 0; i < wanted; i++) {
+            uint32_t b;
+            if (!path.pool.allocate(b)) {
+                path.stats.starved += 1;
+                break;
+            }
+            blocks.push_back(b);
+            layers[b] = layer;
+            path.drawCount = std::max(path.drawCount, int(path.pool.end(b)));
+        }
+    };
+
+    for (auto &d : pendingEmitters) {
+        emitter em;
+        em.data = d;
+        em.lifeScale = d.lifetime / fireLifetime;
+
+        if (!layerOf.contains(d.texture)) {
+            layerOf[d.texture] = files.size();
+            files.push_back(d.texture);
+        }
+        em.layer = layerOf[d.texture];
+
+        // Enough particles to keep rate spawns per second alive for lifetime seconds
+        int wanted = std::max(1, int(std::ceil(d.rate * d.lifetime / blockSize)));
+        allocate(cpuPath, wanted, em.layer, cpuLayers, em.cpuBlocks);
+        allocate(gpuPath, wanted, em.layer, gpuLayers, em.gpuBlocks);
+
+        // Recycled blocks start dead so they respawn at this emitter
+        for (uint32_t b : em.cpuBlocks)
+            store.clear(cpuPath.pool.begin(b), cpuPath.pool.end(b));
+        for (uint32_t b : em.gpuBlocks) {
+            for (int s = 0; s < 2; s++) {
+                glBindBuffer(GL_ARRAY_BUFFER, m_state_vbo[s]);
+                glBufferSubData(GL_ARRAY_BUFFER, gpuPath.pool.begin(b) * particlelDataSize * sizeof(GLfloat),
+                                zeros.size() * sizeof(GLfloat), zeros.data());
             }
+        }
+        emitters.push_back(em);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, cpuPath.layerVbo);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, cpuLayers.size() * sizeof(GLfloat), cpuLayers.data());
+    glBindBuffer(GL_ARRAY_BUFFER, gpuPath.layerVbo);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, gpuLayers.size() * sizeof(GLfloat), gpuLayers.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    loadTextures(files);
+
+    for (auto *path : {&cpuPath, &gpuPath}) {
+        path->stats.emitters = emitters.size();
+        path->stats.used     = path->pool.used() * blockSize;
+        path->stats.capacity = path->pool.capacity();
+    }
+    emittersChanged = false;
+}
 
-            updatePositions(i);
+// One texture array layer per sprite, all resized to the default sprite
+void particle::loadTextures(const std::vector<std::string> &files){
+    QImage base = QImage(QString(":/resources/scene/Particle.png"));
+    base = base.convertToFormat(QImage::Format_RGBA8888).mirrored();
 
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_particle_texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, base.width(), base.height(), files.size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+    for (size_t i = 0; i < files.size(); i++) {
+        QImage image = base;
+        if (!files[i].empty()) {
+            image = QImage(QString::fromStdString(files[i]));
+            if (image.isNull()) {
+                std::cout << "Could not load particle texture " << files[i] << std::endl;
+                image = base;
+            } else {
+                image = image.convertToFormat(QImage::Format_RGBA8888).mirrored()
+                             .scaled(base.width(), base.height(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+            }
         }
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, base.width(), base.height(), 1, GL_RGBA, GL_UNSIGNED_BYTE, image.bits());
+    }
 
-//        glm::vec3((float)rand() / RAND_MAX -0.5, (float)rand() / RAND_MAX-0.5, (float)rand() / RAND_MAX-0.5);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 }
 
+// Freezes emitters outside the view frustum or too far away, and throttles
+// distant ones. Bounds are a sphere around the spawn disc and flame
+void particle::cullEmitters(camera &cam){
+    const glm::mat4 &pv = cam.get_pv();
+    glm::vec4 rows[4] = {
+        glm::vec4(pv[0][0], pv[1][0], pv[2][0], pv[3][0]),
+        glm::vec4(pv[0][1], pv[1][1], pv[2][1], pv[3][1]),
+        glm::vec4(pv[0][2], pv[1][2], pv[2][2], pv[3][2]),
+        glm::vec4(pv[0][3], pv[1][3], pv[2][3], pv[3][3]),
+    };
+    glm::vec4 planes[6] = {
+        rows[3] + rows[0], rows[3] - rows[0],
+        rows[3] + rows[1], rows[3] - rows[1],
+        rows[3] + rows[2], rows[3] - rows[2],
+    };
+    glm::vec3 eye = cam.get_pos();
+
+    for (auto &em : emitters) {
+        glm::vec3 c = em.data.pos + glm::vec3(0, boundHeight * 0.5f, 0);
+        float r = em.data.radius + boundHeight;
 
-void particle::particleDraw(camera &cam){
-    mag = uniform() * 5;
+        bool inside = true;
+        for (auto &p : planes) {
+            if (glm::dot(glm::vec3(p), c) + p.w < -r * glm::length(glm::vec3(p))) {
+                inside = false;
+                break;
+            }
+        }
+
+        float dist = glm::distance(eye, c);
+        int every = 1;
+        if (!inside || dist > freezeDistance)
+            every = 0;
+        else if (dist > throttleDistance)
+            every = throttleInterval;
+
+        for (auto b : em.cpuBlocks)
+            cpuPath.updateEvery[b] = every;
+        for (auto b : em.gpuBlocks)
+            gpuPath.updateEvery[b] = every;
+    }
+}
+
+// Throttled blocks are spread over different steps
+bool particle::shouldUpdate(const path_blocks &path, uint32_t block) const{
+    int every = path.updateEvery[block];
+    return every != 0 && (timer + block) % every == 0;
+}
+
+// Flicker shared by every emitter, advanced once per step
+void particle::spawnStep(){
+    mag = store.uniform() * 5;
     timer += 1;
 
-    if (timer % 10 == 0) center = glm::vec2((uniform()-0.5) * 0.3, (uniform()-0.5) * 0.3);
-    particleUpdate();
+    if (timer % 10 == 0) center = glm::vec2((store.uniform()-0.5) * 0.3, (store.uniform()-0.5) * 0.3);
+}
 
-    glUseProgram(m_particle_shader);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+// One fixed CPU step, called with stepMutex held
+void particle::particleUpdate(){
+    spawnStep();
+
+    std::vector<particle_store::span> spans;
+    for (auto &em : emitters) {
+        particle_store::spawn_params params{em.data.radius, center, mag, em.data.pos, em.lifeScale};
+        for (auto b : em.cpuBlocks) {
+            if (shouldUpdate(cpuPath, b))
+                spans.push_back({cpuPath.pool.begin(b), cpuPath.pool.end(b), params});
+        }
+    }
+    store.update(spans);
+}
+
+// Copies the latest step out for drawing, the older snapshot becomes the previous step.
+// Called with stepMutex held, so the store can't be cleared or resized mid copy
+void particle::publish(){
+    std::lock_guard<std::mutex> lock(snapshotMutex);
+    int dst = 1 - latest;
+    std::copy(store.data(), store.data() + snapshot[dst].size(), snapshot[dst].begin());
+    latest = dst;
+    latestTime = sim_clock::clock_type::now();
+}
+
+void particle::simLoop(){
+    while (!simStop) {
+        // Steps are still consumed while idle, so resuming doesn't catch up
+        int steps = cpuClock.advance();
+        if (!paused && !gpuSim) {
+            for (int i = 0; i < steps; i++) {
+                std::lock_guard<std::mutex> lock(stepMutex);
+                particleUpdate();
+                publish();
+            }
+        }
+        std::this_thread::sleep_for(cpuClock.until_next());
+    }
+}
 
+void particle::stopSim(){
+    simStop = true;
+    if (simThread.joinable())
+        simThread.join();
+}
+
+// Advances the particles with transform feedback: reads state from one
+// buffer, writes it into the other, nothing goes through the CPU.
+// Emitter parameters are looked up per pool block in a buffer texture,
+// spawn position and radius then lifetime scale, 0 for blocks left as they
+// are. Only the blocks up to the last one handed out are stepped. One
+// fixed step, called with stepMutex held
+void particle::particleUpdateGPU(){
+    spawnStep();
+    int dst = 1 - gpuSrc;
+
+    std::vector<glm::vec4> blockData(2 * (gpuPath.drawCount / blockSize), glm::vec4(0));
+    for (auto &em : emitters) {
+        for (auto b : em.gpuBlocks) {
+            if (!shouldUpdate(gpuPath, b))
+                continue;
+            blockData[2 * b]     = glm::vec4(em.data.pos, em.data.radius);
+            blockData[2 * b + 1] = glm::vec4(em.lifeScale, 0, 0, 0);
+        }
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, m_block_tbo);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, blockData.size() * sizeof(glm::vec4), blockData.data());
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, m_block_texture);
+
+    glUseProgram(m_update_shader);
+    glUniform1ui(m_frame_u, timer);
+    glUniform2fv(m_center_u, 1, &center[0]);
+    glUniform1f(m_mag_u, mag);
+    glUniform1ui(m_seed_u, gpuSeed);
+    glUniform1i(m_block_size_u, blockSize);
+    glUniform1i(m_block_data_u, 1);
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(m_update_vao[gpuSrc]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, m_state_vbo[dst]);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, gpuPath.drawCount);
+    glEndTransformFeedback();
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+    glDisable(GL_RASTERIZER_DISCARD);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, m_particle_texture);
 
-    std::vector<float> quadVertices = {
-        // positions         // uv
-        -0.05f, -0.05f, 0.0,  0.0f, 0.0f,
-         0.05f, -0.05f, 0.0,  1.0f, 0.0f,
+    gpuSrc = dst;
+}
 
-        -0.05f,  0.05f, 0.0,  0.0f, 1.0f,
+void particle::particleDraw(camera &cam){
+    if (emittersChanged)
+        applyEmitters();
+    if (emitters.empty())
+        return;
+
+    frames += 1;
+    cullEmitters(cam);
+
+    // The CPU path steps on simThread, only its latest two snapshots are needed here
+    GLuint vao = m_particle_vao;
+    float alpha;
+    int steps = gpuClock.advance();
+    if (gpuSim) {
+        {
+            std::lock_guard<std::mutex> lock(stepMutex);
+            for (int i = 0; i < steps; i++)
+                particleUpdateGPU();
+        }
+        alpha = gpuClock.alpha();
+        vao = m_state_vao[gpuSrc];
+    } else {
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        GLintptr curr = m_instances.upload(snapshot[latest].data(), store.bytes());
+        GLintptr prev = m_instances.upload(snapshot[1 - latest].data(), store.bytes());
+        setDrawAttributes(m_particle_vao, m_instances.id(), sizeof(GLfloat), store.component_offset(),
+                          curr, m_instances.id(), prev, cpuPath.layerVbo);
+
+        auto since = std::chrono::duration<double>(sim_clock::clock_type::now() - latestTime).count();
+        alpha = std::min(1.f, float(since / cpuClock.step()));
+    }
 
-        -0.05f,  0.05f,  0.0, 0.0f, 1.0f,
-         0.05f, -0.05f,  0.0, 1.0f, 0.0f,
-         0.05f,  0.05f,  0.0, 1.0f, 1.0f,
-    };
+    glUseProgram(m_particle_shader);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-//    uniform vec3 cameraRight;
-//    uniform vec3 cameraUp;
-//    glm::mat4 m_view = cam.getView();
-//    glm::mat4 m_proj = cam.getProjection();
-//    std::cout << glm::to_string(cam.view_matrix) << std::endl;
-//    glm::mat4 m_view = glm::mat4(1.0);
-//    glm::mat4 m_proj = glm::mat4(1.0);
-//    glm::mat4 particle_mvp = m_proj * m_view * m_part_model;
-//    GLuint location = glGetUniformLocation(m_particle_shader, "mvp");
-//    glUniformMatrix4fv(location, 1, false, &particle_mvp[0][0]);
-
-//    glm::vec3 CameraRight_worldspace = {m_view[0][0], m_view[1][0], m_view[2][0]};
-//    glm::vec3 CameraUp_worldspace = {m_view[0][1], m_view[1][1], m_view[2][1]};
-//    location = glGetUniformLocation(m_particle_shader, "cameraRight");
-//    glUniform3fv(location, 1, &CameraRight_worldspace[0]);
-//    location = glGetUniformLocation(m_particle_shader, "cameraUp");
-//    glUniform3fv(location, 1, &CameraUp_worldspace[0]);
-    cam.send_particleUiforms(m_particle_shader, m_part_model);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_particle_texture);
+
+    // Particles are simulated in world space
+    cam.send_particleUiforms(m_particle_shader, glm::mat4(1.0));
     GLuint location = glGetUniformLocation(m_particle_shader, "quadSize");
     glUniform1f(location, 0.5);
     location = glGetUniformLocation(m_particle_shader, "u_part_texture");
     glUniform1i(location, 0);
+    location = glGetUniformLocation(m_particle_shader, "alpha");
+    glUniform1f(location, alpha);
 
-    glBindVertexArray(m_particle_vao);
-    glBindBuffer(GL_ARRAY_BUFFER, m_particle_vbo);
-    glBufferData(GL_ARRAY_BUFFER, quadVertices.size() * sizeof(GLfloat), quadVertices.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5* sizeof(GLfloat), reinterpret_cast<void*>(0));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), reinterpret_cast<void*>(3*sizeof(GLfloat)));
-    // also set instance data
-    glEnableVertexAttribArray(2);
-    glBindBuffer(GL_ARRAY_BUFFER, m_partPos_vbo);
-    glBufferData(GL_ARRAY_BUFFER, particles.size()*sizeof(GLfloat),positions.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(2, particlelDataSize, GL_FLOAT, GL_FALSE, particlelDataSize * sizeof(GLfloat), reinterpret_cast<void*>(0));
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glVertexAttribDivisor(2, 1);
-
-//    std::cout << "hello" << std::endl;
-
-//    glBindVertexArray(m_particle_vao);
-//    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, particleSize); // 100 triangles of 6 vertices each
+    // Every emitter in one draw, free blocks are discarded in the vertex shader
+    glBindVertexArray(vao);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, gpuSim ? gpuPath.drawCount : cpuPath.drawCount);
     glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
     glUseProgram(0);
+
+    if (!gpuSim)
+        m_instances.end_frame();
 }
 
 void particle::particleFinish(){
+    stopSim();
     glDeleteBuffers(1, &m_particle_vbo);
-    glDeleteBuffers(1, &m_partPos_vbo);
+    glDeleteBuffers(1, &cpuPath.layerVbo);
+    glDeleteBuffers(1, &gpuPath.layerVbo);
+    m_instances.cleanup();
     glDeleteVertexArrays(1, &m_particle_vao);
+    glDeleteBuffers(2, m_state_vbo);
+    glDeleteVertexArrays(2, m_update_vao);
+    glDeleteVertexArrays(2, m_state_vao);
     glDeleteProgram(m_particle_shader);
+    glDeleteProgram(m_update_shader);
     glDeleteTextures(1, &m_particle_texture);
+    glDeleteBuffers(1, &m_block_tbo);
+    glDeleteTextures(1, &m_block_texture);
 }
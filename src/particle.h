@@ -3,46 +3,145 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 #include "camera.h"
+#include "particle_pool.h"
+#include "particle_store.h"
+#include "sim_clock.h"
+#include "stream_buffer.h"
+#include "utils/scenedata.h"
 #include <QOpenGLWidget>
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+
 
 class particle
 {
 public:
-    struct Particle{
-        glm::vec3 position;
-        float life;
-    };
+    ~particle();
 
-    void particleInit();
+    // Sizes the CPU and GPU pools to hold at least `particles` and
+    // `gpuParticles`, in whole blocks
+    void particleInit(int particles, int gpuParticles);
     void particleDraw(camera &cam);
     void particleUpdate();
-    void particleRevive(int i);
-    void updatePositions(int i);
     void particleFinish();
 
+    // Emitters from the scene file, applied on the next draw
+    void particleSetEmitters(const std::vector<SceneEmitterData> &emitters);
+
+    // Same seed gives the same simulation, for reproducible benchmark runs
+    void particleSeed(uint32_t seed);
+
+    // Simulate on the GPU with transform feedback instead of on the CPU
+    void particleSetGPU(bool gpu);
+
+    // Stops the simulation while the particles aren't shown
+    void particleSetPaused(bool pause);
+
+    // The CPU path's instance stream, for its stats of the last frame
+    const stream_buffer &particleStream() const { return m_instances; }
+
+    // Pool use since the emitters were last applied
+    struct pool_stats {
+        size_t emitters; // Emitters in the scene
+        size_t starved;  // Emitters given fewer blocks than their rate needs, the pool ran out
+        size_t used;     // Particles in blocks handed out
+        size_t capacity; // Particles the pool holds
+    };
+    const pool_stats &particlePoolStats(bool gpu) const { return (gpu ? gpuPath : cpuPath).stats; }
+
 private:
-    glm::vec3 firePos = glm::vec3(-5, -0.4, -3);
+    // Every emitter allocates blockSize particle blocks from a pool per
+    // simulation path, which is also the whole instance range of that
+    // path's single draw call. The GPU path has a pool of its own, so it
+    // can hold far more particles than the CPU store. Sizes are set in
+    // particleInit
+    static constexpr int blockSize = 1024;
+    struct path_blocks {
+        particle_pool pool = particle_pool(0, blockSize);
+        // Set by cullEmitters per block: 0 frozen, 1 every step, N every Nth step
+        std::vector<std::atomic<int>> updateEvery;
+        GLuint layerVbo;   // Sprite layer per block, -1 for free blocks
+        int drawCount = 0; // Instances up to the last block in use
+        pool_stats stats = {};
 
-    float spawnRadius = 0.7;
-    int particleSize = 50000;
+        void resize(int particles);
+    };
+    path_blocks cpuPath;
+    path_blocks gpuPath;
     int particlelDataSize = 4;
-    std::vector<Particle> particles;
-    std::vector<float> positions;
+    particle_store store;
+
+    struct emitter {
+        SceneEmitterData data;
+        std::vector<uint32_t> cpuBlocks;
+        std::vector<uint32_t> gpuBlocks;
+        float lifeScale;
+        int layer; // Sprite layer in the texture array
+    };
+    std::vector<emitter> emitters;
+    std::vector<SceneEmitterData> pendingEmitters;
+    bool emittersChanged = false;
+
+    // The simulation runs at a fixed step, independent of the frame rate: on
+    // simThread for the CPU path and from particleDraw for the GPU path.
+    // Drawing interpolates between the last two steps
+    sim_clock cpuClock;
+    sim_clock gpuClock;
+    std::thread simThread;
+    std::atomic<bool> simStop = false;
+    std::atomic<bool> paused = true;
+    std::mutex stepMutex; // Emitters, store and spawn values
+
+    // Last two CPU steps, copied out of the store for drawing
+    std::mutex snapshotMutex;
+    std::vector<float> snapshot[2];
+    int latest = 0;
+    sim_clock::clock_type::time_point latestTime;
+
     GLuint m_particle_shader;
     GLuint m_particle_vbo;
     GLuint m_particle_vao;
-    GLuint m_partPos_vbo;
-    GLuint m_particle_texture;
-    QImage m_image;
+    stream_buffer m_instances; // CPU simulation instance data, streamed every frame
+    GLuint m_particle_texture; // Texture array, one layer per sprite
+
+    // GPU simulation: particle state ping-pongs between two buffers, which
+    // are also used directly as instance data when drawing
+    std::atomic<bool> gpuSim = false;
+    int gpuSrc = 0;
+    GLuint m_update_shader;
+    GLuint m_state_vbo[2];
+    GLuint m_update_vao[2];
+    GLuint m_state_vao[2];
+    GLint m_frame_u;
+    GLint m_center_u;
+    GLint m_mag_u;
+    GLint m_seed_u;
+    GLint m_block_size_u;
+    GLint m_block_data_u;
+    GLuint m_block_tbo;     // Emitter parameters per pool block, see particleUpdateGPU
+    GLuint m_block_texture; // The same as a buffer texture
+    uint32_t gpuSeed = 0;
 
     glm::vec2 center = glm::vec2(0,0);
-    glm::mat4 m_part_model = glm::mat4(1.0);
 
     float mag = 5.f;
-    int timer = 0;
+    int timer = 0;  // Simulation steps
+    int frames = 0;
 
-    // Spawn randomly in circle
-    glm::vec2 randCirc();
-};
+    // Quad + instance attribute layout for the draw VAOs
+    void setDrawAttributes(GLuint vao, GLuint instance_vbo, GLsizei stride, size_t component_offset,
+                           size_t base, GLuint prev_vbo, size_t prev_base, GLuint layer_vbo);
+    void particleUpdateGPU();
 
+    void simLoop();
+    void stopSim();
+    void spawnStep();
+    void publish();
+
+    void applyEmitters();
+    void loadTextures(const std::vector<std::string> &files);
+    void cullEmitters(camera &cam);
+    bool shouldUpdate(const path_blocks &path, uint32_t block) const;
+};
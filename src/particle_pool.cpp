@@ -0,0 +1,26 @@
+#include "particle_pool.h"
+
+particle_pool::particle_pool(size_t blocks, size_t block_size)
+  : block_count(blocks), block_particles(block_size) {
+  release_all();
+}
+
+bool particle_pool::allocate(uint32_t &block) {
+  if (free_list.empty())
+    return false;
+
+  block = free_list.back();
+  free_list.pop_back();
+  return true;
+}
+
+void particle_pool::release(uint32_t block) {
+  free_list.push_back(block);
+}
+
+void particle_pool::release_all() {
+  // Reversed so blocks are handed out from the start of the storage
+  free_list.clear();
+  for (size_t b = block_count; b-- > 0; )
+    free_list.push_back(static_cast<uint32_t>(b));
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fixed capacity allocator for the particle storage shared by every emitter.
+// Storage is split into equal blocks; released blocks go on a free list and
+// are handed out again first, so the pool never grows or fragments.
+class particle_pool
+{
+public:
+  particle_pool(size_t blocks, size_t block_size);
+
+  // Returns false when every block is in use
+  bool allocate(uint32_t &block);
+  void release(uint32_t block);
+  void release_all();
+
+  size_t block_size() const { return block_particles; }
+  size_t blocks() const { return block_count; }
+  size_t used() const { return block_count - free_list.size(); }
+  size_t capacity() const { return block_count * block_particles; }
+
+  // Particle range covered by a block
+  size_t begin(uint32_t block) const { return block * block_particles; }
+  size_t end(uint32_t block) const { return (block + 1) * block_particles; }
+
+private:
+  size_t block_count;
+  size_t block_particles;
+  std::vector<uint32_t> free_list;
+};
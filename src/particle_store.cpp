@@ -0,0 +1,213 @@
+#include "particle_store.h"
+#include "jobs/job_system.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <random>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+using std::vector;
+
+constexpr float  pi         = 3.1415926535f;
+constexpr float  inv_2_24   = 1.f / 16777216.f;
+constexpr size_t chunk_size = 16384; // Particles per job, multiple of every SIMD width
+
+// Scalar xorshift32, every SIMD lane runs the exact same sequence
+static inline uint32_t xorshift(uint32_t &s) {
+  s ^= s << 13;
+  s ^= s >> 17;
+  s ^= s << 5;
+  return s;
+}
+
+// Uniform in [0, 1) from the top 24 bits
+static inline float to_uniform(uint32_t r) {
+  return (r >> 8) * inv_2_24;
+}
+
+// Scalar movement, same integer math as the SIMD kernels below:
+// floor(u * 3) and floor(u * 10) for u = k / 2^24 are (k * 3) >> 24 and (k * 10) >> 24
+static inline int step_xz(uint32_t r) {
+  return static_cast<int>(((r >> 8) * 3) >> 24) - 1;
+}
+
+static inline int step_y(uint32_t r) {
+  return static_cast<int>(((r >> 8) * 10) >> 24);
+}
+
+particle_store::particle_store() : count(0), padded(0), main_rng(1)
+{
+  seed(std::random_device()());
+}
+
+void particle_store::resize(size_t n) {
+  count  = n;
+  padded = ((n + chunk_size - 1) / chunk_size) * chunk_size;
+
+  // Everything starts dead, so it respawns on the first update
+  buffer.assign(padded * 4, 0.f);
+
+  auto old_rng = rng.size();
+  rng.resize(padded);
+  for (size_t i = old_rng; i < padded; ++i)
+    rng[i] = (main_rng ^ static_cast<uint32_t>(i * 0x9E3779B9u)) | 1u;
+}
+
+void particle_store::seed(uint32_t s) {
+  // Splitmix-style scramble so neighbouring seeds and particles are unrelated
+  auto mix = [](uint32_t x) {
+    x ^= x >> 16; x *= 0x7feb352du;
+    x ^= x >> 15; x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+  };
+
+  main_rng = mix(s) | 1u;
+  for (size_t i = 0; i != rng.size(); ++i)
+    rng[i] = mix(s ^ mix(static_cast<uint32_t>(i))) | 1u;
+}
+
+float particle_store::uniform() {
+  return to_uniform(xorshift(main_rng));
+}
+
+void particle_store::revive(size_t i, const spawn_params &p) {
+  float *x    = buffer.data();
+  float *y    = x + padded;
+  float *z    = y + padded;
+  float *life = z + padded;
+  uint32_t &s = rng[i];
+
+  // Spawn randomly in circle around the emitter
+  float theta  = 2 * pi * to_uniform(xorshift(s));
+  float len    = std::sqrt(to_uniform(xorshift(s))) * p.radius;
+  glm::vec2 local(len * std::cos(theta), len * std::sin(theta));
+  x[i] = p.origin.x + local.x;
+  y[i] = p.origin.y;
+  z[i] = p.origin.z + local.y;
+
+  float dist = glm::distance(p.center, local);
+  life[i] = to_uniform(xorshift(s)) * (5.f * (1.f - std::pow(dist, 0.1f))) * p.mag * p.life_scale;
+}
+
+void particle_store::update_range(size_t begin, size_t end, const spawn_params &p) {
+  float *x    = buffer.data();
+  float *y    = x + padded;
+  float *z    = y + padded;
+  float *life = z + padded;
+  uint32_t *s = rng.data();
+  size_t i    = begin;
+
+#if defined(__AVX2__)
+  const __m256i one   = _mm256_set1_epi32(1);
+  const __m256  step  = _mm256_set1_ps(0.01f);
+  const __m256  decay = _mm256_set1_ps(0.1f);
+  const __m256  zero  = _mm256_setzero_ps();
+
+  auto next = [](__m256i v) {
+    v = _mm256_xor_si256(v, _mm256_slli_epi32(v, 13));
+    v = _mm256_xor_si256(v, _mm256_srli_epi32(v, 17));
+    return _mm256_xor_si256(v, _mm256_slli_epi32(v, 5));
+  };
+  auto times3  = [](__m256i k) { return _mm256_srli_epi32(_mm256_add_epi32(_mm256_slli_epi32(k, 1), k), 24); };
+  auto times10 = [](__m256i k) { return _mm256_srli_epi32(_mm256_add_epi32(_mm256_slli_epi32(k, 3), _mm256_slli_epi32(k, 1)), 24); };
+
+  for (; i + 8 <= end; i += 8) {
+    __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+
+    r = next(r);
+    __m256 dx = _mm256_cvtepi32_ps(_mm256_sub_epi32(times3(_mm256_srli_epi32(r, 8)), one));
+    r = next(r);
+    __m256 dy = _mm256_cvtepi32_ps(times10(_mm256_srli_epi32(r, 8)));
+    r = next(r);
+    __m256 dz = _mm256_cvtepi32_ps(_mm256_sub_epi32(times3(_mm256_srli_epi32(r, 8)), one));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(s + i), r);
+
+    _mm256_storeu_ps(x + i, _mm256_add_ps(_mm256_loadu_ps(x + i), _mm256_mul_ps(dx, step)));
+    _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_mul_ps(dy, step)));
+    _mm256_storeu_ps(z + i, _mm256_add_ps(_mm256_loadu_ps(z + i), _mm256_mul_ps(dz, step)));
+    __m256 l = _mm256_sub_ps(_mm256_loadu_ps(life + i), decay);
+    _mm256_storeu_ps(life + i, l);
+
+    // Respawns are rare, do them one by one
+    unsigned dead = _mm256_movemask_ps(_mm256_cmp_ps(l, zero, _CMP_LE_OQ));
+    while (dead) {
+      revive(i + std::countr_zero(dead), p);
+      dead &= dead - 1;
+    }
+  }
+#elif defined(__SSE2__) || defined(_M_X64)
+  const __m128i one   = _mm_set1_epi32(1);
+  const __m128  step  = _mm_set1_ps(0.01f);
+  const __m128  decay = _mm_set1_ps(0.1f);
+  const __m128  zero  = _mm_setzero_ps();
+
+  auto next = [](__m128i v) {
+    v = _mm_xor_si128(v, _mm_slli_epi32(v, 13));
+    v = _mm_xor_si128(v, _mm_srli_epi32(v, 17));
+    return _mm_xor_si128(v, _mm_slli_epi32(v, 5));
+  };
+  auto times3  = [](__m128i k) { return _mm_srli_epi32(_mm_add_epi32(_mm_slli_epi32(k, 1), k), 24); };
+  auto times10 = [](__m128i k) { return _mm_srli_epi32(_mm_add_epi32(_mm_slli_epi32(k, 3), _mm_slli_epi32(k, 1)), 24); };
+
+  for (; i + 4 <= end; i += 4) {
+    __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+
+    r = next(r);
+    __m128 dx = _mm_cvtepi32_ps(_mm_sub_epi32(times3(_mm_srli_epi32(r, 8)), one));
+    r = next(r);
+    __m128 dy = _mm_cvtepi32_ps(times10(_mm_srli_epi32(r, 8)));
+    r = next(r);
+    __m128 dz = _mm_cvtepi32_ps(_mm_sub_epi32(times3(_mm_srli_epi32(r, 8)), one));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(s + i), r);
+
+    _mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), _mm_mul_ps(dx, step)));
+    _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(dy, step)));
+    _mm_storeu_ps(z + i, _mm_add_ps(_mm_loadu_ps(z + i), _mm_mul_ps(dz, step)));
+    __m128 l = _mm_sub_ps(_mm_loadu_ps(life + i), decay);
+    _mm_storeu_ps(life + i, l);
+
+    // Respawns are rare, do them one by one
+    unsigned dead = _mm_movemask_ps(_mm_cmple_ps(l, zero));
+    while (dead) {
+      revive(i + std::countr_zero(dead), p);
+      dead &= dead - 1;
+    }
+  }
+#endif
+
+  // Scalar tail, or everything on targets without SSE
+  for (; i < end; ++i) {
+    x[i] += step_xz(xorshift(s[i])) * 0.01f; // Move randomly in x direction
+    y[i] += step_y(xorshift(s[i]))  * 0.01f; // Move upwards in y direction
+    z[i] += step_xz(xorshift(s[i])) * 0.01f; // Move randomly in z direction
+    life[i] -= 0.1f;
+
+    if (life[i] <= 0.f)
+      revive(i, p);
+  }
+}
+
+void particle_store::update(const spawn_params &params) {
+  job_system::shared().parallel_for(padded / chunk_size, 1, [&](size_t first, size_t last) {
+    update_range(first * chunk_size, last * chunk_size, params);
+  });
+}
+
+void particle_store::update(const vector<span> &spans) {
+  job_system::shared().parallel_for(spans.size(), 1, [&](size_t first, size_t last) {
+    for (size_t i = first; i != last; ++i)
+      update_range(spans[i].begin, spans[i].end, spans[i].params);
+  });
+}
+
+void particle_store::clear(size_t begin, size_t end) {
+  for (size_t c = 0; c != 4; ++c)
+    std::fill(buffer.begin() + c * padded + begin, buffer.begin() + c * padded + end, 0.f);
+}
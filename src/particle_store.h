@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Structure of arrays storage and update kernel for the CPU particle simulation.
+// x, y, z and life are stored back to back in a single float array, so the whole
+// block can be uploaded as is and bound as four instance attributes.
+class particle_store
+{
+public:
+  // Per frame values shared by every respawning particle of an emitter
+  struct spawn_params {
+    float     radius;
+    glm::vec2 center;
+    float     mag;
+    glm::vec3 origin     = glm::vec3(0); // Particles are stored in world space
+    float     life_scale = 1.f;
+  };
+
+  // A range of particles advanced with the same spawn parameters
+  struct span {
+    size_t       begin;
+    size_t       end;
+    spawn_params params;
+  };
+
+  particle_store();
+
+  // Number of particles, storage is padded to a whole number of chunks
+  void resize(size_t count);
+
+  // Reseed every per particle generator, same seed gives the same simulation
+  void seed(uint32_t s);
+
+  // Advance all particles one step, a job per chunk
+  void update(const spawn_params &params);
+
+  // Advance only the given ranges, a job per span. Particles outside
+  // every span are left as they are
+  void update(const std::vector<span> &spans);
+
+  // Kill a range so it respawns on its next update
+  void clear(size_t begin, size_t end);
+
+  // Uniform float in [0, 1) from the store's own generator
+  float uniform();
+
+  // Instance data
+  size_t size() const { return count; }
+  size_t component_offset() const { return padded * sizeof(float); } // Bytes between x, y, z and life
+  size_t bytes() const { return buffer.size() * sizeof(float); }
+  const float *data() const { return buffer.data(); }
+
+private:
+  size_t count;
+  size_t padded;
+
+  // [x ... | y ... | z ... | life ...]
+  std::vector<float> buffer;
+
+  // One xorshift32 state per particle
+  std::vector<uint32_t> rng;
+  uint32_t main_rng;
+
+  // Scalar respawn, same as the old particle::particleRevive
+  void revive(size_t i, const spawn_params &params);
+  void update_range(size_t begin, size_t end, const spawn_params &params);
+};
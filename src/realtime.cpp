@@ -3,12 +3,17 @@
 #include <QCoreApplication>
 #include <QMouseEvent>
 #include <QKeyEvent>
+#include <QScreen>
+#include <chrono>
+#include <cmath>
 #include <iostream>
 #include <map>
 #include <string>
 #include "glm/ext/matrix_clip_space.hpp"
 #include "glm/ext/matrix_transform.hpp"
 #include "settings.h"
+#include "jobs/job_system.h"
+#include "utils/scenediff.h"
 #include "utils/shaderloader.h"
 
 using std::map;
@@ -31,11 +36,30 @@ Realtime::Realtime(QWidget *parent)
   m_keyMap[Qt::Key_Control] = false;
   m_keyMap[Qt::Key_Space]   = false;
 
+  // Editors write a file in several steps, so a reload waits for them to stop
+  reload_timer.setSingleShot(true);
+  connect(&reload_timer, &QTimer::timeout, this, &Realtime::reloadScene);
+  connect(&scene_watcher, &QFileSystemWatcher::fileChanged, this, [this](const QString &) {
+    // Saving by replacing the file stops it being watched
+    watchScene();
+    reload_timer.start(50);
+  });
+
+  // Frames run back to back only while something changes every frame, each
+  // one started once the last has been swapped
+  m_timer.setSingleShot(true);
+  m_timer.setTimerType(Qt::PreciseTimer);
+  connect(&m_timer, &QTimer::timeout, this, &Realtime::tick);
+  connect(this, &QOpenGLWidget::frameSwapped, this, [this] {
+    m_frames.presented();
+    scheduleFrame();
+  });
+
   // If you must use this function, do not edit anything above this
 }
 
 void Realtime::finish() {
-  killTimer(m_timer);
+  m_timer.stop();
   this->makeCurrent();
 
   // Students: anything requiring OpenGL calls when the program exits should be done here
@@ -44,6 +68,8 @@ void Realtime::finish() {
 
   glDeleteProgram(phong_shader_id);
   glDeleteProgram(texture_shader_id);
+  glDeleteProgram(tess_shader_id);
+  glDeleteProgram(tess_shadow_shader_id);
 
   // SHADOW MAPPING RELATED
   glDeleteFramebuffers(MAX_SPOTLIGHTS, &shadowFBO[0]);
@@ -58,8 +84,8 @@ void Realtime::finish() {
 void Realtime::initializeGL() {
   m_devicePixelRatio = this->devicePixelRatio();
 
-  m_timer = startTimer(1000/60);
-  m_elapsedTimer.start();
+  m_frames.set_refresh(screen()->refreshRate());
+  m_simClock.reset();
 
   // Initializing GL.
   // GLEW (GL Extension Wrangler) provides access to OpenGL functions.
@@ -87,21 +113,38 @@ void Realtime::initializeGL() {
   shadow_shader_id = ShaderLoader::createShaderProgram(":resources/shaders/shadow.vert",
                                                        ":resources/shaders/shadow.frag");
 
+  // GPU tessellation, same fragment shaders as the triangle programs
+  tess_shader_id = ShaderLoader::createTessellationProgram(":resources/shaders/tess.vert",
+                                                           ":resources/shaders/tess.tesc",
+                                                           ":resources/shaders/tess.tese",
+                                                           ":resources/shaders/parallax.frag");
+  tess_shadow_shader_id = ShaderLoader::createTessellationProgram(":resources/shaders/tess.vert",
+                                                                  ":resources/shaders/tess.tesc",
+                                                                  ":resources/shaders/tess.tese",
+                                                                  ":resources/shaders/shadow.frag");
+
   glUseProgram(phong_shader_id);
   // Pass shader to camera
   cam.initialize(phong_shader_id);
+  cam.add_program(tess_shader_id);
   // Pass shader to scene lighting
   scene_lighting.initialize(phong_shader_id);
+  scene_lighting.initialize(tess_shader_id);
   // Pass shader to scene geometry
   scene_objects.initialize(phong_shader_id);
-
-  // Set texture uniform for our phong shader
-  GLint p_tex_u = glGetUniformLocation(phong_shader_id, "tex");
-  glUniform1i(p_tex_u, 0);
-  GLint p_nor_u = glGetUniformLocation(phong_shader_id, "normal_map");
-  glUniform1i(p_nor_u, 1);
-  GLint p_dis_u = glGetUniformLocation(phong_shader_id, "disp_map");
-  glUniform1i(p_dis_u, 2);
+  scene_objects.initialize_patches(tess_shader_id, tess_shadow_shader_id);
+
+  // Set texture uniforms for both lit programs
+  for (GLuint program : { phong_shader_id, tess_shader_id }) {
+    glUseProgram(program);
+    GLint p_tex_u = glGetUniformLocation(program, "tex");
+    glUniform1i(p_tex_u, 0);
+    GLint p_nor_u = glGetUniformLocation(program, "normal_map");
+    glUniform1i(p_nor_u, 1);
+    GLint p_dis_u = glGetUniformLocation(program, "disp_map");
+    glUniform1i(p_dis_u, 2);
+  }
+  glUseProgram(phong_shader_id);
 
   // Store uniform for shadow enabling / disabling
   shadow_bool_u = glGetUniformLocation(phong_shader_id, "do_shadows");
@@ -134,11 +177,16 @@ void Realtime::initializeGL() {
       glBindTexture(GL_TEXTURE_2D, 0);
   }
   // ------------------------------------------------------------------------- //
-  part.particleInit();
+  part.particleInit(settings.particleCount, settings.gpuParticleCount);
+  if (settings.particleSeed != 0)
+    part.particleSeed(settings.particleSeed);
 
   glUseProgram(0);
 
   initialized = true;
+
+  // Anything switched on before there was GL starts its frames now
+  scheduleFrame();
 }
 
 // input is degrees and axis of rotation
@@ -155,12 +203,17 @@ glm::mat4 rotationMat(float theta, glm::vec3 axis) {
                      0, 0, 0, 1);
 }
 
-// SHADOW MAPPING RELATED - rotates the direction vec for all spot lights by 1deg
+// Degrees per second animated instances and spot lights turn about the vertical
+constexpr float spin_speed = 45.f;
+
+// SHADOW MAPPING RELATED - rotates the direction vec for all spot lights while the scene is animated
 void Realtime::updateSpotLightSpaceMat(float deltaTime) {
     // update the directions for all spot lights in the scene & calculate new light space mats
     spotLightSpaceMats.clear();  // clear old spotlight space mats
     for (SceneLightData &light : meta_data.lights) {
         if (light.type == LightType::LIGHT_SPOT) {
+            if (settings.animateScene)
+                light.dir = rotationMat(spin_speed * deltaTime, glm::vec3(0.f, 1.f, 0.f)) * light.dir;
             float FoV = light.angle + light.penumbra; // glm::radians(90.0f);
             glm::mat4 lightProjectionMatrix = glm::perspective(FoV, 1.0f, 0.1f, 100.f);
             glm::mat4 lightViewMatrix = glm::lookAt(glm::vec3(light.pos), glm::vec3(light.pos) + glm::vec3(light.dir), glm::vec3(0.0f,0.0f,1.0f));
@@ -174,7 +227,34 @@ void Realtime::updateSpotLightSpaceMat(float deltaTime) {
       meta_data.globalData.ks);
 }
 
+// Spins every placed instance about its vertical axis. Only the instances'
+// nodes are changed, so only their matrices are recomputed and uploaded
+void Realtime::animateScene(float seconds) {
+  scene_time = std::fmod(scene_time + seconds, 360.f / spin_speed); // A whole turn
+  glm::mat4 spin = rotationMat(spin_speed * scene_time, glm::vec3(0.f, 1.f, 0.f));
+  const auto &nodes = meta_data.nodes;
+  for (uint32_t n = 0; n < nodes.size(); n++)
+    if (nodes.instance[n] != RenderNodes::none)
+      scene_transforms.set_local(n, nodes.local[n] * spin);
+  if (!scene_transforms.dirty())
+    return;
+
+  scene_transforms.update(moved_shapes, moved_instances);
+  makeCurrent();
+  scene_objects.update_shapes(moved_shapes);
+  scene_objects.update_instances(moved_instances);
+  doneCurrent();
+}
+
 void Realtime::paintGL() {
+  m_frames.begin_frame();
+
+  // GL work jobs posted since the last frame, shapes re-tessellated in the
+  // background, and LOD levels for where the camera is now
+  job_system::shared().run_main();
+  scene_objects.sync();
+  scene_objects.update_view(cam);
+
     // --------  SHADOW MAPPING RELATED (render the shadow map into shadowMap texture) -------- //
     if (spotLightsInScene) {  // render shadow map only if there is at least one spot light in the scene
         glUseProgram(shadow_shader_id);
@@ -185,7 +265,7 @@ void Realtime::paintGL() {
             glClear(GL_DEPTH_BUFFER_BIT);
 
             glUniformMatrix4fv(glGetUniformLocation(shadow_shader_id, "spotLightSpaceMat"), 1, GL_FALSE, &spotLightSpaceMats[i][0][0]);
-            scene_objects.draw_shapes_shadows(shadow_shader_id);
+            scene_objects.draw_shapes_shadows(shadow_shader_id, spotLightSpaceMats[i]);
         }
 
         glUseProgram(0);
@@ -220,6 +300,15 @@ void Realtime::paintGL() {
           glUniformMatrix4fv(glGetUniformLocation(phong_shader_id, ("spotLightSpaceMat[" + std::to_string(i) + "]").c_str()), 1, GL_FALSE, &spotLightSpaceMats[i][0][0]);
       }
   }
+
+  // GPU tessellated shapes read the same shadow maps
+  if (settings.gpuTessellation) {
+      glProgramUniform1i(tess_shader_id, glGetUniformLocation(tess_shader_id, "do_shadows"), settings.shadows);
+      for (int i = 0; i < spotLightSpaceMats.size(); ++i) {
+          glProgramUniform1i(tess_shader_id, glGetUniformLocation(tess_shader_id, ("shadowMap[" + std::to_string(i) + "]").c_str()), 7+i);
+          glProgramUniformMatrix4fv(tess_shader_id, glGetUniformLocation(tess_shader_id, ("spotLightSpaceMat[" + std::to_string(i) + "]").c_str()), 1, GL_FALSE, &spotLightSpaceMats[i][0][0]);
+      }
+  }
   // -------------------------------------------- //
 
   // Draw meshes in our master set
@@ -238,6 +327,9 @@ void Realtime::paintGL() {
   full_quad.render();
 
   glUseProgram(0);
+
+  // Frames that stop fitting a refresh are drawn every few instead
+  m_frames.end_frame();
 }
 
 void Realtime::resizeGL(int w, int h) {
@@ -264,65 +356,167 @@ void Realtime::sceneChanged() {
     std::cerr << "Error parsing scene: \"" << settings.sceneFilePath << "\"" << std::endl;
     return;
   }
+  watchScene();
 
   // Fill texture vector
   for (auto &t : textures)
     t.cleanup();
   textures.clear();
-  map<string, size_t> tex_map;
+  texture_ids.clear();
   std::cout << "Filling textures" << std::endl;
-  size_t tex_id = 0;
-  for (auto &s : meta_data.shapes) {
-    auto curr_scene_file_map = &s.primitive.material.textureMap;
-
-    // If this shape is using textures
-    if (curr_scene_file_map->isUsed) {
-      // If we already created a texture object for this filename
-      if (tex_map.contains(curr_scene_file_map->filename)) {
-        curr_scene_file_map->key = tex_map[curr_scene_file_map->filename];
-      // Else, create a new texture
-      } else {
-        textures.push_back(texture(*curr_scene_file_map, tex_id));
-        curr_scene_file_map->key = tex_id;
-        tex_map[curr_scene_file_map->filename] = tex_id;
-        ++tex_id;
-      }
-    }
-  }
+  loadTextures(meta_data);
   std::cout << "Done filling textures" << std::endl;
 
   // Update camera with new settings
   cam.update_scene(meta_data.cameraData, size().width(), size().height());
 
   // Set lighting data
-  scene_lighting.set_data(meta_data.lights,
-    meta_data.globalData.ka, meta_data.globalData.kd,
-    meta_data.globalData.ks);
+  updateLights();
 
-  // --------  SHADOW MAPPING RELATED ------------- //
-  spotLightsInScene = false;
-  spotLightSpaceMats.clear();
-  // loops over lights and saves the lightSpaceMats for all spot lights
-  for (SceneLightData &light : meta_data.lights) {
-      if (light.type == LightType::LIGHT_SPOT) {
-          spotLightsInScene = true;
+  // Set mesh data
+  scene_transforms.set_data(meta_data);
+  scene_objects.set_data(meta_data, textures);
+
+  // Particle emitters, applied on the next frame
+  part.particleSetEmitters(meta_data.emitters);
+
+  update(); // asks for a PaintGL() call to occur
+}
 
-          float FoV = light.angle; // glm::radians(90.0f);
-          glm::mat4 lightProjectionMatrix = glm::perspective(FoV, 1.0f, 0.1f, 100.f);
-          glm::mat4 lightViewMatrix = glm::lookAt(glm::vec3(light.pos), glm::vec3(light.dir), glm::vec3(0.0f,0.0f,1.0f));
+// Files not loaded yet are decoded as jobs. Once they all are, the main
+// queue makes them into textures, which needs GL
+void Realtime::loadTextures(RenderData &data) {
+  std::vector<SceneFileMap> files;
+  for (auto &m : data.materials) {
+    auto curr_scene_file_map = &m.textureMap;
 
-          spotLightSpaceMats.push_back(lightProjectionMatrix * lightViewMatrix);
+    // If this material is textured
+    if (curr_scene_file_map->isUsed) {
+      // Give out a texture id the first time a filename is seen
+      auto found = texture_ids.find(curr_scene_file_map->filename);
+      if (found == texture_ids.end()) {
+        size_t tex_id = textures.size() + files.size();
+        files.push_back(*curr_scene_file_map);
+        found = texture_ids.emplace(curr_scene_file_map->filename, tex_id).first;
       }
+      curr_scene_file_map->key = found->second;
+    }
   }
+  if (files.empty())
+    return;
+
+  auto &jobs = job_system::shared();
+  std::vector<texture::images> decoded(files.size());
+  job_group decoding, uploading;
+  for (size_t k = 0; k != files.size(); ++k)
+    jobs.run(decoding, [&, k] { decoded[k] = texture::images::load(files[k]); });
+  jobs.then(decoding, uploading, [&] {
+    jobs.post_main([&] {
+      for (size_t k = 0; k != files.size(); ++k)
+        textures.push_back(texture(files[k], textures.size(), decoded[k]));
+    });
+  });
+  jobs.wait(uploading);
+  jobs.run_main();
+}
+
+void Realtime::updateLights() {
+  // --------  SHADOW MAPPING RELATED ------------- //
+  spotLightsInScene = false;
+  for (SceneLightData &light : meta_data.lights)
+      spotLightsInScene |= light.type == LightType::LIGHT_SPOT;
+
+  // The light space mats as the ticks make them, which only run while
+  // something is changing now. Also sends the lights
+  updateSpotLightSpaceMat(0.f);
   // --------------------------------------------- //
+}
 
+// Points the watcher at the current scene file, or at nothing
+void Realtime::watchScene() {
+  QString path = QString::fromStdString(settings.sceneFilePath);
+  bool want    = watching && !settings.sceneFilePath.empty();
+  auto files   = scene_watcher.files();
+  if (!files.empty() && (!want || files.front() != path))
+    scene_watcher.removePaths(files);
+  if (want && scene_watcher.files().empty())
+    scene_watcher.addPath(path);
+}
 
-  // Set mesh data
-  scene_objects.set_data(meta_data.shapes, cam.get_pos(), textures);
+// Shapes keep their place in meta_data, which the geometry points into, so
+// only their changed matrices are copied over. Anything GL doesn't have yet
+// (textures, mesh files, tessellations) is loaded, nothing else is uploaded
+void Realtime::reloadScene() {
+  watchScene();
+  RenderData reloaded;
+  if (!SceneParser::parse(settings.sceneFilePath, reloaded)) {
+    // Probably saved half way, the next save reloads again
+    std::cerr << "Error parsing scene: \"" << settings.sceneFilePath << "\"" << std::endl;
+    return;
+  }
+
+  makeCurrent();
+  loadTextures(reloaded);
+  auto changes = scene_diff::compare(meta_data, reloaded);
+
+  if (changes.camera) {
+    meta_data.cameraData = reloaded.cameraData;
+    cam.update_scene(meta_data.cameraData, size().width(), size().height());
+  }
+
+  if (changes.lights) {
+    meta_data.globalData = reloaded.globalData;
+    meta_data.lights     = std::move(reloaded.lights);
+    updateLights();
+  }
+
+  if (changes.emitters) {
+    meta_data.emitters = std::move(reloaded.emitters);
+    part.particleSetEmitters(meta_data.emitters);
+  }
+
+  if (changes.structure) {
+    meta_data.materials  = std::move(reloaded.materials);
+    meta_data.primitives = std::move(reloaded.primitives);
+    meta_data.prototypes = std::move(reloaded.prototypes);
+    meta_data.shapes     = std::move(reloaded.shapes);
+    meta_data.instances  = std::move(reloaded.instances);
+    meta_data.nodes      = std::move(reloaded.nodes);
+    scene_objects.update_structure();
+  } else {
+    if (!changes.shapes.empty()) {
+      for (size_t i : changes.shapes) {
+        meta_data.shapes.ctm[i]     = reloaded.shapes.ctm[i];
+        meta_data.shapes.inv_ctm[i] = reloaded.shapes.inv_ctm[i];
+      }
+      meta_data.materials        = std::move(reloaded.materials);
+      meta_data.primitives       = std::move(reloaded.primitives);
+      meta_data.shapes.primitive = std::move(reloaded.shapes.primitive);
+      scene_objects.update_materials();
+      scene_objects.update_shapes(changes.shapes);
+    }
+    if (!changes.instances.empty()) {
+      meta_data.instances = std::move(reloaded.instances);
+      scene_objects.update_instances(changes.instances);
+    }
+    // Nodes can be regrouped without moving anything
+    meta_data.nodes = std::move(reloaded.nodes);
+  }
+  scene_transforms.set_data(meta_data);
+  doneCurrent();
 
   update(); // asks for a PaintGL() call to occur
 }
 
+void Realtime::compileScene() {
+  if (settings.sceneFilePath.empty() || meta_data.shapes.empty()) {
+    std::cerr << "No scene to compile" << std::endl;
+    return;
+  }
+  if (!SceneParser::compile(settings.sceneFilePath, meta_data))
+    std::cerr << "Error compiling scene: \"" << settings.sceneFilePath << "\"" << std::endl;
+}
+
 void Realtime::settingsChanged() {
   // Clipping planes
   if (settings.nearPlane != prev_near ||
@@ -367,6 +561,35 @@ void Realtime::settingsChanged() {
     extra_parallax = settings.extra_parallax;
   }
 
+  // Round shapes tessellated on the CPU or the GPU
+  if (settings.gpuTessellation != gpu_tessellation) {
+    scene_objects.update_patches(settings.gpuTessellation);
+    gpu_tessellation = settings.gpuTessellation;
+  }
+
+  // Particle simulation on the CPU or the GPU
+  if (settings.gpuParticles != gpu_particles) {
+    part.particleSetGPU(settings.gpuParticles);
+    gpu_particles = settings.gpuParticles;
+  }
+
+  // No point simulating particles that aren't drawn
+  if (settings.fire != particles_on) {
+    part.particleSetPaused(!settings.fire);
+    particles_on = settings.fire;
+  }
+
+  // What keeps frames coming, anything else is drawn once
+  setActive(frame_scheduler::animation, settings.animateScene);
+  setActive(frame_scheduler::particles, settings.fire);
+  setActive(frame_scheduler::building, scene_objects.building());
+
+  // Scene file watching
+  if (settings.watchScene != watching) {
+    watching = settings.watchScene;
+    watchScene();
+  }
+
   // Customizable default FBO and postprocessing filters
   default_fbo = settings.defaultFBO;
 
@@ -381,17 +604,36 @@ void Realtime::settingsChanged() {
   if (full_quad.get_sharpen() != settings.extraCredit5)
     full_quad.set_sharpen(settings.extraCredit5, texture_shader_id);
 
+  applied = settings;
   update(); // asks for a PaintGL() call to occur
 }
 
+// Nothing draws on a timer, so a setting settingsChanged() never saw isn't
+// on screen until something else asks for a frame. The scene file goes
+// through sceneChanged() instead
+bool Realtime::settingsApplied() const {
+  Settings seen      = applied;
+  seen.sceneFilePath = settings.sceneFilePath;
+  return seen == settings;
+}
+
 // ================== Project 6: Action!
 
 void Realtime::keyPressEvent(QKeyEvent *event) {
   m_keyMap[Qt::Key(event->key())] = true;
+  setActive(frame_scheduler::camera, moving());
 }
 
 void Realtime::keyReleaseEvent(QKeyEvent *event) {
   m_keyMap[Qt::Key(event->key())] = false;
+  setActive(frame_scheduler::camera, moving());
+}
+
+bool Realtime::moving() const {
+  for (Qt::Key key : { Qt::Key_W, Qt::Key_A, Qt::Key_S, Qt::Key_D, Qt::Key_Control, Qt::Key_Space })
+    if (m_keyMap.at(key))
+      return true;
+  return false;
 }
 
 void Realtime::mousePressEvent(QMouseEvent *event) {
@@ -427,19 +669,47 @@ void Realtime::mouseMoveEvent(QMouseEvent *event) {
   }
 }
 
-void Realtime::timerEvent(QTimerEvent *event) {
-  int elapsedms   = m_elapsedTimer.elapsed();
-  float deltaTime = elapsedms * 0.001f;
-  m_elapsedTimer.restart();
+// Time spent with nothing on isn't simulated, the first step after it
+// starts from now
+void Realtime::setActive(frame_scheduler::source s, bool on) {
+  if (m_frames.set_active(s, on)) {
+    m_simClock.reset();
+    scheduleFrame();
+  }
+}
+
+void Realtime::scheduleFrame() {
+  if (!initialized || !m_frames.active() || m_timer.isActive())
+    return;
+  auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(m_frames.until_next());
+  m_timer.start(static_cast<int>(wait.count()));
+}
 
-  // Use deltaTime and m_keyMap here to move around
-  cam.move(m_keyMap[Qt::Key_W], m_keyMap[Qt::Key_A],
-    m_keyMap[Qt::Key_S], m_keyMap[Qt::Key_D],
-    m_keyMap[Qt::Key_Control], m_keyMap[Qt::Key_Space], deltaTime);
+// Runs once per frame while something is changing, paced by m_frames
+void Realtime::tick() {
+  // Advance in fixed steps, so a late timer event doesn't change how far things move.
+  // Particles have their own clock, see particle::simLoop
+  int steps = m_simClock.advance();
+  float deltaTime = m_simClock.step();
+
+  for (int i = 0; i < steps; ++i) {
+    // Use deltaTime and m_keyMap here to move around
+    cam.move(m_keyMap[Qt::Key_W], m_keyMap[Qt::Key_A],
+      m_keyMap[Qt::Key_S], m_keyMap[Qt::Key_D],
+      m_keyMap[Qt::Key_Control], m_keyMap[Qt::Key_Space], deltaTime);
+
+    // updates spotLightSpaceMats - the light space mats after rotating all spot lights
+    if (settings.animateScene)
+      updateSpotLightSpaceMat(deltaTime);  // NOTE: comment this line out to stop rotating the spotlights
+  }
 
+  // Instances move to where they are after the steps, in one update
+  if (settings.animateScene && steps > 0)
+    animateScene(steps * deltaTime);
 
-  // updates spotLightSpaceMats - the light space mats after rotating all spot lights by 1deg
-  updateSpotLightSpaceMat(deltaTime);  // NOTE: comment this line out to stop rotating the spotlights
+  // Tessellation swapped in by the last frame is drawn by this one, after
+  // which nothing's left to wait for
+  setActive(frame_scheduler::building, scene_objects.building());
 
   update(); // asks for a PaintGL() call to occur
 }
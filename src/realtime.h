@@ -2,19 +2,25 @@
 
 // Defined before including GLEW to suppress deprecation messages on macOS
 #include "camera.h"
+#include "frame_scheduler.h"
 #include "fullscreen.h"
 #include "lighting.h"
 #include "shapes/geometry.h"
 #include "utils/sceneparser.h"
 #include "particle.h"
+#include "settings.h"
+#include "sim_clock.h"
+#include "transform_hierarchy.h"
 #ifdef __APPLE__
 #define GL_SILENCE_DEPRECATION
 #endif
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
+#include <map>
 #include <unordered_map>
 #include <QElapsedTimer>
+#include <QFileSystemWatcher>
 #include <QOpenGLWidget>
 #include <QTime>
 #include <QTimer>
@@ -25,10 +31,13 @@ public:
     Realtime(QWidget *parent = nullptr);
     void finish();                                      // Called on program exit
     void sceneChanged();
+    void compileScene();                                // Saves the loaded scene in binary for quicker loads
     void settingsChanged();
+    bool settingsApplied() const;                       // Every setting was seen by settingsChanged(), which asks for a frame
+    void reloadScene();                                 // Parses the scene file again, applying only what changed
 
 public slots:
-    void tick(QTimerEvent* event);                      // Called once per tick of m_timer
+    void tick();                                        // Called once per frame while something is changing
 
 protected:
     void initializeGL() override;                       // Called once at the start of the program
@@ -47,11 +56,14 @@ private:
     void mousePressEvent(QMouseEvent *event) override;
     void mouseReleaseEvent(QMouseEvent *event) override;
     void mouseMoveEvent(QMouseEvent *event) override;
-    void timerEvent(QTimerEvent *event) override;
 
     // Tick Related Variables
-    int m_timer;                                        // Stores timer which attempts to run ~60 times per second
-    QElapsedTimer m_elapsedTimer;                       // Stores timer which keeps track of actual time between frames
+    QTimer m_timer;                                     // Started for the next frame, only while one is wanted
+    sim_clock m_simClock;                               // Fixed step clock for camera and light updates
+    frame_scheduler m_frames;                           // When frames are drawn, and how often
+    void setActive(frame_scheduler::source s, bool on); // Something started or stopped changing every frame
+    void scheduleFrame();                               // Starts m_timer if frames are wanted
+    bool moving() const;                                // A movement key is held
 
     // Input Related Variables
     bool m_mouseDown = false;                           // Stores state of left mouse button
@@ -65,8 +77,11 @@ private:
     GLuint phong_shader_id;
     GLuint parallax_shader_id;
     GLuint texture_shader_id;
+    GLuint tess_shader_id;        // Round shapes tessellated on the GPU
+    GLuint tess_shadow_shader_id;
 
     // To avoid unnecessary updates
+    Settings applied;                                   // As settingsChanged() last saw them
     float prev_near, prev_far;
     int prev_tess_1, prev_tess_2;
 
@@ -76,11 +91,35 @@ private:
     bool extra_texturing;
     bool extra_parallax;
 
+  // Particles simulated with transform feedback
+  bool gpu_particles = false;
+  bool particles_on = false;
+
+  // Round shapes tessellated on the GPU
+  bool gpu_tessellation = false;
+
     // Used to change the default FBO since it might be machine dependant
     int default_fbo;
 
     // Extra credit: texture objects, one for each texture string
     std::vector<texture> textures;
+    std::map<std::string, size_t> texture_ids;          // Into textures, by filename
+    void loadTextures(RenderData &data);                // Gives data its texture keys, loading new textures
+
+    // Scene file watching, saves close together are reloaded once
+    QFileSystemWatcher scene_watcher;
+    QTimer reload_timer;
+    bool watching = false;
+    void watchScene();
+
+    void updateLights();                                // After the lights in meta_data changed
+
+    // Runtime transforms of the scene's nodes, animated ones are recomputed
+    // and uploaded once per tick
+    transform_hierarchy scene_transforms;
+    float scene_time = 0.f;                             // Seconds into the current turn
+    std::vector<size_t> moved_shapes, moved_instances;  // Written by the last update, kept for their capacity
+    void animateScene(float seconds);
 
     // Camera
     camera cam;
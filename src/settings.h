@@ -20,6 +20,15 @@ struct Settings {
     bool extra_parallax = false;
     bool shadows = false;
     bool fire = false;
+    bool gpuParticles = false;
+    bool gpuTessellation = false;
+    bool watchScene = false;   // Reload the scene file whenever it's saved
+    bool animateScene = false; // Spin placed objects and spot lights
+    unsigned particleSeed = 0;      // Nonzero gives reproducible particle runs
+    unsigned particleCount = 65536;      // Size of the CPU particle pool, rounded up to whole blocks
+    unsigned gpuParticleCount = 1048576; // The same for the GPU path, which can take far more
+
+    bool operator==(const Settings &) const = default;
 };
 
 
@@ -1,53 +1,35 @@
 #include "geometry.h"
-#include "shapes/cube.h"
-#include "shapes/cylinder.h"
-#include "shapes/cone.h"
+#include "jobs/job_system.h"
 #include "shapes/mesh.h"
-#include "shapes/sphere.h"
-#include <iostream>
+#include "shapes/tangent_space.h"
+#include "shapes/tessellator.h"
+#include <algorithm>
+#include <limits>
 #include <tuple>
+#include <glm/gtc/matrix_access.hpp>
 
 using std::vector;    using glm::vec3;
 using glm::vec4;      using glm::mat4;
 using std::max;       using glm::vec2;
 
-// Parallax mapping, given a bunch of verts / uvs,
-// calculate tangents for them
-vector<float> geometry_set::make_tangents(const vector<float> &vertices,
-  const vector<float> &uvs) {
-  vector<float> ret;
-  ret.reserve(vertices.size());
-
-  for (size_t i = 0; i < vertices.size() / 9; ++i) {
-    size_t p_idx = i * 9;
-    size_t t_idx = i * 6;
-
-    auto p0 = vec3(vertices[p_idx],     vertices[p_idx + 1], vertices[p_idx + 2]);
-    auto p1 = vec3(vertices[p_idx + 3], vertices[p_idx + 4], vertices[p_idx + 5]);
-    auto p2 = vec3(vertices[p_idx + 6], vertices[p_idx + 7], vertices[p_idx + 8]);
-    auto t0 = vec2(uvs[t_idx],     uvs[t_idx + 1]);
-    auto t1 = vec2(uvs[t_idx + 2], uvs[t_idx + 3]);
-    auto t2 = vec2(uvs[t_idx + 4], uvs[t_idx + 5]);
-
-    // Get edges and uv diffs
-    auto e0 = p1 - p0;
-    auto e1 = p2 - p0;
-    auto d0 = t1 - t0;
-    auto d1 = t2 - t0;
-
-    // Calculate tangent
-    float inv_factor = 1.f / (d0.x * d1.y - d0.y * d1.x);
-    auto  tan = vec3(inv_factor * (d1.y * e0.x - d0.y * e1.x),
-                     inv_factor * (d1.y * e0.y - d0.y * e1.y),
-                     inv_factor * (d1.y * e0.z - d0.y * e1.z));
-
-    add_to_vec(ret, tan);
-    add_to_vec(ret, tan);
-    add_to_vec(ret, tan);
-  }
+// Detail of each LOD level relative to the tessellation parameters, finest
+// first. LOD picks one of these instead of any parameter in between, so the
+// whole chain can be built ahead of time
+static constexpr float lod_levels[geometry_set::lod_level_count] = { 1.f, .75f, .5f, 1.f / 3.f };
 
-  return ret;
-}
+// Projected radius in pixels below which a shape drops from level k to k + 1,
+// and how far past a boundary it has to go before switching back, so shapes
+// near a boundary don't pop every frame
+static constexpr float lod_pixels[geometry_set::lod_level_count - 1] = { 160.f, 80.f, 40.f };
+static constexpr float lod_hysteresis = .15f;
+
+// Initial size of the geometry cache, grows if the shapes drawn don't fit
+static constexpr size_t cache_vertices = 1 << 18;
+
+// Pieces frame preparation is split into for workers: shapes a LOD or key
+// job goes through, and mesh shapes a cull job does, which have meshlets
+static constexpr size_t frame_grain = 4096;
+static constexpr size_t cull_grain  = 16;
 
 // Uniquely identifies shape data in a scene by combining primitive
 // type, tessellation parameter 1, and tessellation parameter 2
@@ -67,361 +49,1193 @@ public:
 
   shape_id(PrimitiveType t, int tess_0, int tess_1) :
     type(t), t_0(tess_0), t_1(tess_1) {};
+
+  // Key into the geometry cache
+  uint64_t key() const {
+    return (static_cast<uint64_t>(type) << 56) |
+           (static_cast<uint64_t>(t_0 & 0xfffffff) << 28) |
+           static_cast<uint64_t>(t_1 & 0xfffffff);
+  }
 };
 
-// Description of how a shape is laid out in master data buffers
+// Description of how a shape is laid out in master data buffers. Kept
+// small for the draw loop: the shape's matrices stay in the scene and its
+// material in the material table, both by index
 struct geometry_set::shape_description {
 protected:
-  mat4 const *model_matrix; // Model matrix for this shape
-  mat4 const *inv_model_matrix;
-  size_t      offset;       // Where to start rendering on master buffer
-  size_t      points;       // How many points to render
-  vec3        ambient;      // Object colors
-  vec3        diffuse;
-  vec3        specular;
-  float       shininess;
-  bool        has_tex;      // Has an associated texture
-  size_t      tex_id;       // Position of texture in textures array
-  float       tex_blend;    // How much texture to blend into diffuse
-  bool        has_par;      // Has parallax mapping
-  float       u_repeat;
-  float       v_repeat;
+  PrimitiveType type;
+  uint32_t    transform;    // Shape id, into the scene's ctm and inv_ctm
+  uint32_t    material;     // Into materials
+  uint32_t    offset;       // Where to start rendering on master buffer,
+                            // in indices for meshes
+  uint32_t    points;       // How many points to render
+  uint32_t    meshlet_first = 0; // Meshes: meshlets of the current level
+  uint32_t    meshlet_count = 0;
+  uint32_t    prototype      = 0; // Drawn once per instance of it
+  uint32_t    first_instance = 0;
+  uint32_t    instance_count = 1;
 
   friend class geometry_set;
 
 public:
-  shape_description(const mat4& mat, const mat4 &inv_mat,
-    size_t offset, size_t points, vec3 amb, vec3 dif,
-    vec3 spe, float shi, bool has_tex, size_t tex,
-    float blend, bool has_par, float u_rpt, float v_rpt) :
-    model_matrix(&mat), inv_model_matrix(&inv_mat),
-    offset(offset), points(points), ambient(amb), diffuse(dif),
-    specular(spe), shininess(shi), has_tex(has_tex),
-    tex_id(tex), tex_blend(blend), has_par(has_par),
-    u_repeat(u_rpt), v_repeat(v_rpt) {};
+  shape_description(PrimitiveType type, size_t shape, uint32_t material,
+    size_t offset, size_t points) :
+    type(type), transform(shape), material(material),
+    offset(offset), points(points) {};
+
+  void set_prototype(uint32_t id, const RenderPrototype &p) {
+    prototype      = id;
+    first_instance = p.first_instance;
+    instance_count = p.instance_count;
+  }
 };
 
-geometry_set::geometry_set() : valid(false), lod(false), meshes(false),
-  texturing(false), parallax(false), mode(GL_TRIANGLES) {};
+// What a material sets when a shape is drawn, one per scene material
+struct geometry_set::draw_material {
+  vec3   ambient;      // Object colors
+  vec3   diffuse;
+  vec3   specular;
+  float  shininess;
+  float  tex_blend;    // How much texture to blend into diffuse
+  float  u_repeat;
+  float  v_repeat;
+  size_t tex_id;       // Position of texture in textures array
+  bool   has_tex;      // Has an associated texture
+  bool   has_par;      // Has parallax mapping
+
+  draw_material(const SceneMaterial &m) :
+    ambient(m.cAmbient), diffuse(m.cDiffuse), specular(m.cSpecular),
+    shininess(m.shininess), tex_blend(m.blend),
+    u_repeat(m.textureMap.repeatU), v_repeat(m.textureMap.repeatV),
+    tex_id(m.textureMap.key), has_tex(m.textureMap.isUsed),
+    has_par(m.textureMap.parallax) {};
+};
+
+// Largest scale along an axis of a model matrix, for bounding spheres
+static float ctm_scale(const mat4 &ctm) {
+  return max(glm::length(vec3(ctm[0])),
+         max(glm::length(vec3(ctm[1])), glm::length(vec3(ctm[2]))));
+}
+
+geometry_set::geometry_set() : valid(false), bound_instance(std::string::npos), program(0), patch_program(0),
+  patch_shadow_program(0), cage_id(0), viewport(800.f), view_pv(1.f), lod(false),
+  meshes(false), texturing(false), parallax(false), patches(false),
+  mode(GL_TRIANGLES) {};
+
+geometry_set::shape_uniforms geometry_set::locate(GLuint program_id) {
+  shape_uniforms u;
 
-void geometry_set::initialize(GLuint program_id) {
   // Location of model matrix
-  model_u     = glGetUniformLocation(program_id, "model_matrix");
-  inv_model_u = glGetUniformLocation(program_id, "inv_model_matrix");
+  u.model     = glGetUniformLocation(program_id, "model_matrix");
+  u.inv_model = glGetUniformLocation(program_id, "inv_model_matrix");
+  u.pv        = glGetUniformLocation(program_id, "pv_matrix");
 
   // Locations of color uniforms
-  amb_u = glGetUniformLocation(program_id, "ambient");
-  dif_u = glGetUniformLocation(program_id, "diffuse");
-  spe_u = glGetUniformLocation(program_id, "specular");
-  shi_u = glGetUniformLocation(program_id, "shine");
-  tex_u = glGetUniformLocation(program_id, "texturing");
-  bld_u = glGetUniformLocation(program_id, "tex_blend");
-  pav_u = glGetUniformLocation(program_id, "parallax_vert");
-  paf_u = glGetUniformLocation(program_id, "parallax_frag");
-  urp_u = glGetUniformLocation(program_id, "u_repeat");
-  vrp_u = glGetUniformLocation(program_id, "v_repeat");
+  u.amb = glGetUniformLocation(program_id, "ambient");
+  u.dif = glGetUniformLocation(program_id, "diffuse");
+  u.spe = glGetUniformLocation(program_id, "specular");
+  u.shi = glGetUniformLocation(program_id, "shine");
+  u.tex = glGetUniformLocation(program_id, "texturing");
+  u.bld = glGetUniformLocation(program_id, "tex_blend");
+  u.pav = glGetUniformLocation(program_id, "parallax_vert");
+  u.paf = glGetUniformLocation(program_id, "parallax_frag");
+  u.urp = glGetUniformLocation(program_id, "u_repeat");
+  u.vrp = glGetUniformLocation(program_id, "v_repeat");
+
+  // GPU tessellation
+  u.levels   = glGetUniformLocation(program_id, "patch_levels");
+  u.viewport = glGetUniformLocation(program_id, "viewport");
+
+  return u;
+}
+
+void geometry_set::initialize(GLuint program_id) {
+  program = program_id;
+  shape_u = locate(program_id);
 
   // VAO for this set of meshes
   glGenVertexArrays(1, &vao_id);
 
-  // VBOs
-  glGenBuffers(1, &vbo_id);
-  glGenBuffers(1, &ubo_id);
-  glGenBuffers(1, &nbo_id);
-  glGenBuffers(1, &tbo_id);
+  // VBOs, shapes live in the cache
+  cache.initialize(cache_vertices);
   glGenBuffers(1, &mvo_id);
   glGenBuffers(1, &muo_id);
-  glGenBuffers(1, &mno_id);
-  glGenBuffers(1, &mto_id);
+  glGenBuffers(1, &mqo_id);
+  glGenBuffers(1, &meo_id);
+
+  // Instance matrices, four columns each, advancing once per instance in
+  // every VAO setup since they all share the VAO
+  glGenBuffers(1, &ico_id);
+  glGenBuffers(1, &iio_id);
+  bind();
+  for (GLuint a = 4; a != 12; ++a) {
+    glEnableVertexAttribArray(a);
+    glVertexAttribDivisor(a, 1);
+  }
+  unbind();
+
+  // Background re-tessellation
+  builder = std::thread(&geometry_set::builder_loop, this);
+}
+
+// Uploads every round primitive's cage once, they don't depend on anything
+// the scene or the settings can change
+void geometry_set::initialize_patches(GLuint patch_program_id,
+  GLuint patch_shadow_program_id) {
+  patch_program        = patch_program_id;
+  patch_shadow_program = patch_shadow_program_id;
+  patch_u              = locate(patch_program_id);
+  patch_shadow_u       = locate(patch_shadow_program_id);
+
+  vector<float> data;
+  vector<float> cage;
+  for (int type = 0; type != primitive_types; ++type) {
+    if (!tessellator::has_cage(static_cast<PrimitiveType>(type)))
+      continue;
+
+    size_t count = tessellator::make_cage(static_cast<PrimitiveType>(type), cage);
+    cages[type]  = { data.size() / 6, count, true };
+    data.insert(data.end(), cage.begin(), cage.end());
+  }
+
+  glGenBuffers(1, &cage_id);
+  glBindBuffer(GL_ARRAY_BUFFER, cage_id);
+  glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), data.data(),
+    GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  cage_bytes = data.size() * sizeof(float);
+}
+
+// Reads, simplifies and makes frames for the mesh files the scene uses that
+// aren't loaded yet, a job each, and appends them in the order shapes first
+// use them. Files share no vertices, so each file's frames are made alone,
+// and loading one more file later doesn't redo the others
+void geometry_set::load_mesh_files() {
+  vector<std::string> paths;
+  for (size_t i = 0; i != elements; ++i) {
+    const auto &p = scene->primitives[scene->shapes.primitive[i]];
+    if (p.type == PrimitiveType::PRIMITIVE_MESH && !mesh_file_ids.count(p.meshfile) &&
+        std::find(paths.begin(), paths.end(), p.meshfile) == paths.end())
+      paths.push_back(p.meshfile);
+  }
+
+  vector<std::unique_ptr<mesh>> shapes(paths.size());
+  vector<vector<int16_t>>       frames(paths.size());
+  job_system::shared().parallel_for(paths.size(), 1, [&](size_t first, size_t last) {
+    for (size_t k = first; k != last; ++k) {
+      shapes[k] = std::make_unique<mesh>(paths[k]);
+      shapes[k]->make_mesh(lod_level_count);
+      frames[k] = tangent_space::generate(shapes[k]->vertex_data, shapes[k]->normal_data,
+        shapes[k]->uv_data, shapes[k]->index_data);
+    }
+  });
+
+  for (size_t k = 0; k != paths.size(); ++k) {
+    const auto &shape = *shapes[k];
+
+    // Levels' offsets into the shared index buffer, whose indices are
+    // offset to the file's vertices
+    mesh_file file;
+    size_t   first = mesh_index_buffer_data.size();
+    uint32_t base  = static_cast<uint32_t>(mesh_vertex_buffer_data.size() / 3);
+    size_t first_meshlet = mesh_meshlets.size();
+    for (const auto &l : shape.levels)
+      file.levels.push_back({ first + l.offset, l.count,
+                              first_meshlet + l.first_meshlet, l.meshlet_count });
+    for (uint32_t i : shape.index_data)
+      mesh_index_buffer_data.push_back(base + i);
+    for (auto m : shape.meshlets) {
+      m.offset += first;
+      mesh_meshlets.push_back(m);
+    }
+    file.center = (shape.min_corner + shape.max_corner) * .5f;
+    file.radius = glm::length(shape.max_corner - shape.min_corner) * .5f;
+
+    // Add data to buffers, normals go to the GPU inside the frames
+    mesh_vertex_buffer_data.insert(mesh_vertex_buffer_data.end(),
+      shape.vertex_data.begin(), shape.vertex_data.end());
+    mesh_uv_buffer_data.insert(mesh_uv_buffer_data.end(),
+      shape.uv_data.begin(), shape.uv_data.end());
+    mesh_frame_buffer_data.insert(mesh_frame_buffer_data.end(),
+      frames[k].begin(), frames[k].end());
+
+    mesh_file_ids.emplace(paths[k], mesh_files.size());
+    mesh_files.push_back(std::move(file));
+  }
 }
 
 // Auxiliary function to handle adding mesh data as its own case (doesn't use
-// unique shape map)
-void geometry_set::add_mesh_data(const RenderShapeData &s) {
-  auto shape = mesh(s.primitive.meshfile);
-  shape.make_mesh();
-  auto vertices = std::move(shape.vertex_data);
-  auto normals  = std::move(shape.normal_data);
-  auto uvs      = std::move(shape.uv_data);
+// the geometry cache). Shapes using the same file share its data, which
+// load_mesh_files has loaded
+void geometry_set::add_mesh_data(size_t i) {
+  const auto s       = scene->shape(i);
+  uint32_t prototype = scene->shapes.prototype[i];
+  auto found = mesh_file_ids.find(s.primitive.meshfile);
+  const auto &file = mesh_files[found->second];
+
+  // Bounding sphere in the prototype's space, for LOD
+  mesh_lod_states.push_back({ vec3(s.ctm * vec4(file.center, 1.f)),
+                              file.radius * ctm_scale(s.ctm), found->second,
+                              prototype, 0 });
 
   // Metadata for this shape, i.e. how many tris to render,
   // the shape's material, shape's model matrices, offset in data buffer
-  auto metadata = shape_description(s.ctm, s.inv_ctm,
-    mesh_vertex_buffer_data.size() / 3, vertices.size() / 3,
-    vec3(s.primitive.material.cAmbient),
-    vec3(s.primitive.material.cDiffuse),
-    vec3(s.primitive.material.cSpecular),
-    s.primitive.material.shininess,
-    s.primitive.material.textureMap.isUsed,
-    s.primitive.material.textureMap.key,
-    s.primitive.material.blend,
-    s.primitive.material.textureMap.parallax,
-    s.primitive.material.textureMap.repeatU,
-    s.primitive.material.textureMap.repeatV);
-
-  // Add data to buffers
-  mesh_vertex_buffer_data.insert(mesh_vertex_buffer_data.end(),
-    vertices.begin(), vertices.end());
-  mesh_uv_buffer_data.insert(mesh_uv_buffer_data.end(),
-    uvs.begin(), uvs.end());
-  mesh_normal_buffer_data.insert(mesh_normal_buffer_data.end(),
-    normals.begin(), normals.end());
+  auto level    = file.levels.empty() ? mesh::level{ 0, 0, 0, 0 } : file.levels[0];
+  auto metadata = shape_description(s.primitive.type, i, s.primitive.material,
+    level.offset, level.count);
+  metadata.meshlet_first = level.first_meshlet;
+  metadata.meshlet_count = level.meshlet_count;
+  metadata.set_prototype(prototype, s.prototype);
   mesh_shape_descriptions.push_back(metadata);
 }
 
-// Auxiliary function to get data for any type of primitive
-void geometry_set::add_shape_data(const RenderShapeData &s, size_t idx,
-  bool update_meshes) {
-  // Special case for meshes
-  if (s.primitive.type == PrimitiveType::PRIMITIVE_MESH && update_meshes) {
-    add_mesh_data(s);
-    return;
+
+// Shapes the scene wants at the current parameters: the LOD levels that can
+// be drawn first, then the rest of every LOD chain so turning LOD on is a
+// cache hit
+struct geometry_set::build_request {
+  size_t                generation;
+  int                   t_0;
+  int                   t_1;
+  bool                  patches; // Round primitives drawn from their cages
+  std::vector<shape_id> ids;
+  size_t                needed;  // ids before this can be drawn right now
+  std::vector<size_t>   missing; // Indices into ids that weren't cached when requested
+};
+
+// Per frame LOD selection for one tessellated shape, bounding sphere in the
+// prototype's space
+struct geometry_set::lod_state {
+  vec3          center;
+  float         radius;
+  PrimitiveType type;
+  uint32_t      prototype;
+  int           level;
+};
+
+// Data for every missing shape of a request
+struct geometry_set::build_result {
+  build_request             req;
+  std::vector<tessellation> parts; // parts[i] is ids[missing[i]]
+};
+
+// Tessellation parameters of a LOD level
+static int lod_param(int t, int level) {
+  return max(static_cast<int>(round(t * lod_levels[level])), t / 3);
+}
+
+geometry_set::shape_id geometry_set::lod_id(PrimitiveType type, int level,
+  int tess_0, int tess_1) {
+  // If this is a cube, second param is always 0
+  int t_1_level = type == PrimitiveType::PRIMITIVE_CUBE ? 0 : lod_param(tess_1, level);
+  return shape_id(type, lod_param(tess_0, level), t_1_level);
+}
+
+// Works out the LOD chains the scene needs and which shapes in them have to
+// be built, cheap enough to run on the GUI thread so the builder never
+// touches scene data
+std::unique_ptr<geometry_set::build_request> geometry_set::make_request() {
+  auto req = std::make_unique<build_request>();
+  req->generation = generation;
+  req->t_0        = t_0;
+  req->t_1        = t_1;
+  req->patches    = patches;
+
+  // Shapes drawn from patch cages don't need tessellating at all
+  bool types[primitive_types] = {};
+  for (const auto &p : scene->primitives)
+    if (p.type != PrimitiveType::PRIMITIVE_MESH &&
+        !(patches && tessellator::has_cage(p.type)))
+      types[static_cast<int>(p.type)] = true;
+
+  // With LOD off only the finest level is drawn, the rest is prebuilt.
+  // Levels can repeat at low parameters, so only unique shapes are added
+  std::map<shape_id, size_t> unique;
+  auto add = [&](int type, int level) {
+    auto id = lod_id(static_cast<PrimitiveType>(type), level, t_0, t_1);
+    if (unique.emplace(id, req->ids.size()).second)
+      req->ids.push_back(id);
+  };
+
+  int drawn = lod ? lod_level_count : 1;
+  for (int type = 0; type != primitive_types; ++type)
+    if (types[type])
+      for (int level = 0; level != drawn; ++level)
+        add(type, level);
+  req->needed = req->ids.size();
+
+  for (int type = 0; type != primitive_types; ++type)
+    if (types[type])
+      for (int level = drawn; level != lod_level_count; ++level)
+        add(type, level);
+
+  for (size_t i = 0; i != req->ids.size(); ++i)
+    if (!cache.contains(req->ids[i].key()))
+      req->missing.push_back(i);
+
+  return req;
+}
+
+// Tessellates every missing shape of a request in parallel. Doesn't touch any
+// member, so it can run anywhere
+std::unique_ptr<geometry_set::build_result> geometry_set::build(build_request req) {
+  auto res = std::make_unique<build_result>();
+  res->req = std::move(req);
+  size_t shape_count = res->req.missing.size();
+  res->parts.resize(shape_count);
+
+  // Shapes are independent, a job each, and come with their tangent frames
+  auto &jobs = job_system::shared();
+  jobs.parallel_for(shape_count, 1, [&](size_t first, size_t last) {
+    for (size_t i = first; i != last; ++i) {
+      const auto &id = res->req.ids[res->req.missing[i]];
+      tessellator::tessellate(id.type, id.t_0, id.t_1, res->parts[i]);
+    }
+  });
+
+  return res;
+}
+
+// Makes a finished build the current data: uploads what was built into the
+// cache and rebuilds shape metadata from the current scene. GUI thread only
+void geometry_set::install(build_result &res) {
+  const auto &req = res.req;
+
+  vector<size_t> built(req.ids.size(), std::string::npos);
+  for (size_t i = 0; i != req.missing.size(); ++i)
+    built[req.missing[i]] = i;
+
+  // Pin everything drawn this frame before inserting, so making room can
+  // only evict shapes nobody is using
+  cache.begin_use();
+  vector<const geometry_cache::range *> ranges(req.needed, nullptr);
+  for (size_t i = 0; i != req.needed; ++i)
+    ranges[i] = cache.find(req.ids[i].key());
+
+  auto insert = [&](size_t i, bool required) {
+    if (built[i] != std::string::npos) {
+      const auto &p = res.parts[built[i]];
+      return cache.insert(req.ids[i].key(), p.vertices(), p.vertex_data.data(),
+        p.uv_data.data(), p.frame_data.data(), required);
+    }
+
+    // Cached when requested but evicted since, only worth redoing if it's drawn
+    if (!required)
+      return static_cast<const geometry_cache::range *>(nullptr);
+
+    tessellation p;
+    const auto &id = req.ids[i];
+    tessellator::tessellate(id.type, id.t_0, id.t_1, p);
+    return cache.insert(id.key(), p.vertices(), p.vertex_data.data(),
+      p.uv_data.data(), p.frame_data.data(), true);
+  };
+
+  for (size_t i = 0; i != req.needed; ++i)
+    if (!ranges[i])
+      ranges[i] = insert(i, true);
+
+  // Rest of the LOD chains only go into free or cold space
+  for (size_t i = req.needed; i != req.ids.size(); ++i)
+    if (!cache.find(req.ids[i].key()))
+      insert(i, false);
+
+  // Where every level of every chain ended up, levels that didn't fit are
+  // drawn with the nearest one that did
+  for (auto &chain : chains)
+    for (auto &r : chain)
+      r = {};
+  for (int level = 0; level != lod_level_count; ++level) {
+    for (const auto &id : req.ids) {
+      auto key = lod_id(id.type, level, req.t_0, req.t_1).key();
+      if (auto r = cache.find(key))
+        chains[static_cast<int>(id.type)][level] = { r->offset, r->count, true };
+    }
   }
 
-  int curr_t_0 = t_0;
-  int curr_t_1 = t_1;
+  // Keep the levels shapes were at, by shape. Only when the states still
+  // line up with the descriptions, which a new scene or turning patches on
+  // or off ends by clearing them
+  vector<int> kept_levels(elements, 0);
+  if (lod && lod_states.size() == shape_descriptions.size())
+    for (size_t k = 0; k != lod_states.size(); ++k)
+      if (shape_descriptions[k].transform < elements)
+        kept_levels[shape_descriptions[k].transform] = lod_states[k].level;
+
+  // Metadata for each shape, i.e. how many tris to render,
+  // the shape's material, shape's model matrices, offset in data buffer
+  shape_descriptions.clear();
+  shape_descriptions.reserve(elements);
+  patch_shape_descriptions.clear();
+  lod_states.clear();
+  lod_states.reserve(elements);
+  for (size_t i = 0; i != elements; ++i) {
+    const auto s = scene->shape(i);
+    if (s.primitive.type == PrimitiveType::PRIMITIVE_MESH)
+      continue;
+
+    // Patches pick their detail on the GPU, they have no LOD levels
+    if (req.patches && tessellator::has_cage(s.primitive.type)) {
+      const auto &cage = cages[static_cast<int>(s.primitive.type)];
+      shape_slots[i] = { shape_list::patch, patch_shape_descriptions.size() };
+      patch_shape_descriptions.push_back(shape_description(s.primitive.type, i,
+        s.primitive.material, cage.offset, cage.count));
+      patch_shape_descriptions.back().set_prototype(scene->shapes.prototype[i], s.prototype);
+      continue;
+    }
+
+    // Bounding sphere of the unit primitive under the model matrix
+    int level = kept_levels[i];
+    lod_states.push_back({ vec3(s.ctm[3]), ctm_scale(s.ctm) * std::sqrt(3.f) * .5f, s.primitive.type,
+                           scene->shapes.prototype[i], level });
+    shape_slots[i] = { shape_list::tessellated, shape_descriptions.size() };
 
-  // Extra credit: distance LOD:
-  if (lod) {
-    curr_t_0 = max(static_cast<int>(round(curr_t_0 * distances[idx])), t_0 / 3);
-    curr_t_1 = max(static_cast<int>(round(curr_t_1 * distances[idx])), t_1 / 3);
+    const auto &range = lod_range(s.primitive.type, level);
+    shape_descriptions.push_back(shape_description(s.primitive.type, i,
+      s.primitive.material, range.offset, range.count));
+    shape_descriptions.back().set_prototype(scene->shapes.prototype[i], s.prototype);
   }
 
-  // If this is a cube, second param is always 0
-  if (s.primitive.type == PrimitiveType::PRIMITIVE_CUBE)
-    curr_t_1 = 0;
+  count_scene_binds = true;
 
-  // Metadata for this shape, i.e. how many tris to render,
-  // the shape's material, shape's model matrices, offset and
-  // number of tris are zero atm, since we might have them in
-  // the map or we might have to recalculate them
-  auto metadata = shape_description(s.ctm, s.inv_ctm, 0, 0,
-    vec3(s.primitive.material.cAmbient),
-    vec3(s.primitive.material.cDiffuse),
-    vec3(s.primitive.material.cSpecular),
-    s.primitive.material.shininess,
-    s.primitive.material.textureMap.isUsed,
-    s.primitive.material.textureMap.key,
-    s.primitive.material.blend,
-    s.primitive.material.textureMap.parallax,
-    s.primitive.material.textureMap.repeatU,
-    s.primitive.material.textureMap.repeatV);
-
-  // Check if this shape's data already exists in vertex buffer
-  auto curr_id = shape_id(s.primitive.type, curr_t_0, curr_t_1);
-  bool exists  = unique_shape_starts.count(curr_id);
-
-  // If it already exists, add metadata with existing offset and size into
-  // metadata container
-  if (exists) {
-    auto tri_data = unique_shape_starts[curr_id];
-    metadata.offset = std::get<0>(tri_data);
-    metadata.points = std::get<1>(tri_data);
-  // If it doesn't exist, we have to create it
-  } else {
-    // Vertex and normal data
-    vector<float> vertices;
-    vector<float> normals;
-    vector<float> uvs;
-
-    // Get vertex data at origin, yes, shape should just be a virtual class
-    // to make this cleaner
-    if (s.primitive.type == PrimitiveType::PRIMITIVE_CUBE) {
-      auto shape = cube();
-      shape.update_params(curr_t_0);
-      vertices = std::move(shape.vertex_data);
-      uvs      = std::move(shape.uv_data);
-      normals  = std::move(shape.normal_data);
-    } else if (s.primitive.type == PrimitiveType::PRIMITIVE_CONE) {
-      auto shape = cone();
-      shape.update_params(curr_t_0, curr_t_1);
-      vertices = std::move(shape.vertex_data);
-      uvs      = std::move(shape.uv_data);
-      normals  = std::move(shape.normal_data);
-    } else if (s.primitive.type == PrimitiveType::PRIMITIVE_CYLINDER) {
-      auto shape = cylinder();
-      shape.update_params(curr_t_0, curr_t_1);
-      vertices = std::move(shape.vertex_data);
-      uvs      = std::move(shape.uv_data);
-      normals  = std::move(shape.normal_data);
-    } else if (s.primitive.type == PrimitiveType::PRIMITIVE_SPHERE) {
-      auto shape = sphere();
-      shape.update_params(curr_t_0, curr_t_1);
-      vertices = std::move(shape.vertex_data);
-      uvs      = std::move(shape.uv_data);
-      normals  = std::move(shape.normal_data);
+  cache_stats = cache.take_stats();
+}
+
+// Range to draw a primitive at a LOD level with, the nearest resident level
+// if that one isn't, preferring finer ones
+const geometry_set::chain_range &geometry_set::lod_range(PrimitiveType type, int level) const {
+  const auto &chain = chains[static_cast<int>(type)];
+  for (int l = level; l >= 0; --l)
+    if (chain[l].resident)
+      return chain[l];
+  for (int l = level + 1; l < lod_level_count; ++l)
+    if (chain[l].resident)
+      return chain[l];
+  return chain[0];
+}
+
+// Moves a level through the boundaries its projected size crossed. Compares
+// squared sizes, size^2 = (radius * focal)^2 / distance^2, as
+// (radius * focal)^2 against boundary^2 * distance^2, so it's a handful of
+// multiplies per shape and no divisions or roots
+static int pick_level(int level, int levels, vec3 center, float radius, vec3 eye,
+  float focal_sq, const float *finer, const float *coarser) {
+  vec3  d         = center - eye;
+  float dist_sq   = max(glm::dot(d, d), radius * radius);
+  float projected = radius * radius * focal_sq;
+
+  while (level > 0 && projected > finer[level - 1] * dist_sq)
+    --level;
+  while (level < levels - 1 && projected < coarser[level] * dist_sq)
+    ++level;
+
+  return level;
+}
+
+// Picks LOD levels for the camera, then starts the frame packet off on a
+// worker
+void geometry_set::update_view(const camera &cam) {
+  wait_frame();
+  viewport = cam.get_size();
+  view_pv  = cam.get_pv();
+
+  if (!valid)
+    return;
+  if (lod)
+    pick_levels(cam);
+
+  job_system::shared().run(frame, [this] { prepare_frame(); });
+  prepared = true;
+}
+
+// Picks every shape's LOD level from its projected size. Each shape's is
+// picked on its own, so ranges of them are picked in parallel
+void geometry_set::pick_levels(const camera &cam) {
+  vec3  eye      = cam.get_pos();
+  float focal    = cam.get_focal_pixels();
+  float focal_sq = focal * focal;
+
+  // Squared boundaries, for going finer and coarser past each one
+  float finer[lod_level_count - 1];
+  float coarser[lod_level_count - 1];
+  for (int k = 0; k != lod_level_count - 1; ++k) {
+    finer[k]   = lod_pixels[k] * lod_pixels[k] * (1.f + lod_hysteresis) * (1.f + lod_hysteresis);
+    coarser[k] = lod_pixels[k] * lod_pixels[k] * (1.f - lod_hysteresis) * (1.f - lod_hysteresis);
+  }
+
+  // Shapes are measured as placed by their prototype's nearest instance
+  pick_lod_instances(eye);
+  const auto &instances = scene->instances.ctm;
+  auto &jobs = job_system::shared();
+
+  jobs.parallel_for(lod_states.size(), frame_grain, [&](size_t first, size_t last) {
+    for (size_t i = first; i != last; ++i) {
+      auto &l        = lod_states[i];
+      const auto &m  = instances[lod_instances[l.prototype]];
+      int level = pick_level(l.level, lod_level_count, vec3(m * vec4(l.center, 1.f)),
+                             l.radius * ctm_scale(m), eye, focal_sq, finer, coarser);
+
+      if (level != l.level) {
+        l.level = level;
+        const auto &range = lod_range(l.type, level);
+        shape_descriptions[i].offset = range.offset;
+        shape_descriptions[i].points = range.count;
+      }
+    }
+  });
+
+  // Meshes pick among their simplified levels, drawn and in the shadow passes
+  jobs.parallel_for(mesh_lod_states.size(), frame_grain, [&](size_t first, size_t last) {
+    for (size_t i = first; i != last; ++i) {
+      auto &l       = mesh_lod_states[i];
+      const auto &m = instances[lod_instances[l.prototype]];
+      int  levels   = static_cast<int>(mesh_files[l.file].levels.size());
+      int  level    = pick_level(l.level, levels, vec3(m * vec4(l.center, 1.f)),
+                                 l.radius * ctm_scale(m), eye, focal_sq, finer, coarser);
+
+      if (level != l.level)
+        set_mesh_level(i, level);
     }
+  });
+}
 
-    metadata.offset = vertex_buffer_data.size() / 3;
-    metadata.points = vertices.size() / 3;
-    unique_shape_starts[curr_id] = std::make_tuple(metadata.offset, metadata.points);
-
-    // Add data to buffers
-    vertex_buffer_data.insert(vertex_buffer_data.end(),
-      vertices.begin(), vertices.end());
-    uv_buffer_data.insert(uv_buffer_data.end(),
-      uvs.begin(), uvs.end());
-    normal_buffer_data.insert(normal_buffer_data.end(),
-      normals.begin(), normals.end());
+// Makes the frame packet from the shapes as update_view left them: meshes
+// culled to the camera, a key for every shape it can see, and the keys
+// sorted. Makes no GL calls, so it runs as a job
+void geometry_set::prepare_frame() {
+  if (meshes)
+    cull_meshes(view_pv, view_draws);
+  fill_queue();
+  queue.sort(job_system::shared());
+}
+
+void geometry_set::wait_frame() {
+  job_system::shared().wait(frame);
+}
+
+// Finds each prototype's instance nearest the eye, by where it's placed
+void geometry_set::pick_lod_instances(vec3 eye) {
+  const auto &prototypes = scene->prototypes;
+  const auto &instances  = scene->instances.ctm;
+  lod_instances.resize(prototypes.size());
+
+  for (size_t p = 0; p != prototypes.size(); ++p) {
+    size_t first = prototypes[p].first_instance;
+    size_t last  = first + prototypes[p].instance_count;
+    float  best  = std::numeric_limits<float>::max();
+    lod_instances[p] = first;
+    for (size_t i = first; i != last && last - first > 1; ++i) {
+      vec3  d    = vec3(instances[i][3]) - eye;
+      float dist = glm::dot(d, d);
+      if (dist < best) {
+        best             = dist;
+        lod_instances[p] = i;
+      }
+    }
   }
+}
 
-  shape_descriptions.push_back(metadata);
+void geometry_set::set_mesh_level(size_t i, int level) {
+  auto &l = mesh_lod_states[i];
+  const auto &levels = mesh_files[l.file].levels;
+  if (levels.empty())
+    return;
+
+  l.level = level;
+  mesh_shape_descriptions[i].offset        = levels[level].offset;
+  mesh_shape_descriptions[i].points        = levels[level].count;
+  mesh_shape_descriptions[i].meshlet_first = levels[level].first_meshlet;
+  mesh_shape_descriptions[i].meshlet_count = levels[level].meshlet_count;
+}
+
+// Waits for requests and builds them, only ever the latest one
+void geometry_set::builder_loop() {
+  std::unique_lock<std::mutex> lock(build_mutex);
+  while (true) {
+    build_cv.wait(lock, [this] { return build_stop || requested; });
+    if (build_stop)
+      return;
+
+    auto req = std::move(requested);
+    build_busy = true;
+    lock.unlock();
+    auto res = build(std::move(*req));
+    lock.lock();
+
+    finished   = std::move(res);
+    build_busy = false;
+  }
 }
 
-// Takes scene data and updates relevant meta data like camera position,
+// Takes scene data and updates relevant meta data like
 // number of elements in scene, pointer to objects in scene, then
 // uses update() to set the vertex and normal data
-void geometry_set::set_data(const vector<RenderShapeData> &master_data,
-  vec3 camera_pos, const vector<texture> &tex) {
-  shapes   = &master_data;
+void geometry_set::set_data(const RenderData &master_data,
+  const vector<texture> &tex) {
+  wait_frame();
+  scene    = &master_data;
   textures = &tex;
-  elements = shapes->size();
-  cam_pos  = camera_pos;
+  elements = scene->shapes.size();
   valid    = true;
 
-  // Distances will be used for LOD extra credit
-  // First pass: get distances to all centers, update
-  // distance rangge
-  distances.clear();
-  distances.reserve(elements);
-  min_dist = std::numeric_limits<float>::infinity();
-  max_dist = 0.f;
-  for (const auto &p : *shapes){
-    auto  world_space_center = vec3(p.ctm * vec4(0, 0, 0, 1));
-    float distance = glm::distance(cam_pos, world_space_center);
-
-    // Update min and max distances
-    if (distance < min_dist)
-      min_dist = distance;
-    if (distance > max_dist)
-      max_dist = distance;
-
-    distances.push_back(distance);
-  }
-  dist_range = max_dist - min_dist;
+  // LOD levels are picked again for the new scene
+  lod_states.clear();
 
-  // Second pass: normalize distances
-  for (size_t i = 0; i != elements; ++i)
-    distances[i] = 1.f - ((distances[i] - min_dist) / dist_range);
+  // Anything still being built is for the old scene
+  {
+    std::lock_guard<std::mutex> lock(build_mutex);
+    ++generation;
+    requested.reset();
+    finished.reset();
+  }
 
-  // Clear vertex and mesh data since it's a completely new scene
-  vertex_buffer_data.clear();
-  uv_buffer_data.clear();
-  normal_buffer_data.clear();
-  unique_shape_starts.clear();
+  // Clear mesh data since it's a completely new scene
   mesh_vertex_buffer_data.clear();
   mesh_uv_buffer_data.clear();
-  mesh_normal_buffer_data.clear();
-  mesh_shape_descriptions.clear();
+  mesh_frame_buffer_data.clear();
+  mesh_index_buffer_data.clear();
+  mesh_meshlets.clear();
+  mesh_files.clear();
+  mesh_file_ids.clear();
 
   // Create vertex and normal data
   update_data(true);
 }
 
+// Materials as the draw loop sets them, one per scene material
+void geometry_set::update_materials() {
+  materials.assign(scene->materials.begin(), scene->materials.end());
+  count_scene_binds = true;
+}
+
 // Sets vertex and normal data based on a vector of
-// RenderShapeData
+// RenderShapeData, blocking until it's done
 void geometry_set::update_data(bool update_meshes) {
   if (!valid)
     return;
 
-  // Only clear shape metadata, since that's the
-  // only container that might get invalidated by a single
-  // tessellation parameter change
-  shape_descriptions.clear();
-  shape_descriptions.reserve(elements);
+  shape_slots.assign(elements, shape_slot());
+  update_materials();
+
+  // Meshes come from files and only change with the scene
+  if (update_meshes) {
+    size_t files = mesh_files.size();
+    load_mesh_files();
+    mesh_shape_descriptions.clear();
+    mesh_lod_states.clear();
+    for (size_t i = 0; i != elements; ++i) {
+      if (scene->shape(i).primitive.type == PrimitiveType::PRIMITIVE_MESH) {
+        add_mesh_data(i);
+        shape_slots[i] = { shape_list::mesh, mesh_shape_descriptions.size() - 1 };
+      }
+    }
 
-  // If vertex data is getting too big (4 MB more or less),
-  // clear VBOs and map pointing into them
-  if (vertex_buffer_data.size() > 1000000) {
-    vertex_buffer_data.clear();
-    uv_buffer_data.clear();
-    normal_buffer_data.clear();
-    unique_shape_starts.clear();
+    // Buffers only change if a file was loaded
+    if (mesh_files.size() != files || files == 0)
+      update_mesh_buffers();
   }
 
-  // Create meshes for each of our shapes
-  for (size_t i = 0; i != elements; ++i)
-    add_shape_data((*shapes)[i], i, update_meshes);
+  // Every instance goes up with a new scene
+  upload_instances();
+  lod_instances.assign(scene->prototypes.size(), 0);
+  for (size_t p = 0; p != scene->prototypes.size(); ++p)
+    lod_instances[p] = scene->prototypes[p].first_instance;
 
-  // Parallax mapping
-  tangent_buffer_data = make_tangents(vertex_buffer_data, uv_buffer_data);
-  if (update_meshes) {
-    mesh_tangent_buffer_data = make_tangents(mesh_vertex_buffer_data,
-      mesh_uv_buffer_data);
+  auto res = build(std::move(*make_request()));
+  install(*res);
+}
+
+// Patches shapes edited in place: descriptions index the matrices, so only
+// bounds made from them and material ids are redone
+void geometry_set::update_shapes(const vector<size_t> &changed) {
+  if (!valid)
+    return;
+
+  for (size_t i : changed) {
+    const auto s     = scene->shape(i);
+    const auto &slot = shape_slots[i];
+    switch (slot.list) {
+    case shape_list::tessellated: {
+      shape_descriptions[slot.index].material = s.primitive.material;
+      auto &l  = lod_states[slot.index];
+      l.center = vec3(s.ctm[3]);
+      l.radius = ctm_scale(s.ctm) * std::sqrt(3.f) * .5f;
+      break;
+    }
+    case shape_list::mesh: {
+      mesh_shape_descriptions[slot.index].material = s.primitive.material;
+      auto &l        = mesh_lod_states[slot.index];
+      const auto &f  = mesh_files[l.file];
+      l.center = vec3(s.ctm * vec4(f.center, 1.f));
+      l.radius = f.radius * ctm_scale(s.ctm);
+      break;
+    }
+    case shape_list::patch:
+      patch_shape_descriptions[slot.index].material = s.primitive.material;
+      break;
+    }
   }
+}
+
+// Uploads the matrices of moved instances, runs of neighbours together
+void geometry_set::update_instances(const vector<size_t> &changed) {
+  if (!valid)
+    return;
 
-  update_buffers(update_meshes);
+  const auto &instances = scene->instances;
+  for (size_t k = 0; k != changed.size(); ) {
+    size_t first = changed[k], last = first + 1;
+    for (++k; k != changed.size() && changed[k] == last; ++k)
+      ++last;
+
+    glBindBuffer(GL_ARRAY_BUFFER, ico_id);
+    glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(mat4), (last - first) * sizeof(mat4),
+      &instances.ctm[first]);
+    glBindBuffer(GL_ARRAY_BUFFER, iio_id);
+    glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(mat4), (last - first) * sizeof(mat4),
+      &instances.inv_ctm[first]);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-// Auxiliary to render shapes in any VAO
-void geometry_set::draw_shapes(const vector<shape_description> &vec) {
-  for (const auto &d : vec) {
+// Like set_data, but whatever the last scene already loaded stays
+void geometry_set::update_structure() {
+  if (!valid)
+    return;
+
+  elements = scene->shapes.size();
+  lod_states.clear();
+  {
+    std::lock_guard<std::mutex> lock(build_mutex);
+    ++generation;
+    requested.reset();
+    finished.reset();
+  }
+
+  update_data(true);
+}
+
+// Hands the current parameters to the builder thread, the shapes already
+// uploaded keep being drawn until sync() finds the result
+void geometry_set::request_data() {
+  if (!valid)
+    return;
+
+  std::lock_guard<std::mutex> lock(build_mutex);
+  requested = make_request();
+  build_cv.notify_one();
+}
+
+void geometry_set::sync() {
+  std::unique_ptr<build_result> res;
+  {
+    std::lock_guard<std::mutex> lock(build_mutex);
+    if (finished && finished->req.generation == generation)
+      res = std::move(finished);
+    finished.reset();
+  }
+
+  if (res)
+    install(*res);
+}
+
+bool geometry_set::building() {
+  std::lock_guard<std::mutex> lock(build_mutex);
+  return requested || build_busy || finished;
+}
+
+geometry_set::draw_state geometry_set::state_of(shape_list pass, const shape_description &d) const {
+  const auto &m = materials[d.material];
+  bool textured = texturing && m.has_tex;
+  uint32_t flags = (parallax && m.has_par) << 1 | textured;
+  if (pass == shape_list::patch)
+    flags |= static_cast<uint32_t>(d.type) << 2;
+  return { static_cast<uint32_t>(pass), flags,
+           textured ? static_cast<uint32_t>(m.tex_id) + 1 : 0u, d.material };
+}
+
+// A pass switch resets what the new program has, so everything after it
+// counts again
+void geometry_set::bind_counts::count(const draw_state &last, const draw_state &s) {
+  ++draws;
+  bool pass = s.pass != last.pass;
+  passes    += pass;
+  flags     += pass || s.flags != last.flags;
+  textures  += s.texture && (pass || s.texture != last.texture);
+  materials += pass || s.material != last.material;
+}
+
+// Keys for the shapes the camera can see. Meshes placed once are seen if
+// the cull left any of their meshlets, other shapes placed once if the
+// sphere around their unit primitive is inside the frustum, and instanced
+// shapes always are. Shapes are placed by their prototype's first instance
+// for depth. Pieces of the lists are keyed in parallel, each into its own
+// part of the queue, which is packed afterwards
+void geometry_set::fill_queue() {
+  const vector<shape_description> *lists[3] = {
+    &shape_descriptions, &mesh_shape_descriptions, &patch_shape_descriptions
+  };
+  size_t sizes[3] = {
+    shape_descriptions.size(), meshes ? mesh_shape_descriptions.size() : 0,
+    patch_shape_descriptions.size()
+  };
+  size_t total = sizes[0] + sizes[1] + sizes[2];
+
+  // World space planes, scaled so a sphere's distance to them is a dot
+  vec4 rows[4] = {
+    glm::row(view_pv, 0), glm::row(view_pv, 1), glm::row(view_pv, 2), glm::row(view_pv, 3)
+  };
+  vec4 planes[6] = {
+    rows[3] + rows[0], rows[3] - rows[0],
+    rows[3] + rows[1], rows[3] - rows[1],
+    rows[3] + rows[2], rows[3] - rows[2],
+  };
+  for (auto &p : planes)
+    p /= glm::length(vec3(p));
+
+  queue.resize(total);
+  render_queue::entry *entries = queue.data();
+  size_t pieces = (total + frame_grain - 1) / frame_grain;
+  queue_used.assign(pieces, 0);
+
+  const auto &instances = scene->instances.ctm;
+  const auto &ctm       = scene->shapes.ctm;
+  job_system::shared().parallel_for(pieces, 1, [&](size_t a, size_t b) {
+    for (size_t p = a; p != b; ++p) {
+      size_t first = p * frame_grain, last = std::min(total, first + frame_grain);
+      size_t used  = first;
+      for (size_t g = first; g != last; ++g) {
+        int    list = 0;
+        size_t i    = g;
+        while (i >= sizes[list])
+          i -= sizes[list++];
+
+        const auto &d     = (*lists[list])[i];
+        const auto &place = instances[d.first_instance];
+        vec4 center = place * ctm[d.transform][3];
+        auto pass   = static_cast<shape_list>(list);
+
+        if (d.instance_count == 1) {
+          bool visible = true;
+          if (pass == shape_list::mesh) {
+            visible = view_draws.count[i] != 0;
+          } else {
+            float radius = ctm_scale(place) * ctm_scale(ctm[d.transform]) * std::sqrt(3.f) * .5f;
+            for (int k = 0; k != 6 && visible; ++k)
+              visible = glm::dot(planes[k], center) >= -radius;
+          }
+          if (!visible)
+            continue;
+        }
+
+        auto s = state_of(pass, d);
+        entries[used++] = { render_queue::key(s.pass, s.flags, s.texture, s.material,
+                                              glm::dot(rows[3], center)),
+                            static_cast<uint32_t>(i) };
+      }
+      queue_used[p] = used - first;
+    }
+  });
+
+  // Pieces' keys moved up against each other, still in scene order
+  size_t kept = 0;
+  for (size_t p = 0; p != pieces; ++p) {
+    if (kept != p * frame_grain)
+      std::copy_n(entries + p * frame_grain, queue_used[p], entries + kept);
+    kept += queue_used[p];
+  }
+  queue.resize(kept);
+
+  // What drawing in scene order would have set, to compare with the queue
+  if (count_scene_binds) {
+    count_scene_binds = false;
+    scene_binds = bind_counts();
+    draw_state last = { ~0u, 0, 0, 0 };
+    for (const auto &e : queue) {
+      auto pass = static_cast<shape_list>(render_queue::pass(e.key));
+      auto s    = state_of(pass, (*lists[static_cast<int>(pass)])[e.item]);
+      scene_binds.count(last, s);
+      last = s;
+    }
+  }
+}
+
+// Walks the sorted queue. Model matrices change every draw, the rest only
+// when the draw's state differs from the one before it
+void geometry_set::draw_queue() {
+  // Patches are split at most as finely as the parameters say, which is all
+  // a parameter change has to update
+  glm::vec2 levels[primitive_types];
+  for (int type = 0; type != primitive_types; ++type)
+    levels[type] = tessellator::cage_levels(static_cast<PrimitiveType>(type), t_0, t_1);
+
+  const auto &ctm     = scene->shapes.ctm;
+  const auto &inv_ctm = scene->shapes.inv_ctm;
+  const vector<shape_description> *lists[3] = {
+    &shape_descriptions, &mesh_shape_descriptions, &patch_shape_descriptions
+  };
+
+  queue_binds = bind_counts();
+  draw_state last = { ~0u, 0, 0, 0 };
+  const shape_uniforms *u = &shape_u;
+  GLenum draw_mode = mode;
+  const texture *bound = nullptr;
+  for (const auto &e : queue) {
+    auto pass = static_cast<shape_list>(render_queue::pass(e.key));
+    const auto &d = (*lists[static_cast<int>(pass)])[e.item];
+    auto s = state_of(pass, d);
+    queue_binds.count(last, s);
+
+    // GPU tessellated shapes have their own program, which gets the same
+    // camera and lights
+    if (s.pass != last.pass) {
+      if (last.pass == static_cast<uint32_t>(shape_list::patch))
+        glUseProgram(program);
+      switch (pass) {
+      case shape_list::tessellated:
+        set_vao_tessellated();
+        u = &shape_u;
+        draw_mode = mode;
+        break;
+      case shape_list::mesh:
+        set_vao_meshes();
+        u = &shape_u;
+        draw_mode = mode;
+        break;
+      case shape_list::patch:
+        glUseProgram(patch_program);
+        glUniform2fv(patch_u.viewport, 1, &viewport[0]);
+        set_vao_patches();
+        u = &patch_u;
+        draw_mode = GL_PATCHES;
+        break;
+      }
+    }
+    bool pass_changed = s.pass != last.pass;
+
     // Send this object's model matrix
-    glUniformMatrix4fv(model_u, 1, 0,
-      &(*(d.model_matrix))[0][0]);
-    glUniformMatrix4fv(inv_model_u, 1, 0,
-      &(*(d.inv_model_matrix))[0][0]);
+    glUniformMatrix4fv(u->model, 1, 0, &ctm[d.transform][0][0]);
+    glUniformMatrix4fv(u->inv_model, 1, 0, &inv_ctm[d.transform][0][0]);
 
     // Send this object's color data
-    glUniform3fv(amb_u, 1, &d.ambient[0]);
-    glUniform3fv(dif_u, 1, &d.diffuse[0]);
-    glUniform3fv(spe_u, 1, &d.specular[0]);
-    glUniform1f(shi_u, d.shininess);
-    glUniform1f(bld_u, d.tex_blend);
-    glUniform1f(urp_u, d.u_repeat);
-    glUniform1f(vrp_u, d.v_repeat);
-
-    // If this shape is using a texture, bind the
-    // correct texture
-    if (texturing && d.has_tex) {
-      glUniform1i(tex_u, 1);
-      (*textures)[d.tex_id].bind();
-    } else {
-      glUniform1i(tex_u, 0);
+    const auto &m = materials[d.material];
+    if (pass_changed || s.material != last.material) {
+      glUniform3fv(u->amb, 1, &m.ambient[0]);
+      glUniform3fv(u->dif, 1, &m.diffuse[0]);
+      glUniform3fv(u->spe, 1, &m.specular[0]);
+      glUniform1f(u->shi, m.shininess);
+      glUniform1f(u->bld, m.tex_blend);
+      glUniform1f(u->urp, m.u_repeat);
+      glUniform1f(u->vrp, m.v_repeat);
     }
 
-    // Send parallax information if we have it enabled
-    if (parallax && d.has_par) {
-      glUniform1i(pav_u, true);
-      glUniform1i(paf_u, true);
-    } else {
-      glUniform1i(pav_u, false);
-      glUniform1i(paf_u, false);
+    // Texturing and parallax flags, and patch levels by type
+    if (pass_changed || s.flags != last.flags) {
+      glUniform1i(u->tex, s.flags & 1);
+      glUniform1i(u->pav, (s.flags >> 1) & 1);
+      glUniform1i(u->paf, (s.flags >> 1) & 1);
+      if (draw_mode == GL_PATCHES)
+        glUniform2fv(u->levels, 1, &levels[static_cast<int>(d.type)][0]);
+    }
+
+    // Untextured draws leave the last texture bound, the shader ignores it
+    if (s.texture && (pass_changed || s.texture != last.texture)) {
+      bound = &(*textures)[m.tex_id];
+      bound->bind();
     }
+    last = s;
 
     // Draw this shape
-    glDrawArrays(mode, d.offset, d.points);
+    draw_range(d, draw_mode, view_draws, e.item);
+  }
+
+  if (last.pass == static_cast<uint32_t>(shape_list::patch))
+    glUseProgram(program);
+  if (bound)
+    bound->unbind();
+}
 
-    // Unbind the texture if we used it
-    if (texturing)
-      (*textures)[d.tex_id].unbind();
+// Draws a shape's range of its VAO once per instance. Mesh shape i placed
+// once only draws the meshlets draws kept of it, instanced ones all of
+// their level
+void geometry_set::draw_range(const shape_description &d, GLenum draw_mode,
+  const mesh_draws &draws, size_t i) {
+  bind_instances(d.first_instance);
+  if (d.type != PrimitiveType::PRIMITIVE_MESH)
+    glDrawArraysInstanced(draw_mode, d.offset, d.points, d.instance_count);
+  else if (d.instance_count > 1)
+    glDrawElementsInstanced(draw_mode, d.points, GL_UNSIGNED_INT,
+      reinterpret_cast<const void*>(d.offset * sizeof(uint32_t)), d.instance_count);
+  else if (draws.count[i])
+    glMultiDrawElements(draw_mode, &draws.counts[draws.first[i]], GL_UNSIGNED_INT,
+      &draws.offsets[draws.first[i]], draws.count[i]);
+}
+
+void geometry_set::bind_instances(size_t first) {
+  if (first == bound_instance)
+    return;
+  bound_instance = first;
+
+  const GLuint buffers[2] = { ico_id, iio_id };
+  for (GLuint b = 0; b != 2; ++b) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[b]);
+    for (GLuint c = 0; c != 4; ++c)
+      glVertexAttribPointer(4 + 4 * b + c, 4, GL_FLOAT, GL_FALSE, sizeof(mat4),
+        reinterpret_cast<void*>(first * sizeof(mat4) + c * sizeof(vec4)));
   }
 }
 
+// Dynamic, animated instances are uploaded again every tick
+void geometry_set::upload_instances() {
+  const auto &instances = scene->instances;
+  glBindBuffer(GL_ARRAY_BUFFER, ico_id);
+  glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(mat4),
+    instances.ctm.data(), GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, iio_id);
+  glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(mat4),
+    instances.inv_ctm.data(), GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  bound_instance = std::string::npos;
+}
+
+// Keeps the meshlets of every mesh shape that are inside the view's frustum
+// and face it, and merges neighbours into runs. Pieces of the shapes are
+// culled in parallel into runs of their own, joined in order afterwards
+void geometry_set::cull_meshes(const mat4 &pv, mesh_draws &out) {
+  size_t shapes = mesh_shape_descriptions.size();
+  out.first.assign(shapes, 0);
+  out.count.assign(shapes, 0);
+  size_t pieces = (shapes + cull_grain - 1) / cull_grain;
+  out.pieces.resize(pieces);
+
+  // The eye is the point the projection sends to w = 0, at infinity for
+  // orthographic views, which get no cone tests
+  vec4 eye = glm::inverse(pv) * vec4(0.f, 0.f, 1.f, 0.f);
+
+  job_system::shared().parallel_for(pieces, 1, [&](size_t a, size_t b) {
+    for (size_t piece = a; piece != b; ++piece) {
+      auto &runs = out.pieces[piece];
+      runs.counts.clear();
+      runs.offsets.clear();
+      for (size_t i = piece * cull_grain; i != std::min(shapes, (piece + 1) * cull_grain); ++i) {
+        out.first[i] = static_cast<uint32_t>(runs.counts.size());
+        out.count[i] = cull_mesh(mesh_shape_descriptions[i], pv, eye, runs);
+      }
+    }
+  });
+
+  // Runs one piece after another, shapes' firsts moved past those before
+  out.counts.clear();
+  out.offsets.clear();
+  for (size_t piece = 0; piece != pieces; ++piece) {
+    uint32_t base = static_cast<uint32_t>(out.counts.size());
+    for (size_t i = piece * cull_grain; i != std::min(shapes, (piece + 1) * cull_grain); ++i)
+      out.first[i] += base;
+    const auto &runs = out.pieces[piece];
+    out.counts.insert(out.counts.end(), runs.counts.begin(), runs.counts.end());
+    out.offsets.insert(out.offsets.end(), runs.offsets.begin(), runs.offsets.end());
+  }
+}
+
+// Adds the runs of one mesh shape's visible meshlets, and returns how many.
+// Tests run in the shape's object space, with the frustum's planes and the
+// eye moved there, so the meshlets' bounds are used as they are
+uint32_t geometry_set::cull_mesh(const shape_description &d, const mat4 &pv, vec4 eye,
+  mesh_runs &runs) const {
+  // Instanced meshes are drawn whole
+  if (d.instance_count != 1)
+    return 0;
+  mat4 model     = scene->instances.ctm[d.first_instance] * scene->shapes.ctm[d.transform];
+  mat4 inv_model = scene->shapes.inv_ctm[d.transform] * scene->instances.inv_ctm[d.first_instance];
+
+  mat4 pvm = pv * model;
+  vec4 rows[4] = {
+    glm::row(pvm, 0), glm::row(pvm, 1), glm::row(pvm, 2), glm::row(pvm, 3)
+  };
+  vec4 planes[6] = {
+    rows[3] + rows[0], rows[3] - rows[0],
+    rows[3] + rows[1], rows[3] - rows[1],
+    rows[3] + rows[2], rows[3] - rows[2],
+  };
+  float lengths[6];
+  for (int p = 0; p != 6; ++p)
+    lengths[p] = glm::length(vec3(planes[p]));
+
+  // Mirroring models turn triangles inside out, so cones are skipped
+  vec4 obj_eye = inv_model * eye;
+  bool cones   = std::abs(obj_eye.w) > 1e-12f && glm::determinant(model) > 0.f;
+  vec3 e       = cones ? vec3(obj_eye) / obj_eye.w : vec3(0.f);
+
+  size_t draw_first = runs.counts.size();
+  size_t run_end    = 0;
+  for (size_t k = d.meshlet_first; k != d.meshlet_first + d.meshlet_count; ++k) {
+    const auto &m = mesh_meshlets[k];
+
+    bool visible = true;
+    for (int p = 0; p != 6 && visible; ++p)
+      visible = glm::dot(vec3(planes[p]), m.center) + planes[p].w >= -m.radius * lengths[p];
+
+    vec3 to = m.center - e;
+    if (visible && cones &&
+        glm::dot(to, m.cone_axis) >= m.cone_cutoff * glm::length(to) + m.radius)
+      visible = false;
+
+    if (!visible)
+      continue;
+    if (runs.counts.size() != draw_first && run_end == m.offset) {
+      runs.counts.back() += static_cast<GLsizei>(m.count);
+    } else {
+      runs.counts.push_back(static_cast<GLsizei>(m.count));
+      runs.offsets.push_back(reinterpret_cast<const void*>(m.offset * sizeof(uint32_t)));
+    }
+    run_end = m.offset + m.count;
+  }
+
+  return static_cast<uint32_t>(runs.counts.size() - draw_first);
+}
+
 // Auxiliary to render shapes in any VAO (without the lighting calculations)
-void geometry_set::draw_shapes_shadows(GLuint shadow_shader) {
+void geometry_set::draw_shapes_shadows(GLuint shadow_shader, const mat4 &light_space) {
   set_vao_tessellated();
   const vector<shape_description> &vec = shape_descriptions;
   for (const auto &d : vec) {
     // Send this object's model matrix
-    glUniformMatrix4fv(glGetUniformLocation(shadow_shader, "model"), 1, GL_FALSE, &(*(d.model_matrix))[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(shadow_shader, "model"), 1, GL_FALSE, &scene->shapes.ctm[d.transform][0][0]);
 
     // Draw this shape
-    glDrawArrays(mode, d.offset, d.points);
+    draw_range(d, mode, shadow_draws, 0);
   }
 
-  // Extra credit: draw meshes if option is enabled
+  // Extra credit: draw meshes if option is enabled, as the light sees them
   if (meshes) {
+    cull_meshes(light_space, shadow_draws);
     set_vao_meshes();
     const vector<shape_description> &vec = mesh_shape_descriptions;
-    for (const auto &d : vec) {
+    for (size_t i = 0; i != vec.size(); ++i) {
+      const auto &d = vec[i];
       // Send this object's model matrix
-      glUniformMatrix4fv(glGetUniformLocation(shadow_shader, "model"), 1, GL_FALSE, &(*(d.model_matrix))[0][0]);
+      glUniformMatrix4fv(glGetUniformLocation(shadow_shader, "model"), 1, GL_FALSE, &scene->shapes.ctm[d.transform][0][0]);
 
       // Draw this shape
-      glDrawArrays(mode, d.offset, d.points);
+      draw_range(d, mode, shadow_draws, i);
+    }
+
+  }
+
+  // Patches go through their own program, with the light as the camera
+  if (!patch_shape_descriptions.empty()) {
+    glUseProgram(patch_shadow_program);
+    glUniformMatrix4fv(patch_shadow_u.pv, 1, GL_FALSE, &light_space[0][0]);
+    glUniform2fv(patch_shadow_u.viewport, 1, &viewport[0]);
+    set_vao_patches();
+
+    for (const auto &d : patch_shape_descriptions) {
+      auto levels = tessellator::cage_levels(d.type, t_0, t_1);
+      glUniformMatrix4fv(patch_shadow_u.model, 1, GL_FALSE, &scene->shapes.ctm[d.transform][0][0]);
+      glUniform2fv(patch_shadow_u.levels, 1, &levels[0]);
+      draw_range(d, GL_PATCHES, shadow_draws, 0);
     }
 
+    glUseProgram(shadow_shader);
   }
 }
 
@@ -429,16 +1243,12 @@ void geometry_set::draw() {
   if (!valid)
     return;
 
-  // Draw standard shapes
-  set_vao_tessellated();
-  draw_shapes(shape_descriptions);
-
-  // Extra credit: draw meshes if option is enabled
-  if (meshes) {
-    set_vao_meshes();
-    draw_shapes(mesh_shape_descriptions);
-  }
-
+  // The packet update_view started, or one made now if it didn't
+  if (!prepared)
+    prepare_frame();
+  wait_frame();
+  prepared = false;
+  draw_queue();
   unbind();
 }
 
@@ -447,29 +1257,27 @@ void geometry_set::set_vao_tessellated() {
     return;
 
   bind();
+  bound_instance = std::string::npos;
 
   // Set vertex attribute
-  glBindBuffer(GL_ARRAY_BUFFER, vbo_id);
+  glBindBuffer(GL_ARRAY_BUFFER, cache.vertex_buffer());
   glEnableVertexAttribArray(0);
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0,
     reinterpret_cast<void*>(0));
 
-  // Send normal attribute
-  glBindBuffer(GL_ARRAY_BUFFER, nbo_id);
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0,
-    reinterpret_cast<void*>(0));
+  // Normals are in the frames
+  glDisableVertexAttribArray(1);
 
   // Send UV attribute
-  glBindBuffer(GL_ARRAY_BUFFER, ubo_id);
+  glBindBuffer(GL_ARRAY_BUFFER, cache.uv_buffer());
   glEnableVertexAttribArray(2);
   glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0,
     reinterpret_cast<void*>(0));
 
-  // Send tangent attribute
-  glBindBuffer(GL_ARRAY_BUFFER, tbo_id);
+  // Send tangent frame attribute, normalized to [-1, 1]
+  glBindBuffer(GL_ARRAY_BUFFER, cache.frame_buffer());
   glEnableVertexAttribArray(3);
-  glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0,
+  glVertexAttribPointer(3, 4, GL_SHORT, GL_TRUE, 0,
     reinterpret_cast<void*>(0));
 }
 
@@ -478,6 +1286,7 @@ void geometry_set::set_vao_meshes() {
     return;
 
   bind();
+  bound_instance = std::string::npos;
 
   // Set vertex attribute
   glBindBuffer(GL_ARRAY_BUFFER, mvo_id);
@@ -485,11 +1294,8 @@ void geometry_set::set_vao_meshes() {
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0,
     reinterpret_cast<void*>(0));
 
-  // Send normal attribute
-  glBindBuffer(GL_ARRAY_BUFFER, mno_id);
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0,
-    reinterpret_cast<void*>(0));
+  // Normals are in the frames
+  glDisableVertexAttribArray(1);
 
   // Send UV attribute
   glBindBuffer(GL_ARRAY_BUFFER, muo_id);
@@ -497,69 +1303,65 @@ void geometry_set::set_vao_meshes() {
   glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0,
     reinterpret_cast<void*>(0));
 
-  // Send tangent attribute
-  glBindBuffer(GL_ARRAY_BUFFER, mto_id);
+  // Send tangent frame attribute, normalized to [-1, 1]
+  glBindBuffer(GL_ARRAY_BUFFER, mqo_id);
   glEnableVertexAttribArray(3);
-  glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0,
+  glVertexAttribPointer(3, 4, GL_SHORT, GL_TRUE, 0,
     reinterpret_cast<void*>(0));
+
+  // Triangles index into all of the above
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meo_id);
 }
 
-void geometry_set::update_buffers(bool update_meshes) {
+void geometry_set::set_vao_patches() {
+  bind();
+  bound_instance = std::string::npos;
+
+  // Corner parameters and positions, interleaved
+  glBindBuffer(GL_ARRAY_BUFFER, cage_id);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float),
+    reinterpret_cast<void*>(0));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float),
+    reinterpret_cast<void*>(3 * sizeof(float)));
+
+  // Everything else comes out of the evaluation stage
+  glDisableVertexAttribArray(2);
+  glDisableVertexAttribArray(3);
+
+  glPatchParameteri(GL_PATCH_VERTICES, 4);
+}
+
+void geometry_set::update_mesh_buffers() {
   if (!valid)
     return;
 
   bind();
 
   // Send vertex buffer data
-  glBindBuffer(GL_ARRAY_BUFFER, vbo_id);
+  glBindBuffer(GL_ARRAY_BUFFER, mvo_id);
   glBufferData(GL_ARRAY_BUFFER,
-    vertex_buffer_data.size() * sizeof(float),
-    vertex_buffer_data.data(), GL_STATIC_DRAW);
+    mesh_vertex_buffer_data.size() * sizeof(float),
+    mesh_vertex_buffer_data.data(), GL_STATIC_DRAW);
 
   // Send UV buffer data
-  glBindBuffer(GL_ARRAY_BUFFER, ubo_id);
-  glBufferData(GL_ARRAY_BUFFER,
-    uv_buffer_data.size() * sizeof(float),
-    uv_buffer_data.data(), GL_STATIC_DRAW);
-
-  // Send normal buffer data
-  glBindBuffer(GL_ARRAY_BUFFER, nbo_id);
+  glBindBuffer(GL_ARRAY_BUFFER, muo_id);
   glBufferData(GL_ARRAY_BUFFER,
-    normal_buffer_data.size() * sizeof(float),
-    normal_buffer_data.data(), GL_STATIC_DRAW);
+    mesh_uv_buffer_data.size() * sizeof(float),
+    mesh_uv_buffer_data.data(), GL_STATIC_DRAW);
 
-  // Send tangent buffer data
-  glBindBuffer(GL_ARRAY_BUFFER, tbo_id);
+  // Send tangent frame buffer data
+  glBindBuffer(GL_ARRAY_BUFFER, mqo_id);
   glBufferData(GL_ARRAY_BUFFER,
-    tangent_buffer_data.size() * sizeof(float),
-    tangent_buffer_data.data(), GL_STATIC_DRAW);
+    mesh_frame_buffer_data.size() * sizeof(int16_t),
+    mesh_frame_buffer_data.data(), GL_STATIC_DRAW);
 
-  // Only if we changed mesh data
-  if (update_meshes) {
-    // Send vertex buffer data
-    glBindBuffer(GL_ARRAY_BUFFER, mvo_id);
-    glBufferData(GL_ARRAY_BUFFER,
-      mesh_vertex_buffer_data.size() * sizeof(float),
-      mesh_vertex_buffer_data.data(), GL_STATIC_DRAW);
-
-    // Send UV buffer data
-    glBindBuffer(GL_ARRAY_BUFFER, muo_id);
-    glBufferData(GL_ARRAY_BUFFER,
-      mesh_uv_buffer_data.size() * sizeof(float),
-      mesh_uv_buffer_data.data(), GL_STATIC_DRAW);
-
-    // Send normal buffer data
-    glBindBuffer(GL_ARRAY_BUFFER, mno_id);
-    glBufferData(GL_ARRAY_BUFFER,
-      mesh_normal_buffer_data.size() * sizeof(float),
-      mesh_normal_buffer_data.data(), GL_STATIC_DRAW);
-
-    // Send tangent buffer data
-    glBindBuffer(GL_ARRAY_BUFFER, mto_id);
-    glBufferData(GL_ARRAY_BUFFER,
-      mesh_tangent_buffer_data.size() * sizeof(float),
-      mesh_tangent_buffer_data.data(), GL_STATIC_DRAW);
-  }
+  // Send index buffer data, bound to the VAO
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meo_id);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+    mesh_index_buffer_data.size() * sizeof(uint32_t),
+    mesh_index_buffer_data.data(), GL_STATIC_DRAW);
 
   unbind();
 }
@@ -568,7 +1370,12 @@ void geometry_set::update_buffers(bool update_meshes) {
 // vertex and normal data
 void geometry_set::update_lod(bool new_lod) {
   lod = new_lod;
-  update_data(false);
+  request_data();
+
+  // Meshes have every level already, just go back to the full ones
+  if (!lod)
+    for (size_t i = 0; i != mesh_lod_states.size(); ++i)
+      set_mesh_level(i, 0);
 }
 
 // Updates stored meshes bool
@@ -586,26 +1393,55 @@ void geometry_set::update_parallax(bool new_parallax) {
   parallax = new_parallax;
 }
 
+// Round shapes move between the cage and the cache, in the background like
+// a parameter change
+void geometry_set::update_patches(bool new_patches) {
+  if (patches == new_patches)
+    return;
+
+  patches = new_patches;
+
+  // Different shapes have LOD levels now, and builds made for the old
+  // split are dropped instead of installed
+  lod_states.clear();
+  {
+    std::lock_guard<std::mutex> lock(build_mutex);
+    ++generation;
+    requested.reset();
+    finished.reset();
+  }
+  request_data();
+}
+
 // Updates stored tessellation params, and updates
 // vertex and normal data
 void geometry_set::update_tessellation(int tess_0, int tess_1) {
   t_0 = tess_0;
   t_1 = tess_1;
-  update_data(false);
+  request_data();
 }
 
 geometry_set::~geometry_set() {
+  wait_frame();
+  {
+    std::lock_guard<std::mutex> lock(build_mutex);
+    build_stop = true;
+  }
+  build_cv.notify_one();
+  if (builder.joinable())
+    builder.join();
+
   unbind();
 
   // Cleanup VBOs
-  glDeleteBuffers(1, &vbo_id);
-  glDeleteBuffers(1, &ubo_id);
-  glDeleteBuffers(1, &nbo_id);
-  glDeleteBuffers(1, &tbo_id);
+  cache.cleanup();
+  glDeleteBuffers(1, &cage_id);
   glDeleteBuffers(1, &mvo_id);
   glDeleteBuffers(1, &muo_id);
-  glDeleteBuffers(1, &mno_id);
-  glDeleteBuffers(1, &mto_id);
+  glDeleteBuffers(1, &mqo_id);
+  glDeleteBuffers(1, &meo_id);
+  glDeleteBuffers(1, &ico_id);
+  glDeleteBuffers(1, &iio_id);
 
   // Cleanup attributes
   glDisableVertexAttribArray(0);
@@ -1,75 +1,211 @@
 #pragma once
 
+#include "camera.h"
 #include "texture.h"
+#include "jobs/job_system.h"
+#include "shapes/geometry_cache.h"
+#include "shapes/mesh.h"
+#include "shapes/render_queue.h"
 #include "utils/sceneparser.h"
 #include <GL/glew.h>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <map>
 
 class geometry_set
 {
+public:
+  // Levels in each primitive's LOD chain
+  static constexpr int lod_level_count = 4;
+
 private:
   // Can be drawn
   bool valid;
 
+  // Tessellated shapes, resident on the GPU across parameter changes, and
+  // what the last install did to them
+  geometry_cache        cache;
+  geometry_cache::stats cache_stats = {};
+
   // OpenGL buffer ids
-  GLuint vbo_id; // Vertices
-  GLuint ubo_id; // UVs
-  GLuint nbo_id; // Normals
-  GLuint tbo_id; // Tangents
   GLuint mvo_id; // Mesh vertices
   GLuint muo_id; // Mesh UVs
-  GLuint mno_id; // Mesh normals
-  GLuint mto_id; // Mesh tangents
+  GLuint mqo_id; // Mesh tangent frames
+  GLuint meo_id; // Mesh indices
+  GLuint ico_id; // Instance matrices
+  GLuint iio_id; // Instance inverse matrices
+
+  // Instance a draw starts at. Shapes are drawn once per instance of their
+  // prototype, with the instance's matrices in attributes 4 to 11
+  size_t bound_instance;
+  void bind_instances(size_t first);
+  void upload_instances();
 
   // OpenGL VAO
   GLuint vao_id;
 
-  // Uniform for model matrix
-  GLuint model_u;
-  GLuint inv_model_u;
-
-  // Uniforms for object colors
-  GLuint amb_u;
-  GLuint dif_u;
-  GLuint spe_u;
-  GLuint shi_u;
-  GLuint tex_u; // Texture mapping
-  GLuint bld_u; // Texture mapping
-  GLuint pav_u; // Parallax mapping
-  GLuint paf_u; // Parallax mapping
-  GLuint urp_u; // Parallax mapping
-  GLuint vrp_u; // Parallax mapping
-
-  // Metadata for each shape
+  // Uniforms of a program that draws shapes, the ones a program doesn't
+  // have are -1 and ignored
+  struct shape_uniforms {
+    GLuint model;     // Model matrix
+    GLuint inv_model;
+    GLuint pv;        // Projection * view, for passes the camera doesn't set
+    GLuint amb;       // Object colors
+    GLuint dif;
+    GLuint spe;
+    GLuint shi;
+    GLuint tex;       // Texture mapping
+    GLuint bld;       // Texture mapping
+    GLuint pav;       // Parallax mapping
+    GLuint paf;       // Parallax mapping
+    GLuint urp;       // Parallax mapping
+    GLuint vrp;       // Parallax mapping
+    GLuint levels;    // GPU tessellation
+    GLuint viewport;  // GPU tessellation
+  };
+  static shape_uniforms locate(GLuint program_id);
+
+  // Programs for triangles, and for patches drawn lit and into shadow maps
+  GLuint         program;
+  GLuint         patch_program;
+  GLuint         patch_shadow_program;
+  shape_uniforms shape_u;
+  shape_uniforms patch_u;
+  shape_uniforms patch_shadow_u;
+
+  // Metadata for each shape, and the materials they're drawn with, by id
   struct shape_description;
+  struct draw_material;
+  std::vector<draw_material> materials;
   std::vector<shape_description> shape_descriptions;
   std::vector<shape_description> mesh_shape_descriptions;
+  std::vector<shape_description> patch_shape_descriptions;
+
+  // Which description each scene shape has, so one shape can be patched
+  enum class shape_list : uint8_t { tessellated, mesh, patch };
+  struct shape_slot {
+    shape_list list  = shape_list::tessellated;
+    size_t     index = 0;
+  };
+  std::vector<shape_slot> shape_slots;
+
+  // The main pass's draws, every list's at once with the list as the pass,
+  // sorted by state and drawn with only the state that changed set
+  render_queue queue;
+  std::vector<size_t> queue_used; // Keys each piece of a parallel fill kept
+  struct draw_state {
+    uint32_t pass;
+    uint32_t flags;    // Patch type, textured and parallax, as the key has them
+    uint32_t texture;  // Texture id + 1, 0 for none
+    uint32_t material;
+  };
+  draw_state state_of(shape_list pass, const shape_description &d) const;
+  void fill_queue();
+  void draw_queue();
+
+  // State changes a frame makes drawn in the queue's order, and drawn in
+  // scene order, which is only counted the first frame after the shapes
+  // change
+  struct bind_counts {
+    size_t draws     = 0;
+    size_t passes    = 0; // VAO and program switches
+    size_t flags     = 0;
+    size_t textures  = 0;
+    size_t materials = 0;
+    void count(const draw_state &last, const draw_state &s);
+  };
+  bind_counts scene_binds;
+  bind_counts queue_binds;
+  bool count_scene_binds = false;
 
   // Used for LOD extra credit
   struct shape_id;
-  std::map<shape_id, std::tuple<size_t, size_t>> unique_shape_starts; // Given a shape_id, tells
-                                                                      // you offset in vertex buffer
-                                                                      // and number of tris
-  glm::vec3 cam_pos;
-  float min_dist;
-  float max_dist;
-  float dist_range;
-  std::vector<float> distances;
-
-  // Data buffers
-  std::vector<float> vertex_buffer_data;
-  std::vector<float> uv_buffer_data;
-  std::vector<float> normal_buffer_data;
-  std::vector<float> tangent_buffer_data;
+  static shape_id lod_id(PrimitiveType type, int level, int tess_0, int tess_1);
+
+  // Where each level of each primitive's chain is in the cache, as of the
+  // last install
+  static constexpr int primitive_types = static_cast<int>(PrimitiveType::PRIMITIVE_MESH) + 1;
+  struct chain_range {
+    size_t offset   = 0;
+    size_t count    = 0;
+    bool   resident = false;
+  };
+  chain_range chains[primitive_types][lod_level_count];
+  const chain_range &lod_range(PrimitiveType type, int level) const;
+
+  // GPU tessellation: one coarse patch cage per round primitive, the same
+  // whatever the parameters, in one buffer
+  GLuint      cage_id;
+  size_t      cage_bytes = 0;
+  chain_range cages[primitive_types];
+  glm::vec2   viewport; // Window size in pixels, for edge lengths on screen
+
+  // Current LOD level of each shape in shape_descriptions
+  struct lod_state;
+  std::vector<lod_state> lod_states;
+
+  // Instance of each prototype whose view LOD is picked for, the nearest
+  // one, so no instance gets a coarser level than it needs
+  std::vector<size_t> lod_instances;
+  void pick_lod_instances(glm::vec3 eye);
+
+  // Meshes loaded for the scene, with their simplified levels, and the
+  // current level of each shape in mesh_shape_descriptions
+  struct mesh_file {
+    std::vector<mesh::level> levels; // Into the mesh index buffer
+    glm::vec3 center;                // Object space bounding sphere
+    float     radius;
+  };
+  std::vector<mesh_file> mesh_files;
+  std::map<std::string, size_t> mesh_file_ids; // Into mesh_files, by path
+  struct mesh_lod_state {
+    glm::vec3 center;    // In the prototype's space
+    float     radius;
+    size_t    file;
+    uint32_t  prototype;
+    int       level;
+  };
+  std::vector<mesh_lod_state> mesh_lod_states;
+  void set_mesh_level(size_t i, int level);
 
   // Extra credit, data buffers for meshes
   std::vector<float> mesh_vertex_buffer_data;
   std::vector<float> mesh_uv_buffer_data;
-  std::vector<float> mesh_normal_buffer_data;
-  std::vector<float> mesh_tangent_buffer_data;
+  std::vector<int16_t> mesh_frame_buffer_data;
+  std::vector<uint32_t> mesh_index_buffer_data;
+  std::vector<mesh_optimizer::meshlet> mesh_meshlets; // Into the index buffer
+
+  // Meshlets of the mesh shapes that a view can see, runs of them merged,
+  // for glMultiDrawElements. Mesh shape i has count[i] runs from first[i]
+  struct mesh_runs {
+    std::vector<GLsizei>      counts;
+    std::vector<const void *> offsets;
+  };
+  struct mesh_draws : mesh_runs {
+    std::vector<uint32_t>  first;
+    std::vector<uint32_t>  count;
+    std::vector<mesh_runs> pieces; // Culled in parallel, then joined
+  };
+  mesh_draws view_draws;   // The camera's, culled with the frame packet
+  mesh_draws shadow_draws; // The light's being drawn
+  glm::mat4  view_pv;      // Camera's, as of update_view
+  void cull_meshes(const glm::mat4 &pv, mesh_draws &out);
+  uint32_t cull_mesh(const shape_description &d, const glm::mat4 &pv, glm::vec4 eye,
+                     mesh_runs &runs) const;
+
+  // The frame packet: what the camera sees and its sorted queue, made by a
+  // job from update_view on while the GUI thread draws the shadow maps, and
+  // only replayed by draw(). Nothing may change the shapes in between
+  job_group frame;
+  bool      prepared = false; // A packet was started since the last draw
+  void prepare_frame();
+  void wait_frame();
+  void pick_levels(const camera &cam);
 
   // Count of all elements (points, lines, polys) to render
   size_t elements = 0;
@@ -85,31 +221,53 @@ private:
   bool parallax;
   const std::vector<texture> *textures;
 
+  // Round primitives are tessellated on the GPU from their cages
+  bool patches;
+
   // Points, lines, polys, etc.
   GLenum mode;
 
-  // Shapes this geometry comprises
-  const std::vector<RenderShapeData> *shapes;
+  // Scene whose shapes this geometry comprises
+  const RenderData *scene;
 
   // Set VAO as current
   void set_vao_tessellated();
   void set_vao_meshes();
-
-  // Update buffers with new data
-  void update_buffers(bool update_meshes);
-
-  // Add a specific shape's data
-  void add_mesh_data(const RenderShapeData &s);
-  void add_shape_data(const RenderShapeData &s, size_t idx, bool update_meshes);
-
-  // Set vertex and normal data
+  void set_vao_patches();
+
+  // Upload mesh data, shapes are uploaded by the cache
+  void update_mesh_buffers();
+
+  // Load the scene's new mesh files, then add a specific shape's data
+  void load_mesh_files();
+  void add_mesh_data(size_t i);
+
+  // Re-tessellation: a request lists the unique shapes the scene needs at
+  // the current parameters, a result holds the ones the cache was missing.
+  // Results are built by the builder thread and installed by sync()
+  struct build_request;
+  struct build_result;
+  std::unique_ptr<build_request> make_request();
+  static std::unique_ptr<build_result> build(build_request req);
+  void install(build_result &res);
+
+  std::thread                    builder;
+  std::mutex                     build_mutex;
+  std::condition_variable        build_cv;
+  std::unique_ptr<build_request> requested; // Latest request, older ones are dropped
+  std::unique_ptr<build_result>  finished;  // Done, waiting for sync()
+  bool                           build_stop = false;
+  bool                           build_busy = false; // A request is being built
+  size_t                         generation = 0; // Bumped by set_data, stale results are dropped
+
+  void builder_loop();
+
+  // Set vertex and normal data, right away or in the background
   void update_data(bool update_meshes);
+  void request_data();
 
-  void draw_shapes(const std::vector<shape_description> &vec);
-
-  // Auxiliary to make tangents from triangles
-  std::vector<float> make_tangents(const std::vector<float> &vertices,
-    const std::vector<float> &uvs);
+  void draw_range(const shape_description &d, GLenum draw_mode, const mesh_draws &draws,
+                  size_t i);
 
 public:
    geometry_set();
@@ -118,19 +276,58 @@ public:
   // Initialize uniforms and pointer to scene data
   void initialize(GLuint program_id);
 
-  // Set shape data
-  void set_data(const std::vector<RenderShapeData> &master_data,
-    glm::vec3 camera_pos, const std::vector<texture> &tex);
+  // Programs and patch cages for GPU tessellation, after initialize
+  void initialize_patches(GLuint patch_program_id, GLuint patch_shadow_program_id);
 
-  // Update buffers with new tessellation parameters
+  // Set shape data
+  void set_data(const RenderData &master_data,
+    const std::vector<texture> &tex);
+
+  // The scene was reloaded into the same RenderData, or moved by its
+  // transform hierarchy. Shapes at the same index are the same shape,
+  // changed ones had their matrices or material edited and are patched
+  // where they are
+  void update_shapes(const std::vector<size_t> &changed);
+
+  // The reloaded scene's materials were edited or numbered again, before
+  // update_shapes gives shapes their new ids
+  void update_materials();
+
+  // Instances whose matrices changed, only they are uploaded again
+  void update_instances(const std::vector<size_t> &changed);
+
+  // The reloaded scene has other shapes. Descriptions are made again, the
+  // tessellated shapes come out of the cache and only mesh files that
+  // aren't loaded yet are loaded and uploaded
+  void update_structure();
+
+  // Update buffers with new tessellation parameters. Shapes are
+  // re-tessellated in the background and the old ones are drawn until
+  // sync() swaps the new ones in
   void update_tessellation(int tess_0, int tess_1);
 
+  // Swap in finished background tessellation, once per frame before drawing
+  void sync();
+
+  // Background tessellation is asked for and not swapped in yet, so frames
+  // have to keep coming until it is
+  bool building();
+
+  // Extra credit: LOD, picks each shape's level from its size on screen,
+  // once per frame before drawing. Then starts preparing the frame packet
+  // draw() replays
+  void update_view(const camera &cam);
+
   // Extra credits: distance LOD, meshes and texture mapping
   void update_lod(bool new_lod);
   void update_meshes_display(bool new_meshes);
   void update_texturing(bool new_texturing);
   void update_parallax(bool new_parallax);
 
+  // Spheres, cylinders and cones tessellated on the GPU instead, after
+  // which changing the parameters only changes a uniform
+  void update_patches(bool new_patches);
+
   // Draw everything
   void draw();
 
@@ -143,12 +340,17 @@ public:
   // Simple getters
   int get_elements() { return this->elements; }
   GLenum get_mode() { return this->mode; }
+  const geometry_cache &get_cache() const { return this->cache; }
+  const geometry_cache::stats &get_cache_stats() const { return this->cache_stats; }
+  size_t get_cage_bytes() const { return this->cage_bytes; }
+  const bind_counts &get_queue_binds() const { return this->queue_binds; }
+  const bind_counts &get_scene_binds() const { return this->scene_binds; }
 
   // Utility
   static void add_to_vec(std::vector<float> &vec, glm::vec3 p);
   static void add_to_vec(std::vector<float> &vec, glm::vec4 p);
 
   // Auxiliary to render shapes in any VAO (modified to only draw shapes and not do lighting calc)
-  void draw_shapes_shadows(GLuint shadow_shader);
+  void draw_shapes_shadows(GLuint shadow_shader, const glm::mat4 &light_space);
 
 };
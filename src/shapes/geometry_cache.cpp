@@ -0,0 +1,200 @@
+#include "geometry_cache.h"
+#include "shapes/tangent_space.h"
+
+#include <algorithm>
+
+// Bytes per vertex in each buffer
+static constexpr size_t vertex_bytes = 3 * sizeof(float);
+static constexpr size_t uv_bytes     = 2 * sizeof(float);
+static constexpr size_t frame_bytes  = tangent_space::frame_components * sizeof(int16_t);
+
+geometry_cache::geometry_cache() : vbo_id(0), ubo_id(0), qbo_id(0),
+  capacity_vertices(0), used_vertices(0), stamp(1), counters{} {};
+
+void geometry_cache::initialize(size_t capacity) {
+  glGenBuffers(1, &vbo_id);
+  glGenBuffers(1, &ubo_id);
+  glGenBuffers(1, &qbo_id);
+  create_buffers(capacity);
+
+  clear();
+}
+
+void geometry_cache::cleanup() {
+  glDeleteBuffers(1, &vbo_id);
+  glDeleteBuffers(1, &ubo_id);
+  glDeleteBuffers(1, &qbo_id);
+  vbo_id = ubo_id = qbo_id = 0;
+
+  entries.clear();
+  lru.clear();
+  free_ranges.clear();
+  capacity_vertices = 0;
+  used_vertices     = 0;
+}
+
+void geometry_cache::begin_use() {
+  ++stamp;
+}
+
+const geometry_cache::range *geometry_cache::find(uint64_t key) {
+  auto it = entries.find(key);
+  if (it == entries.end())
+    return nullptr;
+
+  // Most recently used goes to the front
+  lru.splice(lru.begin(), lru, it->second.pos);
+  it->second.stamp = stamp;
+  ++counters.hits;
+
+  return &it->second.r;
+}
+
+const geometry_cache::range *geometry_cache::insert(uint64_t key, size_t count,
+  const float *vertices, const float *uvs, const int16_t *frames,
+  bool required) {
+  if (auto r = find(key))
+    return r;
+
+  // Make room: cold shapes first, then more memory
+  size_t offset;
+  while (!allocate(count, offset)) {
+    if (evict_one())
+      continue;
+    if (!required)
+      return nullptr;
+    grow(capacity_vertices + count);
+  }
+
+  // Sub-upload into every buffer at the same vertex offset
+  auto upload = [&](GLuint id, size_t bytes, const void *data) {
+    glBindBuffer(GL_ARRAY_BUFFER, id);
+    glBufferSubData(GL_ARRAY_BUFFER, offset * bytes, count * bytes, data);
+  };
+  upload(vbo_id, vertex_bytes, vertices);
+  upload(ubo_id, uv_bytes, uvs);
+  upload(qbo_id, frame_bytes, frames);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  lru.push_front(key);
+  auto &e = entries[key];
+  e.r     = { offset, count };
+  e.pos   = lru.begin();
+  e.stamp = stamp;
+  ++counters.inserts;
+
+  return &e.r;
+}
+
+void geometry_cache::clear() {
+  entries.clear();
+  lru.clear();
+  free_ranges.clear();
+  if (capacity_vertices)
+    free_ranges[0] = capacity_vertices;
+  used_vertices = 0;
+}
+
+geometry_cache::stats geometry_cache::take_stats() {
+  stats s  = counters;
+  counters = {};
+  return s;
+}
+
+// First fit
+bool geometry_cache::allocate(size_t count, size_t &offset) {
+  for (auto it = free_ranges.begin(); it != free_ranges.end(); ++it) {
+    if (it->second < count)
+      continue;
+
+    offset = it->first;
+    size_t rest = it->second - count;
+    free_ranges.erase(it);
+    if (rest)
+      free_ranges[offset + count] = rest;
+    used_vertices += count;
+    return true;
+  }
+
+  return false;
+}
+
+void geometry_cache::release(size_t offset, size_t count) {
+  used_vertices -= count;
+  auto it = free_ranges.emplace(offset, count).first;
+
+  // Merge with the following range
+  auto next = std::next(it);
+  if (next != free_ranges.end() && it->first + it->second == next->first) {
+    it->second += next->second;
+    free_ranges.erase(next);
+  }
+
+  // And the preceding one
+  if (it != free_ranges.begin()) {
+    auto prev = std::prev(it);
+    if (prev->first + prev->second == it->first) {
+      prev->second += it->second;
+      free_ranges.erase(it);
+    }
+  }
+}
+
+// Least recently used shape that isn't pinned
+bool geometry_cache::evict_one() {
+  if (lru.empty())
+    return false;
+
+  auto it = entries.find(lru.back());
+  if (it->second.stamp == stamp)
+    return false;
+
+  release(it->second.r.offset, it->second.r.count);
+  lru.pop_back();
+  entries.erase(it);
+  ++counters.evictions;
+
+  return true;
+}
+
+// Doubles the buffers (or more if needed), copying what's resident on the GPU
+void geometry_cache::grow(size_t min_capacity) {
+  size_t old_capacity = capacity_vertices;
+  size_t new_capacity = std::max(old_capacity * 2, min_capacity);
+
+  GLuint old_ids[3] = { vbo_id, ubo_id, qbo_id };
+  glGenBuffers(1, &vbo_id);
+  glGenBuffers(1, &ubo_id);
+  glGenBuffers(1, &qbo_id);
+  create_buffers(new_capacity);
+
+  GLuint new_ids[3] = { vbo_id, ubo_id, qbo_id };
+  size_t bytes[3]   = { vertex_bytes, uv_bytes, frame_bytes };
+  for (int i = 0; i != 3; ++i) {
+    glBindBuffer(GL_COPY_READ_BUFFER, old_ids[i]);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, new_ids[i]);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                        old_capacity * bytes[i]);
+  }
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  glDeleteBuffers(3, old_ids);
+
+  // The new space is one free range, merged with a free tail if there is one
+  release(old_capacity, new_capacity - old_capacity);
+  used_vertices += new_capacity - old_capacity;
+  ++counters.grows;
+}
+
+void geometry_cache::create_buffers(size_t capacity) {
+  capacity_vertices = capacity;
+
+  auto create = [&](GLuint id, size_t bytes) {
+    glBindBuffer(GL_ARRAY_BUFFER, id);
+    glBufferData(GL_ARRAY_BUFFER, capacity * bytes, nullptr, GL_DYNAMIC_DRAW);
+  };
+  create(vbo_id, vertex_bytes);
+  create(ubo_id, uv_bytes);
+  create(qbo_id, frame_bytes);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
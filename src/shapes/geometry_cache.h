@@ -0,0 +1,90 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <unordered_map>
+
+// Tessellated shapes kept on the GPU, keyed by shape. Positions, UVs and
+// tangent frames (see tangent_space.h) live in three buffers that are carved
+// into ranges of vertices, the same range in each. When space runs out the least recently used shapes
+// are evicted, but never one used since the last begin_use().
+class geometry_cache
+{
+public:
+  // In vertices, the same in every buffer
+  struct range {
+    size_t offset;
+    size_t count;
+  };
+
+  struct stats {
+    size_t hits;
+    size_t inserts;
+    size_t evictions;
+    size_t grows;
+  };
+
+  geometry_cache();
+
+  void initialize(size_t capacity_vertices);
+  void cleanup();
+
+  // Starts a new round of use, shapes used from here on are pinned until the
+  // next call
+  void begin_use();
+
+  // Shape's range if it's resident, pins it and marks it recently used
+  const range *find(uint64_t key);
+  bool contains(uint64_t key) const { return entries.count(key); }
+
+  // Uploads a shape into a free range. Cold shapes are evicted to make room,
+  // and if that isn't enough the buffers grow, unless the shape is only
+  // nice to have (required false) in which case it's skipped
+  const range *insert(uint64_t key, size_t count, const float *vertices,
+                      const float *uvs, const int16_t *frames, bool required);
+
+  // Drop every shape, buffers keep their size
+  void clear();
+
+  GLuint vertex_buffer() const { return vbo_id; }
+  GLuint uv_buffer() const { return ubo_id; }
+  GLuint frame_buffer() const { return qbo_id; }
+
+  size_t capacity() const { return capacity_vertices; }
+  size_t used() const { return used_vertices; }
+  size_t resident() const { return entries.size(); }
+
+  // Counters since the last call
+  stats take_stats();
+
+private:
+  GLuint vbo_id;
+  GLuint ubo_id;
+  GLuint qbo_id;
+
+  size_t capacity_vertices;
+  size_t used_vertices;
+
+  // Free ranges by offset, neighbours are merged when freed
+  std::map<size_t, size_t> free_ranges;
+
+  // Front is most recently used
+  std::list<uint64_t> lru;
+  struct entry {
+    range r;
+    std::list<uint64_t>::iterator pos;
+    uint64_t stamp;
+  };
+  std::unordered_map<uint64_t, entry> entries;
+  uint64_t stamp;
+
+  stats counters;
+
+  bool allocate(size_t count, size_t &offset);
+  void release(size_t offset, size_t count);
+  bool evict_one();
+  void grow(size_t min_capacity);
+  void create_buffers(size_t capacity);
+};
@@ -1,4 +1,9 @@
 #include "mesh.h"
+#include "shapes/mesh_optimizer.h"
+#include "shapes/simplifier.h"
+#include "utils/blob.h"
+#include <map>
+#include <tuple>
 
 using std::string;
 using glm::vec3;
@@ -17,31 +22,172 @@ void insert_vec2(vector<float> &data, vec2 v) {
   data.push_back(v.y);
 }
 
-mesh::mesh(string fp) : loader(obj_loader(fp))
+mesh::mesh(string fp) : valid(false), path(fp)
 {
-  valid = loader.success;
-}
-
-void mesh::set_vertex_data() {
-  for (size_t i = 0; i != loader.faces.size(); i += 3) {
-    auto vertex_indices = loader.faces[i];
-    auto uv_indices     = loader.faces[i + 1];
-    auto normal_indices = loader.faces[i + 2];
-
-    insert_vec3(vertex_data, loader.vertices[vertex_indices[0]]);
-    insert_vec3(vertex_data, loader.vertices[vertex_indices[1]]);
-    insert_vec3(vertex_data, loader.vertices[vertex_indices[2]]);
-    insert_vec2(uv_data, loader.uvs[uv_indices[0]]);
-    insert_vec2(uv_data, loader.uvs[uv_indices[1]]);
-    insert_vec2(uv_data, loader.uvs[uv_indices[2]]);
-    insert_vec3(normal_data, normalize(loader.normals[normal_indices[0]]));
-    insert_vec3(normal_data, normalize(loader.normals[normal_indices[1]]));
-    insert_vec3(normal_data, normalize(loader.normals[normal_indices[2]]));
+}
+
+// Unique corners (position, uv and normal), so triangles share vertices
+// wherever the file does
+vector<uint32_t> mesh::index_faces() {
+  std::map<std::tuple<size_t, size_t, size_t>, uint32_t> corner_ids;
+  vector<uint32_t> indices;
+  indices.reserve(loader->faces.size());
+  for (size_t i = 0; i != loader->faces.size(); i += 3) {
+    // Degenerate triangles don't show and would confuse the simplifier
+    const auto &f = loader->faces[i];
+    if (f[0] == f[1] || f[1] == f[2] || f[2] == f[0])
+      continue;
+
+    for (int k = 0; k != 3; ++k) {
+      auto key = std::make_tuple(static_cast<size_t>(loader->faces[i][k]),
+                                 static_cast<size_t>(loader->faces[i + 1][k]),
+                                 static_cast<size_t>(loader->faces[i + 2][k]));
+      auto found = corner_ids.find(key);
+      if (found == corner_ids.end()) {
+        found = corner_ids.emplace(key, static_cast<uint32_t>(corners.size())).first;
+        corners.push_back({ std::get<0>(key), std::get<1>(key), std::get<2>(key) });
+        positions.push_back(loader->vertices[std::get<0>(key)]);
+        position_ids.push_back(static_cast<uint32_t>(std::get<0>(key)));
+      }
+      indices.push_back(found->second);
+    }
+  }
+
+  return indices;
+}
+
+// Simplified levels, each with half the triangles of the one before
+void mesh::add_lod_levels(int count, vector<vector<uint32_t>> &lods) {
+  size_t triangles = lods[0].size() / 3;
+  vector<size_t> targets;
+  for (int l = 1; l != count; ++l)
+    targets.push_back(triangles >> l);
+
+  auto simplified = simplifier::simplify(positions, position_ids, lods[0], targets);
+  for (auto &lod : simplified)
+    lods.push_back(std::move(lod));
+}
+
+// Orders every level's triangles for the vertex cache and overdraw, then the
+// shared vertices for fetching, and lays it all out
+void mesh::optimize(vector<vector<uint32_t>> &lods) {
+  cache_before = mesh_optimizer::analyze(lods[0], corners.size());
+
+  for (auto &lod : lods) {
+    mesh_optimizer::optimize_cache(lod, corners.size());
+    mesh_optimizer::optimize_overdraw(lod, positions);
+  }
+
+  // Renumbered across all levels at once, so they keep sharing vertices
+  for (const auto &lod : lods) {
+    levels.push_back({ index_data.size(), lod.size(), 0, 0 });
+    index_data.insert(index_data.end(), lod.begin(), lod.end());
+  }
+  auto order = mesh_optimizer::optimize_fetch(index_data, corners.size());
+
+  vector<vec3> ordered;
+  ordered.reserve(order.size());
+  for (uint32_t c : order) {
+    const auto &[v, t, n] = corners[c];
+    insert_vec3(vertex_data, loader->vertices[v]);
+    insert_vec2(uv_data, loader->uvs[t]);
+    insert_vec3(normal_data, normalize(loader->normals[n]));
+    ordered.push_back(loader->vertices[v]);
+  }
+
+  for (auto &l : levels) {
+    auto cut = mesh_optimizer::build_meshlets(index_data, ordered, l.offset, l.count);
+    l.first_meshlet = meshlets.size();
+    l.meshlet_count = cut.size();
+    meshlets.insert(meshlets.end(), cut.begin(), cut.end());
   }
+
+  cache_after = mesh_optimizer::analyze(
+    vector<uint32_t>(index_data.begin(), index_data.begin() + levels[0].count),
+    order.size());
+}
+
+// Processed meshes are cached next to their file, until the file changes
+// or the processing does (bump cache_version then)
+constexpr uint32_t cache_magic   = 0x48534d43; // "CMSH"
+constexpr uint32_t cache_version = 1;
+
+bool mesh::load_cache(int lod_levels) {
+  string cache = path + ".meshbin";
+  if (!blob::newer_than(cache, { path }))
+    return false;
+
+  blob::mapping file(cache);
+  blob::reader in(file.data(), file.size(), cache_magic, cache_version);
+  int32_t levels_in_file = 0;
+  in.get(levels_in_file);
+  if (!in.ok() || levels_in_file != lod_levels)
+    return false;
+
+  in.get(min_corner);
+  in.get(max_corner);
+  in.get_array(vertex_data);
+  in.get_array(normal_data);
+  in.get_array(uv_data);
+  in.get_array(index_data);
+  in.get_array(meshlets);
+  in.get_array(levels);
+  if (!in.ok())
+    return false;
+
+  // Everything below indexes what's above, a bad file mustn't get further
+  size_t vertices = vertex_data.size() / 3;
+  bool sane = normal_data.size() == vertex_data.size() && uv_data.size() == vertices * 2;
+  for (uint32_t i : index_data)
+    sane = sane && i < vertices;
+  for (const auto &l : levels)
+    sane = sane && l.offset + l.count <= index_data.size() &&
+           l.first_meshlet + l.meshlet_count <= meshlets.size();
+  for (const auto &m : meshlets)
+    sane = sane && m.offset + m.count <= index_data.size();
+  if (!sane) {
+    vertex_data.clear(); normal_data.clear(); uv_data.clear();
+    index_data.clear(); meshlets.clear(); levels.clear();
+    return false;
+  }
+
+  valid = true;
+  return true;
 }
 
-void mesh::make_mesh() {
+void mesh::save_cache(int lod_levels) const {
+  blob::writer out(cache_magic, cache_version);
+  out.put<int32_t>(lod_levels);
+  out.put(min_corner);
+  out.put(max_corner);
+  out.put_array(vertex_data);
+  out.put_array(normal_data);
+  out.put_array(uv_data);
+  out.put_array(index_data);
+  out.put_array(meshlets);
+  out.put_array(levels);
+  out.save(path + ".meshbin");
+}
+
+void mesh::make_mesh(int lod_levels) {
+  if (load_cache(lod_levels))
+    return;
+
+  loader.emplace(path);
+  valid = loader->success;
   if (!valid)
     return;
-  set_vertex_data();
+
+  min_corner = max_corner = loader->vertices.empty() ? vec3(0) : loader->vertices[0];
+  for (const auto &v : loader->vertices) {
+    min_corner = glm::min(min_corner, v);
+    max_corner = glm::max(max_corner, v);
+  }
+
+  vector<vector<uint32_t>> lods = { index_faces() };
+  if (lod_levels > 1 && !lods[0].empty())
+    add_lod_levels(lod_levels, lods);
+
+  optimize(lods);
+  save_cache(lod_levels);
 }
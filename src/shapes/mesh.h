@@ -1,23 +1,75 @@
 #pragma once
 
+#include <cstdint>
+#include <optional>
 #include <string>
 #include "utils/obj_loader.h"
+#include "shapes/mesh_optimizer.h"
 #include <shapes/triangle.h>
+#include <glm/glm.hpp>
 
 class mesh
 {
 private:
-  obj_loader loader;
-  void set_vertex_data();
+  // Only loaded when there's no processed copy of the file cached
+  std::optional<obj_loader> loader;
+
+  // Unique corners of the file's faces: position, UV and normal index
+  struct corner {
+    size_t v;
+    size_t t;
+    size_t n;
+  };
+  std::vector<corner> corners;
+  std::vector<glm::vec3> positions;    // Of every corner
+  std::vector<uint32_t>  position_ids; // Equal for corners at the same position
+
+  std::vector<uint32_t> index_faces();
+  void add_lod_levels(int count, std::vector<std::vector<uint32_t>> &lods);
+  void optimize(std::vector<std::vector<uint32_t>> &lods);
+
+  // The processed mesh, cached next to the file
+  bool load_cache(int lod_levels);
+  void save_cache(int lod_levels) const;
 
   // All good with obj laoder
   bool valid;
 
+  std::string path;
+
 public:
+  // Vertices every LOD level shares, in the order the levels first use them
   std::vector<float> vertex_data;
   std::vector<float> normal_data;
   std::vector<float> uv_data;
 
+  // Every LOD level's triangles back to back, finest first, ordered for the
+  // vertex cache and for overdraw
+  std::vector<uint32_t> index_data;
+
+  // Every LOD level's meshlets back to back, covering its indices in order
+  std::vector<mesh_optimizer::meshlet> meshlets;
+
+  // Where each LOD level is in the indices and in the meshlets. Level 0 is
+  // the mesh as loaded, the rest are simplified to a fraction of its
+  // triangles
+  struct level {
+    size_t offset;
+    size_t count;
+    size_t first_meshlet;
+    size_t meshlet_count;
+  };
+  std::vector<level> levels;
+
+  // Level 0's vertex cache use before and after it was optimized, zero for
+  // meshes loaded from the cache
+  mesh_optimizer::cache_stats cache_before = {};
+  mesh_optimizer::cache_stats cache_after  = {};
+
+  // Object space bounds of the mesh
+  glm::vec3 min_corner = glm::vec3(0);
+  glm::vec3 max_corner = glm::vec3(0);
+
   mesh(std::string fp);
-  void make_mesh();
+  void make_mesh(int lod_levels = 1);
 };
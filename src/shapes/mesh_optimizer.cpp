@@ -0,0 +1,373 @@
+#include "shapes/mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+using glm::vec3;
+using std::vector;
+
+namespace {
+
+// Forsyth's scoring: vertices near the front of an LRU cache of this size
+// score high, more so the fewer triangles they have left
+constexpr size_t lru_size       = 32;
+constexpr float  cache_decay    = 1.5f;
+constexpr float  last_tri_score = .75f;
+constexpr float  valence_scale  = 2.f;
+constexpr size_t valence_table  = 32;
+
+struct scores {
+  float cache[lru_size];
+  float valence[valence_table];
+
+  scores() {
+    for (size_t i = 0; i != lru_size; ++i)
+      cache[i] = i < 3 ? last_tri_score
+                       : std::pow(1.f - float(i - 3) / float(lru_size - 3), cache_decay);
+    for (size_t i = 0; i != valence_table; ++i)
+      valence[i] = i ? valence_scale / std::sqrt(float(i)) : 0.f;
+  }
+
+  float vertex(int cache_pos, uint32_t remaining) const {
+    if (!remaining)
+      return -1.f;
+    float v = remaining < valence_table ? valence[remaining]
+                                        : valence_scale / std::sqrt(float(remaining));
+    return v + (cache_pos >= 0 ? cache[cache_pos] : 0.f);
+  }
+};
+
+// FIFO cache by insertion time: a vertex is in it if it was inserted less
+// than size misses ago
+struct fifo {
+  vector<uint32_t> inserted;
+  uint32_t         time;
+  size_t           size;
+
+  fifo(size_t vertex_count, size_t size) :
+    inserted(vertex_count, 0), time(size + 1), size(size) {}
+
+  void reset() { time += static_cast<uint32_t>(size) + 1; }
+
+  // Misses of a triangle, which go into the cache
+  int add(const uint32_t *tri) {
+    int misses = 0;
+    for (int k = 0; k != 3; ++k) {
+      if (time - inserted[tri[k]] > size) {
+        inserted[tri[k]] = time++;
+        ++misses;
+      }
+    }
+    return misses;
+  }
+};
+
+}
+
+mesh_optimizer::cache_stats mesh_optimizer::analyze(const vector<uint32_t> &indices,
+  size_t vertex_count, size_t cache_size) {
+  size_t tris = indices.size() / 3;
+  if (!tris)
+    return { 0.f, 0.f };
+
+  fifo   cache(vertex_count, cache_size);
+  size_t misses = 0;
+  for (size_t t = 0; t != tris; ++t)
+    misses += cache.add(&indices[t * 3]);
+
+  vector<bool> used(vertex_count, false);
+  size_t referenced = 0;
+  for (uint32_t i : indices) {
+    referenced += !used[i];
+    used[i] = true;
+  }
+
+  return { float(misses) / float(tris), float(misses) / float(referenced) };
+}
+
+void mesh_optimizer::optimize_cache(vector<uint32_t> &indices, size_t vertex_count) {
+  static const scores score;
+  size_t tris = indices.size() / 3;
+  if (!tris)
+    return;
+
+  // Triangles around every vertex, the first remaining[v] of them not yet
+  // emitted
+  vector<uint32_t> remaining(vertex_count, 0);
+  for (uint32_t i : indices)
+    ++remaining[i];
+  vector<uint32_t> first(vertex_count + 1, 0);
+  for (size_t v = 0; v != vertex_count; ++v)
+    first[v + 1] = first[v] + remaining[v];
+  vector<uint32_t> around(indices.size());
+  {
+    vector<uint32_t> fill(first.begin(), first.end() - 1);
+    for (size_t i = 0; i != indices.size(); ++i)
+      around[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+  }
+
+  vector<int>   cache_pos(vertex_count, -1);
+  vector<float> vertex_score(vertex_count);
+  for (size_t v = 0; v != vertex_count; ++v)
+    vertex_score[v] = score.vertex(-1, remaining[v]);
+
+  auto tri_score = [&](size_t t) {
+    return vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] +
+           vertex_score[indices[t * 3 + 2]];
+  };
+  vector<float> triangle_score(tris);
+  vector<bool>  emitted(tris, false);
+  for (size_t t = 0; t != tris; ++t)
+    triangle_score[t] = tri_score(t);
+
+  vector<uint32_t> out;
+  out.reserve(indices.size());
+
+  // Three extra entries for a triangle's vertices pushing others out
+  uint32_t cache[lru_size + 3];
+  uint32_t next_cache[lru_size + 3];
+  size_t   cache_count = 0;
+
+  // Starts with the best triangle anywhere, then the best one touching the
+  // cache, or the first one left when the cache has nothing to offer
+  size_t cursor = 0;
+  long   best   = std::max_element(triangle_score.begin(), triangle_score.end()) -
+                  triangle_score.begin();
+  while (out.size() != indices.size()) {
+    if (best < 0) {
+      while (emitted[cursor])
+        ++cursor;
+      best = static_cast<long>(cursor);
+    }
+
+    const uint32_t *tri = &indices[best * 3];
+    out.insert(out.end(), tri, tri + 3);
+    emitted[best] = true;
+
+    // Its vertices go to the front, the rest move back
+    size_t next_count = 0;
+    for (int k = 0; k != 3; ++k)
+      next_cache[next_count++] = tri[k];
+    for (size_t i = 0; i != cache_count; ++i)
+      if (cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2])
+        next_cache[next_count++] = cache[i];
+
+    for (int k = 0; k != 3; ++k) {
+      uint32_t v    = tri[k];
+      uint32_t *its = &around[first[v]];
+      uint32_t *end = its + remaining[v];
+      *std::find(its, end, static_cast<uint32_t>(best)) = end[-1];
+      --remaining[v];
+    }
+
+    // New scores for the cache's vertices, including the ones that just
+    // fell out, then for their triangles
+    for (size_t i = 0; i != next_count; ++i) {
+      uint32_t v   = next_cache[i];
+      cache_pos[v] = i < lru_size ? static_cast<int>(i) : -1;
+      vertex_score[v] = score.vertex(cache_pos[v], remaining[v]);
+    }
+
+    best = -1;
+    float best_score = -1.f;
+    for (size_t i = 0; i != next_count; ++i) {
+      uint32_t v = next_cache[i];
+      for (uint32_t j = first[v]; j != first[v] + remaining[v]; ++j) {
+        uint32_t t = around[j];
+        triangle_score[t] = tri_score(t);
+        if (triangle_score[t] > best_score) {
+          best_score = triangle_score[t];
+          best       = t;
+        }
+      }
+    }
+
+    cache_count = std::min(next_count, lru_size);
+    std::copy_n(next_cache, cache_count, cache);
+  }
+
+  indices.swap(out);
+}
+
+void mesh_optimizer::optimize_overdraw(vector<uint32_t> &indices,
+  const vector<vec3> &positions, float threshold) {
+  size_t tris = indices.size() / 3;
+  if (!tris)
+    return;
+
+  // Hard boundaries, where the order already misses on all three vertices
+  fifo cache(positions.size(), fifo_size);
+  vector<size_t> hard;
+  for (size_t t = 0; t != tris; ++t)
+    if (cache.add(&indices[t * 3]) == 3)
+      hard.push_back(t);
+  hard.push_back(tris);
+  if (hard.front() != 0)
+    hard.insert(hard.begin(), 0);
+
+  // Soft boundaries inside those, wherever starting over with an empty cache
+  // keeps the cluster's ACMR close to what it was
+  vector<size_t> clusters;
+  for (size_t h = 0; h + 1 < hard.size(); ++h) {
+    size_t start = hard[h], end = hard[h + 1];
+
+    cache.reset();
+    size_t misses = 0;
+    for (size_t t = start; t != end; ++t)
+      misses += cache.add(&indices[t * 3]);
+    float limit = threshold * float(misses) / float(end - start);
+
+    cache.reset();
+    clusters.push_back(start);
+    size_t soft_start = start, soft_misses = 0;
+    for (size_t t = start; t != end; ++t) {
+      soft_misses += cache.add(&indices[t * 3]);
+      if (t + 1 != end && float(soft_misses) / float(t + 1 - soft_start) <= limit) {
+        clusters.push_back(t + 1);
+        soft_start  = t + 1;
+        soft_misses = 0;
+        cache.reset();
+      }
+    }
+  }
+  clusters.push_back(tris);
+
+  // Area weighted centroid and normal of every cluster and of the mesh
+  size_t count = clusters.size() - 1;
+  vector<vec3> centroids(count, vec3(0.f)), normals(count, vec3(0.f));
+  vector<float> areas(count, 0.f);
+  vec3  mesh_centroid(0.f);
+  float mesh_area = 0.f;
+  for (size_t c = 0; c != count; ++c) {
+    for (size_t t = clusters[c]; t != clusters[c + 1]; ++t) {
+      const vec3 &a = positions[indices[t * 3]];
+      const vec3 &b = positions[indices[t * 3 + 1]];
+      const vec3 &d = positions[indices[t * 3 + 2]];
+      vec3  cr   = glm::cross(b - a, d - a);
+      float area = glm::length(cr);
+      centroids[c] += (a + b + d) * (area / 3.f);
+      normals[c]   += cr;
+      areas[c]     += area;
+    }
+    mesh_centroid += centroids[c];
+    mesh_area     += areas[c];
+  }
+  if (mesh_area > 0.f)
+    mesh_centroid /= mesh_area;
+
+  // Clusters facing away from the centroid are on the outside, those go first
+  vector<float> facing(count, 0.f);
+  for (size_t c = 0; c != count; ++c) {
+    float len = glm::length(normals[c]);
+    if (areas[c] > 0.f && len > 0.f)
+      facing[c] = glm::dot(centroids[c] / areas[c] - mesh_centroid, normals[c] / len);
+  }
+
+  vector<size_t> order(count);
+  for (size_t c = 0; c != count; ++c)
+    order[c] = c;
+  std::stable_sort(order.begin(), order.end(),
+    [&](size_t a, size_t b) { return facing[a] > facing[b]; });
+
+  vector<uint32_t> out;
+  out.reserve(indices.size());
+  for (size_t c : order)
+    out.insert(out.end(), indices.begin() + clusters[c] * 3,
+               indices.begin() + clusters[c + 1] * 3);
+  indices.swap(out);
+}
+
+vector<uint32_t> mesh_optimizer::optimize_fetch(vector<uint32_t> &indices,
+  size_t vertex_count) {
+  constexpr uint32_t unused = 0xffffffff;
+
+  vector<uint32_t> remap(vertex_count, unused);
+  vector<uint32_t> order;
+  for (uint32_t &i : indices) {
+    if (remap[i] == unused) {
+      remap[i] = static_cast<uint32_t>(order.size());
+      order.push_back(i);
+    }
+    i = remap[i];
+  }
+
+  return order;
+}
+
+vector<mesh_optimizer::meshlet> mesh_optimizer::build_meshlets(const vector<uint32_t> &indices,
+  const vector<vec3> &positions, size_t first, size_t count) {
+  // Past the minimum, a triangle further than this from the meshlet's
+  // average normal starts the next one, so cones stay narrow enough to cull
+  constexpr float split_dot = .5f;
+
+  vector<meshlet> out;
+  vector<uint32_t> seen(positions.size(), 0);
+  uint32_t stamp = 0;
+
+  auto normal = [&](size_t i) {
+    const vec3 &a = positions[indices[i]];
+    vec3 cr  = glm::cross(positions[indices[i + 1]] - a, positions[indices[i + 2]] - a);
+    float len = glm::length(cr);
+    return len > 0.f ? cr / len : vec3(0.f);
+  };
+
+  size_t end = first + count;
+  for (size_t start = first; start < end;) {
+    ++stamp;
+    size_t vertices = 0;
+    vec3   normals(0.f);
+    size_t i = start;
+    for (; i < end; i += 3) {
+      size_t tris = (i - start) / 3;
+      if (tris == meshlet_max_triangles)
+        break;
+
+      size_t added = 0;
+      for (int k = 0; k != 3; ++k)
+        added += seen[indices[i + k]] != stamp;
+      if (vertices + added > meshlet_max_vertices)
+        break;
+
+      vec3 n = normal(i);
+      if (tris >= meshlet_min_triangles && glm::dot(n, glm::normalize(normals)) < split_dot)
+        break;
+
+      for (int k = 0; k != 3; ++k)
+        seen[indices[i + k]] = stamp;
+      vertices += added;
+      normals  += n;
+    }
+
+    meshlet m;
+    m.offset = start;
+    m.count  = i - start;
+
+    // Sphere around the box's center, which is close enough at this size
+    vec3 lo = positions[indices[start]], hi = lo;
+    for (size_t j = start; j != i; ++j) {
+      lo = glm::min(lo, positions[indices[j]]);
+      hi = glm::max(hi, positions[indices[j]]);
+    }
+    m.center = (lo + hi) * .5f;
+    m.radius = 0.f;
+    for (size_t j = start; j != i; ++j)
+      m.radius = std::max(m.radius, glm::distance(m.center, positions[indices[j]]));
+
+    // Cone from the spread of the normals around their average, degenerate
+    // triangles don't face anywhere
+    float len   = glm::length(normals);
+    m.cone_axis = len > 0.f ? normals / len : vec3(0.f, 0.f, 1.f);
+    float min_dot = len > 0.f ? 1.f : -1.f;
+    for (size_t j = start; j != i; j += 3) {
+      vec3 n = normal(j);
+      if (n != vec3(0.f))
+        min_dot = std::min(min_dot, glm::dot(n, m.cone_axis));
+    }
+    m.cone_cutoff = min_dot <= 0.f ? 1.f : std::sqrt(1.f - min_dot * min_dot);
+
+    out.push_back(m);
+    start = i;
+  }
+
+  return out;
+}
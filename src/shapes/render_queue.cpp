@@ -0,0 +1,127 @@
+#include "render_queue.h"
+#include "jobs/job_system.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Keys per piece of a parallel sort, fewer are sorted on one thread
+constexpr size_t sort_grain = 1 << 14;
+
+uint64_t field(uint32_t value, int bits) {
+  return std::min<uint64_t>(value, (uint64_t(1) << bits) - 1);
+}
+
+}
+
+uint64_t render_queue::key(uint32_t pass, uint32_t flags, uint32_t texture,
+                           uint32_t material, float depth) {
+  // Positive floats order like their bits, the top ones are kept
+  uint32_t d = 0;
+  if (depth > 0.f) {
+    std::memcpy(&d, &depth, sizeof(d));
+    d >>= 32 - depth_bits;
+  }
+  return field(pass, pass_bits) << (64 - pass_bits) |
+         field(flags, flag_bits) << (texture_bits + material_bits + depth_bits) |
+         field(texture, texture_bits) << (material_bits + depth_bits) |
+         field(material, material_bits) << depth_bits |
+         d;
+}
+
+void render_queue::sort() {
+  size_t n = entries.size();
+  if (n < 2)
+    return;
+
+  // Every byte's counts in one pass over the keys
+  uint32_t counts[8][256] = {};
+  for (const auto &e : entries)
+    for (int b = 0; b != 8; ++b)
+      ++counts[b][(e.key >> (8 * b)) & 0xff];
+
+  scratch.resize(n);
+  for (int b = 0; b != 8; ++b) {
+    auto &c = counts[b];
+    if (c[(entries[0].key >> (8 * b)) & 0xff] == n)
+      continue;
+
+    uint32_t sum = 0;
+    for (auto &count : c) {
+      uint32_t here = count;
+      count = sum;
+      sum  += here;
+    }
+    for (const auto &e : entries)
+      scratch[c[(e.key >> (8 * b)) & 0xff]++] = e;
+    entries.swap(scratch);
+  }
+}
+
+void render_queue::sort(job_system &jobs) {
+  size_t n = entries.size();
+  size_t pieces = std::min<size_t>(n / sort_grain, jobs.concurrency() * 4);
+  if (pieces < 2) {
+    sort();
+    return;
+  }
+  auto piece = [&](size_t p) {
+    return std::make_pair(n * p / pieces, n * (p + 1) / pieces);
+  };
+
+  // Bytes every key shares are found from the differences to one key
+  uint64_t first = entries[0].key;
+  std::vector<uint64_t> differs(pieces, 0);
+  jobs.parallel_for(pieces, 1, [&](size_t a, size_t b) {
+    for (size_t p = a; p != b; ++p) {
+      auto [begin, end] = piece(p);
+      uint64_t bits = 0;
+      for (size_t i = begin; i != end; ++i)
+        bits |= entries[i].key ^ first;
+      differs[p] = bits;
+    }
+  });
+  uint64_t bits = 0;
+  for (uint64_t d : differs)
+    bits |= d;
+
+  scratch.resize(n);
+  piece_counts.resize(pieces * 256);
+  for (int b = 0; b != 8; ++b) {
+    int shift = 8 * b;
+    if (!((bits >> shift) & 0xff))
+      continue;
+
+    jobs.parallel_for(pieces, 1, [&](size_t a, size_t z) {
+      for (size_t p = a; p != z; ++p) {
+        uint32_t *c = &piece_counts[p * 256];
+        std::fill(c, c + 256, 0u);
+        auto [begin, end] = piece(p);
+        for (size_t i = begin; i != end; ++i)
+          ++c[(entries[i].key >> shift) & 0xff];
+      }
+    });
+
+    // Each piece's keys of a byte go after every piece's smaller bytes and
+    // the pieces' before it of the same byte, which keeps the sort stable
+    uint32_t sum = 0;
+    for (size_t byte = 0; byte != 256; ++byte)
+      for (size_t p = 0; p != pieces; ++p) {
+        uint32_t &count = piece_counts[p * 256 + byte];
+        uint32_t here   = count;
+        count = sum;
+        sum  += here;
+      }
+
+    jobs.parallel_for(pieces, 1, [&](size_t a, size_t z) {
+      for (size_t p = a; p != z; ++p) {
+        uint32_t *c = &piece_counts[p * 256];
+        auto [begin, end] = piece(p);
+        for (size_t i = begin; i != end; ++i)
+          scratch[c[(entries[i].key >> shift) & 0xff]++] = entries[i];
+      }
+    });
+    entries.swap(scratch);
+  }
+}
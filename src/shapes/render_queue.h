@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class job_system;
+
+// A frame's draws, each with a packed sort key, sorted so draws that share
+// state are next to each other. From the top bit down a key holds the pass,
+// the shader permutation, the texture, the material and the depth, so what
+// costs most to change changes least often, and draws with the same state
+// go front to back for early depth rejection.
+class render_queue
+{
+public:
+  static constexpr int pass_bits     = 2;
+  static constexpr int flag_bits     = 5;
+  static constexpr int texture_bits  = 12;
+  static constexpr int material_bits = 20;
+  static constexpr int depth_bits    = 25;
+
+  struct entry {
+    uint64_t key;
+    uint32_t item; // Up to the caller
+  };
+
+  // Fields too large for their bits are clamped, so those draws share a
+  // place in the order. Depth is the distance along the view, anything at
+  // or behind the eye goes first
+  static uint64_t key(uint32_t pass, uint32_t flags, uint32_t texture,
+                      uint32_t material, float depth);
+  static uint32_t pass(uint64_t key) { return key >> (64 - pass_bits); }
+
+  void clear() { entries.clear(); }
+  void push(uint64_t key, uint32_t item) { entries.push_back({ key, item }); }
+
+  // For filling in parallel: room for count entries written by index, then
+  // whatever wasn't written is packed out or cut off
+  void resize(size_t count) { entries.resize(count); }
+  entry *data() { return entries.data(); }
+
+  // Radix sort, least significant byte first. Bytes every key shares are
+  // skipped, which is most of the depth's for a static camera
+  void sort();
+
+  // The same in parallel: each pass every piece of the keys counts its
+  // bytes, and then moves its keys to where the counts before it say
+  void sort(job_system &jobs);
+
+  size_t size() const { return entries.size(); }
+  std::vector<entry>::const_iterator begin() const { return entries.begin(); }
+  std::vector<entry>::const_iterator end() const { return entries.end(); }
+
+private:
+  std::vector<entry> entries;
+  std::vector<entry> scratch;
+  std::vector<uint32_t> piece_counts; // 256 per piece
+};
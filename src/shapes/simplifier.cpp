@@ -0,0 +1,325 @@
+#include "shapes/simplifier.h"
+
+#include <algorithm>
+#include <map>
+#include <queue>
+
+using glm::dvec3;
+using glm::vec3;
+using std::vector;
+
+namespace {
+
+// Sum of squared distances to a set of planes, as the symmetric 4x4 matrix
+// of the planes' outer products
+struct quadric {
+  double a2 = 0, ab = 0, ac = 0, ad = 0;
+  double b2 = 0, bc = 0, bd = 0;
+  double c2 = 0, cd = 0;
+  double d2 = 0;
+
+  quadric() = default;
+
+  quadric(const dvec3 &n, double d, double w) :
+    a2(w * n.x * n.x), ab(w * n.x * n.y), ac(w * n.x * n.z), ad(w * n.x * d),
+    b2(w * n.y * n.y), bc(w * n.y * n.z), bd(w * n.y * d),
+    c2(w * n.z * n.z), cd(w * n.z * d),
+    d2(w * d * d) {}
+
+  quadric &operator+=(const quadric &q) {
+    a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+    b2 += q.b2; bc += q.bc; bd += q.bd;
+    c2 += q.c2; cd += q.cd;
+    d2 += q.d2;
+    return *this;
+  }
+
+  double error(const dvec3 &p) const {
+    return a2 * p.x * p.x + 2 * ab * p.x * p.y + 2 * ac * p.x * p.z + 2 * ad * p.x
+         + b2 * p.y * p.y + 2 * bc * p.y * p.z + 2 * bd * p.y
+         + c2 * p.z * p.z + 2 * cd * p.z
+         + d2;
+  }
+};
+
+// Moving position u onto v, valid while neither has changed since it was queued
+struct collapse {
+  double   cost;
+  uint32_t u;
+  uint32_t v;
+  uint32_t u_version;
+  uint32_t v_version;
+
+  bool operator>(const collapse &rhs) const { return cost > rhs.cost; }
+};
+
+// Triangles are made of vertices, vertices sit at positions. Topology and
+// error are tracked per position, triangles keep pointing at vertices
+class simplification {
+public:
+  simplification(const vector<vec3> &vertex_positions, const vector<uint32_t> &position_ids,
+                 const vector<uint32_t> &indices) :
+    at(position_ids), tris(indices),
+    alive(indices.size() / 3, true), live(indices.size() / 3) {
+    size_t positions = 0;
+    for (uint32_t p : at)
+      positions = std::max<size_t>(positions, p + 1);
+
+    pos.resize(positions);
+    for (size_t v = 0; v != at.size(); ++v)
+      pos[at[v]] = vertex_positions[v];
+
+    removed.assign(positions, false);
+    border.assign(positions, false);
+    version.assign(positions, 0);
+    quadrics.resize(positions);
+    around.resize(positions);
+
+    // Position edges with a single triangle are on a border
+    std::map<std::pair<uint32_t, uint32_t>, int> edges;
+    for (size_t t = 0; t != alive.size(); ++t) {
+      for (int k = 0; k != 3; ++k) {
+        uint32_t a = p_of(t, k);
+        uint32_t b = p_of(t, (k + 1) % 3);
+        ++edges[{ std::min(a, b), std::max(a, b) }];
+      }
+    }
+    for (const auto &[e, count] : edges) {
+      if (count == 1) {
+        border[e.first]  = true;
+        border[e.second] = true;
+      }
+    }
+
+    // Area weighted plane of every triangle goes to its positions
+    for (size_t t = 0; t != alive.size(); ++t) {
+      uint32_t p[3] = { p_of(t, 0), p_of(t, 1), p_of(t, 2) };
+      dvec3  cr  = glm::cross(pos[p[1]] - pos[p[0]], pos[p[2]] - pos[p[0]]);
+      double len = glm::length(cr);
+      if (len > 0) {
+        dvec3 nor = cr / len;
+        quadric q(nor, -glm::dot(nor, pos[p[0]]), len * .5);
+        for (int k = 0; k != 3; ++k)
+          quadrics[p[k]] += q;
+      }
+      for (int k = 0; k != 3; ++k)
+        around[p[k]].push_back(static_cast<uint32_t>(t));
+    }
+
+    for (const auto &[e, count] : edges) {
+      queue(e.first, e.second);
+      queue(e.second, e.first);
+    }
+  }
+
+  // Collapses the cheapest edges until there are at most target triangles
+  // left or nothing can collapse
+  void reduce(size_t target) {
+    while (live > target && !heap.empty()) {
+      collapse c = heap.top();
+      heap.pop();
+
+      if (removed[c.u] || removed[c.v] ||
+          version[c.u] != c.u_version || version[c.v] != c.v_version)
+        continue;
+
+      if (!can_collapse(c.u, c.v))
+        continue;
+
+      apply(c.u, c.v);
+    }
+  }
+
+  vector<uint32_t> indices() const {
+    vector<uint32_t> out;
+    out.reserve(live * 3);
+    for (size_t t = 0; t != alive.size(); ++t)
+      if (alive[t])
+        out.insert(out.end(), tris.begin() + t * 3, tris.begin() + t * 3 + 3);
+    return out;
+  }
+
+private:
+  vector<uint32_t> at;   // Position of each vertex
+  vector<uint32_t> tris; // Vertices
+  vector<bool>     alive;
+  size_t           live;
+
+  vector<dvec3>    pos;
+  vector<bool>     removed;
+  vector<bool>     border;
+  vector<uint32_t> version;
+  vector<quadric>  quadrics;
+  vector<vector<uint32_t>> around; // Triangles at each position, dead ones are skipped
+
+  std::priority_queue<collapse, vector<collapse>, std::greater<collapse>> heap;
+
+  // Scratch
+  vector<uint32_t> nu;
+  vector<uint32_t> nv;
+  vector<std::pair<uint32_t, uint32_t>> matches; // Vertex at u, vertex at v
+
+  uint32_t p_of(size_t t, int k) const { return at[tris[t * 3 + k]]; }
+
+  bool has(size_t t, uint32_t p) const {
+    return p_of(t, 0) == p || p_of(t, 1) == p || p_of(t, 2) == p;
+  }
+
+  void queue(uint32_t u, uint32_t v) {
+    quadric q = quadrics[u];
+    q += quadrics[v];
+    heap.push({ q.error(pos[v]), u, v, version[u], version[v] });
+  }
+
+  // Other positions of live triangles around p
+  void neighbours(uint32_t p, vector<uint32_t> &out) const {
+    out.clear();
+    for (uint32_t t : around[p]) {
+      if (!alive[t])
+        continue;
+      for (int k = 0; k != 3; ++k)
+        if (p_of(t, k) != p)
+          out.push_back(p_of(t, k));
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+  }
+
+  // Vertex at u in triangle t
+  uint32_t vertex_at(size_t t, uint32_t p) const {
+    for (int k = 0; k != 3; ++k)
+      if (p_of(t, k) == p)
+        return tris[t * 3 + k];
+    return 0;
+  }
+
+  // Vertex at v that a vertex at u turns into, from the triangles on the edge
+  bool match(uint32_t vertex_u, uint32_t &vertex_v) const {
+    for (const auto &m : matches) {
+      if (m.first == vertex_u) {
+        vertex_v = m.second;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool can_collapse(uint32_t u, uint32_t v) {
+    // Triangles on the edge, these go away
+    size_t on_edge = 0;
+    matches.clear();
+    for (uint32_t t : around[u]) {
+      if (!alive[t] || !has(t, v))
+        continue;
+      ++on_edge;
+
+      // Every vertex at u has to turn into the same vertex at v, whichever
+      // side of the edge it's on, or the seam would tear
+      uint32_t vu = vertex_at(t, u);
+      uint32_t vv = vertex_at(t, v);
+      uint32_t existing;
+      if (match(vu, existing)) {
+        if (existing != vv)
+          return false;
+      } else {
+        matches.push_back({ vu, vv });
+      }
+    }
+    if (on_edge == 0)
+      return false;
+
+    // Border positions only move along the border, keeping the outline
+    if (border[u] && (!border[v] || on_edge != 1))
+      return false;
+
+    // Link condition: the only neighbours u and v share are the opposite
+    // corners of the triangles on the edge, otherwise the surface pinches
+    neighbours(u, nu);
+    neighbours(v, nv);
+    size_t shared = 0;
+    for (size_t i = 0, j = 0; i != nu.size() && j != nv.size();) {
+      if (nu[i] < nv[j])      ++i;
+      else if (nv[j] < nu[i]) ++j;
+      else { ++shared; ++i; ++j; }
+    }
+    if (shared != on_edge)
+      return false;
+
+    // Triangles that stay need a vertex to move to, and must not flip or
+    // collapse to a sliver
+    for (uint32_t t : around[u]) {
+      if (!alive[t] || has(t, v))
+        continue;
+
+      uint32_t target;
+      if (!match(vertex_at(t, u), target))
+        return false;
+
+      dvec3 p[3]   = { pos[p_of(t, 0)], pos[p_of(t, 1)], pos[p_of(t, 2)] };
+      dvec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+      for (int k = 0; k != 3; ++k)
+        if (p_of(t, k) == u)
+          p[k] = pos[v];
+      dvec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+
+      double lb = glm::length(before);
+      double la = glm::length(after);
+      if (la <= 1e-12 * (lb + 1e-30) || glm::dot(before, after) < 0.2 * lb * la)
+        return false;
+    }
+
+    return true;
+  }
+
+  // Expects matches from the can_collapse that allowed it
+  void apply(uint32_t u, uint32_t v) {
+    for (uint32_t t : around[u]) {
+      if (!alive[t])
+        continue;
+      if (has(t, v)) {
+        alive[t] = false;
+        --live;
+        continue;
+      }
+
+      for (int k = 0; k != 3; ++k)
+        if (p_of(t, k) == u)
+          match(tris[t * 3 + k], tris[t * 3 + k]);
+      around[v].push_back(t);
+    }
+
+    around[u].clear();
+    removed[u] = true;
+    quadrics[v] += quadrics[u];
+    ++version[v];
+
+    // Drop dead triangles from v's list so it doesn't keep growing
+    auto &list = around[v];
+    list.erase(std::remove_if(list.begin(), list.end(),
+      [this](uint32_t t) { return !alive[t]; }), list.end());
+
+    // Every edge around v has a new cost
+    neighbours(v, nv);
+    for (uint32_t w : nv) {
+      queue(v, w);
+      queue(w, v);
+    }
+  }
+};
+
+}
+
+vector<vector<uint32_t>> simplifier::simplify(const vector<vec3> &positions,
+  const vector<uint32_t> &position_ids, const vector<uint32_t> &indices,
+  const vector<size_t> &targets) {
+  simplification s(positions, position_ids, indices);
+
+  vector<vector<uint32_t>> levels;
+  levels.reserve(targets.size());
+  for (size_t target : targets) {
+    s.reduce(target);
+    levels.push_back(s.indices());
+  }
+
+  return levels;
+}
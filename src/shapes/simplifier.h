@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Quadric error edge collapse for indexed triangle meshes. Collapses work on
+// positions, moving one onto a neighbour, so no new positions or attributes
+// are made. Vertices at the same position (UV seams, hard edges) move
+// together, each onto the matching vertex across the edge, and a collapse is
+// only allowed if that match exists, so seams slide along themselves and
+// never tear. Open borders only collapse along the border.
+namespace simplifier {
+  // Simplifies down through every target triangle count (largest first) in
+  // one pass, returning the index buffer at each. A level that can't get all
+  // the way down gets as close as the mesh allows.
+  //   positions    - per vertex
+  //   position_ids - per vertex, equal for vertices at the same position
+  //   indices      - three per triangle
+  std::vector<std::vector<uint32_t>> simplify(const std::vector<glm::vec3> &positions,
+                                              const std::vector<uint32_t> &position_ids,
+                                              const std::vector<uint32_t> &indices,
+                                              const std::vector<size_t> &targets);
+}
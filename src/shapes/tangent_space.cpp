@@ -0,0 +1,259 @@
+#include "shapes/tangent_space.h"
+#include "jobs/job_system.h"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+using glm::vec3;
+using std::vector;
+
+namespace {
+
+// Lists with fewer corners than this aren't worth starting threads for
+constexpr size_t parallel_corners = 1 << 15;
+
+// Triangles the face kernel works on at a time
+constexpr size_t block = 64;
+
+// acos to within 7e-5 (Abramowitz and Stegun 4.4.45), plenty for weights,
+// and without branches so it vectorizes
+inline float fast_acos(float x) {
+  float a = std::fabs(x);
+  float r = std::sqrt(1.f - a) * (1.5707288f + a * (-.2121144f + a * (.0742610f - .0187293f * a)));
+  return x < 0.f ? 3.14159265f - r : r;
+}
+
+// Splits [0, count) evenly into a piece per worker and runs
+// fn(first, last, worker) on each, as jobs
+template <class F>
+void run_workers(unsigned workers, size_t count, F &&fn) {
+  if (workers == 1) {
+    fn(0, count, 0);
+    return;
+  }
+  job_system::shared().parallel_for(workers, 1, [&](size_t first, size_t last) {
+    for (size_t w = first; w != last; ++w)
+      fn(count * w / workers, count * (w + 1) / workers, static_cast<unsigned>(w));
+  });
+}
+
+struct lists {
+  const float    *pos;
+  const float    *nor;
+  const float    *uv;
+  const uint32_t *indices;
+  size_t          corners;
+
+  // Per corner the angle weighted tangent, per triangle whether its UVs
+  // are mirrored
+  vector<float>   weighted;
+  vector<uint8_t> mirrored;
+
+  // Angle weighted tangents at the corners of triangles [first, last), and
+  // whether each triangle's UVs are mirrored. Blocks of triangles are split
+  // into an array per component and padded to a full block first, so the
+  // math runs over fixed size arrays and vectorizes
+  void corner_tangents(size_t first, size_t last) {
+    float p[3][3][block] = {}, n[3][3][block] = {}, t[3][2][block] = {};
+    float f[3][block], w[3][3][block];
+    uint8_t flip[block];
+
+    for (size_t b = first; b < last; b += block) {
+      size_t m = std::min(block, last - b);
+
+      for (size_t i = 0; i != m; ++i) {
+        for (int k = 0; k != 3; ++k) {
+          size_t c = indices[(b + i) * 3 + k];
+          for (int j = 0; j != 3; ++j) {
+            p[k][j][i] = pos[c * 3 + j];
+            n[k][j][i] = nor[c * 3 + j];
+          }
+          t[k][0][i] = uv[c * 2];
+          t[k][1][i] = uv[c * 2 + 1];
+        }
+      }
+
+      // Face tangent along increasing u. Only its direction matters, so
+      // the UV determinant is only used for its sign
+      for (size_t i = 0; i != block; ++i) {
+        float d1u = t[1][0][i] - t[0][0][i], d1v = t[1][1][i] - t[0][1][i];
+        float d2u = t[2][0][i] - t[0][0][i], d2v = t[2][1][i] - t[0][1][i];
+        float det = d1u * d2v - d2u * d1v;
+        float s   = det < 0.f ? -1.f : 1.f;
+        for (int j = 0; j != 3; ++j)
+          f[j][i] = s * ((p[1][j][i] - p[0][j][i]) * d2v - (p[2][j][i] - p[0][j][i]) * d1v);
+        flip[i] = det < 0.f;
+      }
+
+      for (int k = 0; k != 3; ++k) {
+        int k1 = (k + 1) % 3;
+        int k2 = (k + 2) % 3;
+        for (size_t i = 0; i != block; ++i) {
+          // Projected onto the corner's tangent plane
+          float d  = n[k][0][i] * f[0][i] + n[k][1][i] * f[1][i] + n[k][2][i] * f[2][i];
+          float tx = f[0][i] - n[k][0][i] * d;
+          float ty = f[1][i] - n[k][1][i] * d;
+          float tz = f[2][i] - n[k][2][i] * d;
+          float tt = tx * tx + ty * ty + tz * tz;
+
+          // Angle between the edges leaving the corner, none if degenerate
+          float ax = p[k1][0][i] - p[k][0][i], bx = p[k2][0][i] - p[k][0][i];
+          float ay = p[k1][1][i] - p[k][1][i], by = p[k2][1][i] - p[k][1][i];
+          float az = p[k1][2][i] - p[k][2][i], bz = p[k2][2][i] - p[k][2][i];
+          float ab     = ax * bx + ay * by + az * bz;
+          float aabb   = (ax * ax + ay * ay + az * az) * (bx * bx + by * by + bz * bz);
+          float cosine = aabb > 0.f ? ab / std::sqrt(aabb) : 1.f;
+          float angle  = fast_acos(std::min(1.f, std::max(-1.f, cosine)));
+
+          float scale = tt > 1e-30f ? angle / std::sqrt(tt) : 0.f;
+          w[k][0][i] = tx * scale;
+          w[k][1][i] = ty * scale;
+          w[k][2][i] = tz * scale;
+        }
+      }
+
+      for (size_t i = 0; i != m; ++i) {
+        mirrored[b + i] = flip[i];
+        for (int k = 0; k != 3; ++k)
+          for (int j = 0; j != 3; ++j)
+            weighted[((b + i) * 3 + k) * 3 + j] = w[k][j][i];
+      }
+    }
+  }
+
+  // Indexed lists already share vertices, so the corners of vertices
+  // [first, last) just add up. A vertex can't split, it takes the UV winding
+  // most of its corners have
+  void sum_vertices(size_t first, size_t last, int16_t *out) const {
+    vector<float> sum((last - first) * 3, 0.f);
+    vector<int>   winding(last - first, 0);
+    for (size_t c = 0; c != corners; ++c) {
+      size_t v = indices[c];
+      if (v < first || v >= last)
+        continue;
+      for (int j = 0; j != 3; ++j)
+        sum[(v - first) * 3 + j] += weighted[c * 3 + j];
+      winding[v - first] += mirrored[c / 3] ? -1 : 1;
+    }
+
+    for (size_t v = first; v != last; ++v) {
+      const float *t = &sum[(v - first) * 3];
+      tangent_space::encode(vec3(nor[v * 3], nor[v * 3 + 1], nor[v * 3 + 2]), vec3(t[0], t[1], t[2]),
+                            winding[v - first] < 0, out + v * 4);
+    }
+  }
+};
+
+}
+
+vector<int16_t> tangent_space::generate(const vector<float> &positions,
+  const vector<float> &normals, const vector<float> &uvs,
+  const vector<uint32_t> &indices, unsigned threads) {
+  lists l;
+  l.pos     = positions.data();
+  l.nor     = normals.data();
+  l.uv      = uvs.data();
+  l.indices = indices.data();
+  l.corners = indices.size() / 3 * 3;
+
+  size_t vertices = positions.size() / 3;
+  vector<int16_t> out(vertices * frame_components);
+  if (!vertices)
+    return out;
+
+  unsigned workers = threads ? threads : job_system::shared().concurrency();
+  if (l.corners < parallel_corners)
+    workers = 1;
+
+  l.weighted.resize(l.corners * 3);
+  l.mirrored.resize(l.corners / 3);
+
+  // Per triangle, then per range of vertices
+  run_workers(workers, l.corners / 3, [&](size_t first, size_t last, unsigned) {
+    l.corner_tangents(first, last);
+  });
+  run_workers(workers, vertices, [&](size_t first, size_t last, unsigned) {
+    l.sum_vertices(first, last, out.data());
+  });
+
+  return out;
+}
+
+void tangent_space::encode(const vec3 &normal, vec3 tangent, bool mirrored, int16_t *out) {
+  float q[4];
+  rotation(normal, tangent, q);
+  quantize(q, 1, mirrored, out);
+}
+
+// Orthonormal frame around the normal, as the rotation with its axes for
+// columns
+void tangent_space::rotation(const vec3 &normal, vec3 t, float *q) {
+  vec3 n = normal / std::sqrt(glm::dot(normal, normal));
+  t -= n * glm::dot(n, t);
+
+  // No UV gradient to go by, anything in the tangent plane will do
+  float tt = glm::dot(t, t);
+  if (tt < 1e-20f) {
+    t  = glm::cross(n, std::fabs(n.x) < .9f ? vec3(1, 0, 0) : vec3(0, 1, 0));
+    tt = glm::dot(t, t);
+  }
+  t /= std::sqrt(tt);
+  vec3 b = glm::cross(n, t);
+
+  // From the largest component, so nothing is divided by a small one
+  float trace = t.x + b.y + n.z;
+  if (trace > 0.f) {
+    float s = .5f / std::sqrt(trace + 1.f);
+    q[0] = (b.z - n.y) * s; q[1] = (n.x - t.z) * s; q[2] = (t.y - b.x) * s; q[3] = .25f / s;
+  } else if (t.x > b.y && t.x > n.z) {
+    float s = .5f / std::sqrt(1.f + t.x - b.y - n.z);
+    q[0] = .25f / s; q[1] = (b.x + t.y) * s; q[2] = (n.x + t.z) * s; q[3] = (b.z - n.y) * s;
+  } else if (b.y > n.z) {
+    float s = .5f / std::sqrt(1.f + b.y - t.x - n.z);
+    q[0] = (b.x + t.y) * s; q[1] = .25f / s; q[2] = (n.y + b.z) * s; q[3] = (n.x - t.z) * s;
+  } else {
+    float s = .5f / std::sqrt(1.f + n.z - t.x - b.y);
+    q[0] = (n.x + t.z) * s; q[1] = (n.y + b.z) * s; q[2] = .25f / s; q[3] = (t.y - b.x) * s;
+  }
+}
+
+// Quaternions with a positive w, as each one's negation is the same
+// rotation, then the bitangent's sign in the sign of w
+void tangent_space::quantize(const float *q, size_t count, bool mirrored, int16_t *out) {
+  // Smallest w that survives quantization, so w is never 0 and keeps its
+  // sign. Raising w that little leaves the quaternion unit length to well
+  // within a quantization step
+  constexpr float bias = 1.f / 32767.f;
+
+  float  scale = mirrored ? -32767.f : 32767.f;
+  size_t i     = 0;
+
+#if defined(__SSE2__) || defined(_M_X64)
+  // Two quaternions at a time, one register each, packed into one store
+  const __m128 low   = _mm_setr_ps(-1.f, -1.f, -1.f, bias);
+  const __m128 high  = _mm_set1_ps(1.f);
+  const __m128 minus = _mm_set1_ps(-0.f);
+  const __m128 s     = _mm_set1_ps(scale);
+
+  auto positive_w = [&](__m128 v) {
+    v = _mm_xor_ps(v, _mm_and_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)), minus));
+    return _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(v, low), high), s));
+  };
+  for (; i + 2 <= count; i += 2, q += 8, out += 8)
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out),
+                     _mm_packs_epi32(positive_w(_mm_loadu_ps(q)), positive_w(_mm_loadu_ps(q + 4))));
+#endif
+
+  // The odd one out, or everything on targets without SSE
+  for (; i != count; ++i, q += 4, out += 4) {
+    float sign = std::copysign(1.f, q[3]);
+    float v[4] = { q[0] * sign, q[1] * sign, q[2] * sign, std::max(bias, std::fabs(q[3])) };
+    for (int j = 0; j != 4; ++j)
+      out[j] = static_cast<int16_t>(std::nearbyint(std::min(1.f, std::max(-1.f, v[j])) * scale));
+  }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/vec3.hpp>
+
+// Tangent frames for indexed triangle lists, generated the way MikkTSpace
+// does it: each triangle's tangent from its UVs is projected onto every
+// corner's normal and weighted by the corner's angle, and the corners of a
+// vertex add up to one smooth tangent. Surfaces whose tangents are known,
+// like the tessellated primitives, encode them directly instead.
+//
+// A frame is stored as a single quaternion rotating (1, 0, 0) onto the
+// tangent and (0, 0, 1) onto the normal, with the bitangent's sign in the
+// sign of w, quantized to four 16 bit normalized integers per vertex.
+// parallax.vert decodes it.
+namespace tangent_space {
+  // Integers per vertex in a frame buffer
+  constexpr size_t frame_components = 4;
+
+  // Frames for every vertex of an indexed triangle list, with attributes
+  // per vertex and three indices per triangle. Large lists are split into
+  // `threads` jobs, 0 for one per thread of the job system
+  std::vector<int16_t> generate(const std::vector<float> &positions,
+                                const std::vector<float> &normals,
+                                const std::vector<float> &uvs,
+                                const std::vector<uint32_t> &indices,
+                                unsigned threads = 0);
+
+  // One frame from a normal and a tangent, which is made orthogonal to it.
+  // Mirrored frames have their bitangent along -cross(normal, tangent)
+  void encode(const glm::vec3 &normal, glm::vec3 tangent, bool mirrored, int16_t *out);
+
+  // The two halves of encode(): the frame's rotation as a unit quaternion,
+  // x, y, z then w, and the quantization of `count` of them. Frames that
+  // are others turned about an axis are cheaper multiplied than worked out
+  // again
+  void rotation(const glm::vec3 &normal, glm::vec3 tangent, float *q);
+  void quantize(const float *q, size_t count, bool mirrored, int16_t *out);
+}
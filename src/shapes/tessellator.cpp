@@ -0,0 +1,429 @@
+#include "shapes/tessellator.h"
+#include "shapes/tangent_space.h"
+
+#include <cmath>
+
+using glm::vec2;
+using glm::vec3;
+using std::vector;
+
+constexpr double pi = 3.14159265358979323846;
+
+namespace {
+
+// cos and sin for segments + 1 evenly spaced angles over [0, range],
+// the last entry repeats the first one for full turns
+struct trig_table {
+  vector<float> c;
+  vector<float> s;
+
+  trig_table(int segments, double range) : c(segments + 1), s(segments + 1) {
+    for (int i = 0; i <= segments; ++i) {
+      double a = range * i / segments;
+      c[i] = static_cast<float>(std::cos(a));
+      s[i] = static_cast<float>(std::sin(a));
+    }
+  }
+};
+
+// An encoded tangent frame
+struct frame {
+  int16_t q[tangent_space::frame_components];
+};
+
+// Frame of a surface whose u grows along t and v along b, mirrored when b
+// runs against cross(n, t)
+inline frame make_frame(const vec3 &n, const vec3 &t, const vec3 &b) {
+  frame f;
+  tangent_space::encode(n, t, glm::dot(glm::cross(n, t), b) < 0.f, f.q);
+  return f;
+}
+
+// Writes straight into presized output, one vertex at a time
+struct writer {
+  float   *v;
+  float   *n;
+  float   *t;
+  int16_t *f;
+
+  void put(const vec3 &p, const vec3 &nor, const vec2 &uv, const frame &fr) {
+    v[0] = p.x;   v[1] = p.y;   v[2] = p.z;   v += 3;
+    n[0] = nor.x; n[1] = nor.y; n[2] = nor.z; n += 3;
+    t[0] = uv.x;  t[1] = uv.y;                t += 2;
+    f[0] = fr.q[0]; f[1] = fr.q[1]; f[2] = fr.q[2]; f[3] = fr.q[3]; f += 4;
+  }
+};
+
+// A corner of a tile
+struct corner {
+  vec3  p;
+  vec3  n;
+  vec2  uv;
+  frame f;
+};
+
+// Two triangles, same winding the old per-shape make_tile functions used
+inline void tile(writer &w, const corner &tl, const corner &tr,
+                 const corner &bl, const corner &br) {
+  w.put(tl.p, tl.n, tl.uv, tl.f);
+  w.put(bl.p, bl.n, bl.uv, bl.f);
+  w.put(tr.p, tr.n, tr.uv, tr.f);
+
+  w.put(tr.p, tr.n, tr.uv, tr.f);
+  w.put(bl.p, bl.n, bl.uv, bl.f);
+  w.put(br.p, br.n, br.uv, br.f);
+}
+
+// Around the body of round shapes u runs against theta
+inline vec3 round_tangent(const trig_table &theta, int j) {
+  return vec3(theta.s[j], 0.f, -theta.c[j]);
+}
+
+// U around the body of round shapes, 1 at theta = 0 going down to 0 after a full turn
+inline float round_u(int j, int segments) {
+  return 1.f - static_cast<float>(j) / segments;
+}
+
+inline vec2 cap_uv(const vec3 &p) {
+  return vec2(p.x + .5f, -p.z + .5f);
+}
+
+template <PrimitiveType T> struct generator;
+
+template <> struct generator<PrimitiveType::PRIMITIVE_SPHERE> {
+  static size_t count(int p1, int p2) { return size_t(p1) * p2 * 6; }
+
+  static void write(writer &w, int p1, int p2) {
+    trig_table theta(p2, 2 * pi);
+    trig_table phi(p1, pi);
+
+    // Normals are the positions on a unit sphere, v runs from the top pole,
+    // against cross(n, t), so frames are mirrored. Every column's frames are
+    // the first column's turned about y by theta, (0, -sin(theta / 2), 0,
+    // cos(theta / 2)) times them, and are made a column ahead of the tiles
+    size_t        points = size_t(p1 + 1);
+    vector<float> first(points * 4), turned(points * 4);
+    for (int i = 0; i <= p1; ++i)
+      tangent_space::rotation(vec3(phi.s[i], phi.c[i], 0.f), round_tangent(theta, 0), &first[i * 4]);
+
+    // A column's corners, each used by up to four tiles, so made once
+    trig_table half(p2, pi);
+    vector<int16_t> frames(points * tangent_space::frame_components);
+    auto column = [&](int j, vector<corner> &corners) {
+      float rw = half.c[j], ry = -half.s[j];
+      for (size_t i = 0; i != points; ++i) {
+        const float *q = &first[i * 4];
+        float       *r = &turned[i * 4];
+        r[0] = rw * q[0] + ry * q[2];
+        r[1] = rw * q[1] + ry * q[3];
+        r[2] = rw * q[2] - ry * q[0];
+        r[3] = rw * q[3] - ry * q[1];
+      }
+      tangent_space::quantize(turned.data(), points, true, frames.data());
+
+      for (int i = 0; i <= p1; ++i) {
+        vec3 n(phi.s[i] * theta.c[j], phi.c[i], phi.s[i] * theta.s[j]);
+        const int16_t *q = &frames[i * tangent_space::frame_components];
+        corners[i] = corner{n * 0.5f, n, vec2(round_u(j, p2), static_cast<float>(i) / p1),
+                            frame{q[0], q[1], q[2], q[3]}};
+      }
+    };
+
+    vector<corner> here(points), next(points);
+    column(0, here);
+    for (int j = 0; j != p2; ++j) {
+      column(j + 1, next);
+      for (int i = 0; i != p1; ++i)
+        tile(w, next[i], here[i], next[i + 1], here[i + 1]);
+      here.swap(next);
+    }
+  }
+};
+
+template <> struct generator<PrimitiveType::PRIMITIVE_CYLINDER> {
+  static size_t count(int p1, int p2) { return size_t(p1) * p2 * 18; }
+
+  static void write(writer &w, int p1, int p2) {
+    trig_table theta(p2, 2 * pi);
+
+    // Body frames only depend on the angle, v runs up the body. Caps have
+    // u along x and v along -z
+    vector<frame> sides(p2 + 1);
+    for (int j = 0; j <= p2; ++j)
+      sides[j] = make_frame(vec3(theta.c[j], 0.f, theta.s[j]), round_tangent(theta, j), vec3(0.f, 1.f, 0.f));
+    frame top    = make_frame(vec3(0.f, 1.f, 0.f), vec3(1.f, 0.f, 0.f), vec3(0.f, 0.f, -1.f));
+    frame bottom = make_frame(vec3(0.f, -1.f, 0.f), vec3(1.f, 0.f, 0.f), vec3(0.f, 0.f, -1.f));
+
+    auto body = [&](int i, int j) {
+      float y = 0.5f - static_cast<float>(i) / p1;
+      return corner{vec3(0.5f * theta.c[j], y, 0.5f * theta.s[j]),
+                    vec3(theta.c[j], 0.f, theta.s[j]),
+                    vec2(round_u(j, p2), y - .5f), sides[j]};
+    };
+    auto cap = [&](int i, int j, float y) {
+      float r = 0.5f * i / p1;
+      vec3  p(r * theta.c[j], y, r * theta.s[j]);
+      return corner{p, vec3(0.f, y > 0.f ? 1.f : -1.f, 0.f), cap_uv(p), y > 0.f ? top : bottom};
+    };
+
+    for (int j = 0; j != p2; ++j) {
+      for (int i = 0; i != p1; ++i)
+        tile(w, body(i, j + 1), body(i, j), body(i + 1, j + 1), body(i + 1, j));
+
+      for (int i = 0; i != p1; ++i) {
+        tile(w, cap(i, j + 1, .5f), cap(i, j, .5f), cap(i + 1, j + 1, .5f), cap(i + 1, j, .5f));
+        tile(w, cap(i + 1, j + 1, -.5f), cap(i + 1, j, -.5f), cap(i, j + 1, -.5f), cap(i, j, -.5f));
+      }
+    }
+  }
+};
+
+template <> struct generator<PrimitiveType::PRIMITIVE_CONE> {
+  static size_t count(int p1, int p2) { return size_t(p1) * p2 * 12; }
+
+  // Down the slope from the tip, the way v grows
+  static vec3 down_slope(const trig_table &theta, int j) {
+    return vec3(0.5f * theta.c[j], -1.f, 0.5f * theta.s[j]);
+  }
+
+  static void write(writer &w, int p1, int p2) {
+    trig_table theta(p2, 2 * pi);
+
+    // Slope normals and frames only depend on the angle, v runs down the
+    // slope. The cap has u along x and v along -z
+    vector<vec3>  slope(p2 + 1);
+    vector<frame> sides(p2 + 1);
+    for (int j = 0; j <= p2; ++j) {
+      slope[j] = glm::normalize(vec3(theta.c[j], 0.5f, theta.s[j]));
+      sides[j] = make_frame(slope[j], round_tangent(theta, j), down_slope(theta, j));
+    }
+    frame bottom = make_frame(vec3(0.f, -1.f, 0.f), vec3(1.f, 0.f, 0.f), vec3(0.f, 0.f, -1.f));
+
+    auto body = [&](int i, int j, const vec3 &n, const frame &f) {
+      float y = 0.5f - static_cast<float>(i) / p1;
+      float r = 0.5f * i / p1;
+      return corner{vec3(r * theta.c[j], y, r * theta.s[j]), n,
+                    vec2(round_u(j, p2), 0.5f - y), f};
+    };
+    auto cap = [&](int i, int j) {
+      float r = 0.5f * i / p1;
+      vec3  p(r * theta.c[j], -.5f, r * theta.s[j]);
+      return corner{p, vec3(0.f, -1.f, 0.f), cap_uv(p), bottom};
+    };
+
+    for (int j = 0; j != p2; ++j) {
+      // The tip uses the wedge's average slope, with each side's tangent
+      vec3  tip = glm::normalize(vec3((theta.c[j] + theta.c[j + 1]) * 0.5f, 0.5f,
+                                      (theta.s[j] + theta.s[j + 1]) * 0.5f));
+      frame tip_left  = make_frame(tip, round_tangent(theta, j + 1), down_slope(theta, j + 1));
+      frame tip_right = make_frame(tip, round_tangent(theta, j), down_slope(theta, j));
+
+      for (int i = 0; i != p1; ++i) {
+        bool tip_row = i == 0;
+        tile(w, body(i, j + 1, tip_row ? tip : slope[j + 1], tip_row ? tip_left : sides[j + 1]),
+                body(i, j, tip_row ? tip : slope[j], tip_row ? tip_right : sides[j]),
+                body(i + 1, j + 1, slope[j + 1], sides[j + 1]), body(i + 1, j, slope[j], sides[j]));
+      }
+
+      for (int i = 0; i != p1; ++i)
+        tile(w, cap(i + 1, j + 1), cap(i + 1, j), cap(i, j + 1), cap(i, j));
+    }
+  }
+};
+
+template <> struct generator<PrimitiveType::PRIMITIVE_CUBE> {
+  static size_t count(int p1, int) { return size_t(p1) * p1 * 36; }
+
+  static vec2 cube_uv(const vec3 &p, const vec3 &n) {
+    if (n.x > 0.5f) return vec2(-p.z + 0.5f, -p.y + 0.5f);
+    if (n.x < -0.5f) return vec2(p.z + 0.5f,  -p.y + 0.5f);
+    if (std::abs(n.y) > 0.5f) return vec2(p.x + 0.5f,  -p.z + 0.5f);
+    if (n.z > 0.5f) return vec2(p.x + 0.5f,  -p.y + 0.5f);
+    return vec2(-p.x + 0.5f, -p.y + 0.5f);
+  }
+
+  static void face(writer &w, int p1, vec3 top_left, vec3 top_right, vec3 bottom_left) {
+    vec3 x_step = (top_right - top_left) / static_cast<float>(p1);
+    vec3 y_step = (bottom_left - top_left) / static_cast<float>(p1);
+    vec3 n      = glm::normalize(glm::cross(y_step, x_step));
+
+    // UVs are linear over the face, so the directions u and v grow in come
+    // from how they change along its two edges
+    vec3  x   = top_right - top_left, y = bottom_left - top_left;
+    vec2  dx  = cube_uv(top_right, n) - cube_uv(top_left, n);
+    vec2  dy  = cube_uv(bottom_left, n) - cube_uv(top_left, n);
+    float det = dx.x * dy.y - dy.x * dx.y;
+    frame f   = make_frame(n, (x * dy.y - y * dx.y) / det, (y * dx.x - x * dy.x) / det);
+
+    // And step along with the positions
+    vec2 uv        = cube_uv(top_left, n);
+    vec2 uv_x_step = dx / static_cast<float>(p1);
+    vec2 uv_y_step = dy / static_cast<float>(p1);
+
+    auto at = [&](int i, int j) {
+      float fi = static_cast<float>(i), fj = static_cast<float>(j);
+      return corner{top_left + fi * y_step + fj * x_step, n, uv + fi * uv_y_step + fj * uv_x_step, f};
+    };
+
+    for (int i = 0; i != p1; ++i)
+      for (int j = 0; j != p1; ++j)
+        tile(w, at(i, j), at(i, j + 1), at(i + 1, j), at(i + 1, j + 1));
+  }
+
+  static void write(writer &w, int p1, int) {
+    face(w, p1, vec3(-0.5f,  0.5f,  0.5f), vec3( 0.5f,  0.5f,  0.5f), vec3(-0.5f, -0.5f,  0.5f));
+    face(w, p1, vec3( 0.5f,  0.5f, -0.5f), vec3(-0.5f,  0.5f, -0.5f), vec3( 0.5f, -0.5f, -0.5f));
+    face(w, p1, vec3(-0.5f,  0.5f, -0.5f), vec3( 0.5f,  0.5f, -0.5f), vec3(-0.5f,  0.5f,  0.5f));
+    face(w, p1, vec3(-0.5f, -0.5f,  0.5f), vec3( 0.5f, -0.5f,  0.5f), vec3(-0.5f, -0.5f, -0.5f));
+    face(w, p1, vec3(-0.5f,  0.5f, -0.5f), vec3(-0.5f,  0.5f,  0.5f), vec3(-0.5f, -0.5f, -0.5f));
+    face(w, p1, vec3( 0.5f,  0.5f,  0.5f), vec3( 0.5f,  0.5f, -0.5f), vec3( 0.5f, -0.5f,  0.5f));
+  }
+};
+
+template <PrimitiveType T>
+void run(int p1, int p2, tessellation &out) {
+  size_t n = generator<T>::count(p1, p2);
+  out.vertex_data.resize(n * 3);
+  out.normal_data.resize(n * 3);
+  out.uv_data.resize(n * 2);
+  out.frame_data.resize(n * tangent_space::frame_components);
+
+  writer w{out.vertex_data.data(), out.normal_data.data(), out.uv_data.data(), out.frame_data.data()};
+  generator<T>::write(w, p1, p2);
+}
+
+}
+
+int tessellator::clamp_param1(PrimitiveType type, int param1) {
+  int min = type == PrimitiveType::PRIMITIVE_SPHERE ? 2 : 1;
+  return param1 < min ? min : param1;
+}
+
+int tessellator::clamp_param2(PrimitiveType type, int param2) {
+  if (type == PrimitiveType::PRIMITIVE_CUBE)
+    return 0;
+  return param2 < 3 ? 3 : param2;
+}
+
+size_t tessellator::vertex_count(PrimitiveType type, int param1, int param2) {
+  int p1 = clamp_param1(type, param1);
+  int p2 = clamp_param2(type, param2);
+
+  switch (type) {
+  case PrimitiveType::PRIMITIVE_CUBE:     return generator<PrimitiveType::PRIMITIVE_CUBE>::count(p1, p2);
+  case PrimitiveType::PRIMITIVE_CONE:     return generator<PrimitiveType::PRIMITIVE_CONE>::count(p1, p2);
+  case PrimitiveType::PRIMITIVE_CYLINDER: return generator<PrimitiveType::PRIMITIVE_CYLINDER>::count(p1, p2);
+  case PrimitiveType::PRIMITIVE_SPHERE:   return generator<PrimitiveType::PRIMITIVE_SPHERE>::count(p1, p2);
+  default:                                return 0;
+  }
+}
+
+void tessellator::tessellate(PrimitiveType type, int param1, int param2, tessellation &out) {
+  int p1 = clamp_param1(type, param1);
+  int p2 = clamp_param2(type, param2);
+
+  switch (type) {
+  case PrimitiveType::PRIMITIVE_CUBE:     run<PrimitiveType::PRIMITIVE_CUBE>(p1, p2, out);     break;
+  case PrimitiveType::PRIMITIVE_CONE:     run<PrimitiveType::PRIMITIVE_CONE>(p1, p2, out);     break;
+  case PrimitiveType::PRIMITIVE_CYLINDER: run<PrimitiveType::PRIMITIVE_CYLINDER>(p1, p2, out); break;
+  case PrimitiveType::PRIMITIVE_SPHERE:   run<PrimitiveType::PRIMITIVE_SPHERE>(p1, p2, out);   break;
+  default:
+    out.vertex_data.clear();
+    out.normal_data.clear();
+    out.uv_data.clear();
+    out.frame_data.clear();
+    break;
+  }
+}
+
+// Patches around the body of round cages, and rows of them down a sphere.
+// GPU tessellation only has to refine these, so a handful is enough
+static constexpr int cage_around      = 8;
+static constexpr int cage_sphere_rows = 4;
+
+// Highest level every GL 4 implementation supports
+static constexpr float max_patch_level = 64.f;
+
+namespace {
+
+using tessellator::patch_part;
+
+// Same surfaces tess.tese evaluates, only used to place corners so the
+// control stage can measure edges on screen. A full turn lands exactly where
+// it started so patches on either side of the seam agree
+vec3 cage_point(patch_part part, float u, float v) {
+  double theta = 2 * pi * (u == 1.f ? 0.f : u);
+  float  c     = static_cast<float>(std::cos(theta));
+  float  s     = static_cast<float>(std::sin(theta));
+
+  switch (part) {
+  case patch_part::sphere: {
+    double phi = pi * v;
+    float  r   = static_cast<float>(std::sin(phi));
+    return vec3(r * c, static_cast<float>(std::cos(phi)), r * s) * .5f;
+  }
+  case patch_part::cylinder: return vec3(.5f * c, .5f - v, .5f * s);
+  case patch_part::cone:     return vec3(.5f * v * c, .5f - v, .5f * v * s);
+  case patch_part::top_cap:  return vec3(.5f * v * c, .5f, .5f * v * s);
+  default:                   return vec3(.5f * v * c, -.5f, .5f * v * s);
+  }
+}
+
+// A row of patches all the way around over [v0, v1]. Corners go (u0, v0),
+// (u1, v0), (u1, v1), (u0, v1), with u running backwards on the bottom cap so
+// every patch faces out
+void cage_row(vector<float> &out, patch_part part, float v0, float v1) {
+  bool flip = part == patch_part::bottom_cap;
+  for (int j = 0; j != cage_around; ++j) {
+    float u0 = static_cast<float>(flip ? j + 1 : j) / cage_around;
+    float u1 = static_cast<float>(flip ? j : j + 1) / cage_around;
+
+    for (vec2 c : { vec2(u0, v0), vec2(u1, v0), vec2(u1, v1), vec2(u0, v1) }) {
+      vec3 p = cage_point(part, c.x, c.y);
+      out.insert(out.end(), { c.x, c.y, static_cast<float>(part), p.x, p.y, p.z });
+    }
+  }
+}
+
+}
+
+bool tessellator::has_cage(PrimitiveType type) {
+  return type == PrimitiveType::PRIMITIVE_SPHERE ||
+         type == PrimitiveType::PRIMITIVE_CYLINDER ||
+         type == PrimitiveType::PRIMITIVE_CONE;
+}
+
+size_t tessellator::make_cage(PrimitiveType type, vector<float> &out) {
+  out.clear();
+
+  switch (type) {
+  case PrimitiveType::PRIMITIVE_SPHERE:
+    for (int i = 0; i != cage_sphere_rows; ++i)
+      cage_row(out, patch_part::sphere, static_cast<float>(i) / cage_sphere_rows,
+               static_cast<float>(i + 1) / cage_sphere_rows);
+    break;
+  case PrimitiveType::PRIMITIVE_CYLINDER:
+    cage_row(out, patch_part::cylinder, 0.f, 1.f);
+    cage_row(out, patch_part::top_cap, 0.f, 1.f);
+    cage_row(out, patch_part::bottom_cap, 0.f, 1.f);
+    break;
+  case PrimitiveType::PRIMITIVE_CONE:
+    cage_row(out, patch_part::cone, 0.f, 1.f);
+    cage_row(out, patch_part::bottom_cap, 0.f, 1.f);
+    break;
+  default:
+    break;
+  }
+
+  return out.size() / 6;
+}
+
+glm::vec2 tessellator::cage_levels(PrimitiveType type, int param1, int param2) {
+  int   p1   = clamp_param1(type, param1);
+  int   p2   = clamp_param2(type, param2);
+  float rows = type == PrimitiveType::PRIMITIVE_SPHERE ? cage_sphere_rows : 1.f;
+
+  return glm::clamp(vec2(std::ceil(static_cast<float>(p2) / cage_around),
+                         std::ceil(p1 / rows)),
+                    vec2(1.f), vec2(max_patch_level));
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "utils/scenedata.h"
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Triangle list for one primitive at unit size, three floats per vertex for
+// positions and normals, two for UVs and a tangent_space frame
+struct tessellation {
+  std::vector<float>   vertex_data;
+  std::vector<float>   normal_data;
+  std::vector<float>   uv_data;
+  std::vector<int16_t> frame_data;
+
+  size_t vertices() const { return vertex_data.size() / 3; }
+};
+
+// Builds the primitive shapes. Every angle a shape needs is computed once per
+// call into a trig table, and the output is sized exactly up front, so the
+// generators only do table lookups and stores. Tangents are known from the
+// surface, the direction u grows in, the same ones tess.tese uses, so frames
+// are encoded once per distinct one and copied like the rest.
+namespace tessellator {
+  // Parameters after clamping to each primitive's minimum
+  int clamp_param1(PrimitiveType type, int param1);
+  int clamp_param2(PrimitiveType type, int param2);
+
+  // Exact number of vertices tessellate() produces
+  size_t vertex_count(PrimitiveType type, int param1, int param2);
+
+  // Fills out for a cube, cone, cylinder or sphere, anything else is left empty
+  void tessellate(PrimitiveType type, int param1, int param2, tessellation &out);
+
+  // Surfaces the patches of a cage are on, tess.tese evaluates them by these
+  // numbers
+  enum class patch_part { sphere, cylinder, cone, top_cap, bottom_cap };
+
+  // Whether a primitive can be tessellated on the GPU from a patch cage,
+  // true for the round ones
+  bool has_cage(PrimitiveType type);
+
+  // Coarse quad patches over a round primitive for GPU tessellation. Each
+  // patch is a rectangle in the surface's (u, v) parameters, four corners of
+  // u, v, part and then the corner's position, six floats each. Returns the
+  // number of corners
+  size_t make_cage(PrimitiveType type, std::vector<float> &out);
+
+  // Most segments the tessellation control stage may split a patch edge
+  // into along u and v, so the GPU never goes finer than the parameters
+  // would on the CPU
+  glm::vec2 cage_levels(PrimitiveType type, int param1, int param2);
+}
@@ -0,0 +1,35 @@
+#include "sim_clock.h"
+
+#include <algorithm>
+
+sim_clock::sim_clock(double step_seconds, int max_steps_p)
+  : dt(step_seconds), max_steps(max_steps_p), accumulator(0.0) {
+  reset();
+}
+
+void sim_clock::reset() {
+  accumulator = 0.0;
+  last = clock_type::now();
+}
+
+int sim_clock::advance() {
+  auto now = clock_type::now();
+  accumulator += std::chrono::duration<double>(now - last).count();
+  last = now;
+
+  int steps = static_cast<int>(accumulator / dt);
+  if (steps > max_steps) {
+    steps = max_steps;
+    accumulator = 0.0;
+  } else {
+    accumulator -= steps * dt;
+  }
+
+  return steps;
+}
+
+sim_clock::clock_type::duration sim_clock::until_next() const {
+  double elapsed = accumulator + std::chrono::duration<double>(clock_type::now() - last).count();
+  auto left = std::chrono::duration<double>(std::max(0.0, dt - elapsed));
+  return std::chrono::duration_cast<clock_type::duration>(left);
+}
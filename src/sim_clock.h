@@ -0,0 +1,35 @@
+#pragma once
+
+#include <chrono>
+
+// Fixed timestep clock. Real time is accumulated and handed out as whole
+// steps, so a simulation advances by the same amount however often it is
+// polled. alpha() is how far real time has run past the last step, for
+// interpolating between the last two simulated states.
+class sim_clock
+{
+public:
+  using clock_type = std::chrono::steady_clock;
+
+  // After a long stall at most max_steps are run, the rest of the time is dropped
+  explicit sim_clock(double step_seconds = 1.0 / 60.0, int max_steps = 5);
+
+  void reset();
+
+  // Number of steps due since the last call
+  int advance();
+
+  // Fraction of a step left over after the last advance(), in [0, 1)
+  float alpha() const { return static_cast<float>(accumulator / dt); }
+
+  // Time until the next step is due
+  clock_type::duration until_next() const;
+
+  double step() const { return dt; }
+
+private:
+  double dt;
+  int    max_steps;
+  double accumulator;
+  clock_type::time_point last;
+};
@@ -0,0 +1,163 @@
+#include "stream_buffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+stream_buffer::stream_buffer() : target(GL_ARRAY_BUFFER), buffer_id(0),
+  use_storage(false), mapped(false), segment_size(0), segment(0), head(0),
+  persistent_ptr(nullptr), current{}, previous{} {
+  fences.fill(nullptr);
+  touched.fill(false);
+}
+
+void stream_buffer::initialize(GLenum t, size_t segment_bytes) {
+  target      = t;
+  use_storage = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+  create(segment_bytes);
+}
+
+void stream_buffer::cleanup() {
+  destroy();
+}
+
+void stream_buffer::create(size_t segment_bytes) {
+  segment_size = segment_bytes;
+  segment      = 0;
+  head         = 0;
+  touched.fill(false);
+
+  glGenBuffers(1, &buffer_id);
+  glBindBuffer(target, buffer_id);
+
+  if (use_storage) {
+    // Mapped once for the lifetime of the buffer, coherent so no flushes are needed
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(target, segment_size * segments, nullptr, flags);
+    persistent_ptr = static_cast<char *>(
+      glMapBufferRange(target, 0, segment_size * segments, flags));
+  } else {
+    glBufferData(target, segment_size * segments, nullptr, GL_STREAM_DRAW);
+  }
+
+  glBindBuffer(target, 0);
+}
+
+void stream_buffer::destroy() {
+  for (auto &f : fences) {
+    if (f)
+      glDeleteSync(f);
+    f = nullptr;
+  }
+
+  if (use_storage && persistent_ptr) {
+    glBindBuffer(target, buffer_id);
+    glUnmapBuffer(target);
+    glBindBuffer(target, 0);
+  }
+  persistent_ptr = nullptr;
+
+  glDeleteBuffers(1, &buffer_id);
+  buffer_id = 0;
+}
+
+// Blocks until the GPU is done with a segment, counting it as a stall if it wasn't already
+void stream_buffer::wait_segment(size_t s) {
+  if (!fences[s])
+    return;
+
+  GLenum result = glClientWaitSync(fences[s], 0, 0);
+  if (result == GL_TIMEOUT_EXPIRED) {
+    ++current.stalls;
+    do {
+      result = glClientWaitSync(fences[s], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    } while (result == GL_TIMEOUT_EXPIRED);
+  }
+
+  glDeleteSync(fences[s]);
+  fences[s] = nullptr;
+}
+
+stream_buffer::allocation stream_buffer::map(size_t bytes, size_t alignment) {
+  size_t start = (head + alignment - 1) / alignment * alignment;
+
+  // Out of room in this segment, move on to the next one unless it still
+  // holds data for this same frame
+  if (start + bytes > segment_size && bytes <= segment_size &&
+      !touched[(segment + 1) % segments]) {
+    segment = (segment + 1) % segments;
+    start   = 0;
+  }
+
+  // Doesn't fit at all, grow the whole ring. Draws already issued keep
+  // reading the old buffer, since deleting it is deferred by the driver
+  if (start + bytes > segment_size) {
+    ++current.stalls;
+    destroy();
+    create(std::max(bytes, segment_size) * 2);
+    start = 0;
+  }
+
+  // First write into this segment, make sure the GPU has released it
+  if (start == 0)
+    wait_segment(segment);
+
+  GLintptr offset = segment * segment_size + start;
+  head = start + bytes;
+  touched[segment] = true;
+  current.bytes += bytes;
+  ++current.allocs;
+
+  if (use_storage)
+    return { persistent_ptr + offset, offset };
+
+  // GL 4.1: orphan the whole buffer when the ring wraps, every other segment
+  // of the current storage is untouched so an unsynchronized map is safe
+  glBindBuffer(target, buffer_id);
+  if (offset == 0)
+    glBufferData(target, segment_size * segments, nullptr, GL_STREAM_DRAW);
+  void *ptr = glMapBufferRange(target, offset, bytes, GL_MAP_WRITE_BIT |
+    GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+  mapped = true;
+
+  return { ptr, offset };
+}
+
+void stream_buffer::unmap() {
+  if (!mapped)
+    return;
+
+  glBindBuffer(target, buffer_id);
+  glUnmapBuffer(target);
+  glBindBuffer(target, 0);
+  mapped = false;
+}
+
+GLintptr stream_buffer::upload(const void *data, size_t bytes, size_t alignment) {
+  auto a = map(bytes, alignment);
+  std::memcpy(a.ptr, data, bytes);
+  unmap();
+  return a.offset;
+}
+
+void stream_buffer::end_frame() {
+  // Guard every segment written this frame, after the draws that read it
+  bool any = false;
+  for (size_t s = 0; s != segments; ++s) {
+    if (!touched[s])
+      continue;
+
+    if (use_storage)
+      fences[s] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    touched[s] = false;
+    any = true;
+  }
+
+  // Nothing written this frame, stay on the same segment
+  if (!any)
+    return;
+
+  segment  = (segment + 1) % segments;
+  head     = 0;
+  previous = current;
+  current  = {};
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <array>
+#include <cstddef>
+
+// Ring buffer for data that is rewritten every frame (particle instances, per
+// object uniforms, debug lines). The buffer is split into segments, one per
+// frame in flight. With ARB_buffer_storage it is persistently mapped and each
+// segment is guarded by a fence; on plain GL 4.1 each segment is mapped
+// unsynchronized and the whole buffer is orphaned when the ring wraps.
+class stream_buffer
+{
+public:
+  static constexpr size_t segments = 3;
+
+  // A region written by the CPU this frame, offset is where it lives in id()
+  struct allocation {
+    void    *ptr;
+    GLintptr offset;
+  };
+
+  // Per frame counters
+  struct stats {
+    size_t bytes;  // Bytes written
+    size_t allocs; // Number of allocations
+    size_t stalls; // Times the CPU had to wait for the GPU
+  };
+
+  stream_buffer();
+
+  // segment_bytes is the most that can be written in one frame, it grows if exceeded
+  void initialize(GLenum target, size_t segment_bytes);
+  void cleanup();
+
+  // Reserve bytes in this frame's segment, write them, then unmap() before drawing
+  allocation map(size_t bytes, size_t alignment = 16);
+  void unmap();
+
+  // Shorthand for map + memcpy + unmap, returns the offset
+  GLintptr upload(const void *data, size_t bytes, size_t alignment = 16);
+
+  // Call once every draw reading this frame's data has been issued
+  void end_frame();
+
+  GLuint id() const { return buffer_id; }
+  bool   persistent() const { return use_storage; }
+  const stats &last_frame() const { return previous; }
+
+private:
+  GLenum target;
+  GLuint buffer_id;
+  bool   use_storage;
+  bool   mapped;
+
+  size_t segment_size;
+  size_t segment;       // Current segment
+  size_t head;          // Write position inside the current segment
+  char  *persistent_ptr;
+
+  std::array<GLsync, segments> fences;
+  std::array<bool, segments>   touched; // Written this frame, fenced in end_frame()
+
+  stats current;
+  stats previous;
+
+  void create(size_t segment_bytes);
+  void destroy();
+  void wait_segment(size_t s);
+};
@@ -1,18 +1,67 @@
+#include <cstring>
 #include <iostream>
 #include "texture.h"
+#include "utils/blob.h"
 
 using std::string;
 using std::cout;    using std::endl;
 
-texture::texture(const SceneFileMap &filemap, size_t tex_unit) : tex_unit(tex_unit) {
-  string filepath = filemap.filename;
+// Decoded images are cached next to their file as raw RGBA, which loads
+// without decoding, until the file changes
+constexpr uint32_t cache_magic   = 0x58455443; // "CTEX"
+constexpr uint32_t cache_version = 1;
+
+// Loads an image as RGBA, bottom row first the way OpenGL wants it
+QImage load_image(const string &filepath) {
+  string cache = filepath + ".texbin";
+  if (blob::newer_than(cache, { filepath })) {
+    blob::mapping file(cache);
+    blob::reader in(file.data(), file.size(), cache_magic, cache_version);
+    int32_t width = 0, height = 0;
+    size_t bytes = 0;
+    in.get(width);
+    in.get(height);
+    const unsigned char *pixels = in.view<unsigned char>(bytes);
+    if (in.ok() && width > 0 && height > 0 && bytes == size_t(width) * height * 4) {
+      QImage img(width, height, QImage::Format_RGBA8888);
+      std::memcpy(img.bits(), pixels, bytes);
+      cout << "Done loading texture: " << cache << endl;
+      return img;
+    }
+  }
+
   QImage img;
-  if (!img.load(QString::fromStdString(filepath)))
+  if (!img.load(QString::fromStdString(filepath))) {
     cout << "Failed to load in texture: " << filepath << endl;
-  else
-    cout << "Done loading texture: " << filepath << endl;
+    return img;
+  }
+  cout << "Done loading texture: " << filepath << endl;
 
   img = img.convertToFormat(QImage::Format_RGBA8888).mirrored();
+  blob::writer out(cache_magic, cache_version);
+  out.put<int32_t>(img.width());
+  out.put<int32_t>(img.height());
+  out.put_array(img.constBits(), size_t(img.sizeInBytes()));
+  out.save(cache);
+  return img;
+}
+
+texture::images texture::images::load(const SceneFileMap &filemap) {
+  images img;
+  img.color = load_image(filemap.filename);
+  if (filemap.parallax) {
+    img.normal       = load_image(filemap.normal_fn);
+    img.displacement = load_image(filemap.disp_fn);
+  }
+  return img;
+}
+
+texture::texture(const SceneFileMap &filemap, size_t tex_unit)
+  : texture(filemap, tex_unit, images::load(filemap)) {}
+
+texture::texture(const SceneFileMap &filemap, size_t tex_unit, const images &decoded)
+  : tex_unit(tex_unit) {
+  const QImage &img = decoded.color;
 
   // Generate texture through OpenGL
   glGenTextures(1, &tex_id);
@@ -28,21 +77,8 @@ texture::texture(const SceneFileMap &filemap, size_t tex_unit) : tex_unit(tex_un
 
   // Bind parallax mapping files if enabled
   if (filemap.parallax) {
-    string norm_fp = filemap.normal_fn;
-    string disp_fp = filemap.disp_fn;
-    QImage nor_img, dis_img;
-
-    if (!nor_img.load(QString::fromStdString(norm_fp)))
-      cout << "Failed to load in texture: " << norm_fp << endl;
-    else
-      cout << "Done loading texture: " << norm_fp << endl;
-    if (!dis_img.load(QString::fromStdString(disp_fp)))
-      cout << "Failed to load in texture: " << disp_fp << endl;
-    else
-      cout << "Done loading texture: " << disp_fp << endl;
-
-    nor_img = nor_img.convertToFormat(QImage::Format_RGBA8888).mirrored();
-    dis_img = dis_img.convertToFormat(QImage::Format_RGBA8888).mirrored();
+    const QImage &nor_img = decoded.normal;
+    const QImage &dis_img = decoded.displacement;
 
     // Generate textures through OpenGL
     glGenTextures(1, &nor_id);
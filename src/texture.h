@@ -14,7 +14,18 @@ public:
   GLuint tex_id;
   GLuint nor_id;
   GLuint dis_id;
+
+  // A file map's images decoded, which any thread can do. Making them into
+  // textures needs GL, which only the GUI thread has
+  struct images {
+    QImage color;
+    QImage normal;       // Parallax mapping
+    QImage displacement; // Parallax mapping
+    static images load(const SceneFileMap &filemap);
+  };
+
   texture(const SceneFileMap &filemap, size_t tex_unit);
+  texture(const SceneFileMap &filemap, size_t tex_unit, const images &img);
 
   void bind() const;
   void unbind() const;
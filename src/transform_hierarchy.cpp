@@ -0,0 +1,200 @@
+#include "transform_hierarchy.h"
+
+#include <algorithm>
+#include <glm/gtc/matrix_inverse.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+using std::vector;	using glm::mat4;
+
+namespace {
+
+bool affine(const mat4 &m) {
+  return m[0][3] == 0.f && m[1][3] == 0.f && m[2][3] == 0.f && m[3][3] == 1.f;
+}
+
+#if defined(__SSE2__) || defined(_M_X64)
+
+// out = a * b, a column of out at a time from the columns of a
+inline void multiply(const mat4 &a, const mat4 &b, mat4 &out) {
+  const __m128 a0 = _mm_loadu_ps(&a[0][0]);
+  const __m128 a1 = _mm_loadu_ps(&a[1][0]);
+  const __m128 a2 = _mm_loadu_ps(&a[2][0]);
+  const __m128 a3 = _mm_loadu_ps(&a[3][0]);
+  for (int c = 0; c < 4; c++) {
+    __m128 r = _mm_mul_ps(a0, _mm_set1_ps(b[c][0]));
+    r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(b[c][1])));
+    r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(b[c][2])));
+    r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(b[c][3])));
+    _mm_storeu_ps(&out[c][0], r);
+  }
+}
+
+inline __m128 cross(__m128 a, __m128 b) {
+  __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+  __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+  __m128 c     = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+  return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+// Dot product in every lane, w has to be 0 in one of them
+inline __m128 dot(__m128 a, __m128 b) {
+  __m128 m = _mm_mul_ps(a, b);
+  m = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+// Inverse of an affine matrix. The rows of the 3x3 part's inverse are the
+// cross products of its columns over the determinant, the translation is
+// taken back through them. Rows are built with the translation in w and
+// transposed into columns
+inline void invert(const mat4 &m, mat4 &out) {
+  if (!affine(m)) {
+    out = glm::inverse(m);
+    return;
+  }
+  const __m128 c0 = _mm_loadu_ps(&m[0][0]);
+  const __m128 c1 = _mm_loadu_ps(&m[1][0]);
+  const __m128 c2 = _mm_loadu_ps(&m[2][0]);
+  const __m128 t  = _mm_loadu_ps(&m[3][0]);
+  __m128 r0 = cross(c1, c2);
+  __m128 r1 = cross(c2, c0);
+  __m128 r2 = cross(c0, c1);
+  __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.f), dot(c0, r0));
+  r0 = _mm_mul_ps(r0, inv_det);
+  r1 = _mm_mul_ps(r1, inv_det);
+  r2 = _mm_mul_ps(r2, inv_det);
+
+  const __m128 w = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+  const __m128 zero = _mm_setzero_ps();
+  r0 = _mm_or_ps(r0, _mm_and_ps(w, _mm_sub_ps(zero, dot(r0, t))));
+  r1 = _mm_or_ps(r1, _mm_and_ps(w, _mm_sub_ps(zero, dot(r1, t))));
+  r2 = _mm_or_ps(r2, _mm_and_ps(w, _mm_sub_ps(zero, dot(r2, t))));
+  __m128 r3 = _mm_set_ps(1.f, 0.f, 0.f, 0.f);
+  _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+  _mm_storeu_ps(&out[0][0], r0);
+  _mm_storeu_ps(&out[1][0], r1);
+  _mm_storeu_ps(&out[2][0], r2);
+  _mm_storeu_ps(&out[3][0], r3);
+}
+
+#else
+
+inline void multiply(const mat4 &a, const mat4 &b, mat4 &out) {
+  out = a * b;
+}
+
+inline void invert(const mat4 &m, mat4 &out) {
+  out = affine(m) ? glm::affineInverse(m) : glm::inverse(m);
+}
+
+#endif
+
+}
+
+void transform_hierarchy::set_data(RenderData &data) {
+  scene = &data;
+  const auto &nodes = data.nodes;
+  size_t count = nodes.size();
+  locals = nodes.local;
+  worlds.resize(count);
+  dirty_flags.assign(count, 0);
+  flagged.clear();
+
+  // Subtrees end where their last child's does
+  subtree_end.resize(count);
+  for (size_t n = 0; n < count; n++)
+    subtree_end[n] = n + 1;
+  for (size_t n = count; n-- > 0; ) {
+    uint32_t p = nodes.parent[n];
+    if (p != RenderNodes::none)
+      subtree_end[p] = std::max(subtree_end[p], subtree_end[n]);
+  }
+
+  for (size_t n = 0; n < count; n++) {
+    uint32_t p = nodes.parent[n];
+    if (p == RenderNodes::none)
+      worlds[n] = locals[n];
+    else
+      multiply(worlds[p], locals[n], worlds[n]);
+  }
+}
+
+void transform_hierarchy::set_local(uint32_t node, const mat4 &m) {
+  locals[node] = m;
+  if (!dirty_flags[node]) {
+    dirty_flags[node] = 1;
+    flagged.push_back(node);
+  }
+}
+
+void transform_hierarchy::update(vector<size_t> &shapes, vector<size_t> &instances) {
+  shapes.clear();
+  instances.clear();
+  if (flagged.empty())
+    return;
+
+  // A flagged node under another flagged node is updated with it. Nodes
+  // are usually set in order
+  if (!std::is_sorted(flagged.begin(), flagged.end()))
+    std::sort(flagged.begin(), flagged.end());
+  uint32_t covered = 0;
+  for (uint32_t n : flagged) {
+    dirty_flags[n] = 0;
+    if (n < covered)
+      continue;
+    covered = subtree_end[n];
+    update_run(n, covered, shapes, instances);
+  }
+  flagged.clear();
+
+  // Shapes come in node order, which is their order. Instances are grouped
+  // by prototype and within one they're in node order too, so grouping the
+  // list by prototype sorts it
+  const auto &prototype = scene->instances.prototype;
+  prototype_first.assign(scene->prototypes.size() + 1, 0);
+  for (size_t i : instances)
+    prototype_first[prototype[i] + 1]++;
+  for (size_t p = 1; p < prototype_first.size(); p++)
+    prototype_first[p] += prototype_first[p - 1];
+  sorted.resize(instances.size());
+  for (size_t i : instances)
+    sorted[prototype_first[prototype[i]]++] = i;
+  instances.swap(sorted);
+}
+
+// The run's first node has a parent outside it, which is up to date
+void transform_hierarchy::update_run(uint32_t first, uint32_t last,
+                                     vector<size_t> &shapes, vector<size_t> &instances) {
+  const auto &nodes = scene->nodes;
+  for (uint32_t n = first; n < last; n++) {
+    uint32_t p = nodes.parent[n];
+    if (p == RenderNodes::none)
+      worlds[n] = locals[n];
+    else
+      multiply(worlds[p], locals[n], worlds[n]);
+  }
+
+  // Only nodes with shapes or an instance need inverses
+  auto &s = scene->shapes;
+  auto &i = scene->instances;
+  mat4 inv;
+  for (uint32_t n = first; n < last; n++) {
+    uint32_t shape_count = nodes.shape_count[n], instance = nodes.instance[n];
+    if (shape_count == 0 && instance == RenderNodes::none)
+      continue;
+    invert(worlds[n], inv);
+    for (uint32_t k = nodes.first_shape[n]; k < nodes.first_shape[n] + shape_count; k++) {
+      s.ctm[k]     = worlds[n];
+      s.inv_ctm[k] = inv;
+      shapes.push_back(k);
+    }
+    if (instance != RenderNodes::none) {
+      i.ctm[instance]     = worlds[n];
+      i.inv_ctm[instance] = inv;
+      instances.push_back(instance);
+    }
+  }
+}
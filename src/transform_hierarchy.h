@@ -0,0 +1,53 @@
+#pragma once
+
+#include "utils/sceneparser.h"
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Prototype 0's nodes at runtime, for moving parts of a scene without
+// parsing it again. Each node has a local matrix and a world matrix.
+// set_local() changes a node's local matrix and flags it, update() then
+// recomputes the world matrices under flagged nodes only and writes them
+// into the scene's shapes and instances. Nodes are in the scene's order,
+// parents before their children, so a flagged subtree is a run updated
+// front to back in one pass.
+class transform_hierarchy
+{
+public:
+  // Takes scene's nodes, update() writes into its shapes and instances.
+  // Local matrices start as they are in the scene
+  void set_data(RenderData &scene);
+
+  size_t size() const { return locals.size(); }
+
+  const glm::mat4 &local(uint32_t node) const { return locals[node]; }
+  const glm::mat4 &world(uint32_t node) const { return worlds[node]; }
+
+  // The node and everything under it move on the next update()
+  void set_local(uint32_t node, const glm::mat4 &m);
+
+  // Whether any node was changed since the last update()
+  bool dirty() const { return !flagged.empty(); }
+
+  // Recomputes the world matrices under changed nodes, and the inverses of
+  // the ones shapes and instances use, and writes those into the scene.
+  // Their ids are listed in increasing order
+  void update(std::vector<size_t> &shapes, std::vector<size_t> &instances);
+
+private:
+  void update_run(uint32_t first, uint32_t last,
+                  std::vector<size_t> &shapes, std::vector<size_t> &instances);
+
+  RenderData *scene = nullptr;
+  std::vector<glm::mat4> locals;
+  std::vector<glm::mat4> worlds;
+  std::vector<uint32_t>  subtree_end; // One past the last node under each
+  std::vector<uint8_t>   dirty_flags; // Set by set_local until the next update
+  std::vector<uint32_t>  flagged;     // Nodes with their flag set
+
+  // For sorting the instances update() lists
+  std::vector<uint32_t> prototype_first;
+  std::vector<size_t>   sorted;
+};
@@ -0,0 +1,87 @@
+#include "utils/blob.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include <QFile>
+
+namespace fs = std::filesystem;
+
+namespace blob {
+
+bool newer_than(const std::string &file, const std::vector<std::string> &sources) {
+  std::error_code error;
+  auto written = fs::last_write_time(file, error);
+  if (error)
+    return false;
+  for (const auto &s : sources) {
+    auto source = fs::last_write_time(s, error);
+    if (error || source >= written)
+      return false;
+  }
+  return true;
+}
+
+writer::writer(uint32_t magic, uint32_t version) {
+  put(magic);
+  put(version);
+}
+
+void writer::append(const void *data, size_t size) {
+  const char *p = static_cast<const char*>(data);
+  bytes.insert(bytes.end(), p, p + size);
+  bytes.resize((bytes.size() + 7) & ~size_t(7), 0);
+}
+
+bool writer::save(const std::string &path) const {
+  std::string temporary = path + ".tmp";
+  {
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    if (!out.write(bytes.data(), bytes.size())) {
+      std::cerr << "could not write " << temporary << std::endl;
+      return false;
+    }
+  }
+
+  std::error_code error;
+  fs::rename(temporary, path, error);
+  if (error) {
+    std::cerr << "could not write " << path << ": " << error.message() << std::endl;
+    fs::remove(temporary, error);
+    return false;
+  }
+  return true;
+}
+
+reader::reader(const char *data, size_t size, uint32_t magic, uint32_t version)
+  : at(data), end(data + size), good(data != nullptr) {
+  uint32_t m = 0, v = 0;
+  good = good && get(m) && get(v) && m == magic && v == version;
+}
+
+const char *reader::take(size_t size) {
+  size_t padded = (size + 7) & ~size_t(7);
+  if (!good || size_t(end - at) < size) {
+    good = false;
+    return nullptr;
+  }
+  const char *p = at;
+  at += std::min(padded, size_t(end - at));
+  return p;
+}
+
+mapping::mapping(const std::string &path) : file(std::make_unique<QFile>(QString::fromStdString(path))) {
+  if (!file->open(QFile::ReadOnly) || file->size() == 0)
+    return;
+  length = file->size();
+  ptr = reinterpret_cast<const char*>(file->map(0, length));
+  if (!ptr)
+    length = 0;
+}
+
+// Closing the file unmaps it
+mapping::~mapping() = default;
+
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+class QFile;
+
+// Binary cache files: a magic number and a version, then values, arrays
+// and strings back to back. Everything starts 8 byte aligned, so arrays can
+// be read straight out of a memory mapping. Caches are only used while
+// they're newer than the files they were made from, and are rewritten
+// whenever the version changes.
+namespace blob {
+  // True if file exists and was written after every one of sources
+  bool newer_than(const std::string &file, const std::vector<std::string> &sources);
+
+  class writer {
+  public:
+    writer(uint32_t magic, uint32_t version);
+
+    template <class T> void put(const T &v) {
+      static_assert(std::is_trivially_copyable_v<T>);
+      append(&v, sizeof(T));
+    }
+
+    template <class T> void put_array(const T *data, size_t count) {
+      static_assert(std::is_trivially_copyable_v<T>);
+      put<uint64_t>(count);
+      append(data, count * sizeof(T));
+    }
+
+    template <class T> void put_array(const std::vector<T> &v) {
+      put_array(v.data(), v.size());
+    }
+
+    void put_string(const std::string &s) {
+      put_array(s.data(), s.size());
+    }
+
+    // Writes through a temporary file, so nobody reads half a blob
+    bool save(const std::string &path) const;
+
+  private:
+    void append(const void *data, size_t size);
+
+    std::vector<char> bytes;
+  };
+
+  class reader {
+  public:
+    // Checks the header, every read fails if it doesn't match
+    reader(const char *data, size_t size, uint32_t magic, uint32_t version);
+
+    // False once a read has gone past the end or the header was wrong
+    bool ok() const { return good; }
+
+    template <class T> bool get(T &v) {
+      static_assert(std::is_trivially_copyable_v<T>);
+      const char *p = take(sizeof(T));
+      if (p)
+        std::memcpy(&v, p, sizeof(T));
+      return p;
+    }
+
+    // An array where it lies in the data, nullptr if it doesn't fit
+    template <class T> const T *view(size_t &count) {
+      static_assert(std::is_trivially_copyable_v<T>);
+      uint64_t n;
+      if (!get(n) || n > (end - at) / sizeof(T)) {
+        good = false;
+        return nullptr;
+      }
+      count = n;
+      return reinterpret_cast<const T*>(take(n * sizeof(T)));
+    }
+
+    template <class T> bool get_array(std::vector<T> &v) {
+      size_t count;
+      const T *p = view<T>(count);
+      if (p)
+        v.assign(p, p + count);
+      return p;
+    }
+
+    bool get_string(std::string &s) {
+      size_t count;
+      const char *p = view<char>(count);
+      if (p)
+        s.assign(p, count);
+      return p;
+    }
+
+  private:
+    const char *take(size_t size);
+
+    const char *at;
+    const char *end;
+    bool good;
+  };
+
+  // A whole file mapped read-only into memory
+  class mapping {
+  public:
+    mapping(const std::string &path);
+    ~mapping();
+
+    const char *data() const { return ptr; }
+    size_t size() const { return length; }
+    bool valid() const { return ptr != nullptr; }
+
+  private:
+    std::unique_ptr<QFile> file;
+    const char *ptr = nullptr;
+    size_t length = 0;
+  };
+}
@@ -146,7 +146,7 @@ obj_loader::obj_loader(string fp) : success(false)
       } else {
         auto face_toks_0 = face_split(toks[1]);
 
-        for (size_t i = 1; i != toks.size() - 1; ++i) {
+        for (size_t i = 2; i != toks.size() - 1; ++i) {
           auto face_toks_1 = face_split(toks[i]);
           auto face_toks_2 = face_split(toks[i + 1]);
 
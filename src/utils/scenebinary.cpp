@@ -0,0 +1,329 @@
+#include "utils/scenebinary.h"
+#include "utils/blob.h"
+
+#include <iostream>
+#include <map>
+
+using std::string;	using std::vector;
+
+namespace {
+
+constexpr uint32_t magic   = 0x4e435343; // "CSCN"
+constexpr uint32_t version = 3;
+
+// Sizes of the structs stored as they are, a build where they differ
+// can't read the file
+struct layout {
+  uint32_t global_data;
+  uint32_t camera_data;
+  uint32_t light_data;
+  uint32_t matrix;
+  uint32_t prototype;
+};
+
+constexpr layout current_layout = {
+  sizeof(SceneGlobalData), sizeof(SceneCameraData), sizeof(SceneLightData), sizeof(glm::mat4),
+  sizeof(RenderPrototype)
+};
+
+// Strings are indices into the string table, 0 being the empty string
+struct map_record {
+  uint32_t filename;
+  uint32_t normal;
+  uint32_t displacement;
+  uint32_t used;
+  uint32_t parallax;
+  float    repeat_u;
+  float    repeat_v;
+};
+
+struct material_record {
+  glm::vec4  ambient, diffuse, specular, reflective, transparent, emissive;
+  float      shininess, ior, blend;
+  map_record texture, bump;
+};
+
+struct primitive_record {
+  uint32_t type;
+  uint32_t material;
+  uint32_t meshfile;
+};
+
+struct emitter_record {
+  glm::vec3 pos;
+  float     radius;
+  float     rate;
+  float     lifetime;
+  uint32_t  texture;
+};
+
+// Hands out one index per distinct value
+template <class T, class Key = T>
+class interner {
+public:
+  uint32_t operator()(const T &v, const Key &key) {
+    auto found = ids.emplace(key, static_cast<uint32_t>(values.size()));
+    if (found.second)
+      values.push_back(v);
+    return found.first->second;
+  }
+
+  vector<T> values;
+
+private:
+  std::map<Key, uint32_t> ids;
+};
+
+map_record map_to_record(const SceneFileMap &map, interner<string> &strings) {
+  map_record r;
+  std::memset(&r, 0, sizeof(r));
+  r.filename     = strings(map.filename, map.filename);
+  r.normal       = strings(map.normal_fn, map.normal_fn);
+  r.displacement = strings(map.disp_fn, map.disp_fn);
+  r.used         = map.isUsed;
+  r.parallax     = map.parallax;
+  r.repeat_u     = map.repeatU;
+  r.repeat_v     = map.repeatV;
+  return r;
+}
+
+SceneFileMap map_from_record(const map_record &r, const vector<string> &strings) {
+  SceneFileMap map;
+  map.clear();
+  map.isUsed    = r.used;
+  map.key       = 0;
+  map.filename  = strings[r.filename];
+  map.normal_fn = strings[r.normal];
+  map.disp_fn   = strings[r.displacement];
+  map.parallax  = r.parallax;
+  map.repeatU   = r.repeat_u;
+  map.repeatV   = r.repeat_v;
+  return map;
+}
+
+material_record material_to_record(const SceneMaterial &m, interner<string> &strings) {
+  material_record r;
+  std::memset(&r, 0, sizeof(r));
+  r.ambient     = m.cAmbient;
+  r.diffuse     = m.cDiffuse;
+  r.specular    = m.cSpecular;
+  r.reflective  = m.cReflective;
+  r.transparent = m.cTransparent;
+  r.emissive    = m.cEmissive;
+  r.shininess   = m.shininess;
+  r.ior         = m.ior;
+  r.blend       = m.blend;
+  r.texture     = map_to_record(m.textureMap, strings);
+  r.bump        = map_to_record(m.bumpMap, strings);
+  return r;
+}
+
+SceneMaterial material_from_record(const material_record &r, const vector<string> &strings) {
+  SceneMaterial m;
+  m.cAmbient     = r.ambient;
+  m.cDiffuse     = r.diffuse;
+  m.cSpecular    = r.specular;
+  m.cReflective  = r.reflective;
+  m.cTransparent = r.transparent;
+  m.cEmissive    = r.emissive;
+  m.shininess    = r.shininess;
+  m.ior          = r.ior;
+  m.blend        = r.blend;
+  m.textureMap   = map_from_record(r.texture, strings);
+  m.bumpMap      = map_from_record(r.bump, strings);
+  return m;
+}
+
+// Records are compared by their bytes, which memset leaves without garbage
+template <class T>
+string record_key(const T &r) {
+  return string(reinterpret_cast<const char*>(&r), sizeof(T));
+}
+
+}
+
+namespace scene_binary {
+
+string path_for(const string &scene) {
+  return scene + ".bin";
+}
+
+bool save(const string &scene, const RenderData &data) {
+  interner<string> strings;
+  strings(string(), string());
+
+  // Materials only differing in their texture keys become one, equal
+  // primitives are stored once too, and shapes are renumbered to match
+  interner<material_record, string> materials;
+  vector<uint32_t> material_ids;
+  material_ids.reserve(data.materials.size());
+  for (const auto &m : data.materials) {
+    auto material = material_to_record(m, strings);
+    material_ids.push_back(materials(material, record_key(material)));
+  }
+
+  interner<primitive_record, string> primitives;
+  vector<uint32_t> primitive_ids;
+  primitive_ids.reserve(data.primitives.size());
+  for (const auto &p : data.primitives) {
+    primitive_record r = { static_cast<uint32_t>(p.type), material_ids[p.material],
+                           strings(p.meshfile, p.meshfile) };
+    primitive_ids.push_back(primitives(r, record_key(r)));
+  }
+  vector<uint32_t> shape_primitives(data.shapes.primitive.size());
+  for (size_t i = 0; i < shape_primitives.size(); i++)
+    shape_primitives[i] = primitive_ids[data.shapes.primitive[i]];
+
+  vector<emitter_record> emitters;
+  for (const auto &e : data.emitters)
+    emitters.push_back({ e.pos, e.radius, e.rate, e.lifetime, strings(e.texture, e.texture) });
+
+  blob::writer out(magic, version);
+  out.put(current_layout);
+  out.put_string(scene);
+  out.put(data.globalData);
+  out.put(data.cameraData);
+  out.put_array(data.lights);
+  out.put<uint64_t>(strings.values.size());
+  for (const auto &s : strings.values)
+    out.put_string(s);
+  out.put_array(materials.values);
+  out.put_array(primitives.values);
+  out.put_array(emitters);
+  out.put_array(data.prototypes);
+  out.put_array(shape_primitives);
+  out.put_array(data.shapes.prototype);
+  out.put_array(data.shapes.ctm);
+  out.put_array(data.shapes.inv_ctm);
+  out.put_array(data.instances.prototype);
+  out.put_array(data.instances.ctm);
+  out.put_array(data.instances.inv_ctm);
+  out.put_array(data.nodes.parent);
+  out.put_array(data.nodes.local);
+  out.put_array(data.nodes.first_shape);
+  out.put_array(data.nodes.shape_count);
+  out.put_array(data.nodes.instance);
+
+  return out.save(path_for(scene));
+}
+
+bool load(const string &scene, RenderData &data) {
+  string path = path_for(scene);
+  if (!blob::newer_than(path, { scene }))
+    return false;
+
+  blob::mapping file(path);
+  blob::reader in(file.data(), file.size(), magic, version);
+
+  // Paths in the file were resolved against the scene's own path
+  layout l;
+  string compiled_from;
+  if (!in.get(l) || std::memcmp(&l, &current_layout, sizeof(layout)) != 0 ||
+      !in.get_string(compiled_from) || compiled_from != scene)
+    return false;
+
+  RenderData loaded;
+  uint64_t string_count = 0;
+  in.get(loaded.globalData);
+  in.get(loaded.cameraData);
+  in.get_array(loaded.lights);
+  in.get(string_count);
+  vector<string> strings(in.ok() && string_count <= file.size() / 8 ? string_count : 0);
+  for (auto &s : strings)
+    in.get_string(s);
+
+  size_t material_count = 0, primitive_count = 0, emitter_count = 0;
+  const material_record  *materials  = in.view<material_record>(material_count);
+  const primitive_record *primitives = in.view<primitive_record>(primitive_count);
+  const emitter_record   *emitters   = in.view<emitter_record>(emitter_count);
+  in.get_array(loaded.prototypes);
+  in.get_array(loaded.shapes.primitive);
+  in.get_array(loaded.shapes.prototype);
+  in.get_array(loaded.shapes.ctm);
+  in.get_array(loaded.shapes.inv_ctm);
+  in.get_array(loaded.instances.prototype);
+  in.get_array(loaded.instances.ctm);
+  in.get_array(loaded.instances.inv_ctm);
+  in.get_array(loaded.nodes.parent);
+  in.get_array(loaded.nodes.local);
+  in.get_array(loaded.nodes.first_shape);
+  in.get_array(loaded.nodes.shape_count);
+  in.get_array(loaded.nodes.instance);
+  if (!in.ok()) {
+    std::cerr << "could not read " << path << std::endl;
+    return false;
+  }
+
+  // Indices are checked once here, so nothing downstream has to
+  auto bad = [&](uint32_t s) { return s >= strings.size(); };
+  loaded.materials.reserve(material_count);
+  for (size_t i = 0; i < material_count; i++) {
+    const auto &m = materials[i];
+    if (bad(m.texture.filename) || bad(m.texture.normal) || bad(m.texture.displacement) ||
+        bad(m.bump.filename) || bad(m.bump.normal) || bad(m.bump.displacement))
+      return false;
+    loaded.materials.push_back(material_from_record(m, strings));
+  }
+
+  loaded.primitives.reserve(primitive_count);
+  for (size_t i = 0; i < primitive_count; i++) {
+    const auto &p = primitives[i];
+    if (p.type > static_cast<uint32_t>(PrimitiveType::PRIMITIVE_MESH) ||
+        p.material >= material_count || bad(p.meshfile))
+      return false;
+    loaded.primitives.push_back({ static_cast<PrimitiveType>(p.type), p.material, strings[p.meshfile] });
+  }
+
+  for (size_t i = 0; i < emitter_count; i++) {
+    const auto &e = emitters[i];
+    if (bad(e.texture))
+      return false;
+    loaded.emitters.push_back({ e.pos, e.radius, e.rate, e.lifetime, strings[e.texture] });
+  }
+
+  size_t shapes = loaded.shapes.primitive.size(), instances = loaded.instances.size();
+  if (loaded.shapes.prototype.size() != shapes || loaded.shapes.ctm.size() != shapes ||
+      loaded.shapes.inv_ctm.size() != shapes || loaded.instances.ctm.size() != instances ||
+      loaded.instances.inv_ctm.size() != instances)
+    return false;
+  for (uint32_t p : loaded.shapes.primitive)
+    if (p >= loaded.primitives.size())
+      return false;
+
+  // Prototypes' runs have to cover the shapes and instances, which name them
+  uint64_t covered_shapes = 0, covered_instances = 0;
+  for (size_t p = 0; p < loaded.prototypes.size(); p++) {
+    const auto &r = loaded.prototypes[p];
+    covered_shapes    += r.shape_count;
+    covered_instances += r.instance_count;
+    if (uint64_t(r.first_shape) + r.shape_count > shapes ||
+        uint64_t(r.first_instance) + r.instance_count > instances)
+      return false;
+    for (uint32_t s = r.first_shape; s < r.first_shape + r.shape_count; s++)
+      if (loaded.shapes.prototype[s] != p)
+        return false;
+    for (uint32_t i = r.first_instance; i < r.first_instance + r.instance_count; i++)
+      if (loaded.instances.prototype[i] != p)
+        return false;
+  }
+  if (covered_shapes != shapes || covered_instances != instances)
+    return false;
+
+  // Nodes come after their parents and only have prototype 0's shapes
+  const auto &n = loaded.nodes;
+  size_t nodes = n.size();
+  uint64_t root_shapes = loaded.prototypes.empty() ? 0 : loaded.prototypes[0].shape_count;
+  if (n.local.size() != nodes || n.first_shape.size() != nodes || n.shape_count.size() != nodes ||
+      n.instance.size() != nodes)
+    return false;
+  for (size_t i = 0; i < nodes; i++)
+    if ((i == 0 ? n.parent[i] != RenderNodes::none : n.parent[i] >= i) ||
+        uint64_t(n.first_shape[i]) + n.shape_count[i] > root_shapes ||
+        (n.instance[i] != RenderNodes::none && n.instance[i] >= instances))
+      return false;
+
+  data = std::move(loaded);
+  return true;
+}
+
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "sceneparser.h"
+
+#include <string>
+
+// Compiled scenes: the RenderData SceneParser makes from a scene file,
+// saved so that loading the file again needs no parsing at all. Lights, the
+// camera and the flattened prototypes, shapes, instances and nodes are
+// stored as they are in memory. Materials are stored as the table the
+// primitives index, and every path goes into a string table. Mesh files and
+// textures are only referenced by path, their processed data has its own
+// caches next to them (see mesh and texture).
+namespace scene_binary {
+  // Where the compiled version of a scene file goes
+  std::string path_for(const std::string &scene);
+
+  // Compiles data, parsed from the scene file scene
+  bool save(const std::string &scene, const RenderData &data);
+
+  // Loads the compiled version of scene if it's newer than the scene file.
+  // False if there is none, or it's stale or from another version
+  bool load(const std::string &scene, RenderData &data);
+}
@@ -72,6 +72,15 @@ struct SceneCameraData {
     float focalLength;   // Only applicable for depth of field
 };
 
+// Struct which contains data for a particle emitter
+struct SceneEmitterData {
+    glm::vec3   pos;      // Base of the emitter, particles spawn on a disc around it
+    float       radius;   // Radius of the spawn disc
+    float       rate;     // Particles spawned per second
+    float       lifetime; // Longest particle lifetime in seconds
+    std::string texture;  // Sprite image, empty for the default one
+};
+
 // Struct which contains data for texture mapping files
 struct SceneFileMap {
     SceneFileMap() : isUsed(false) {}
@@ -0,0 +1,114 @@
+#include "utils/scenediff.h"
+
+using std::vector;
+
+namespace {
+
+bool same(const SceneGlobalData &a, const SceneGlobalData &b) {
+  return a.ka == b.ka && a.kd == b.kd && a.ks == b.ks && a.kt == b.kt;
+}
+
+bool same(const SceneCameraData &a, const SceneCameraData &b) {
+  return a.pos == b.pos && a.look == b.look && a.up == b.up &&
+         a.heightAngle == b.heightAngle && a.aperture == b.aperture &&
+         a.focalLength == b.focalLength;
+}
+
+bool same(const SceneLightData &a, const SceneLightData &b) {
+  return a.id == b.id && a.type == b.type && a.color == b.color &&
+         a.function == b.function && a.pos == b.pos && a.dir == b.dir &&
+         a.penumbra == b.penumbra && a.angle == b.angle &&
+         a.width == b.width && a.height == b.height;
+}
+
+bool same(const SceneEmitterData &a, const SceneEmitterData &b) {
+  return a.pos == b.pos && a.radius == b.radius && a.rate == b.rate &&
+         a.lifetime == b.lifetime && a.texture == b.texture;
+}
+
+bool same(const SceneFileMap &a, const SceneFileMap &b) {
+  return a.isUsed == b.isUsed && a.filename == b.filename &&
+         a.normal_fn == b.normal_fn && a.disp_fn == b.disp_fn &&
+         a.parallax == b.parallax && a.repeatU == b.repeatU && a.repeatV == b.repeatV;
+}
+
+bool same(const SceneMaterial &a, const SceneMaterial &b) {
+  return a.cAmbient == b.cAmbient && a.cDiffuse == b.cDiffuse &&
+         a.cSpecular == b.cSpecular && a.shininess == b.shininess &&
+         a.cReflective == b.cReflective && a.cTransparent == b.cTransparent &&
+         a.ior == b.ior && a.blend == b.blend && a.cEmissive == b.cEmissive &&
+         same(a.textureMap, b.textureMap) && same(a.bumpMap, b.bumpMap);
+}
+
+template <class T>
+bool same(const vector<T> &a, const vector<T> &b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); i++)
+    if (!same(a[i], b[i]))
+      return false;
+  return true;
+}
+
+}
+
+namespace scene_diff {
+
+changes compare(const RenderData &resident, const RenderData &reloaded) {
+  changes c;
+  c.camera   = !same(resident.cameraData, reloaded.cameraData);
+  c.lights   = !same(resident.globalData, reloaded.globalData) ||
+               !same(resident.lights, reloaded.lights);
+  c.emitters = !same(resident.emitters, reloaded.emitters);
+
+  const auto &from = resident.shapes;
+  const auto &to   = reloaded.shapes;
+  bool same_layout = from.size() == to.size() &&
+                     resident.instances.size() == reloaded.instances.size() &&
+                     resident.prototypes.size() == reloaded.prototypes.size();
+  for (size_t p = 0; same_layout && p < reloaded.prototypes.size(); p++) {
+    const auto &a = resident.prototypes[p], &b = reloaded.prototypes[p];
+    same_layout = a.first_shape == b.first_shape && a.shape_count == b.shape_count &&
+                  a.first_instance == b.first_instance && a.instance_count == b.instance_count;
+  }
+  if (!same_layout) {
+    c.structure = true;
+    return c;
+  }
+
+  // Materials are numbered in the order they're first used, so an edit that
+  // doesn't add or merge one leaves the tables lined up and each is
+  // compared once instead of once per shape
+  bool lined_up = resident.materials.size() == reloaded.materials.size();
+  vector<char> material_changed;
+  if (lined_up) {
+    material_changed.resize(reloaded.materials.size());
+    for (size_t m = 0; m < material_changed.size(); m++)
+      material_changed[m] = !same(resident.materials[m], reloaded.materials[m]);
+  }
+
+  for (size_t i = 0; i < to.size(); i++) {
+    const auto &pa = resident.primitives[from.primitive[i]];
+    const auto &pb = reloaded.primitives[to.primitive[i]];
+    if (pa.type != pb.type || pa.meshfile != pb.meshfile) {
+      c.structure = true;
+      c.shapes.clear();
+      return c;
+    }
+
+    // A shape whose material moved in the table is patched to point at
+    // its new place
+    uint32_t a = pa.material, b = pb.material;
+    bool material = a != b || (lined_up ? material_changed[b]
+                                        : !same(resident.materials[a], reloaded.materials[b]));
+    if (material || from.ctm[i] != to.ctm[i])
+      c.shapes.push_back(i);
+  }
+
+  for (size_t i = 0; i < reloaded.instances.size(); i++)
+    if (resident.instances.ctm[i] != reloaded.instances.ctm[i])
+      c.instances.push_back(i);
+  return c;
+}
+
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "sceneparser.h"
+
+#include <cstddef>
+#include <vector>
+
+// What changed between two parses of a scene file, so a reload only has to
+// redo that. Shapes and instances are matched by their index in the
+// flattened arrays, which follows their order in the file, so edits to
+// materials and transforms keep every one where it was. Adding, removing or
+// retyping a shape, or using a master more or less often, moves the rest and
+// is reported as a change of structure instead.
+namespace scene_diff {
+  struct changes {
+    bool camera    = false;
+    bool lights    = false; // Or the global coefficients they're lit with
+    bool emitters  = false;
+    bool structure = false; // Shapes or instances added or removed, or shapes of another primitive or mesh file
+
+    // Without a change of structure, shapes whose matrices or material
+    // changed, and instances that moved
+    std::vector<size_t> shapes;
+    std::vector<size_t> instances;
+
+    bool empty() const {
+      return !camera && !lights && !emitters && !structure && shapes.empty() && instances.empty();
+    }
+  };
+
+  // Changes from resident to reloaded. Texture keys aren't compared, they're
+  // given out by the renderer after parsing
+  changes compare(const RenderData &resident, const RenderData &reloaded);
+}
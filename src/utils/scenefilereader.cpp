@@ -26,6 +26,7 @@ ScenefileReader::ScenefileReader(const std::string& name)
    memset(&m_globalData, 0, sizeof(SceneGlobalData));
    m_objects.clear();
    m_lights.clear();
+   m_emitters.clear();
    m_nodes.clear();
 }
 
@@ -73,6 +74,10 @@ std::vector<SceneLightData> ScenefileReader::getLights() const {
    return ret;
 }
 
+std::vector<SceneEmitterData> ScenefileReader::getEmitters() const {
+   return m_emitters;
+}
+
 SceneNode* ScenefileReader::getRootNode() const {
    std::map<std::string, SceneNode*>::iterator node = m_objects.find("root");
    if (node == m_objects.end())
@@ -131,6 +136,9 @@ bool ScenefileReader::readXML() {
        } else if (e.tagName() == "cameradata") {
            if (!parseCameraData(e))
                return false;
+       } else if (e.tagName() == "emitter") {
+           if (!parseEmitterData(e))
+               return false;
        } else if (e.tagName() == "object") {
            if (!parseObjectData(e))
                return false;
@@ -448,6 +456,71 @@ bool ScenefileReader::parseLightData(const QDomElement &lightdata) {
    return true;
 }
 
+/**
+* Parse an <emitter> tag and add a new SceneEmitterData to m_emitters.
+* The texture is relative to the scenefile root, like texture maps.
+* Example emitter tag:
+*
+* <emitter>
+*   <position x="-5" y="-0.4" z="-3"/>
+*   <radius v="0.7"/>
+*   <rate v="12000"/>
+*   <lifetime v="4.2"/>
+*   <texture file="scene/Particle.png"/>
+* </emitter>
+*/
+bool ScenefileReader::parseEmitterData(const QDomElement &emitterdata) {
+   // Default emitter, the size of the original fireplace
+   SceneEmitterData emitter;
+   emitter.pos = glm::vec3(0.f);
+   emitter.radius = 0.7f;
+   emitter.rate = 12000.f;
+   emitter.lifetime = 4.2f;
+
+   std::filesystem::path basepath = std::filesystem::path(file_name).parent_path().parent_path();
+
+   // Iterate over child elements
+   QDomNode childNode = emitterdata.firstChild();
+   while (!childNode.isNull()) {
+       QDomElement e = childNode.toElement();
+       if (e.tagName() == "position") {
+           if (!parseTriple(e, emitter.pos.x, emitter.pos.y, emitter.pos.z, "x", "y", "z")) {
+               PARSE_ERROR(e);
+               return false;
+           }
+       } else if (e.tagName() == "radius") {
+           if (!parseSingle(e, emitter.radius, "v")) {
+               PARSE_ERROR(e);
+               return false;
+           }
+       } else if (e.tagName() == "rate") {
+           if (!parseSingle(e, emitter.rate, "v") || emitter.rate <= 0) {
+               PARSE_ERROR(e);
+               return false;
+           }
+       } else if (e.tagName() == "lifetime") {
+           if (!parseSingle(e, emitter.lifetime, "v") || emitter.lifetime <= 0) {
+               PARSE_ERROR(e);
+               return false;
+           }
+       } else if (e.tagName() == "texture") {
+           if (!e.hasAttribute("file")) {
+               PARSE_ERROR(e);
+               return false;
+           }
+           std::filesystem::path relativePath(e.attribute("file").toStdString());
+           emitter.texture = (basepath / relativePath).string();
+       } else if (!e.isNull()) {
+           UNSUPPORTED_ELEMENT(e);
+           return false;
+       }
+       childNode = childNode.nextSibling();
+   }
+
+   m_emitters.push_back(emitter);
+   return true;
+}
+
 /**
 * Parse a <cameradata> tag and fill in m_cameraData.
 */
@@ -25,6 +25,8 @@ public:
 
     std::vector<SceneLightData> getLights() const;
 
+    std::vector<SceneEmitterData> getEmitters() const;
+
     SceneNode* getRootNode() const;
 
 private:
@@ -33,6 +35,7 @@ private:
     bool parseGlobalData(const QDomElement &globaldata);
     bool parseCameraData(const QDomElement &cameradata);
     bool parseLightData(const QDomElement &lightdata);
+    bool parseEmitterData(const QDomElement &emitterdata);
     bool parseObjectData(const QDomElement &object);
     bool parseTransBlock(const QDomElement &transblock, SceneNode* node);
     bool parsePrimitive(const QDomElement &prim, SceneNode* node);
@@ -42,5 +45,6 @@ private:
     SceneGlobalData m_globalData;
     SceneCameraData m_cameraData;
     std::vector<SceneLightData*> m_lights;
+    std::vector<SceneEmitterData> m_emitters;
     std::vector<SceneNode*> m_nodes;
 };
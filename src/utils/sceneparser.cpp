@@ -1,31 +1,529 @@
 #include "sceneparser.h"
+#include "scenebinary.h"
 #include "scenefilereader.h"
+#include "scenestreamreader.h"
 #include "transforms.h"
+#include "jobs/job_system.h"
+
+#include <glm/gtc/matrix_inverse.hpp>
 
 #include <chrono>
+#include <map>
 #include <memory>
+#include <unordered_map>
 
 using std::vector;	using glm::inverse;
 using glm::mat4;	using std::string;
 
-long recursive_traversal(const mat4 &ctm, const SceneNode *root,
-                         vector<RenderShapeData> &primitives, long id) {
-    // Update the CTM with this node's transforms
-    auto new_ctm = transforms::apply_transforms(ctm, root->transformations);
-    auto inv_ctm = inverse(new_ctm);
+// Shapes a flattening task writes, about
+constexpr uint64_t flatten_grain = 1 << 12;
+
+// Inverse of a CTM. Scene transformations are affine, only a <matrix> can
+// make one projective
+mat4 inverse_ctm(const mat4 &m) {
+    if (m[0][3] == 0.f && m[1][3] == 0.f && m[2][3] == 0.f && m[3][3] == 1.f)
+        return glm::affineInverse(m);
+    return inverse(m);
+}
+
+// What tells materials apart, as bytes. Texture keys are given out after
+// parsing, they aren't part of it
+template <class T>
+void append_bytes(string &key, const T &v) {
+    key.append(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+void append_map(string &key, const SceneFileMap &m) {
+    append_bytes(key, m.isUsed);
+    append_bytes(key, m.parallax);
+    append_bytes(key, m.repeatU);
+    append_bytes(key, m.repeatV);
+    for (const string *s : { &m.filename, &m.normal_fn, &m.disp_fn }) {
+        append_bytes(key, s->size());
+        key += *s;
+    }
+}
+
+string material_key(const SceneMaterial &m) {
+    string key;
+    for (const auto *c : { &m.cAmbient, &m.cDiffuse, &m.cSpecular, &m.cReflective,
+                           &m.cTransparent, &m.cEmissive })
+        append_bytes(key, *c);
+    append_bytes(key, m.shininess);
+    append_bytes(key, m.ior);
+    append_bytes(key, m.blend);
+    append_map(key, m.textureMap);
+    append_map(key, m.bumpMap);
+    return key;
+}
+
+// Moves the reader's primitives into data, each distinct material once
+void intern_materials(vector<ScenePrimitive> primitives, RenderData &data) {
+    std::unordered_map<string, uint32_t> ids;
+    data.primitives.reserve(primitives.size());
+    for (auto &p : primitives) {
+        auto id = ids.emplace(material_key(p.material), data.materials.size());
+        if (id.second)
+            data.materials.push_back(std::move(p.material));
+        data.primitives.push_back({ p.type, id.first->second, std::move(p.meshfile) });
+    }
+}
 
-    // Add primitives that might be in this node to the final vector
-    for(auto &p : root->primitives)
-        primitives.push_back(RenderShapeData{id++, *p, new_ctm, inv_ctm});
+// Puts instances in the order of their prototypes, keeping the order they
+// were found in within each, and fills in the prototypes' instance runs.
+// Nodes are pointed at their instances' new places
+void group_instances(RenderData &data) {
+    auto &instances = data.instances;
+    vector<uint32_t> first(data.prototypes.size() + 1, 0);
+    for (uint32_t p : instances.prototype)
+        first[p + 1]++;
+    for (size_t p = 0; p < data.prototypes.size(); p++) {
+        first[p + 1] += first[p];
+        data.prototypes[p].first_instance = first[p];
+        data.prototypes[p].instance_count = first[p + 1] - first[p];
+    }
 
-    // Recurse for children
-    for(const auto &c : root->children)
-        id = recursive_traversal(new_ctm, c, primitives, id);
+    RenderInstances grouped;
+    grouped.prototype.resize(instances.size());
+    grouped.ctm.resize(instances.size());
+    grouped.inv_ctm.resize(instances.size());
+    vector<uint32_t> moved_to(instances.size());
+    for (size_t i = 0; i < instances.size(); i++) {
+        uint32_t at = first[instances.prototype[i]]++;
+        grouped.prototype[at] = instances.prototype[i];
+        grouped.ctm[at]       = instances.ctm[i];
+        grouped.inv_ctm[at]   = instances.inv_ctm[i];
+        moved_to[i] = at;
+    }
+    instances = std::move(grouped);
 
-    return id;
+    for (auto &i : data.nodes.instance)
+        if (i != RenderNodes::none)
+            i = moved_to[i];
 }
 
-bool SceneParser::parse(string filepath, RenderData &renderData) {
+// Flattens a ScenefileReader's graph. Nodes are found by pointer, a node
+// that's a child in more than one place is a prototype
+class dom_flattener {
+public:
+    explicit dom_flattener(RenderData &data) : data(data) {}
+
+    // Returns the primitives shapes index
+    vector<ScenePrimitive> flatten(const SceneNode *root) {
+        vector<const SceneNode*> shared;
+        count_references(root, shared);
+        prototype_of[root] = 0;
+        for (auto n : shared)
+            if (references[n] > 1 && !prototype_of.count(n))
+                prototype_of.emplace(n, prototype_of.size());
+
+        vector<const SceneNode*> roots(prototype_of.size());
+        for (const auto &p : prototype_of)
+            roots[p.second] = p.first;
+
+        add_instance(0, mat4(1.f));
+        for (uint32_t p = 0; p < roots.size(); p++) {
+            uint32_t first = data.shapes.size();
+            traverse(mat4(1.f), roots[p], p, p == 0);
+            data.prototypes.push_back({ first, uint32_t(data.shapes.size() - first), 0, 0 });
+        }
+        group_instances(data);
+        return std::move(primitives);
+    }
+
+private:
+    void count_references(const SceneNode *n, vector<const SceneNode*> &order) {
+        for (const auto &c : n->children)
+            if (references[c]++ == 0) {
+                order.push_back(c);
+                count_references(c, order);
+            }
+    }
+
+    void add_instance(uint32_t prototype, const mat4 &ctm) {
+        data.instances.prototype.push_back(prototype);
+        data.instances.ctm.push_back(ctm);
+        data.instances.inv_ctm.push_back(inverse_ctm(ctm));
+    }
+
+    uint32_t add_node(uint32_t parent, const mat4 &local, size_t first_shape, size_t shape_count,
+                      uint32_t instance) {
+        auto &nodes = data.nodes;
+        nodes.parent.push_back(parent);
+        nodes.local.push_back(local);
+        nodes.first_shape.push_back(first_shape);
+        nodes.shape_count.push_back(shape_count);
+        nodes.instance.push_back(instance);
+        return nodes.size() - 1;
+    }
+
+    void drop_last_node() {
+        auto &nodes = data.nodes;
+        nodes.parent.pop_back();
+        nodes.local.pop_back();
+        nodes.first_shape.pop_back();
+        nodes.shape_count.pop_back();
+        nodes.instance.pop_back();
+    }
+
+    // Writes a subtree's shapes, with masters that are prototypes placed as
+    // instances when cut, and expanded when not. A cut subtree's nodes are
+    // kept too, under parent
+    void traverse(const mat4 &ctm, const SceneNode *root, uint32_t prototype, bool cut,
+                  uint32_t parent = RenderNodes::none) {
+        // Update the CTM with this node's transforms
+        auto new_ctm = transforms::apply_transforms(ctm, root->transformations);
+        auto inv_ctm = root->primitives.empty() ? mat4(1.f) : inverse_ctm(new_ctm);
+        uint32_t node = RenderNodes::none;
+        if (cut)
+            node = add_node(parent, transforms::apply_transforms(mat4(1.f), root->transformations),
+                            root->primitives.empty() ? 0 : data.shapes.size(), root->primitives.size(),
+                            RenderNodes::none);
+
+        // Add primitives that might be in this node to the final arrays, each
+        // primitive is stored once however many times it's instanced
+        for(auto &p : root->primitives) {
+            auto id = ids.emplace(p, primitives.size());
+            if (id.second)
+                primitives.push_back(*p);
+            data.shapes.primitive.push_back(id.first->second);
+            data.shapes.prototype.push_back(prototype);
+            data.shapes.ctm.push_back(new_ctm);
+            data.shapes.inv_ctm.push_back(inv_ctm);
+        }
+
+        // Recurse for children
+        for(const auto &c : root->children) {
+            auto p = prototype_of.find(c);
+            if (cut && p != prototype_of.end()) {
+                add_node(node, mat4(1.f), 0, 0, data.instances.size());
+                add_instance(p->second, new_ctm);
+            } else {
+                traverse(new_ctm, c, prototype, cut, node);
+            }
+        }
+
+        // Nothing under it to move
+        if (cut && root->primitives.empty() && node == data.nodes.size() - 1)
+            drop_last_node();
+    }
+
+    RenderData &data;
+    std::map<const SceneNode*, uint32_t> references;
+    std::map<const SceneNode*, uint32_t> prototype_of;
+    std::map<const ScenePrimitive*, uint32_t> ids;
+    vector<ScenePrimitive> primitives;
+};
+
+// Flattens a ScenestreamReader's graph into preallocated arrays. How many
+// shapes and instances are under every node is counted first, which fixes
+// where each subtree's go, so subtrees are written by different jobs.
+// Prototype 0 is written cut, placing an instance wherever it meets a
+// prototype's root, and its nodes are kept. Prototypes are written
+// expanded, from their own roots
+class arena_flattener {
+public:
+    arena_flattener(const ScenestreamReader &reader, RenderData &data)
+        : reader(reader), data(data), references(reader.getNodes().size(), 0),
+          prototype_of(reader.getNodes().size(), none) {
+        for (auto &c : counts)
+            c.assign(reader.getNodes().size(), unknown);
+    }
+
+    void flatten(uint32_t root, job_system &jobs) {
+        // Prototypes are numbered in the order they're first met
+        vector<uint32_t> order;
+        count_references(root, order);
+        vector<uint32_t> roots = { root };
+        prototype_of[root] = 0;
+        for (uint32_t n : order)
+            if (references[n] > 1 && prototype_of[n] == none) {
+                prototype_of[n] = roots.size();
+                roots.push_back(n);
+            }
+
+        uint64_t shape_total = 0;
+        for (uint32_t p = 0; p < roots.size(); p++) {
+            uint64_t count = shapes(roots[p], p == 0);
+            data.prototypes.push_back({ uint32_t(shape_total), uint32_t(count), 0, 0 });
+            shape_total += count;
+        }
+        uint64_t instance_total = 1 + instances(root);
+        uint64_t node_total     = nodes(root);
+
+        auto &s = data.shapes;
+        s.primitive.resize(shape_total);
+        s.prototype.resize(shape_total);
+        s.ctm.resize(shape_total);
+        s.inv_ctm.resize(shape_total);
+        auto &i = data.instances;
+        i.prototype.resize(instance_total);
+        i.ctm.resize(instance_total);
+        i.inv_ctm.resize(instance_total);
+        auto &n = data.nodes;
+        n.parent.resize(node_total);
+        n.local.resize(node_total);
+        n.first_shape.resize(node_total);
+        n.shape_count.resize(node_total);
+        n.instance.resize(node_total);
+        write_instance(0, 0, mat4(1.f));
+
+        // A scene with nothing in it keeps no nodes, not even its root
+        auto start = [&](uint32_t p) { return p != 0 || node_total != 0; };
+
+        // Small scenes aren't worth splitting
+        if (shape_total + instance_total <= flatten_grain) {
+            for (uint32_t p = 0; p < roots.size(); p++)
+                if (start(p))
+                    fill(roots[p], mat4(1.f), { data.prototypes[p].first_shape, 1, 0 }, p, p == 0, none);
+        } else {
+            for (uint32_t p = 0; p < roots.size(); p++)
+                if (start(p))
+                    split(roots[p], mat4(1.f), { data.prototypes[p].first_shape, 1, 0 }, p, p == 0, none);
+
+            jobs.parallel_for(tasks.size(), 1, [&](size_t first, size_t last) {
+                for (size_t t = first; t < last; t++)
+                    fill_children(tasks[t]);
+            });
+        }
+
+        group_instances(data);
+    }
+
+private:
+    static constexpr uint64_t unknown = ~uint64_t(0);
+    static constexpr uint32_t none    = ~uint32_t(0);
+
+    // Where the next shape, instance and node go
+    struct offsets {
+        uint64_t shape;
+        uint64_t instance;
+        uint64_t node;
+    };
+
+    // A run of a node's children, together about the grain size
+    struct task {
+        uint32_t node;
+        uint32_t first, last;
+        mat4     ctm; // The node's CTM
+        offsets  at;
+        uint32_t prototype;
+        bool     cut;
+        uint32_t parent; // Where the node was written, when cut
+    };
+
+    const SceneArenaNode &node(uint32_t n) const { return reader.getNodes()[n]; }
+    uint32_t child(const SceneArenaNode &n, uint32_t i) const { return reader.getChildren()[n.firstChild + i]; }
+    bool placed(uint32_t n, bool cut) const { return cut && prototype_of[n] != none; }
+
+    void count_references(uint32_t n, vector<uint32_t> &order) {
+        const auto &a = node(n);
+        for (uint32_t i = 0; i < a.childCount; i++) {
+            uint32_t c = child(a, i);
+            if (references[c]++ == 0) {
+                order.push_back(c);
+                count_references(c, order);
+            }
+        }
+    }
+
+    // Shapes under a node, and the instances and nodes a cut subtree
+    // places. Masters are counted once however often they're used
+    enum { shapes_expanded, shapes_cut, instances_cut, nodes_cut };
+
+    uint64_t shapes(uint32_t n, bool cut) { return count(n, cut ? shapes_cut : shapes_expanded); }
+    uint64_t instances(uint32_t n) { return count(n, instances_cut); }
+    uint64_t nodes(uint32_t n) { return count(n, nodes_cut); }
+
+    uint64_t count(uint32_t n, int what) {
+        auto &memo = counts[what];
+        if (memo[n] != unknown)
+            return memo[n];
+        // Like the DOM's, a node is only kept when there's something under it
+        if (what == nodes_cut && shapes(n, true) + instances(n) == 0)
+            return memo[n] = 0;
+        const auto &a = node(n);
+        uint64_t c = what == instances_cut ? 0 : what == nodes_cut ? 1 : a.primitiveCount;
+        for (uint32_t i = 0; i < a.childCount; i++) {
+            uint32_t ch = child(a, i);
+            if (what != shapes_expanded && prototype_of[ch] != none)
+                c += what != shapes_cut;
+            else
+                c += count(ch, what);
+        }
+        return memo[n] = c;
+    }
+
+    // Work a child is for a task, placing an instance is one piece
+    uint64_t weight(uint32_t c, bool cut) {
+        if (placed(c, cut))
+            return 1;
+        return shapes(c, cut) + (cut ? instances(c) : 0);
+    }
+
+    void advance(offsets &at, uint32_t c, bool cut) {
+        if (placed(c, cut)) {
+            at.instance++;
+            at.node++;
+        } else {
+            at.shape += shapes(c, cut);
+            if (cut) {
+                at.instance += instances(c);
+                at.node     += nodes(c);
+            }
+        }
+    }
+
+    mat4 node_ctm(const SceneArenaNode &a, const mat4 &ctm) const {
+        return transforms::apply_transforms(ctm, reader.getTransformations().data() + a.firstTransformation,
+                                            a.transformationCount);
+    }
+
+    // Writes a node's own shapes at offset, returns the offset after them
+    uint64_t write(const SceneArenaNode &a, const mat4 &ctm, uint64_t offset, uint32_t prototype) {
+        if (a.primitiveCount == 0)
+            return offset;
+        mat4 inv_ctm = inverse_ctm(ctm);
+        auto &s = data.shapes;
+        for (uint32_t i = 0; i < a.primitiveCount; i++, offset++) {
+            s.primitive[offset] = a.firstPrimitive + i;
+            s.prototype[offset] = prototype;
+            s.ctm[offset]       = ctm;
+            s.inv_ctm[offset]   = inv_ctm;
+        }
+        return offset;
+    }
+
+    void write_instance(uint64_t offset, uint32_t prototype, const mat4 &ctm) {
+        auto &i = data.instances;
+        i.prototype[offset] = prototype;
+        i.ctm[offset]       = ctm;
+        i.inv_ctm[offset]   = inverse_ctm(ctm);
+    }
+
+    // Writes a node of prototype 0 at at.node, the shapes it has are at
+    // at.shape. Returns where it went
+    uint32_t write_node(offsets &at, uint32_t parent, const mat4 &local, uint32_t shape_count,
+                        uint32_t instance) {
+        auto &n = data.nodes;
+        uint64_t offset = at.node++;
+        n.parent[offset]      = parent;
+        n.local[offset]       = local;
+        n.first_shape[offset] = shape_count ? at.shape : 0;
+        n.shape_count[offset] = shape_count;
+        n.instance[offset]    = instance;
+        return offset;
+    }
+
+    uint32_t write_node(offsets &at, uint32_t parent, const SceneArenaNode &a, bool cut) {
+        if (!cut)
+            return none;
+        return write_node(at, parent, node_ctm(a, mat4(1.f)), a.primitiveCount, none);
+    }
+
+    // Cuts a node bigger than the grain into tasks, writing its own shapes
+    // on the way. Children bigger than the grain are cut in turn, runs of
+    // smaller ones become tasks
+    void split(uint32_t n, const mat4 &ctm, offsets at, uint32_t prototype, bool cut, uint32_t parent) {
+        const auto &a = node(n);
+        mat4 new_ctm  = node_ctm(a, ctm);
+        uint32_t self = write_node(at, parent, a, cut);
+        at.shape = write(a, new_ctm, at.shape, prototype);
+
+        task run{n, 0, 0, new_ctm, at, prototype, cut, self};
+        uint64_t run_weight = 0;
+        for (uint32_t i = 0; i < a.childCount; i++) {
+            uint32_t c = child(a, i);
+            uint64_t w = weight(c, cut);
+            if (w > flatten_grain) {
+                if (run_weight)
+                    tasks.push_back(run);
+                split(c, new_ctm, at, prototype, cut, self);
+                run_weight = 0;
+            } else {
+                if (run_weight == 0) {
+                    run.first = i;
+                    run.at    = at;
+                }
+                run.last = i + 1;
+                run_weight += w;
+                if (run_weight >= flatten_grain) {
+                    tasks.push_back(run);
+                    run_weight = 0;
+                }
+            }
+            advance(at, c, cut);
+        }
+        if (run_weight)
+            tasks.push_back(run);
+    }
+
+    void fill(uint32_t n, const mat4 &ctm, offsets at, uint32_t prototype, bool cut, uint32_t parent) {
+        const auto &a = node(n);
+        mat4 new_ctm  = node_ctm(a, ctm);
+        uint32_t self = write_node(at, parent, a, cut);
+        at.shape = write(a, new_ctm, at.shape, prototype);
+        fill_run(a, new_ctm, 0, a.childCount, at, prototype, cut, self);
+    }
+
+    void fill_run(const SceneArenaNode &a, const mat4 &ctm, uint32_t first, uint32_t last,
+                  offsets at, uint32_t prototype, bool cut, uint32_t parent) {
+        for (uint32_t i = first; i < last; i++) {
+            uint32_t c = child(a, i);
+            if (placed(c, cut)) {
+                write_instance(at.instance, prototype_of[c], ctm);
+                offsets here = at;
+                write_node(here, parent, mat4(1.f), 0, at.instance);
+            } else if (weight(c, cut) != 0) {
+                fill(c, ctm, at, prototype, cut, parent);
+            }
+            advance(at, c, cut);
+        }
+    }
+
+    void fill_children(const task &t) {
+        fill_run(node(t.node), t.ctm, t.first, t.last, t.at, t.prototype, t.cut, t.parent);
+    }
+
+    const ScenestreamReader &reader;
+    RenderData &data;
+    vector<uint32_t> references;
+    vector<uint32_t> prototype_of;
+    vector<uint64_t> counts[4];
+    vector<task> tasks;
+};
+
+bool SceneParser::parse(string filepath, RenderData &renderData, bool streaming) {
+  if (scene_binary::load(filepath, renderData))
+    return true;
+
+  renderData.materials.clear();
+  renderData.primitives.clear();
+  renderData.prototypes.clear();
+  renderData.shapes    = RenderShapes();
+  renderData.instances = RenderInstances();
+  renderData.nodes     = RenderNodes();
+
+  if (streaming) {
+    ScenestreamReader streamReader(filepath);
+    if (!streamReader.readXML())
+      return false;
+
+    renderData.globalData = streamReader.getGlobalData();
+    renderData.cameraData = streamReader.getCameraData();
+    renderData.lights     = streamReader.getLights();
+    renderData.emitters   = streamReader.getEmitters();
+
+    if (auto root = streamReader.getRootNode()) {
+      arena_flattener flattener(streamReader, renderData);
+      flattener.flatten(root - streamReader.getNodes().data(), job_system::shared());
+    }
+
+    // Shapes index the arena's primitives, which the reader no longer needs
+    intern_materials(streamReader.takePrimitives(), renderData);
+    return true;
+  }
+
   ScenefileReader fileReader = ScenefileReader(filepath);
   bool success = fileReader.readXML();
   if (!success)
@@ -34,9 +532,14 @@ bool SceneParser::parse(string filepath, RenderData &renderData) {
   renderData.globalData = fileReader.getGlobalData();
   renderData.cameraData = fileReader.getCameraData();
   renderData.lights     = fileReader.getLights();
+  renderData.emitters   = fileReader.getEmitters();
 
-  renderData.shapes.clear();
-  recursive_traversal(mat4(1.0f), fileReader.getRootNode(), renderData.shapes, 0);
+  if (fileReader.getRootNode())
+    intern_materials(dom_flattener(renderData).flatten(fileReader.getRootNode()), renderData);
 
   return true;
 }
+
+bool SceneParser::compile(string filepath, const RenderData &renderData) {
+  return scene_binary::save(filepath, renderData);
+}
@@ -1,15 +1,79 @@
 #pragma once
 
 #include "scenedata.h"
+#include <cstdint>
 #include <vector>
 #include <string>
 
-// Struct which contains data for a single primitive, to be used for rendering
+// The flattened scene graph. A subtree used as a master from more than one
+// place is a prototype: its shapes are stored once, relative to its root,
+// and instances place it in the scene. Everything else is prototype 0,
+// which has a single instance at the origin. Nested masters are expanded
+// into the prototype they're in.
+
+// A primitive of the scene file. Equal materials are stored once, in a
+// table primitives index
+struct RenderPrimitive {
+  PrimitiveType type;
+  uint32_t      material; // index into RenderData::materials
+  std::string   meshfile; // Used for triangle meshes
+};
+
+// Shapes of every prototype, one entry per primitive in each array. A
+// shape's id is its index, prototype by prototype, each one's in the order
+// of a depth-first traversal
+struct RenderShapes {
+  std::vector<uint32_t>  primitive; // index into RenderData::primitives
+  std::vector<uint32_t>  prototype; // index into RenderData::prototypes
+  std::vector<glm::mat4> ctm;       // the cumulative transformation matrix, within the prototype
+  std::vector<glm::mat4> inv_ctm;   // the inverse of the cumulative transformation matrix
+
+  size_t size() const { return primitive.size(); }
+  bool empty() const { return primitive.empty(); }
+};
+
+// Where prototypes are placed, grouped by prototype
+struct RenderInstances {
+  std::vector<uint32_t>  prototype; // index into RenderData::prototypes
+  std::vector<glm::mat4> ctm;       // from the prototype's space to world space
+  std::vector<glm::mat4> inv_ctm;
+
+  size_t size() const { return prototype.size(); }
+  bool empty() const { return prototype.empty(); }
+};
+
+// A prototype's runs of shapes and of instances
+struct RenderPrototype {
+  uint32_t first_shape;
+  uint32_t shape_count;
+  uint32_t first_instance;
+  uint32_t instance_count;
+};
+
+// The transforms of prototype 0's part of the graph, so it can be moved at
+// runtime. Nodes are in depth-first order, parents before their children,
+// which makes every subtree a run. An instance is a node of its own, under
+// the node that places it. Subtrees without shapes or instances are left out
+struct RenderNodes {
+  static constexpr uint32_t none = ~uint32_t(0);
+
+  std::vector<uint32_t>  parent;      // none for the root
+  std::vector<glm::mat4> local;       // the node's transformations, relative to its parent
+  std::vector<uint32_t>  first_shape; // its own shapes, a run of prototype 0's
+  std::vector<uint32_t>  shape_count;
+  std::vector<uint32_t>  instance;    // index into RenderData::instances, or none
+
+  size_t size() const { return parent.size(); }
+  bool empty() const { return parent.empty(); }
+};
+
+// A single shape's data, as references into RenderData's arrays
 struct RenderShapeData {
-  long id;
-  ScenePrimitive primitive;
-  glm::mat4 ctm; // the cumulative transformation matrix
-  glm::mat4 inv_ctm; // the inverse of the cumulative transformation matrix
+  const RenderPrimitive &primitive;
+  const SceneMaterial   &material;
+  const RenderPrototype &prototype;
+  const glm::mat4 &ctm;
+  const glm::mat4 &inv_ctm;
 };
 
 // Struct which contains all the data needed to render a scene
@@ -18,7 +82,27 @@ struct RenderData {
   SceneCameraData cameraData;
 
   std::vector<SceneLightData> lights;
-  std::vector<RenderShapeData> shapes;
+  std::vector<SceneMaterial> materials;    // every distinct material once
+  std::vector<RenderPrimitive> primitives; // every primitive of the file once, shared by its instances
+  std::vector<RenderPrototype> prototypes;
+  RenderShapes shapes;
+  RenderInstances instances;
+  RenderNodes nodes;
+  std::vector<SceneEmitterData> emitters;
+
+  RenderShapeData shape(size_t i) const {
+    const auto &p = primitives[shapes.primitive[i]];
+    return { p, materials[p.material], prototypes[shapes.prototype[i]],
+             shapes.ctm[i], shapes.inv_ctm[i] };
+  }
+
+  // Shapes drawn, every prototype's once per instance
+  size_t drawn_shapes() const {
+    size_t n = 0;
+    for (const auto &p : prototypes)
+      n += size_t(p.shape_count) * p.instance_count;
+    return n;
+  }
 };
 
 class SceneParser {
@@ -26,7 +110,16 @@ public:
   // Parse the scene and store the results in renderData.
   // @param filepath    The path of the scene file to load.
   // @param renderData  On return, this will contain the metadata of the loaded scene.
+  // @param streaming   Whether to use ScenestreamReader, which parses in one pass
+  //                    without a DOM, instead of ScenefileReader.
   // @return            A boolean value indicating whether the parse was successful.
-  static bool parse(std::string filepath, RenderData &renderData);
+  static bool parse(std::string filepath, RenderData &renderData, bool streaming = true);
+
+  // Compile a parsed scene into a binary file, which parse() loads instead
+  // of the scene file for as long as it is newer.
+  // @param filepath    The path of the scene file renderData was parsed from.
+  // @param renderData  The parsed scene.
+  // @return            A boolean value indicating whether it was written.
+  static bool compile(std::string filepath, const RenderData &renderData);
 };
 
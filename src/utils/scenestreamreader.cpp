@@ -0,0 +1,952 @@
+#include "scenestreamreader.h"
+
+#include "glm/gtc/type_ptr.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string_view>
+
+#define ERROR_AT(c) "error at line " << c.lineNumber() << " col " << c.columnNumber() << ": "
+#define PARSE_ERROR(c) std::cout << ERROR_AT(c) << "could not parse <" << c.name() \
+   << ">" << std::endl
+#define UNSUPPORTED_ELEMENT(c) std::cout << ERROR_AT(c) << "unsupported element <" \
+   << c.name() << ">" << std::endl;
+
+/**
+* Walks the tags of an XML document in place. Names and attribute values are
+* views into the document, entities in attribute values are decoded over the
+* encoded text. Text, comments, CDATA, processing instructions and DOCTYPEs
+* without an internal subset are skipped.
+*/
+class XmlCursor {
+public:
+   enum Token { START, END, END_OF_FILE, INVALID };
+
+   XmlCursor(std::string &document)
+       : m_begin(document.data()), m_p(document.data()),
+         m_end(document.data() + document.size()), m_tag(document.data()) {}
+
+   // Moves to the next start or end tag. A self-closing tag is a start tag
+   // followed by its end tag
+   Token next();
+
+   // Moves to the next child of the element open at depth, skipping what is
+   // left of the one before. Returns false once that element ends, or on an
+   // error
+   bool nextChild(int depth) {
+       while (true) {
+           Token token = next();
+           if (token == START && m_depth == depth + 1)
+               return true;
+           if (token == END && m_depth < depth)
+               return false;
+           if (token == END_OF_FILE || token == INVALID) {
+               if (token == END_OF_FILE) fail("unexpected end of file");
+               return false;
+           }
+       }
+   }
+
+   int depth() const { return m_depth; }
+   bool failed() const { return m_failed; }
+   std::string_view name() const { return m_name; }
+
+   bool hasAttribute(std::string_view name) const {
+       return find(name) != nullptr;
+   }
+
+   std::string_view attribute(std::string_view name) const {
+       const std::string_view *value = find(name);
+       return value ? *value : std::string_view();
+   }
+
+   int lineNumber() const {
+       return 1 + std::count(m_begin, m_tag, '\n');
+   }
+
+   int columnNumber() const {
+       const char *line = m_tag;
+       while (line > m_begin && line[-1] != '\n') line--;
+       return 1 + (m_tag - line);
+   }
+
+   // Reports a syntax error at the current tag
+   void fail(const char *message) {
+       if (!m_failed)
+           std::cout << ERROR_AT((*this)) << message << std::endl;
+       m_failed = true;
+   }
+
+private:
+   static constexpr size_t max_attributes = 16;
+
+   static bool isSpace(char c) {
+       return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+   }
+
+   static bool isNameEnd(char c) {
+       return isSpace(c) || c == '/' || c == '>' || c == '=';
+   }
+
+   const std::string_view *find(std::string_view name) const {
+       for (size_t i = 0; i < m_attributeCount; i++)
+           if (m_attributes[i][0] == name)
+               return &m_attributes[i][1];
+       return nullptr;
+   }
+
+   // Moves past the first occurrence of s, false if there is none
+   bool skipPast(const char *s) {
+       std::string_view rest(m_p, m_end - m_p);
+       size_t at = rest.find(s);
+       if (at == std::string_view::npos)
+           return false;
+       m_p += at + std::strlen(s);
+       return true;
+   }
+
+   void skipSpace() {
+       while (m_p < m_end && isSpace(*m_p)) m_p++;
+   }
+
+   std::string_view readName() {
+       const char *start = m_p;
+       while (m_p < m_end && !isNameEnd(*m_p)) m_p++;
+       return std::string_view(start, m_p - start);
+   }
+
+   bool readStartTag();
+   bool decode(char *begin, char *&end);
+
+   const char *m_begin;
+   char *m_p;
+   char *m_end;
+   const char *m_tag;
+
+   std::string_view m_name;
+   std::string_view m_attributes[max_attributes][2];
+   size_t m_attributeCount = 0;
+   std::vector<std::string_view> m_open;
+   int m_depth = 0;
+   bool m_selfClosing = false;
+   bool m_failed = false;
+};
+
+XmlCursor::Token XmlCursor::next() {
+   if (m_failed)
+       return INVALID;
+
+   if (m_selfClosing) {
+       m_selfClosing = false;
+       m_open.pop_back();
+       m_depth--;
+       return END;
+   }
+
+   while (true) {
+       char *lt = static_cast<char*>(std::memchr(m_p, '<', m_end - m_p));
+       if (!lt) {
+           m_p = m_end;
+           return END_OF_FILE;
+       }
+       m_p = lt;
+       m_tag = lt;
+
+       std::string_view rest(m_p, m_end - m_p);
+       if (rest.starts_with("<!--")) {
+           if (!skipPast("-->")) break;
+       } else if (rest.starts_with("<![CDATA[")) {
+           if (!skipPast("]]>")) break;
+       } else if (rest.starts_with("<?")) {
+           if (!skipPast("?>")) break;
+       } else if (rest.starts_with("<!")) {
+           size_t close = rest.find('>');
+           if (close == std::string_view::npos) break;
+           if (rest.substr(0, close).find('[') != std::string_view::npos) {
+               fail("DOCTYPE internal subsets are not supported");
+               return INVALID;
+           }
+           m_p += close + 1;
+       } else if (rest.starts_with("</")) {
+           m_p += 2;
+           m_name = readName();
+           skipSpace();
+           if (m_p == m_end || *m_p != '>') break;
+           m_p++;
+           if (m_open.empty() || m_open.back() != m_name) {
+               fail("mismatched end tag");
+               return INVALID;
+           }
+           m_open.pop_back();
+           m_depth--;
+           return END;
+       } else {
+           m_p++;
+           if (!readStartTag()) break;
+           m_open.push_back(m_name);
+           m_depth++;
+           return START;
+       }
+   }
+
+   fail("malformed tag");
+   return INVALID;
+}
+
+bool XmlCursor::readStartTag() {
+   m_name = readName();
+   m_attributeCount = 0;
+   if (m_name.empty())
+       return false;
+
+   while (true) {
+       skipSpace();
+       if (m_p == m_end)
+           return false;
+       if (*m_p == '>') {
+           m_p++;
+           return true;
+       }
+       if (*m_p == '/') {
+           if (++m_p == m_end || *m_p != '>')
+               return false;
+           m_p++;
+           m_selfClosing = true;
+           return true;
+       }
+
+       std::string_view name = readName();
+       skipSpace();
+       if (name.empty() || m_p == m_end || *m_p != '=')
+           return false;
+       m_p++;
+       skipSpace();
+       if (m_p == m_end || (*m_p != '"' && *m_p != '\''))
+           return false;
+
+       char quote = *m_p++;
+       char *begin = m_p;
+       char *end = static_cast<char*>(std::memchr(m_p, quote, m_end - m_p));
+       if (!end)
+           return false;
+       m_p = end + 1;
+       if (std::memchr(begin, '&', end - begin) && !decode(begin, end))
+           return false;
+
+       if (m_attributeCount == max_attributes)
+           return false;
+       m_attributes[m_attributeCount][0] = name;
+       m_attributes[m_attributeCount][1] = std::string_view(begin, end - begin);
+       m_attributeCount++;
+   }
+}
+
+/**
+* Decodes the entity and character references in [begin, end) in place, end
+* is moved back to the end of the decoded text.
+*/
+bool XmlCursor::decode(char *begin, char *&end) {
+   char *out = begin;
+   for (char *in = begin; in < end; ) {
+       if (*in != '&') {
+           *out++ = *in++;
+           continue;
+       }
+       char *semicolon = static_cast<char*>(std::memchr(in, ';', end - in));
+       if (!semicolon)
+           return false;
+       std::string_view entity(in + 1, semicolon - in - 1);
+       in = semicolon + 1;
+
+       if (entity == "lt") *out++ = '<';
+       else if (entity == "gt") *out++ = '>';
+       else if (entity == "amp") *out++ = '&';
+       else if (entity == "quot") *out++ = '"';
+       else if (entity == "apos") *out++ = '\'';
+       else if (entity.starts_with('#')) {
+           unsigned code = 0;
+           bool hex = entity.size() > 1 && entity[1] == 'x';
+           const char *first = entity.data() + (hex ? 2 : 1);
+           const char *last = entity.data() + entity.size();
+           auto [ptr, ec] = std::from_chars(first, last, code, hex ? 16 : 10);
+           if (ec != std::errc() || ptr != last || first == last || code > 0x10FFFF)
+               return false;
+
+           // Written as UTF-8, which is never longer than the reference
+           if (code < 0x80) {
+               *out++ = char(code);
+           } else if (code < 0x800) {
+               *out++ = char(0xC0 | (code >> 6));
+               *out++ = char(0x80 | (code & 0x3F));
+           } else if (code < 0x10000) {
+               *out++ = char(0xE0 | (code >> 12));
+               *out++ = char(0x80 | ((code >> 6) & 0x3F));
+               *out++ = char(0x80 | (code & 0x3F));
+           } else {
+               *out++ = char(0xF0 | (code >> 18));
+               *out++ = char(0x80 | ((code >> 12) & 0x3F));
+               *out++ = char(0x80 | ((code >> 6) & 0x3F));
+               *out++ = char(0x80 | (code & 0x3F));
+           }
+       } else {
+           return false;
+       }
+   }
+   end = out;
+   return true;
+}
+
+ScenestreamReader::ScenestreamReader(const std::string& name)
+{
+   file_name = name;
+
+   memset(&m_cameraData, 0, sizeof(SceneCameraData));
+   memset(&m_globalData, 0, sizeof(SceneGlobalData));
+}
+
+SceneGlobalData ScenestreamReader::getGlobalData() const {
+   return m_globalData;
+}
+
+SceneCameraData ScenestreamReader::getCameraData() const {
+   return m_cameraData;
+}
+
+std::vector<SceneLightData> ScenestreamReader::getLights() const {
+   return m_lights;
+}
+
+std::vector<SceneEmitterData> ScenestreamReader::getEmitters() const {
+   return m_emitters;
+}
+
+const SceneArenaNode* ScenestreamReader::getRootNode() const {
+   auto node = m_objects.find("root");
+   if (node == m_objects.end())
+       return nullptr;
+   return &m_nodes[node->second];
+}
+
+bool ScenestreamReader::readXML() {
+   auto start = std::chrono::steady_clock::now();
+
+   // Read the whole file into one buffer, which the cursor parses in place
+   std::ifstream file(file_name, std::ios::binary);
+   if (!file) {
+       std::cout << "could not open " << file_name << std::endl;
+       return false;
+   }
+   file.seekg(0, std::ios::end);
+   std::string document(size_t(file.tellg()), '\0');
+   file.seekg(0, std::ios::beg);
+   file.read(document.data(), document.size());
+   file.close();
+
+   XmlCursor cursor(document);
+   if (cursor.next() != XmlCursor::START || cursor.name() != "scenefile") {
+       std::cout << "missing <scenefile>" << std::endl;
+       return false;
+   }
+
+   // Default camera
+   m_cameraData.pos = glm::vec4(5.f, 5.f, 5.f, 1.f);
+   m_cameraData.up = glm::vec4(0.f, 1.f, 0.f, 0.f);
+   m_cameraData.look = glm::vec4(-1.f, -1.f, -1.f, 0.f);
+   m_cameraData.heightAngle = 45 * M_PI / 180.f;
+
+   // Default global data
+   m_globalData.ka = 0.5f;
+   m_globalData.kd = 0.5f;
+   m_globalData.ks = 0.5f;
+
+   m_basepath = std::filesystem::path(file_name).parent_path().parent_path();
+
+   // A guess from the file's size saves most of the arena's regrowth
+   m_nodes.reserve(document.size() / 256);
+   m_transformations.reserve(document.size() / 128);
+   m_primitives.reserve(document.size() / 512);
+   m_children.reserve(document.size() / 256);
+
+   // Iterate over child elements
+   while (cursor.nextChild(1)) {
+       if (cursor.name() == "globaldata") {
+           if (!parseGlobalData(cursor))
+               return false;
+       } else if (cursor.name() == "lightdata") {
+           if (!parseLightData(cursor))
+               return false;
+       } else if (cursor.name() == "cameradata") {
+           if (!parseCameraData(cursor))
+               return false;
+       } else if (cursor.name() == "emitter") {
+           if (!parseEmitterData(cursor))
+               return false;
+       } else if (cursor.name() == "object") {
+           if (!parseObjectData(cursor))
+               return false;
+       } else {
+           UNSUPPORTED_ELEMENT(cursor);
+           return false;
+       }
+   }
+   if (cursor.failed())
+       return false;
+
+   auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+   std::cout << "Finished reading " << file_name << ": " << m_nodes.size() << " nodes, "
+             << m_primitives.size() << " primitives in " << ms << " ms" << std::endl;
+   return true;
+}
+
+/**
+* Parses a number the way QString::toDouble does, surrounding whitespace and
+* a leading plus sign are allowed.
+*/
+template <typename T> bool toNumber(std::string_view s, T &a) {
+   while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+   while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+   if (!s.empty() && s.front() == '+') s.remove_prefix(1);
+
+   auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), a);
+   return ec == std::errc() && ptr == s.data() + s.size() && !s.empty();
+}
+
+bool parseInt(const XmlCursor &single, int &a, const char *name) {
+   return single.hasAttribute(name) && toNumber(single.attribute(name), a);
+}
+
+bool parseSingle(const XmlCursor &single, float &a, const char *name) {
+   double v;
+   if (!single.hasAttribute(name) || !toNumber(single.attribute(name), v))
+       return false;
+   a = v;
+   return true;
+}
+
+bool parseTriple(const XmlCursor &triple, float &a, float &b, float &c,
+                 const char *str_a, const char *str_b, const char *str_c) {
+   float v[3];
+   if (!parseSingle(triple, v[0], str_a) ||
+       !parseSingle(triple, v[1], str_b) ||
+       !parseSingle(triple, v[2], str_c))
+       return false;
+   a = v[0]; b = v[1]; c = v[2];
+   return true;
+}
+
+bool parseQuadruple(const XmlCursor &quadruple, float &a, float &b, float &c, float &d,
+                    const char *str_a, const char *str_b, const char *str_c, const char *str_d) {
+   float v[4];
+   if (!parseSingle(quadruple, v[0], str_a) ||
+       !parseSingle(quadruple, v[1], str_b) ||
+       !parseSingle(quadruple, v[2], str_c) ||
+       !parseSingle(quadruple, v[3], str_d))
+       return false;
+   a = v[0]; b = v[1]; c = v[2]; d = v[3];
+   return true;
+}
+
+/**
+* Helper function to parse a row-major <matrix> into a column-major glm matrix.
+*/
+bool parseMatrix(XmlCursor &matrix, glm::mat4 &m) {
+   float *valuePtr = glm::value_ptr(m);
+   int depth = matrix.depth();
+   int col = 0;
+
+   while (col < 4 && matrix.nextChild(depth)) {
+       float a, b, c, d;
+       if (!parseQuadruple(matrix, a, b, c, d, "a", "b", "c", "d")
+               && !parseQuadruple(matrix, a, b, c, d, "v1", "v2", "v3", "v4")) {
+           PARSE_ERROR(matrix);
+           return false;
+       }
+       valuePtr[0*4 + col] = a;
+       valuePtr[1*4 + col] = b;
+       valuePtr[2*4 + col] = c;
+       valuePtr[3*4 + col] = d;
+       col++;
+   }
+
+   return (col == 4);
+}
+
+/**
+* Helper function to parse a color, with an optional alpha that defaults to 1.
+*/
+bool parseColor(const XmlCursor &color, SceneColor &c) {
+   c.a = 1;
+   return parseQuadruple(color, c.r, c.g, c.b, c.a, "r", "g", "b", "a") ||
+          parseQuadruple(color, c.r, c.g, c.b, c.a, "x", "y", "z", "w") ||
+          parseTriple(color, c.r, c.g, c.b, "r", "g", "b") ||
+          parseTriple(color, c.r, c.g, c.b, "x", "y", "z");
+}
+
+/**
+* Helper function to parse a texture map tag, relative to the scenefile root.
+*/
+bool parseMap(const XmlCursor &e, SceneFileMap &map, const std::filesystem::path &basepath) {
+   if (!e.hasAttribute("file"))
+       return false;
+
+   map.filename = (basepath / e.attribute("file")).string();
+   map.repeatU = 1;
+   map.repeatV = 1;
+   if ((e.hasAttribute("u") && !parseSingle(e, map.repeatU, "u")) ||
+       (e.hasAttribute("v") && !parseSingle(e, map.repeatV, "v")))
+       return false;
+   map.isUsed = true;
+
+   if (e.hasAttribute("normal") && e.hasAttribute("displacement")) {
+       map.normal_fn = (basepath / e.attribute("normal")).string();
+       map.disp_fn   = (basepath / e.attribute("displacement")).string();
+       map.parallax  = true;
+   }
+
+   return true;
+}
+
+bool ScenestreamReader::parseGlobalData(XmlCursor &e) {
+   int depth = e.depth();
+   while (e.nextChild(depth)) {
+       float *coeff = nullptr;
+       if (e.name() == "ambientcoeff") coeff = &m_globalData.ka;
+       else if (e.name() == "diffusecoeff") coeff = &m_globalData.kd;
+       else if (e.name() == "specularcoeff") coeff = &m_globalData.ks;
+       else if (e.name() == "transparentcoeff") coeff = &m_globalData.kt;
+
+       if (coeff && !parseSingle(e, *coeff, "v")) {
+           PARSE_ERROR(e);
+           return false;
+       }
+   }
+
+   return !e.failed();
+}
+
+bool ScenestreamReader::parseLightData(XmlCursor &e) {
+   // Create a default light
+   SceneLightData light;
+   memset(&light, 0, sizeof(SceneLightData));
+   light.pos = glm::vec4(3.f, 3.f, 3.f, 1.f);
+   light.dir = glm::vec4(0.f, 0.f, 0.f, 0.f);
+   light.color.r = light.color.g = light.color.b = 1;
+   light.function = glm::vec3(1, 0, 0);
+
+   int depth = e.depth();
+   while (e.nextChild(depth)) {
+       if (e.name() == "id") {
+           if (!parseInt(e, light.id, "v")) {
+               PARSE_ERROR(e);
+               return false;
+           }
+       } else if (e.name() == "type") {
+           if (!e.hasAttribute("v")) {
+               PARSE_ERROR(e);
+               return false;
+           }
+           std::string_view type = e.attribute("v");
+           if (type == "directional") light.type = LightType::LIGHT_DIRECTIONAL;
+           else if (type == "point") light.type = LightType::LIGHT_POINT;
+           else if (type == "spot") light.type = LightType::LIGHT_SPOT;
+           else if (type == "area") light.type = LightType::LIGHT_AREA;
+           else {
+               std::cout << ERROR_AT(e) << "unknown light type " << type << std::endl;
+               return false;
+           }
+       } else if (e.name() == "color") {
+           if (!parseColor(e, light.color)) {
+               PARSE_ERROR(e);
+               return false;
+           }
+       } else if (e.name() == "function") {
+           if (!parseTriple(e, light.function.x, light.function.y, light.function.z, "a", "b", "c") &&
+               !parseTriple(e, light.function.x, light.function.y, light.function.z, "x", "y", "z") &&
+               !parseTriple(e, light.function.x, light.function.y, light.function.z, "v1", "v2", "v3")) {
+               PARSE_ERROR(e);
+               return false;
+           }
+       } else if (e.name() == "position") {
+           if (light.type == LightType::LIGHT_DIRECTIONAL) {
+               std::cout << ERROR_AT(e) << "position is not applicable to directional lights" << std::endl;
+               return false;
+           }
+           if (!parseTriple(e, light.pos.x, light.pos.y, light.pos.z, "x", "y", "z")) {
+               PARSE_ERROR(e);
+               return false;
+           }
+       } else if (e.name() == "direction") {
+           if (light.type == LightType::LIGHT_POINT) {
+               std::cout << ERROR_AT(e) << "direction is not applicable to point lights" << std::endl;
+               return false;
+           }
+           if (!parseTriple(e, light.dir.x, light.dir.y, light.dir.z, "x", "y", "z")) {
+               PARSE_ERROR(e);
+               return false;
+           }
+       } else if (e.name() == "penumbra" || e.name() == "angle") {
+           if (light.type != LightType::LIGHT_SPOT) {
+               std::cout << ERROR_AT(e) << e.name() << " is only applicable to spot lights" << std::endl;
+               return false;
+           }
+           float degrees = 0.f;
+           if (!parseSingle(e, degrees, "v")) {
+               PARSE_ERROR(e);
+               return false;
+           }
+           (e.name() == "angle" ? light.angle : light.penumbra) = degrees * M_PI / 180.f;
+       } else if (e.name() == "width" || e.name() == "height") {
+           if (light.type != LightType::LIGHT_AREA) {
+               std::cout << ERROR_AT(e) << e.name() << " is only applicable to area lights" << std::endl;
+               return false;
+           }
+           if (!parseSingle(e, e.name() == "width" ? light.width : light.height, "v")) {
+               PARSE_ERROR(e);
+               return false;
+           }
+       } else {
+           UNSUPPORTED_ELEMENT(e);
+           return false;
+       }
+   }
+
+   m_lights.push_back(light);
+   return !e.failed();
+}
+
+bool ScenestreamReader::parseEmitterData(XmlCursor &e) {
+   // Default emitter, the size of the original fireplace
+   SceneEmitterData emitter;
+   emitter.pos = glm::vec3(0.f);
+   emitter.radius = 0.7f;
+   emitter.rate = 12000.f;
+   emitter.lifetime = 4.2f;
+
+   int depth = e.depth();
+   while (e.nextChild(depth)) {
+       if (e.name() == "position") {
+           if (!parseTriple(e, emitter.pos.x, emitter.pos.y, emitter.pos.z, "x", "y", "z")) {
+               PARSE_ERROR(e);
+               return false;
+           }
+       } else if (e.name() == "radius") {
+           if (!parseSingle(e, emitter.radius, "v")) {
+               PARSE_ERROR(e);
+               return false;
+           }
+       } else if (e.name() == "rate") {
+           if (!parseSingle(e, emitter.rate, "v") || emitter.rate <= 0) {
+               PARSE_ERROR(e);
+               return false;
+           }
+       } else if (e.name() == "lifetime") {
+           if (!parseSingle(e, emitter.lifetime, "v") || emitter.lifetime <= 0) {
+               PARSE_ERROR(e);
+               return false;
+           }
+       } else if (e.name() == "texture") {
+           if (!e.hasAttribute("file")) {
+               PARSE_ERROR(e);
+               return false;
+           }
+           emitter.texture = (m_basepath / e.attribute("file")).string();
+       } else {
+           UNSUPPORTED_ELEMENT(e);
+           return false;
+       }
+   }
+
+   m_emitters.push_back(emitter);
+   return !e.failed();
+}
+
+bool ScenestreamReader::parseCameraData(XmlCursor &e) {
+   bool focusFound = false;
+   bool lookFound = false;
+
+   int depth = e.depth();
+   while (e.nextChild(depth)) {
+       if (e.name() == "pos") {
+           if (!parseTriple(e, m_cameraData.pos.x, m_cameraData.pos.y, m_cameraData.pos.z, "x", "y", "z")) {
+               PARSE_ERROR(e);
+               return false;
+           }
+           m_cameraData.pos.w = 1;
+       } else if (e.name() == "look" || e.name() == "focus") {
+           if (!parseTriple(e, m_cameraData.look.x, m_cameraData.look.y, m_cameraData.look.z, "x", "y", "z")) {
+               PARSE_ERROR(e);
+               return false;
+           }
+
+           // A focus point is turned into a look vector once the position is known
+           bool focus = e.name() == "focus";
+           m_cameraData.look.w = focus ? 1 : 0;
+           (focus ? focusFound : lookFound) = true;
+       } else if (e.name() == "up") {
+           if (!parseTriple(e, m_cameraData.up.x, m_cameraData.up.y, m_cameraData.up.z, "x", "y", "z")) {
+               PARSE_ERROR(e);
+               return false;
+           }
+           m_cameraData.up.w = 0;
+       } else if (e.name() == "heightangle") {
+           float heightAngle = 0.f;
+           if (!parseSingle(e, heightAngle, "v")) {
+               PARSE_ERROR(e);
+               return false;
+           }
+           m_cameraData.heightAngle = heightAngle * M_PI / 180.f;
+       } else if (e.name() == "aperture") {
+           if (!parseSingle(e, m_cameraData.aperture, "v")) {
+               PARSE_ERROR(e);
+               return false;
+           }
+       } else if (e.name() == "focallength") {
+           if (!parseSingle(e, m_cameraData.focalLength, "v")) {
+               PARSE_ERROR(e);
+               return false;
+           }
+       } else {
+           UNSUPPORTED_ELEMENT(e);
+           return false;
+       }
+   }
+   if (e.failed())
+       return false;
+
+   if (focusFound && lookFound) {
+       std::cout << ERROR_AT(e) << "camera can not have both look and focus" << std::endl;
+       return false;
+   }
+
+   if (focusFound)
+       m_cameraData.look -= m_cameraData.pos;
+
+   return true;
+}
+
+uint32_t ScenestreamReader::openNode() {
+   m_nodes.push_back(SceneArenaNode{});
+   return m_nodes.size() - 1;
+}
+
+void ScenestreamReader::closeNode(uint32_t node, size_t transformations, size_t primitives, size_t children) {
+   SceneArenaNode &n = m_nodes[node];
+
+   n.firstTransformation = m_transformations.size();
+   n.transformationCount = m_pendingTransformations.size() - transformations;
+   m_transformations.insert(m_transformations.end(),
+                            m_pendingTransformations.begin() + transformations,
+                            m_pendingTransformations.end());
+   m_pendingTransformations.resize(transformations);
+
+   n.firstPrimitive = m_primitives.size();
+   n.primitiveCount = m_pendingPrimitives.size() - primitives;
+   m_primitives.insert(m_primitives.end(),
+                       std::make_move_iterator(m_pendingPrimitives.begin() + primitives),
+                       std::make_move_iterator(m_pendingPrimitives.end()));
+   m_pendingPrimitives.resize(primitives);
+
+   n.firstChild = m_children.size();
+   n.childCount = m_pendingChildren.size() - children;
+   m_children.insert(m_children.end(), m_pendingChildren.begin() + children, m_pendingChildren.end());
+   m_pendingChildren.resize(children);
+}
+
+/**
+* Parse a top-level <object> tag into a new node named after it.
+*/
+bool ScenestreamReader::parseObjectData(XmlCursor &object) {
+   if (!object.hasAttribute("name")) {
+       PARSE_ERROR(object);
+       return false;
+   }
+
+   if (object.attribute("type") != "tree") {
+       std::cout << "top-level <object> elements must be of type tree" << std::endl;
+       return false;
+   }
+
+   std::string name(object.attribute("name"));
+   if (m_objects.count(name)) {
+       std::cout << ERROR_AT(object) << "two objects with the same name: " << name << std::endl;
+       return false;
+   }
+
+   uint32_t node = openNode();
+
+   size_t transformations = m_pendingTransformations.size();
+   size_t primitives = m_pendingPrimitives.size();
+   size_t children = m_pendingChildren.size();
+   if (!parseTree(object))
+       return false;
+   closeNode(node, transformations, primitives, children);
+
+   // Named once complete, so an object can't instance itself
+   m_objects[name] = node;
+   return true;
+}
+
+/**
+* Parse the <transblock> children of a tree object into children of the open node.
+*/
+bool ScenestreamReader::parseTree(XmlCursor &tree) {
+   int depth = tree.depth();
+   while (tree.nextChild(depth)) {
+       if (tree.name() != "transblock") {
+           UNSUPPORTED_ELEMENT(tree);
+           return false;
+       }
+       uint32_t child = openNode();
+       if (!parseTransBlock(tree, child)) {
+           PARSE_ERROR(tree);
+           return false;
+       }
+       m_pendingChildren.push_back(child);
+   }
+
+   return !tree.failed();
+}
+
+/**
+* Parse a <transblock> tag into node, see ScenefileReader::parseTransBlock.
+*/
+bool ScenestreamReader::parseTransBlock(XmlCursor &e, uint32_t node) {
+   size_t transformations = m_pendingTransformations.size();
+   size_t primitives = m_pendingPrimitives.size();
+   size_t children = m_pendingChildren.size();
+
+   int depth = e.depth();
+   while (e.nextChild(depth)) {
+       if (e.name() == "translate") {
+           SceneTransformation &t = m_pendingTransformations.emplace_back();
+           t.type = TransformationType::TRANSFORMATION_TRANSLATE;
+
+           if (!parseTriple(e, t.translate.x, t.translate.y, t.translate.z, "x", "y", "z")) {
+               PARSE_ERROR(e);
+               return false;
+           }
+       } else if (e.name() == "rotate") {
+           SceneTransformation &t = m_pendingTransformations.emplace_back();
+           t.type = TransformationType::TRANSFORMATION_ROTATE;
+
+           float angle;
+           if (!parseQuadruple(e, t.rotate.x, t.rotate.y, t.rotate.z, angle, "x", "y", "z", "angle")) {
+               PARSE_ERROR(e);
+               return false;
+           }
+
+           // Convert to radians
+           t.angle = angle * M_PI / 180;
+       } else if (e.name() == "scale") {
+           SceneTransformation &t = m_pendingTransformations.emplace_back();
+           t.type = TransformationType::TRANSFORMATION_SCALE;
+
+           if (!parseTriple(e, t.scale.x, t.scale.y, t.scale.z, "x", "y", "z")) {
+               PARSE_ERROR(e);
+               return false;
+           }
+       } else if (e.name() == "matrix") {
+           SceneTransformation &t = m_pendingTransformations.emplace_back();
+           t.type = TransformationType::TRANSFORMATION_MATRIX;
+
+           if (!parseMatrix(e, t.matrix)) {
+               PARSE_ERROR(e);
+               return false;
+           }
+       } else if (e.name() == "object") {
+           std::string_view type = e.attribute("type");
+           if (type == "master") {
+               std::string masterName(e.attribute("name"));
+               auto master = m_objects.find(masterName);
+               if (master == m_objects.end()) {
+                   std::cout << ERROR_AT(e) << "invalid master object reference: " << masterName << std::endl;
+                   return false;
+               }
+               m_pendingChildren.push_back(master->second);
+           } else if (type == "tree") {
+               if (!parseTree(e))
+                   return false;
+           } else if (type == "primitive") {
+               if (!parsePrimitive(e)) {
+                   PARSE_ERROR(e);
+                   return false;
+               }
+           } else {
+               std::cout << ERROR_AT(e) << "invalid object type: " << type << std::endl;
+               return false;
+           }
+       } else {
+           UNSUPPORTED_ELEMENT(e);
+           return false;
+       }
+   }
+   if (e.failed())
+       return false;
+
+   closeNode(node, transformations, primitives, children);
+   return true;
+}
+
+/**
+* Parse an <object type="primitive"> tag into the open node.
+*/
+bool ScenestreamReader::parsePrimitive(XmlCursor &prim) {
+   // Default primitive
+   ScenePrimitive &primitive = m_pendingPrimitives.emplace_back();
+   SceneMaterial& mat = primitive.material;
+   mat.clear();
+   primitive.type = PrimitiveType::PRIMITIVE_CUBE;
+   mat.cDiffuse.r = mat.cDiffuse.g = mat.cDiffuse.b = 1;
+
+   // Parse primitive type
+   std::string_view primType = prim.attribute("name");
+   if (primType == "sphere") primitive.type = PrimitiveType::PRIMITIVE_SPHERE;
+   else if (primType == "cube") primitive.type = PrimitiveType::PRIMITIVE_CUBE;
+   else if (primType == "cylinder") primitive.type = PrimitiveType::PRIMITIVE_CYLINDER;
+   else if (primType == "cone") primitive.type = PrimitiveType::PRIMITIVE_CONE;
+   else if (primType == "torus") primitive.type = PrimitiveType::PRIMITIVE_TORUS;
+   else if (primType == "mesh") {
+       primitive.type = PrimitiveType::PRIMITIVE_MESH;
+       if (prim.hasAttribute("meshfile")) {
+           primitive.meshfile = (m_basepath / prim.attribute("meshfile")).string();
+       } else if (prim.hasAttribute("filename")) {
+           primitive.meshfile = (m_basepath / prim.attribute("filename")).string();
+       } else {
+           std::cout << "mesh object must specify filename" << std::endl;
+           return false;
+       }
+   }
+
+   int depth = prim.depth();
+   while (prim.nextChild(depth)) {
+       std::string_view name = prim.name();
+       bool parsed;
+       if (name == "diffuse") parsed = parseColor(prim, mat.cDiffuse);
+       else if (name == "ambient") parsed = parseColor(prim, mat.cAmbient);
+       else if (name == "reflective") parsed = parseColor(prim, mat.cReflective);
+       else if (name == "specular") parsed = parseColor(prim, mat.cSpecular);
+       else if (name == "emissive") parsed = parseColor(prim, mat.cEmissive);
+       else if (name == "transparent") parsed = parseColor(prim, mat.cTransparent);
+       else if (name == "shininess") parsed = parseSingle(prim, mat.shininess, "v");
+       else if (name == "ior") parsed = parseSingle(prim, mat.ior, "v");
+       else if (name == "texture") parsed = parseMap(prim, mat.textureMap, m_basepath);
+       else if (name == "bumpmap") parsed = parseMap(prim, mat.bumpMap, m_basepath);
+       else if (name == "blend") parsed = parseSingle(prim, mat.blend, "v");
+       else {
+           UNSUPPORTED_ELEMENT(prim);
+           return false;
+       }
+
+       if (!parsed) {
+           PARSE_ERROR(prim);
+           return false;
+       }
+   }
+
+   return !prim.failed();
+}
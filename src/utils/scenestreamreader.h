@@ -0,0 +1,84 @@
+#pragma once
+
+#include "scenedata.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A node of the scene graph in a ScenestreamReader's arena. Rather than
+// owning pointers, its transformations, primitives and children are ranges
+// of the reader's flat arrays, children being indices into getNodes().
+struct SceneArenaNode {
+    uint32_t firstTransformation, transformationCount;
+    uint32_t firstPrimitive, primitiveCount;
+    uint32_t firstChild, childCount;
+};
+
+class XmlCursor;
+
+// Parses the same scene files as ScenefileReader in one forward pass over
+// the file's bytes, without building a DOM. Tags and attributes are views
+// into the file's buffer and the scene graph is stored in a few contiguous
+// arrays, so nothing is allocated per node.
+class ScenestreamReader {
+public:
+    // Create a ScenestreamReader, passing it the scene file.
+    ScenestreamReader(const std::string& filename);
+
+    // Parse the XML scene file. Returns false if scene is invalid.
+    bool readXML();
+
+    SceneGlobalData getGlobalData() const;
+
+    SceneCameraData getCameraData() const;
+
+    std::vector<SceneLightData> getLights() const;
+
+    std::vector<SceneEmitterData> getEmitters() const;
+
+    // The node of the object named "root", or nullptr if there is none
+    const SceneArenaNode* getRootNode() const;
+
+    const std::vector<SceneArenaNode>& getNodes() const { return m_nodes; }
+    const std::vector<SceneTransformation>& getTransformations() const { return m_transformations; }
+    const std::vector<ScenePrimitive>& getPrimitives() const { return m_primitives; }
+    const std::vector<uint32_t>& getChildren() const { return m_children; }
+
+    // Moves the primitives out, for when the graph has been flattened
+    std::vector<ScenePrimitive> takePrimitives() { return std::move(m_primitives); }
+
+private:
+    bool parseGlobalData(XmlCursor &cursor);
+    bool parseCameraData(XmlCursor &cursor);
+    bool parseLightData(XmlCursor &cursor);
+    bool parseEmitterData(XmlCursor &cursor);
+    bool parseObjectData(XmlCursor &cursor);
+    bool parseTransBlock(XmlCursor &cursor, uint32_t node);
+    bool parseTree(XmlCursor &cursor);
+    bool parsePrimitive(XmlCursor &cursor);
+
+    // Starts a node whose ranges are filled in by closeNode
+    uint32_t openNode();
+    void closeNode(uint32_t node, size_t transformations, size_t primitives, size_t children);
+
+    std::string file_name;
+    std::filesystem::path m_basepath;
+    std::unordered_map<std::string, uint32_t> m_objects;
+    SceneGlobalData m_globalData;
+    SceneCameraData m_cameraData;
+    std::vector<SceneLightData> m_lights;
+    std::vector<SceneEmitterData> m_emitters;
+
+    // The arena. While a node is open its entries are collected at the end
+    // of the pending arrays, closing it moves them into the flat ones
+    std::vector<SceneArenaNode> m_nodes;
+    std::vector<SceneTransformation> m_transformations;
+    std::vector<ScenePrimitive> m_primitives;
+    std::vector<uint32_t> m_children;
+    std::vector<SceneTransformation> m_pendingTransformations;
+    std::vector<ScenePrimitive> m_pendingPrimitives;
+    std::vector<uint32_t> m_pendingChildren;
+};
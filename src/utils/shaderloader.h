@@ -8,6 +8,7 @@
 #include <QFile>
 #include <QTextStream>
 #include <iostream>
+#include <vector>
 
 class ShaderLoader{
 public:
@@ -44,6 +45,77 @@ public:
         return programID;
     }
 
+    // Program with tessellation control and evaluation stages between the
+    // vertex and fragment ones, drawn with GL_PATCHES
+    static GLuint createTessellationProgram(const char * vertex_file_path,
+                                            const char * control_file_path,
+                                            const char * evaluation_file_path,
+                                            const char * fragment_file_path){
+        GLuint shaderIDs[4] = {
+            createShader(GL_VERTEX_SHADER, vertex_file_path),
+            createShader(GL_TESS_CONTROL_SHADER, control_file_path),
+            createShader(GL_TESS_EVALUATION_SHADER, evaluation_file_path),
+            createShader(GL_FRAGMENT_SHADER, fragment_file_path)
+        };
+
+        GLuint programID = glCreateProgram();
+        for (GLuint id : shaderIDs)
+            glAttachShader(programID, id);
+        glLinkProgram(programID);
+
+        // Print the info log if error
+        GLint status;
+        glGetProgramiv(programID, GL_LINK_STATUS, &status);
+
+        if (status == GL_FALSE) {
+            GLint length;
+            glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &length);
+
+            std::string log(length, '\0');
+            glGetProgramInfoLog(programID, length, nullptr, &log[0]);
+
+            glDeleteProgram(programID);
+            throw std::runtime_error(log);
+        }
+
+        for (GLuint id : shaderIDs)
+            glDeleteShader(id);
+
+        return programID;
+    }
+
+    // Vertex-only program whose outputs are captured with transform feedback.
+    // The varyings are written interleaved into a single buffer, in the given order.
+    static GLuint createTransformFeedbackProgram(const char * vertex_file_path,
+                                                 const std::vector<const char *> &varyings){
+        GLuint vertexShaderID = createShader(GL_VERTEX_SHADER, vertex_file_path);
+
+        // Varyings have to be declared before linking
+        GLuint programID = glCreateProgram();
+        glAttachShader(programID, vertexShaderID);
+        glTransformFeedbackVaryings(programID, varyings.size(), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+        glLinkProgram(programID);
+
+        // Print the info log if error
+        GLint status;
+        glGetProgramiv(programID, GL_LINK_STATUS, &status);
+
+        if (status == GL_FALSE) {
+            GLint length;
+            glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &length);
+
+            std::string log(length, '\0');
+            glGetProgramInfoLog(programID, length, nullptr, &log[0]);
+
+            glDeleteProgram(programID);
+            throw std::runtime_error(log);
+        }
+
+        glDeleteShader(vertexShaderID);
+
+        return programID;
+    }
+
 private:
     static GLuint createShader(GLenum shaderType, const char *filepath){
         GLuint shaderID = glCreateShader(shaderType);
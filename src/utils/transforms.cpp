@@ -31,6 +31,33 @@ mat4 transforms::apply_transforms(const mat4 &m, const vector<SceneTransformatio
   return ret;
 }
 
+// Same as above, for transformations stored contiguously. Translations,
+// scales and rotations are applied in place instead of multiplying by a
+// full matrix
+mat4 transforms::apply_transforms(const mat4 &m, const SceneTransformation *ts, size_t count) {
+  auto ret = m;
+
+  for(size_t i = 0; i < count; i++) {
+    const auto &t = ts[i];
+    switch (t.type) {
+      case TransformationType::TRANSFORMATION_TRANSLATE:
+        ret = translate(ret, t.translate);
+        break;
+      case TransformationType::TRANSFORMATION_SCALE:
+        ret = scale(ret, t.scale);
+        break;
+      case TransformationType::TRANSFORMATION_ROTATE:
+        ret = rotate(ret, t.angle, t.rotate);
+        break;
+      case TransformationType::TRANSFORMATION_MATRIX:
+        ret *= t.matrix;
+        break;
+      }
+  }
+
+  return ret;
+}
+
 mat4 transforms::manual_rotate_y(float angle) {
   auto rad = glm::radians(angle);
   return mat4(cos(rad), 0.0f, -sin(rad), 0.0f,